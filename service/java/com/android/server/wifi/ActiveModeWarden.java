@@ -73,6 +73,7 @@ public class ActiveModeWarden {
     private final ScanRequestProxy mScanRequestProxy;
     private final WifiNative mWifiNative;
     private final WifiController mWifiController;
+    private final WifiStateSnapshotPublisher mWifiStateSnapshotPublisher;
 
     private WifiManager.SoftApCallback mSoftApCallback;
     private WifiManager.SoftApCallback mLohsCallback;
@@ -121,6 +122,7 @@ public class ActiveModeWarden {
         mScanRequestProxy = wifiInjector.getScanRequestProxy();
         mWifiNative = wifiNative;
         mWifiController = new WifiController();
+        mWifiStateSnapshotPublisher = wifiInjector.getWifiStateSnapshotPublisher();
 
         wifiNative.registerStatusListener(isReady -> {
             if (!isReady && !mIsShuttingdown) {
@@ -503,16 +505,27 @@ public class ActiveModeWarden {
         }
     }
 
+    /**
+     * Publishes the interface concurrency read by the WifiServiceImpl getters. Called whenever a
+     * mode manager starts or stops, since the chip may only report it once started.
+     */
+    private void publishStateSnapshot() {
+        mWifiStateSnapshotPublisher.publishStaApConcurrencySupported(
+                isStaApConcurrencySupported());
+    }
+
     private class SoftApListener extends ModeCallback implements ActiveModeManager.Listener {
         @Override
         public void onStarted() {
             updateBatteryStats();
+            publishStateSnapshot();
         }
 
         @Override
         public void onStopped() {
             mActiveModeManagers.remove(getActiveModeManager());
             updateBatteryStats();
+            publishStateSnapshot();
             mWifiController.sendMessage(WifiController.CMD_AP_STOPPED);
         }
 
@@ -520,6 +533,7 @@ public class ActiveModeWarden {
         public void onStartFailure() {
             mActiveModeManagers.remove(getActiveModeManager());
             updateBatteryStats();
+            publishStateSnapshot();
             mWifiController.sendMessage(WifiController.CMD_AP_START_FAILURE);
         }
     }
@@ -529,6 +543,7 @@ public class ActiveModeWarden {
         public void onStarted() {
             updateClientScanMode();
             updateBatteryStats();
+            publishStateSnapshot();
         }
 
         @Override
@@ -536,6 +551,7 @@ public class ActiveModeWarden {
             mActiveModeManagers.remove(getActiveModeManager());
             updateClientScanMode();
             updateBatteryStats();
+            publishStateSnapshot();
             mWifiController.sendMessage(WifiController.CMD_STA_STOPPED);
         }
 
@@ -544,6 +560,7 @@ public class ActiveModeWarden {
             mActiveModeManagers.remove(getActiveModeManager());
             updateClientScanMode();
             updateBatteryStats();
+            publishStateSnapshot();
             mWifiController.sendMessage(WifiController.CMD_STA_START_FAILURE);
         }
     }
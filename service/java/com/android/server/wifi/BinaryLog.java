@@ -0,0 +1,463 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.server.wifi;
+
+import android.util.Log;
+
+import com.android.internal.annotations.GuardedBy;
+import com.android.internal.annotations.VisibleForTesting;
+
+import java.io.PrintWriter;
+import java.util.Calendar;
+
+import javax.annotation.concurrent.ThreadSafe;
+
+/**
+ * Provides a WifiLog implementation which records messages, unformatted, into a preallocated
+ * in-memory ring ({@link Buffer}), and only formats them when the ring is dumped.
+ *
+ * A message is recorded as its format string, which is a compile-time constant and so is not
+ * copied, its arguments as raw words (or String references), a timestamp and the id of the
+ * logging thread. Once the ring is full, recording a message allocates nothing. With verbose
+ * logging enabled, trace messages also name their caller, as LogcatLog does: they then record a
+ * Throwable, whose stack trace is only walked when the message is formatted.
+ *
+ * Error and warning messages are also formatted and written to logcat as they are logged, as are
+ * all other messages when verbose logging is enabled.
+ *
+ * Instances may be shared between threads. As with other WifiLog implementations, the LogMessage
+ * returned by a logging method must only be used by the calling thread, and only until flush().
+ */
+@ThreadSafe
+class BinaryLog implements WifiLog {
+    private static volatile boolean sVerboseLogging = false;
+
+    // LogMessage reused by each thread, so that logging a message does not allocate one.
+    private static final ThreadLocal<RecordingLogMessage> sLogMessages =
+            ThreadLocal.withInitial(RecordingLogMessage::new);
+
+    private final String mTag;
+    private final Buffer mBuffer;
+
+    BinaryLog(String tag, Buffer buffer) {
+        mTag = tag;
+        mBuffer = buffer;
+    }
+
+    public static void enableVerboseLogging(int verboseMode) {
+        sVerboseLogging = verboseMode > 0;
+    }
+
+    /* New-style methods */
+    @Override
+    public LogMessage err(String format) {
+        return obtainLogMessage(Log.ERROR, format);
+    }
+
+    @Override
+    public LogMessage warn(String format) {
+        return obtainLogMessage(Log.WARN, format);
+    }
+
+    @Override
+    public LogMessage info(String format) {
+        return obtainLogMessage(Log.INFO, format);
+    }
+
+    @Override
+    public LogMessage trace(String format) {
+        RecordingLogMessage logMessage = obtainLogMessage(Log.DEBUG, format);
+        if (sVerboseLogging) {
+            logMessage.setCaller(new Throwable(), 1);
+        }
+        return logMessage;
+    }
+
+    @Override
+    public LogMessage trace(String format, int numFramesToIgnore) {
+        RecordingLogMessage logMessage = obtainLogMessage(Log.DEBUG, format);
+        if (sVerboseLogging) {
+            // Frame 0 is this method, so that as with LogcatLog, the caller of trace() is named
+            // when no frames are ignored.
+            logMessage.setCaller(new Throwable(), numFramesToIgnore + 1);
+        }
+        return logMessage;
+    }
+
+    @Override
+    public LogMessage dump(String format) {
+        return obtainLogMessage(Log.VERBOSE, format);
+    }
+
+    @Override
+    public void eC(String msg) {
+        log(Log.ERROR, msg);
+    }
+
+    @Override
+    public void wC(String msg) {
+        log(Log.WARN, msg);
+    }
+
+    @Override
+    public void iC(String msg) {
+        log(Log.INFO, msg);
+    }
+
+    @Override
+    public void tC(String msg) {
+        log(Log.DEBUG, msg);
+    }
+
+    /* Legacy methods */
+    @Override
+    public void e(String msg) {
+        log(Log.ERROR, msg);
+    }
+
+    @Override
+    public void w(String msg) {
+        log(Log.WARN, msg);
+    }
+
+    @Override
+    public void i(String msg) {
+        log(Log.INFO, msg);
+    }
+
+    @Override
+    public void d(String msg) {
+        log(Log.DEBUG, msg);
+    }
+
+    @Override
+    public void v(String msg) {
+        log(Log.VERBOSE, msg);
+    }
+
+    /* Internal details */
+    private RecordingLogMessage obtainLogMessage(int logLevel, String format) {
+        RecordingLogMessage logMessage = sLogMessages.get();
+        if (logMessage.mInUse) {
+            // An argument of the message being built by this thread is itself logging
+            logMessage = new RecordingLogMessage();
+        }
+        logMessage.reset(this, logLevel, format);
+        return logMessage;
+    }
+
+    /**
+     * Logs a message without arguments. Any placeholder in |msg| is kept as is.
+     */
+    private void log(int logLevel, String msg) {
+        mBuffer.append(logLevel, mTag, msg, 0, null, null, null, null, 0);
+        if (shouldWriteToLogcat(logLevel)) {
+            Log.println(logLevel, mTag, msg);
+        }
+    }
+
+    private static boolean shouldWriteToLogcat(int logLevel) {
+        return logLevel >= Log.WARN || sVerboseLogging;
+    }
+
+    /**
+     * Appends |format| to |sb|, with its placeholders replaced by the |numArgs| arguments starting
+     * at |offset| in the argument arrays. Placeholders without an argument are kept as is, as
+     * are arguments without a placeholder dropped, to match LogcatLog. If |caller| is set, the
+     * message is prefixed with the name of the method at frame |callerFrame| of its stack trace.
+     */
+    private static void formatMessage(StringBuilder sb, Throwable caller, int callerFrame,
+            String format, int numArgs, byte[] argTypes, long[] argWords, String[] argStrings,
+            int offset) {
+        if (caller != null) {
+            StackTraceElement[] stackTrace = caller.getStackTrace();
+            sb.append(callerFrame < stackTrace.length
+                    ? stackTrace[callerFrame].getMethodName() : "<unknown>").append(' ');
+        }
+        int pos = 0;
+        for (int i = 0; i < numArgs && pos < format.length(); i++) {
+            int placeholderPos = format.indexOf(WifiLog.PLACEHOLDER, pos);
+            if (placeholderPos == -1) {
+                break;
+            }
+            sb.append(format, pos, placeholderPos);
+            int index = offset + i;
+            switch (argTypes[index]) {
+                case ARG_TYPE_LONG:
+                    sb.append(argWords[index]);
+                    break;
+                case ARG_TYPE_CHAR:
+                    sb.append((char) argWords[index]);
+                    break;
+                case ARG_TYPE_BOOLEAN:
+                    sb.append(argWords[index] != 0);
+                    break;
+                default:
+                    sb.append(argStrings[index]);
+                    break;
+            }
+            pos = placeholderPos + 1;
+        }
+        sb.append(format, pos, format.length());
+    }
+
+    private static final byte ARG_TYPE_STRING = 0;
+    private static final byte ARG_TYPE_LONG = 1;
+    private static final byte ARG_TYPE_CHAR = 2;
+    private static final byte ARG_TYPE_BOOLEAN = 3;
+
+    /**
+     * Maximum number of arguments recorded per message. Further arguments are dropped, leaving
+     * their placeholders unformatted.
+     */
+    @VisibleForTesting
+    static final int MAX_ARGS = 8;
+
+    private static class RecordingLogMessage implements WifiLog.LogMessage {
+        private final byte[] mArgTypes = new byte[MAX_ARGS];
+        private final long[] mArgWords = new long[MAX_ARGS];
+        private final String[] mArgStrings = new String[MAX_ARGS];
+        private BinaryLog mLog;
+        private int mLogLevel;
+        private String mFormat;
+        private int mNumArgs;
+        private Throwable mCaller;
+        private int mCallerFrame;
+        private boolean mInUse;
+
+        void reset(BinaryLog log, int logLevel, String format) {
+            mInUse = true;
+            mLog = log;
+            mLogLevel = logLevel;
+            mFormat = format;
+            mNumArgs = 0;
+            mCaller = null;
+        }
+
+        void setCaller(Throwable caller, int callerFrame) {
+            mCaller = caller;
+            mCallerFrame = callerFrame;
+        }
+
+        @Override
+        public WifiLog.LogMessage r(String value) {
+            // As with LogcatLog, sensitive information is not tagged.
+            return c(value);
+        }
+
+        @Override
+        public WifiLog.LogMessage c(String value) {
+            if (mNumArgs < MAX_ARGS) {
+                mArgTypes[mNumArgs] = ARG_TYPE_STRING;
+                mArgStrings[mNumArgs] = value;
+                mNumArgs++;
+            }
+            return this;
+        }
+
+        @Override
+        public WifiLog.LogMessage c(long value) {
+            return addWord(ARG_TYPE_LONG, value);
+        }
+
+        @Override
+        public WifiLog.LogMessage c(char value) {
+            return addWord(ARG_TYPE_CHAR, value);
+        }
+
+        @Override
+        public WifiLog.LogMessage c(boolean value) {
+            return addWord(ARG_TYPE_BOOLEAN, value ? 1 : 0);
+        }
+
+        @Override
+        public void flush() {
+            mLog.mBuffer.append(mLogLevel, mLog.mTag, mFormat, mNumArgs, mArgTypes, mArgWords,
+                    mArgStrings, mCaller, mCallerFrame);
+            if (shouldWriteToLogcat(mLogLevel)) {
+                Log.println(mLogLevel, mLog.mTag, toString());
+            }
+            for (int i = 0; i < mNumArgs; i++) {
+                mArgStrings[i] = null;
+            }
+            mCaller = null;
+            mInUse = false;
+        }
+
+        @VisibleForTesting
+        public String toString() {
+            StringBuilder sb = new StringBuilder();
+            formatMessage(sb, mCaller, mCallerFrame, mFormat, mNumArgs, mArgTypes, mArgWords,
+                    mArgStrings, 0);
+            return sb.toString();
+        }
+
+        private WifiLog.LogMessage addWord(byte type, long value) {
+            if (mNumArgs < MAX_ARGS) {
+                mArgTypes[mNumArgs] = type;
+                mArgWords[mNumArgs] = value;
+                mNumArgs++;
+            }
+            return this;
+        }
+    }
+
+    /**
+     * A fixed capacity ring of unformatted log messages, shared by the BinaryLog instances that
+     * write to it. All the storage is allocated upfront; the oldest messages are overwritten
+     * once the ring is full.
+     */
+    @ThreadSafe
+    static class Buffer {
+        private final Object mLock = new Object();
+        private final int mCapacity;
+        @GuardedBy("mLock") private final long[] mTimestampsMs;
+        @GuardedBy("mLock") private final long[] mThreadIds;
+        @GuardedBy("mLock") private final int[] mLogLevels;
+        @GuardedBy("mLock") private final String[] mTags;
+        @GuardedBy("mLock") private final String[] mFormats;
+        @GuardedBy("mLock") private final int[] mNumArgs;
+        @GuardedBy("mLock") private final byte[] mArgTypes;
+        @GuardedBy("mLock") private final long[] mArgWords;
+        @GuardedBy("mLock") private final String[] mArgStrings;
+        @GuardedBy("mLock") private final Throwable[] mCallers;
+        @GuardedBy("mLock") private final int[] mCallerFrames;
+        // Index of the next message to write, and number of messages held.
+        @GuardedBy("mLock") private int mNext;
+        @GuardedBy("mLock") private int mSize;
+        @GuardedBy("mLock") private long mNumMessagesDropped;
+
+        /**
+         * Creates a ring holding the last |capacity| messages.
+         */
+        Buffer(int capacity) {
+            if (capacity < 1) {
+                throw new IllegalArgumentException();
+            }
+            mCapacity = capacity;
+            mTimestampsMs = new long[capacity];
+            mThreadIds = new long[capacity];
+            mLogLevels = new int[capacity];
+            mTags = new String[capacity];
+            mFormats = new String[capacity];
+            mNumArgs = new int[capacity];
+            mArgTypes = new byte[capacity * MAX_ARGS];
+            mArgWords = new long[capacity * MAX_ARGS];
+            mArgStrings = new String[capacity * MAX_ARGS];
+            mCallers = new Throwable[capacity];
+            mCallerFrames = new int[capacity];
+        }
+
+        void append(int logLevel, String tag, String format, int numArgs, byte[] argTypes,
+                long[] argWords, String[] argStrings, Throwable caller, int callerFrame) {
+            long timestampMs = System.currentTimeMillis();
+            long threadId = Thread.currentThread().getId();
+            synchronized (mLock) {
+                int index = mNext;
+                if (mSize == mCapacity) {
+                    mNumMessagesDropped++;
+                } else {
+                    mSize++;
+                }
+                mNext = (mNext + 1) % mCapacity;
+                mTimestampsMs[index] = timestampMs;
+                mThreadIds[index] = threadId;
+                mLogLevels[index] = logLevel;
+                mTags[index] = tag;
+                mFormats[index] = format;
+                mNumArgs[index] = numArgs;
+                mCallers[index] = caller;
+                mCallerFrames[index] = callerFrame;
+                int offset = index * MAX_ARGS;
+                for (int i = 0; i < numArgs; i++) {
+                    mArgTypes[offset + i] = argTypes[i];
+                    mArgWords[offset + i] = argWords[i];
+                    mArgStrings[offset + i] = argStrings[i];
+                }
+                // Do not keep Strings of a previous message alive
+                for (int i = numArgs; i < MAX_ARGS && mArgStrings[offset + i] != null; i++) {
+                    mArgStrings[offset + i] = null;
+                }
+            }
+        }
+
+        /**
+         * Returns the number of messages held.
+         */
+        int size() {
+            synchronized (mLock) {
+                return mSize;
+            }
+        }
+
+        /**
+         * Returns the |i|-th oldest message held, formatted as it would be written to logcat.
+         */
+        @VisibleForTesting
+        String getMessage(int i) {
+            synchronized (mLock) {
+                if (i < 0 || i >= mSize) {
+                    throw new IndexOutOfBoundsException();
+                }
+                int index = (mNext - mSize + i + mCapacity) % mCapacity;
+                StringBuilder sb = new StringBuilder();
+                formatMessage(sb, mCallers[index], mCallerFrames[index], mFormats[index],
+                        mNumArgs[index], mArgTypes, mArgWords, mArgStrings, index * MAX_ARGS);
+                return sb.toString();
+            }
+        }
+
+        /**
+         * Formats and writes all the messages held, oldest first.
+         */
+        void dump(PrintWriter pw) {
+            synchronized (mLock) {
+                pw.println("BinaryLog: " + mSize + " messages, " + mNumMessagesDropped
+                        + " dropped");
+                StringBuilder sb = new StringBuilder();
+                Calendar c = Calendar.getInstance();
+                for (int i = 0; i < mSize; i++) {
+                    int index = (mNext - mSize + i + mCapacity) % mCapacity;
+                    sb.setLength(0);
+                    c.setTimeInMillis(mTimestampsMs[index]);
+                    sb.append(String.format("%tm-%td %tH:%tM:%tS.%tL", c, c, c, c, c, c));
+                    sb.append(' ').append(mThreadIds[index]);
+                    sb.append(' ').append(logLevelToChar(mLogLevels[index]));
+                    sb.append(' ').append(mTags[index]).append(": ");
+                    formatMessage(sb, mCallers[index], mCallerFrames[index], mFormats[index],
+                            mNumArgs[index], mArgTypes, mArgWords, mArgStrings, index * MAX_ARGS);
+                    pw.println(sb);
+                }
+            }
+        }
+
+        private static char logLevelToChar(int logLevel) {
+            switch (logLevel) {
+                case Log.ERROR:
+                    return 'E';
+                case Log.WARN:
+                    return 'W';
+                case Log.INFO:
+                    return 'I';
+                case Log.DEBUG:
+                    return 'D';
+                default:
+                    return 'V';
+            }
+        }
+    }
+}
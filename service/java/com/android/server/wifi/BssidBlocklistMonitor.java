@@ -28,6 +28,7 @@ import android.util.LocalLog;
 import android.util.Log;
 
 import com.android.internal.annotations.VisibleForTesting;
+import com.android.server.wifi.util.BssidHistoryRecorder;
 import com.android.wifi.resources.R;
 
 import java.io.FileDescriptor;
@@ -38,7 +39,6 @@ import java.util.ArrayList;
 import java.util.Arrays;
 import java.util.Calendar;
 import java.util.Collections;
-import java.util.LinkedList;
 import java.util.List;
 import java.util.Map;
 import java.util.Set;
@@ -123,6 +123,20 @@ public class BssidBlocklistMonitor {
             REASON_ABNORMAL_DISCONNECT,
             REASON_FRAMEWORK_DISCONNECT_CONNECTED_SCORE
     ));
+    // Triggers of the removal of a BSSID from the blocklist, as recorded in the history.
+    private static final int TRIGGER_NETWORK_VALIDATION_SUCCESS = 0;
+    private static final int TRIGGER_CLEAR_BSSID_BLOCKLIST_FOR_SSID = 1;
+    private static final int TRIGGER_CLEAR_BSSID_BLOCKLIST = 2;
+    private static final int TRIGGER_RSSI_SIGNIFICANTLY_IMPROVED = 3;
+    private static final int TRIGGER_BLOCKLIST_EXPIRED = 4;
+    private static final String[] TRIGGER_STRINGS = {
+            "Network validation success",
+            "clearBssidBlocklistForSsid",
+            "clearBssidBlocklist",
+            "rssi significantly improved",
+            "updateAndGetBssidBlocklistInternal"
+    };
+    private static final int BSSID_STATUS_HISTORY_SIZE = 30;
     private static final long ABNORMAL_DISCONNECT_RESET_TIME_MS = TimeUnit.HOURS.toMillis(3);
     private static final int MIN_RSSI_DIFF_TO_UNBLOCK_BSSID = 5;
     private static final String TAG = "BssidBlocklistMonitor";
@@ -140,7 +154,9 @@ public class BssidBlocklistMonitor {
     private Map<String, BssidStatus> mBssidStatusMap = new ArrayMap<>();
 
     // Keeps history of 30 blocked BSSIDs that were most recently removed.
-    private BssidStatusHistoryLogger mBssidStatusHistoryLogger = new BssidStatusHistoryLogger(30);
+    private final BssidHistoryRecorder mBssidStatusHistory = new BssidHistoryRecorder(
+            BSSID_STATUS_HISTORY_SIZE, trigger -> TRIGGER_STRINGS[trigger],
+            this::getFailureReasonString);
 
     /**
      * Create a new instance of BssidBlocklistMonitor
@@ -188,12 +204,14 @@ public class BssidBlocklistMonitor {
         pw.println("BssidBlocklistMonitor - Bssid blocklist begin ----");
         mBssidStatusMap.values().stream().forEach(entry -> pw.println(entry));
         pw.println("BssidBlocklistMonitor - Bssid blocklist end ----");
-        mBssidStatusHistoryLogger.dump(pw);
+        pw.println("BssidBlocklistMonitor - Bssid blocklist history begin ----");
+        mBssidStatusHistory.dump(pw);
+        pw.println("BssidBlocklistMonitor - Bssid blocklist history end ----");
     }
 
     private void addToBlocklist(@NonNull BssidStatus entry, long durationMs,
-            @FailureReason int reason, int rssi) {
-        entry.setAsBlocked(durationMs, reason, rssi);
+            @FailureReason int reason, int rssi, int streak) {
+        entry.setAsBlocked(durationMs, reason, rssi, streak);
         localLog(TAG + " addToBlocklist: bssid=" + entry.bssid + ", ssid=" + entry.ssid
                 + ", durationMs=" + durationMs + ", reason=" + getFailureReasonString(reason)
                 + ", rssi=" + rssi);
@@ -272,7 +290,7 @@ public class BssidBlocklistMonitor {
             // Return because this BSSID is already being blocked for a longer time.
             return;
         }
-        addToBlocklist(status, durationMs, blockReason, rssi);
+        addToBlocklist(status, durationMs, blockReason, rssi, 0);
     }
 
     private String getFailureReasonString(@FailureReason int reasonCode) {
@@ -333,7 +351,7 @@ public class BssidBlocklistMonitor {
             int baseBlockDurationMs = getBaseBlockDurationForReason(reasonCode);
             addToBlocklist(entry,
                     getBlocklistDurationWithExponentialBackoff(currentStreak, baseBlockDurationMs),
-                    reasonCode, rssi);
+                    reasonCode, rssi, currentStreak);
             mWifiScoreCard.incrementBssidBlocklistStreak(ssid, bssid, reasonCode);
             return true;
         }
@@ -430,7 +448,7 @@ public class BssidBlocklistMonitor {
          * BSSIDs.
          **/
         if (status.isInBlocklist) {
-            mBssidStatusHistoryLogger.add(status, "Network validation success");
+            addToHistory(status, TRIGGER_NETWORK_VALIDATION_SUCCESS);
             mBssidStatusMap.remove(bssid);
         }
     }
@@ -469,7 +487,7 @@ public class BssidBlocklistMonitor {
                 return false;
             }
             if (status.ssid.equals(ssid)) {
-                mBssidStatusHistoryLogger.add(status, "clearBssidBlocklistForSsid");
+                addToHistory(status, TRIGGER_CLEAR_BSSID_BLOCKLIST_FOR_SSID);
                 return true;
             }
             return false;
@@ -488,7 +506,7 @@ public class BssidBlocklistMonitor {
         if (mBssidStatusMap.size() > 0) {
             int prevSize = mBssidStatusMap.size();
             for (BssidStatus status : mBssidStatusMap.values()) {
-                mBssidStatusHistoryLogger.add(status, "clearBssidBlocklist");
+                addToHistory(status, TRIGGER_CLEAR_BSSID_BLOCKLIST);
             }
             mBssidStatusMap.clear();
             localLog(TAG + " clearBssidBlocklist: num BSSIDs cleared="
@@ -575,7 +593,7 @@ public class BssidBlocklistMonitor {
             int sufficientRssi = mScoringParams.getSufficientRssi(scanResult.frequency);
             if (status.lastRssi < sufficientRssi && scanResult.level >= sufficientRssi
                     && scanResult.level - status.lastRssi >= MIN_RSSI_DIFF_TO_UNBLOCK_BSSID) {
-                mBssidStatusHistoryLogger.add(status, "rssi significantly improved");
+                addToHistory(status, TRIGGER_RSSI_SIGNIFICANTLY_IMPROVED);
                 mBssidStatusMap.remove(status.bssid);
             }
         }
@@ -592,7 +610,7 @@ public class BssidBlocklistMonitor {
             BssidStatus status = e.getValue();
             if (status.isInBlocklist) {
                 if (status.blocklistEndTimeMs < curTime) {
-                    mBssidStatusHistoryLogger.add(status, "updateAndGetBssidBlocklistInternal");
+                    addToHistory(status, TRIGGER_BLOCKLIST_EXPIRED);
                     return true;
                 }
                 builder.accept(status);
@@ -636,46 +654,20 @@ public class BssidBlocklistMonitor {
 
     @VisibleForTesting
     public int getBssidStatusHistoryLoggerSize() {
-        return mBssidStatusHistoryLogger.size();
+        return mBssidStatusHistory.size();
     }
 
-    private class BssidStatusHistoryLogger {
-        private LinkedList<String> mLogHistory = new LinkedList<>();
-        private int mBufferSize;
-
-        BssidStatusHistoryLogger(int bufferSize) {
-            mBufferSize = bufferSize;
-        }
-
-        public void add(BssidStatus bssidStatus, String trigger) {
-            // only log history for Bssids that had been blocked.
-            if (bssidStatus == null || !bssidStatus.isInBlocklist) {
-                return;
-            }
-            StringBuilder sb = new StringBuilder();
-            mCalendar.setTimeInMillis(mClock.getWallClockMillis());
-            sb.append(", logTimeMs="
-                    + String.format("%tm-%td %tH:%tM:%tS.%tL", mCalendar, mCalendar,
-                    mCalendar, mCalendar, mCalendar, mCalendar));
-            sb.append(", trigger=" + trigger);
-            mLogHistory.add(bssidStatus.toString() + sb.toString());
-            if (mLogHistory.size() > mBufferSize) {
-                mLogHistory.removeFirst();
-            }
-        }
-
-        @VisibleForTesting
-        public int size() {
-            return mLogHistory.size();
-        }
-
-        public void dump(PrintWriter pw) {
-            pw.println("BssidBlocklistMonitor - Bssid blocklist history begin ----");
-            for (String line : mLogHistory) {
-                pw.println(line);
-            }
-            pw.println("BssidBlocklistMonitor - Bssid blocklist history end ----");
+    /**
+     * Records the removal of |bssidStatus| from the blocklist in the history.
+     */
+    private void addToHistory(@NonNull BssidStatus bssidStatus, int trigger) {
+        // only log history for Bssids that had been blocked.
+        if (!bssidStatus.isInBlocklist) {
+            return;
         }
+        mBssidStatusHistory.record(mClock.getWallClockMillis(), bssidStatus.ssid,
+                BssidHistoryRecorder.packBssid(bssidStatus.bssid), trigger,
+                bssidStatus.blockReason, bssidStatus.lastRssi, bssidStatus.blockStreak);
     }
 
     /**
@@ -688,6 +680,8 @@ public class BssidBlocklistMonitor {
         public int blockReason = INVALID_REASON; // reason of blocking this BSSID
         // The latest RSSI that's seen before this BSSID is added to blocklist.
         public int lastRssi = 0;
+        // The blocklist streak of the BSSID when it was added to blocklist.
+        public int blockStreak = 0;
 
         // The following are used to flag how long this BSSID stays in the blocklist.
         public boolean isInBlocklist;
@@ -712,13 +706,16 @@ public class BssidBlocklistMonitor {
          * @param durationMs
          * @param blockReason
          * @param rssi
+         * @param streak
          */
-        public void setAsBlocked(long durationMs, @FailureReason int blockReason, int rssi) {
+        public void setAsBlocked(long durationMs, @FailureReason int blockReason, int rssi,
+                int streak) {
             isInBlocklist = true;
             blocklistStartTimeMs = mClock.getWallClockMillis();
             blocklistEndTimeMs = blocklistStartTimeMs + durationMs;
             this.blockReason = blockReason;
             lastRssi = rssi;
+            blockStreak = streak;
         }
 
         @Override
@@ -150,6 +150,7 @@ import java.time.Duration;
 import java.util.ArrayList;
 import java.util.Arrays;
 import java.util.List;
+import java.util.Objects;
 import java.util.Set;
 import java.util.concurrent.atomic.AtomicBoolean;
 import java.util.concurrent.atomic.AtomicInteger;
@@ -219,12 +220,22 @@ public class ClientModeImpl extends StateMachine {
     private final WifiConfigManager mWifiConfigManager;
     private final WifiConnectivityManager mWifiConnectivityManager;
     private final BssidBlocklistMonitor mBssidBlocklistMonitor;
+    private final ConnectionPhaseTracer mConnectionPhaseTracer;
     private ConnectivityManager mCm;
     private BaseWifiDiagnostics mWifiDiagnostics;
     private final boolean mP2pSupported;
     private final AtomicBoolean mP2pConnected = new AtomicBoolean(false);
     private boolean mTemporarilyDisconnectWifi = false;
     private final Clock mClock;
+    private final MessageLatencyTracker mMessageLatencyTracker;
+    private final WifiStateSnapshotPublisher mWifiStateSnapshotPublisher;
+    // Features of the client interface, read whenever it is set up for connect mode.
+    private long mSupportedFeatures;
+    // Last published client mode state, compared against to publish only on change.
+    private int mPublishedWifiState = WIFI_STATE_UNKNOWN;
+    private WifiInfo mPublishedWifiInfo;
+    private Network mPublishedNetwork;
+    private long mPublishedSupportedFeatures;
     private final PropertyService mPropertyService;
     private final BuildProperties mBuildProperties;
     private final WifiCountryCode mCountryCode;
@@ -494,6 +505,8 @@ public class ClientModeImpl extends StateMachine {
     static final int CMD_RSSI_POLL                                      = BASE + 83;
     /** Runs RSSI poll once */
     static final int CMD_ONESHOT_RSSI_POLL                              = BASE + 84;
+    /** Link layer stats fetched for the RSSI poll with token arg1 */
+    static final int CMD_RSSI_POLL_LINK_LAYER_STATS                     = BASE + 85;
     /* Enable suspend mode optimizations in the driver */
     static final int CMD_SET_SUSPEND_OPT_ENABLED                        = BASE + 86;
 
@@ -759,6 +772,8 @@ public class ClientModeImpl extends StateMachine {
         mWifiInjector = wifiInjector;
         mWifiMetrics = mWifiInjector.getWifiMetrics();
         mClock = wifiInjector.getClock();
+        mMessageLatencyTracker = new MessageLatencyTracker(mClock, this::getWhatToString);
+        mWifiStateSnapshotPublisher = wifiInjector.getWifiStateSnapshotPublisher();
         mPropertyService = wifiInjector.getPropertyService();
         mBuildProperties = wifiInjector.getBuildProperties();
         mWifiScoreCard = wifiInjector.getWifiScoreCard();
@@ -796,6 +811,7 @@ public class ClientModeImpl extends StateMachine {
         mSupplicantStateTracker = supplicantStateTracker;
         mWifiConnectivityManager = mWifiInjector.makeWifiConnectivityManager(this);
         mBssidBlocklistMonitor = mWifiInjector.getBssidBlocklistMonitor();
+        mConnectionPhaseTracer = mWifiInjector.getConnectionPhaseTracer();
         mConnectionFailureNotifier = mWifiInjector.makeConnectionFailureNotifier(
                 mWifiConnectivityManager);
 
@@ -946,6 +962,9 @@ public class ClientModeImpl extends StateMachine {
                 mSupplicantStateTracker.getHandler());
         mWifiMonitor.registerHandler(mInterfaceName, WifiMonitor.MBO_OCE_BSS_TM_HANDLING_DONE,
                 getHandler());
+        // Only the latest supplicant state matters to ClientModeImpl, unlike to
+        // SupplicantStateTracker and WifiMetrics, which need every state change.
+        mWifiMonitor.setEventCollapsingEnabled(getHandler(), true);
     }
 
     private void setMulticastFilter(boolean enabled) {
@@ -1310,15 +1329,7 @@ public class ClientModeImpl extends StateMachine {
         mLastLinkLayerStatsUpdate = mClock.getWallClockMillis();
         if (mWifiLinkLayerStatsSupported > 0) {
             stats = mWifiNative.getWifiLinkLayerStats(mInterfaceName);
-            if (stats == null) {
-                mWifiLinkLayerStatsSupported -= 1;
-            } else {
-                mOnTime = stats.on_time;
-                mTxTime = stats.tx_time;
-                mRxTime = stats.rx_time;
-                mRunningBeaconCount = stats.beacon_rx;
-                mWifiInfo.updatePacketRates(stats, mLastLinkLayerStatsUpdate);
-            }
+            noteWifiLinkLayerStats(stats);
         } else { // LinkLayerStats are broken or unsupported
             long mTxPkts = mFacade.getTxPackets(mInterfaceName);
             long mRxPkts = mFacade.getRxPackets(mInterfaceName);
@@ -1327,6 +1338,33 @@ public class ClientModeImpl extends StateMachine {
         return stats;
     }
 
+    private void noteWifiLinkLayerStats(WifiLinkLayerStats stats) {
+        if (stats == null) {
+            mWifiLinkLayerStatsSupported -= 1;
+        } else {
+            mOnTime = stats.on_time;
+            mTxTime = stats.tx_time;
+            mRxTime = stats.rx_time;
+            mRunningBeaconCount = stats.beacon_rx;
+            mWifiInfo.updatePacketRates(stats, mLastLinkLayerStatsUpdate);
+        }
+    }
+
+    /**
+     * Requests the link layer stats for the RSSI poll with |rssiPollToken| without blocking the
+     * wifi thread on the HAL. They are delivered as CMD_RSSI_POLL_LINK_LAYER_STATS.
+     *
+     * @return false if the stats were not requested, as they are unsupported or too many HAL
+     *         calls are pending.
+     */
+    private boolean requestWifiLinkLayerStatsAsync(int rssiPollToken) {
+        if (mInterfaceName == null || mWifiLinkLayerStatsSupported <= 0) {
+            return false;
+        }
+        return mWifiNative.getWifiLinkLayerStatsAsync(mInterfaceName, stats -> sendMessage(
+                CMD_RSSI_POLL_LINK_LAYER_STATS, rssiPollToken, 0, stats));
+    }
+
     /**
      * Check if a Wi-Fi band is supported
      *
@@ -1467,6 +1505,7 @@ public class ClientModeImpl extends StateMachine {
                     Log.d(TAG, "setting wifi state to: " + newState);
                 }
                 mWifiState.set(newState);
+                mWifiStateSnapshotPublisher.publishWifiState(newState);
                 return;
             default:
                 Log.d(TAG, "attempted to set an invalid state: " + newState);
@@ -1590,6 +1629,7 @@ public class ClientModeImpl extends StateMachine {
             // do a quick sanity check on the iface name, make sure it isn't null
             if (ifaceName != null) {
                 mInterfaceName = ifaceName;
+                mSupportedFeatures = mWifiNative.getSupportedFeatureSet(ifaceName);
                 updateInterfaceCapabilities(ifaceName);
                 transitionTo(mDisconnectedState);
                 mWifiScoreReport.setInterfaceName(ifaceName);
@@ -1888,6 +1928,7 @@ public class ClientModeImpl extends StateMachine {
         mNetworkFactory.dump(fd, pw, args);
         mUntrustedNetworkFactory.dump(fd, pw, args);
         pw.println("Wlan Wake Reasons:" + mWifiNative.getWlanWakeReasonCount());
+        mWifiNative.dumpVendorHalAsyncCalls(pw);
         pw.println();
 
         mWifiConfigManager.dump(fd, pw, args);
@@ -1896,6 +1937,9 @@ public class ClientModeImpl extends StateMachine {
         pw.println();
         mWifiDiagnostics.captureBugReportData(WifiDiagnostics.REPORT_REASON_USER_ACTION);
         mWifiDiagnostics.dump(fd, pw, args);
+        mMessageLatencyTracker.dump(fd, pw, args);
+        mWifiMonitor.dump(pw);
+        pw.println();
         dumpIpClient(fd, pw, args);
         mWifiConnectivityManager.dump(fd, pw, args);
         mWifiHealthMonitor.dump(fd, pw, args);
@@ -1917,6 +1961,79 @@ public class ClientModeImpl extends StateMachine {
      * ******************************************************
      */
 
+    @Override
+    protected void onPreHandleMessage(Message msg) {
+        mMessageLatencyTracker.onPreHandleMessage(msg, getCurrentState());
+    }
+
+    @Override
+    protected void onPostHandleMessage(Message msg) {
+        mMessageLatencyTracker.onPostHandleMessage(msg);
+        publishStateSnapshot();
+    }
+
+    /**
+     * Publishes the state read by the WifiServiceImpl getters. Called after every message
+     * handled, since most messages may update the connection info.
+     */
+    private void publishStateSnapshot() {
+        int wifiState = mWifiState.get();
+        Network currentNetwork = getCurrentNetwork();
+        if (wifiState == mPublishedWifiState
+                && Objects.equals(currentNetwork, mPublishedNetwork)
+                && mSupportedFeatures == mPublishedSupportedFeatures
+                && mPublishedWifiInfo != null
+                && isSameConnectionInfo(mWifiInfo, mPublishedWifiInfo)) {
+            return;
+        }
+        mPublishedWifiState = wifiState;
+        mPublishedNetwork = currentNetwork;
+        mPublishedSupportedFeatures = mSupportedFeatures;
+        // The snapshot owns the copy and never modifies it, so it is safe to compare against.
+        mPublishedWifiInfo = new WifiInfo(mWifiInfo);
+        mWifiStateSnapshotPublisher.publishClientModeState(wifiState, mPublishedWifiInfo,
+                currentNetwork, mSupportedFeatures);
+    }
+
+    /**
+     * Returns whether two connection infos hold the same values in every field that
+     * ClientModeImpl updates. WifiInfo does not implement equals().
+     */
+    private static boolean isSameConnectionInfo(@NonNull WifiInfo a, @NonNull WifiInfo b) {
+        return a.getNetworkId() == b.getNetworkId()
+                && a.getRssi() == b.getRssi()
+                && a.getFrequency() == b.getFrequency()
+                && a.getLinkSpeed() == b.getLinkSpeed()
+                && a.getTxLinkSpeedMbps() == b.getTxLinkSpeedMbps()
+                && a.getRxLinkSpeedMbps() == b.getRxLinkSpeedMbps()
+                && a.getMaxSupportedTxLinkSpeedMbps() == b.getMaxSupportedTxLinkSpeedMbps()
+                && a.getMaxSupportedRxLinkSpeedMbps() == b.getMaxSupportedRxLinkSpeedMbps()
+                && a.getWifiStandard() == b.getWifiStandard()
+                && a.getScore() == b.getScore()
+                && a.getIpAddress() == b.getIpAddress()
+                && a.getSupplicantState() == b.getSupplicantState()
+                && a.getMeteredHint() == b.getMeteredHint()
+                && a.isEphemeral() == b.isEphemeral()
+                && a.isTrusted() == b.isTrusted()
+                && a.isOsuAp() == b.isOsuAp()
+                && a.txBad == b.txBad
+                && a.txRetries == b.txRetries
+                && a.txSuccess == b.txSuccess
+                && a.rxSuccess == b.rxSuccess
+                && a.getLostTxPacketsPerSecond() == b.getLostTxPacketsPerSecond()
+                && a.getRetriedTxPacketsPerSecond() == b.getRetriedTxPacketsPerSecond()
+                && a.getSuccessfulTxPacketsPerSecond() == b.getSuccessfulTxPacketsPerSecond()
+                && a.getSuccessfulRxPacketsPerSecond() == b.getSuccessfulRxPacketsPerSecond()
+                && Objects.equals(a.getSSID(), b.getSSID())
+                && Objects.equals(a.getBSSID(), b.getBSSID())
+                && Objects.equals(a.getMacAddress(), b.getMacAddress())
+                && Objects.equals(a.getPasspointFqdn(), b.getPasspointFqdn())
+                && Objects.equals(a.getPasspointProviderFriendlyName(),
+                        b.getPasspointProviderFriendlyName())
+                && Objects.equals(a.getPasspointUniqueId(), b.getPasspointUniqueId())
+                && Objects.equals(a.getRequestingPackageName(), b.getRequestingPackageName());
+    }
+
     private void logStateAndMessage(Message message, State state) {
         mMessageHandlingStatus = 0;
         if (mVerboseLoggingEnabled) {
@@ -2962,6 +3079,9 @@ public class ClientModeImpl extends StateMachine {
             ssid = getTargetSsid();
         }
         if (level2FailureCode != WifiMetrics.ConnectionEvent.FAILURE_NONE) {
+            mConnectionPhaseTracer.trace(ConnectionPhaseTracer.PHASE_FAILED,
+                    (configuration == null) ? WifiConfiguration.INVALID_NETWORK_ID
+                            : configuration.networkId, bssid);
             int blocklistReason = convertToBssidBlocklistMonitorFailureReason(
                     level2FailureCode, level2FailureReason);
             if (blocklistReason != -1) {
@@ -3462,6 +3582,7 @@ public class ClientModeImpl extends StateMachine {
                 case WifiMonitor.ASSOCIATION_REJECTION_EVENT:
                 case CMD_RSSI_POLL:
                 case CMD_ONESHOT_RSSI_POLL:
+                case CMD_RSSI_POLL_LINK_LAYER_STATS:
                 case CMD_PRE_DHCP_ACTION:
                 case CMD_PRE_DHCP_ACTION_COMPLETE:
                 case CMD_POST_DHCP_ACTION:
@@ -3682,6 +3803,7 @@ public class ClientModeImpl extends StateMachine {
         }
         mCountryCode.setReadyForChange(false);
         mInterfaceName = null;
+        mSupportedFeatures = 0;
         mWifiScoreReport.setInterfaceName(null);
         // TODO: b/79504296 This broadcast has been deprecated and should be removed
         sendSupplicantConnectionChangedBroadcast(false);
@@ -4098,6 +4220,8 @@ public class ClientModeImpl extends StateMachine {
                         break;
                     }
                     mTargetNetworkId = netId;
+                    mConnectionPhaseTracer.trace(ConnectionPhaseTracer.PHASE_CONNECT_START,
+                            netId, bssid);
                     // Update scorecard while there is still state from existing connection
                     int scanRssi = mWifiConfigManager.findScanRssi(netId,
                             mWifiHealthMonitor.getScanRssiValidTimeMs());
@@ -4209,6 +4333,8 @@ public class ClientModeImpl extends StateMachine {
                         }
                         // Update last associated BSSID
                         mLastBssid = someBssid;
+                        mConnectionPhaseTracer.trace(ConnectionPhaseTracer.PHASE_ASSOCIATED,
+                                mTargetNetworkId, someBssid);
                     }
                     handleStatus = NOT_HANDLED;
                     break;
@@ -4219,6 +4345,8 @@ public class ClientModeImpl extends StateMachine {
                     if (mSentHLPs) mWifiMetrics.incrementL2ConnectionThroughFilsAuthCount();
                     mWifiConfigManager.clearRecentFailureReason(mLastNetworkId);
                     mLastBssid = (String) message.obj;
+                    mConnectionPhaseTracer.trace(ConnectionPhaseTracer.PHASE_L2_CONNECTED,
+                            mLastNetworkId, mLastBssid);
                     reasonCode = message.arg2;
                     // TODO: This check should not be needed after ClientModeImpl refactor.
                     // Currently, the last connected network configuration is left in
@@ -4615,6 +4743,8 @@ public class ClientModeImpl extends StateMachine {
                             + Integer.toString(mWifiInfo.getScore()));
                 }
                 mWifiMetrics.logStaEvent(StaEvent.TYPE_NETWORK_AGENT_VALID_NETWORK);
+                mConnectionPhaseTracer.trace(ConnectionPhaseTracer.PHASE_VALIDATED,
+                        mWifiInfo.getNetworkId(), mWifiInfo.getBSSID());
                 doNetworkStatus(status);
             }
         }
@@ -4726,6 +4856,7 @@ public class ClientModeImpl extends StateMachine {
         @Override
         public void enter() {
             mRssiPollToken++;
+            mWifiTrafficPoller.resetPollState();
             if (mEnableRssiPolling) {
                 mLinkProbeManager.resetOnNewConnection();
                 sendMessage(CMD_RSSI_POLL, mRssiPollToken, 0);
@@ -4799,6 +4930,7 @@ public class ClientModeImpl extends StateMachine {
                     sb.append(" ").append(mLastBssid);
                 }
             }
+            mWifiTrafficPoller.resetPollState();
             mCountryCode.setReadyForChange(true);
             mWifiMetrics.setWifiState(WifiMetricsProto.WifiLog.WIFI_DISCONNECTED);
             mWifiStateTracker.updateState(WifiStateTracker.DISCONNECTED);
@@ -4855,6 +4987,8 @@ public class ClientModeImpl extends StateMachine {
                         mWifiNative.disconnect(mInterfaceName);
                         transitionTo(mDisconnectingState);
                     } else {
+                        mConnectionPhaseTracer.trace(ConnectionPhaseTracer.PHASE_L3_CONNECTED,
+                                mLastNetworkId, mLastBssid);
                         handleSuccessfulIpConfiguration();
                         sendConnectedState();
                         transitionTo(mConnectedState);
@@ -4919,51 +5053,29 @@ public class ClientModeImpl extends StateMachine {
                     break;
                 case CMD_RSSI_POLL:
                     if (message.arg1 == mRssiPollToken) {
-                        WifiLinkLayerStats stats = updateLinkLayerStatsRssiAndScoreReportInternal();
-                        mWifiMetrics.updateWifiUsabilityStatsEntries(mWifiInfo, stats);
-                        if (mWifiScoreReport.shouldCheckIpLayer()) {
-                            if (mIpClient != null) {
-                                mIpClient.confirmConfiguration();
-                            }
-                            mWifiScoreReport.noteIpCheck();
-                        }
-                        int statusDataStall = mWifiDataStall.checkDataStallAndThroughputSufficiency(
-                                mLastLinkLayerStats, stats, mWifiInfo);
-                        if (mDataStallTriggerTimeMs == -1
-                                && statusDataStall != WifiIsUnusableEvent.TYPE_UNKNOWN) {
-                            mDataStallTriggerTimeMs = mClock.getElapsedSinceBootMillis();
-                            mLastStatusDataStall = statusDataStall;
-                        }
-                        if (mDataStallTriggerTimeMs != -1) {
-                            long elapsedTime =  mClock.getElapsedSinceBootMillis()
-                                    - mDataStallTriggerTimeMs;
-                            if (elapsedTime >= DURATION_TO_WAIT_ADD_STATS_AFTER_DATA_STALL_MS) {
-                                mDataStallTriggerTimeMs = -1;
-                                mWifiMetrics.addToWifiUsabilityStatsList(
-                                        WifiUsabilityStats.LABEL_BAD,
-                                        convertToUsabilityStatsTriggerType(mLastStatusDataStall),
-                                        -1);
-                                mLastStatusDataStall = WifiIsUnusableEvent.TYPE_UNKNOWN;
-                            }
+                        // The poll continues on CMD_RSSI_POLL_LINK_LAYER_STATS, unless the stats
+                        // cannot be fetched without blocking.
+                        if (!requestWifiLinkLayerStatsAsync(mRssiPollToken)) {
+                            handleRssiPollStats(updateLinkLayerStatsRssiAndScoreReportInternal());
                         }
-                        mWifiMetrics.incrementWifiLinkLayerUsageStats(stats);
-                        mLastLinkLayerStats = stats;
-                        mWifiScoreCard.noteSignalPoll(mWifiInfo);
-                        mLinkProbeManager.updateConnectionStats(
-                                mWifiInfo, mInterfaceName);
-                        sendMessageDelayed(obtainMessage(CMD_RSSI_POLL, mRssiPollToken, 0),
-                                getPollRssiIntervalMsecs());
-                        if (mVerboseLoggingEnabled) sendRssiChangeBroadcast(mWifiInfo.getRssi());
-                        mWifiTrafficPoller.notifyOnDataActivity(mWifiInfo.txSuccess,
-                                mWifiInfo.rxSuccess);
                     } else {
                         // Polling has completed
                     }
                     break;
+                case CMD_RSSI_POLL_LINK_LAYER_STATS:
+                    if (message.arg1 == mRssiPollToken) {
+                        WifiLinkLayerStats stats = (WifiLinkLayerStats) message.obj;
+                        mLastLinkLayerStatsUpdate = mClock.getWallClockMillis();
+                        noteWifiLinkLayerStats(stats);
+                        updateRssiAndScoreReport();
+                        handleRssiPollStats(stats);
+                    }
+                    break;
                 case CMD_ENABLE_RSSI_POLL:
                     cleanWifiScore();
                     mEnableRssiPolling = (message.arg1 == 1);
                     mRssiPollToken++;
+                    mWifiTrafficPoller.resetPollState();
                     if (mEnableRssiPolling) {
                         // First poll
                         mLastSignalLevel = -1;
@@ -5079,11 +5191,57 @@ public class ClientModeImpl extends StateMachine {
          */
         private WifiLinkLayerStats updateLinkLayerStatsRssiAndScoreReportInternal() {
             WifiLinkLayerStats stats = getWifiLinkLayerStats();
+            updateRssiAndScoreReport();
+            return stats;
+        }
+
+        private void updateRssiAndScoreReport() {
             // Get Info and continue polling
             fetchRssiLinkSpeedAndFrequencyNative();
             // Send the update score to network agent.
             mWifiScoreReport.calculateAndReportScore();
-            return stats;
+        }
+
+        /**
+         * Completes an RSSI poll with its link layer |stats|, and schedules the next poll.
+         */
+        private void handleRssiPollStats(WifiLinkLayerStats stats) {
+            mWifiMetrics.updateWifiUsabilityStatsEntries(mWifiInfo, stats);
+            if (mWifiScoreReport.shouldCheckIpLayer()) {
+                if (mIpClient != null) {
+                    mIpClient.confirmConfiguration();
+                }
+                mWifiScoreReport.noteIpCheck();
+            }
+            int statusDataStall = mWifiDataStall.checkDataStallAndThroughputSufficiency(
+                    mLastLinkLayerStats, stats, mWifiInfo);
+            if (mDataStallTriggerTimeMs == -1
+                    && statusDataStall != WifiIsUnusableEvent.TYPE_UNKNOWN) {
+                mDataStallTriggerTimeMs = mClock.getElapsedSinceBootMillis();
+                mLastStatusDataStall = statusDataStall;
+            }
+            if (mDataStallTriggerTimeMs != -1) {
+                long elapsedTime =  mClock.getElapsedSinceBootMillis()
+                        - mDataStallTriggerTimeMs;
+                if (elapsedTime >= DURATION_TO_WAIT_ADD_STATS_AFTER_DATA_STALL_MS) {
+                    mDataStallTriggerTimeMs = -1;
+                    mWifiMetrics.addToWifiUsabilityStatsList(
+                            WifiUsabilityStats.LABEL_BAD,
+                            convertToUsabilityStatsTriggerType(mLastStatusDataStall),
+                            -1);
+                    mLastStatusDataStall = WifiIsUnusableEvent.TYPE_UNKNOWN;
+                }
+            }
+            mWifiMetrics.incrementWifiLinkLayerUsageStats(stats);
+            mLastLinkLayerStats = stats;
+            mWifiScoreCard.noteSignalPoll(mWifiInfo);
+            mLinkProbeManager.updateConnectionStats(
+                    mWifiInfo, mInterfaceName);
+            sendMessageDelayed(obtainMessage(CMD_RSSI_POLL, mRssiPollToken, 0),
+                    getPollRssiIntervalMsecs());
+            if (mVerboseLoggingEnabled) sendRssiChangeBroadcast(mWifiInfo.getRssi());
+            mWifiTrafficPoller.notifyOnDataActivity(mWifiInfo.txSuccess,
+                    mWifiInfo.rxSuccess);
         }
     }
 
@@ -0,0 +1,378 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.server.wifi;
+
+import android.annotation.Nullable;
+
+import com.android.internal.annotations.GuardedBy;
+import com.android.internal.annotations.VisibleForTesting;
+
+import java.io.PrintWriter;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
+
+import javax.annotation.concurrent.ThreadSafe;
+
+/**
+ * Records the phases each connection attempt goes through, from network selection to network
+ * validation, and breaks down where the time of recent connections was spent.
+ *
+ * Trace points (phase, network id, BSSID, timestamp) are written into preallocated parallel
+ * arrays used as a ring, so tracing allocates nothing. They are only grouped into connection
+ * attempts and analyzed when dumped.
+ */
+@ThreadSafe
+public class ConnectionPhaseTracer {
+    /** WifiConnectivityManager selected a network and is about to connect to it. */
+    public static final int PHASE_NETWORK_SELECTED = 0;
+    /** ClientModeImpl started connecting to a network. */
+    public static final int PHASE_CONNECT_START = 1;
+    /** Supplicant associated with the BSSID. */
+    public static final int PHASE_ASSOCIATED = 2;
+    /** Supplicant completed the 4-way handshake (or other authentication) with the BSSID. */
+    public static final int PHASE_L2_CONNECTED = 3;
+    /** IpClient completed provisioning (e.g. DHCP). */
+    public static final int PHASE_L3_CONNECTED = 4;
+    /** Connectivity service validated the network. */
+    public static final int PHASE_VALIDATED = 5;
+    /** The connection attempt failed. */
+    public static final int PHASE_FAILED = 6;
+    private static final int NUM_PHASES = 7;
+
+    private static final String[] PHASE_NAMES = {
+            "NETWORK_SELECTED",
+            "CONNECT_START",
+            "ASSOCIATED",
+            "L2_CONNECTED",
+            "L3_CONNECTED",
+            "VALIDATED",
+            "FAILED",
+    };
+
+    // Name of the step of a connection ending with each phase, as reported by the analyzer.
+    private static final String[] STEP_NAMES = {
+            null,
+            "selection",
+            "association",
+            "handshake",
+            "ip provisioning",
+            "validation",
+            null,
+    };
+
+    private static final int DEFAULT_CAPACITY = 512;
+    // Number of latest connections analyzed by default
+    static final int DEFAULT_NUM_CONNECTIONS = 50;
+
+    private final Clock mClock;
+    private final Object mLock = new Object();
+    @GuardedBy("mLock")
+    private final int[] mPhases;
+    @GuardedBy("mLock")
+    private final int[] mNetworkIds;
+    @GuardedBy("mLock")
+    private final String[] mBssids;
+    @GuardedBy("mLock")
+    private final long[] mTimestampsMs;
+    // Index of the oldest trace point, and number of trace points in the ring
+    @GuardedBy("mLock")
+    private int mStart;
+    @GuardedBy("mLock")
+    private int mSize;
+
+    public ConnectionPhaseTracer(Clock clock) {
+        this(clock, DEFAULT_CAPACITY);
+    }
+
+    @VisibleForTesting
+    ConnectionPhaseTracer(Clock clock, int capacity) {
+        mClock = clock;
+        mPhases = new int[capacity];
+        mNetworkIds = new int[capacity];
+        mBssids = new String[capacity];
+        mTimestampsMs = new long[capacity];
+    }
+
+    /**
+     * Records that a connection attempt reached |phase|.
+     * @param phase one of the PHASE_* constants
+     * @param networkId id of the network being connected to, or
+     *                  WifiConfiguration.INVALID_NETWORK_ID if unknown
+     * @param bssid BSSID being connected to, or null if unknown
+     */
+    public void trace(int phase, int networkId, @Nullable String bssid) {
+        long nowMs = mClock.getElapsedSinceBootMillis();
+        synchronized (mLock) {
+            int capacity = mPhases.length;
+            int index;
+            if (mSize < capacity) {
+                index = (mStart + mSize) % capacity;
+                mSize++;
+            } else {
+                index = mStart;
+                mStart = (mStart + 1) % capacity;
+            }
+            mPhases[index] = phase;
+            mNetworkIds[index] = networkId;
+            mBssids[index] = bssid;
+            mTimestampsMs[index] = nowMs;
+        }
+    }
+
+    /**
+     * Clears all trace points.
+     */
+    public void clear() {
+        synchronized (mLock) {
+            Arrays.fill(mBssids, null);
+            mStart = 0;
+            mSize = 0;
+        }
+    }
+
+    /**
+     * A connection attempt, assembled from consecutive trace points.
+     */
+    @VisibleForTesting
+    static class Attempt {
+        public final int networkId;
+        public String bssid;
+        public final long startTimeMs;
+        // Time at which each phase was first reached, or -1 if it was not reached
+        public final long[] phaseTimesMs = new long[NUM_PHASES];
+
+        Attempt(int networkId, long startTimeMs) {
+            this.networkId = networkId;
+            this.startTimeMs = startTimeMs;
+            Arrays.fill(phaseTimesMs, -1);
+        }
+
+        boolean isConnected() {
+            return phaseTimesMs[PHASE_L3_CONNECTED] >= 0;
+        }
+
+        /**
+         * Returns the duration of the step ending with |phase|, measured from the latest earlier
+         * phase reached, or -1 if the phase was not reached.
+         */
+        long getStepDurationMs(int phase) {
+            if (phaseTimesMs[phase] < 0) {
+                return -1;
+            }
+            for (int previous = phase - 1; previous >= PHASE_NETWORK_SELECTED; previous--) {
+                if (phaseTimesMs[previous] >= 0) {
+                    return phaseTimesMs[phase] - phaseTimesMs[previous];
+                }
+            }
+            return -1;
+        }
+
+        /**
+         * Returns the time from the start of the attempt to the latest successful phase reached.
+         */
+        long getTotalDurationMs() {
+            for (int phase = PHASE_VALIDATED; phase > PHASE_NETWORK_SELECTED; phase--) {
+                if (phaseTimesMs[phase] >= 0) {
+                    return phaseTimesMs[phase] - startTimeMs;
+                }
+            }
+            return 0;
+        }
+    }
+
+    /**
+     * Groups the recorded trace points into connection attempts, oldest first.
+     *
+     * An attempt starts at a PHASE_NETWORK_SELECTED or PHASE_CONNECT_START trace point (the
+     * latter continuing an attempt started by the selection of the same network), and ends at
+     * PHASE_VALIDATED, PHASE_FAILED or the start of the next attempt. Trace points outside any
+     * attempt, such as associations while roaming, are ignored.
+     * @param connected list to which the attempts which got to PHASE_L3_CONNECTED are added
+     * @return the number of attempts which failed or were abandoned
+     */
+    @VisibleForTesting
+    int getAttempts(List<Attempt> connected) {
+        int numFailed = 0;
+        Attempt current = null;
+        synchronized (mLock) {
+            for (int i = 0; i < mSize; i++) {
+                int index = (mStart + i) % mPhases.length;
+                int phase = mPhases[index];
+                int networkId = mNetworkIds[index];
+                long timeMs = mTimestampsMs[index];
+                if (phase == PHASE_CONNECT_START && current != null
+                        && current.networkId == networkId
+                        && current.phaseTimesMs[PHASE_CONNECT_START] < 0
+                        && current.phaseTimesMs[PHASE_ASSOCIATED] < 0) {
+                    current.phaseTimesMs[PHASE_CONNECT_START] = timeMs;
+                    continue;
+                }
+                if (phase == PHASE_NETWORK_SELECTED || phase == PHASE_CONNECT_START) {
+                    if (current != null) {
+                        numFailed += endAttempt(current, connected);
+                    }
+                    current = new Attempt(networkId, timeMs);
+                    current.phaseTimesMs[phase] = timeMs;
+                } else if (current == null) {
+                    continue;
+                } else if (phase == PHASE_FAILED) {
+                    current.phaseTimesMs[phase] = timeMs;
+                    numFailed += endAttempt(current, connected);
+                    current = null;
+                    continue;
+                } else if (phase == PHASE_VALIDATED) {
+                    // A late validation of the previous network does not end this attempt.
+                    if (!current.isConnected()) {
+                        continue;
+                    }
+                    current.phaseTimesMs[phase] = timeMs;
+                    numFailed += endAttempt(current, connected);
+                    current = null;
+                    continue;
+                } else if (current.phaseTimesMs[phase] < 0) {
+                    current.phaseTimesMs[phase] = timeMs;
+                }
+                if (mBssids[index] != null) {
+                    current.bssid = mBssids[index];
+                }
+            }
+        }
+        // The latest attempt may still be waiting for validation, or still in progress.
+        if (current != null && current.isConnected()) {
+            connected.add(current);
+        }
+        return numFailed;
+    }
+
+    private static int endAttempt(Attempt attempt, List<Attempt> connected) {
+        if (attempt.isConnected() && attempt.phaseTimesMs[PHASE_FAILED] < 0) {
+            connected.add(attempt);
+            return 0;
+        }
+        return 1;
+    }
+
+    /**
+     * Returns the |percentile| value of |sortedValues| (nearest rank), or -1 if there is none.
+     */
+    private static long getPercentile(long[] sortedValues, int count, int percentile) {
+        if (count == 0) {
+            return -1;
+        }
+        int rank = (int) Math.ceil(percentile / 100.0 * count);
+        return sortedValues[Math.max(rank, 1) - 1];
+    }
+
+    /**
+     * Prints the per-step p50/p95/max latencies of the last |numConnections| successful
+     * connections, and lists those whose total latency is an outlier, i.e. at or above p95.
+     */
+    public void analyze(PrintWriter pw, int numConnections) {
+        List<Attempt> attempts = new ArrayList<>();
+        int numFailed = getAttempts(attempts);
+        if (attempts.size() > numConnections) {
+            attempts = attempts.subList(attempts.size() - numConnections, attempts.size());
+        }
+        int count = attempts.size();
+        pw.println("Connection phase latencies of the last " + count + " connections ("
+                + numFailed + " failed or abandoned attempts traced):");
+        if (count == 0) {
+            return;
+        }
+        pw.println(String.format("  %-16s %8s %8s %8s %8s", "step", "count", "p50 ms", "p95 ms",
+                "max ms"));
+        long[] durations = new long[count];
+        for (int phase = PHASE_CONNECT_START; phase <= PHASE_VALIDATED; phase++) {
+            int numDurations = 0;
+            for (Attempt attempt : attempts) {
+                long durationMs = attempt.getStepDurationMs(phase);
+                if (durationMs >= 0) {
+                    durations[numDurations++] = durationMs;
+                }
+            }
+            printPercentiles(pw, STEP_NAMES[phase], durations, numDurations);
+        }
+        for (int i = 0; i < count; i++) {
+            durations[i] = attempts.get(i).getTotalDurationMs();
+        }
+        long[] totalPercentilesMs = printPercentiles(pw, "total", durations, count);
+        long p50TotalMs = totalPercentilesMs[0];
+        long p95TotalMs = totalPercentilesMs[1];
+
+        pw.println("Outliers (total >= p95):");
+        for (Attempt attempt : attempts) {
+            long totalMs = attempt.getTotalDurationMs();
+            if (totalMs < p95TotalMs || totalMs <= p50TotalMs) {
+                continue;
+            }
+            StringBuilder sb = new StringBuilder();
+            sb.append("  elapsed=").append(attempt.startTimeMs)
+                    .append(" netId=").append(attempt.networkId)
+                    .append(" bssid=").append(attempt.bssid)
+                    .append(" total=").append(totalMs).append("ms");
+            int slowestPhase = -1;
+            long slowestMs = -1;
+            for (int phase = PHASE_CONNECT_START; phase <= PHASE_VALIDATED; phase++) {
+                long durationMs = attempt.getStepDurationMs(phase);
+                if (durationMs < 0) {
+                    continue;
+                }
+                sb.append(' ').append(STEP_NAMES[phase]).append('=').append(durationMs);
+                if (durationMs > slowestMs) {
+                    slowestMs = durationMs;
+                    slowestPhase = phase;
+                }
+            }
+            if (slowestPhase >= 0) {
+                sb.append(" slowest=").append(STEP_NAMES[slowestPhase]);
+            }
+            pw.println(sb.toString());
+        }
+    }
+
+    /**
+     * Sorts the first |count| of |values| and prints their p50/p95/max.
+     * @return the p50 and p95, -1 if there are no values
+     */
+    private static long[] printPercentiles(PrintWriter pw, String name, long[] values,
+            int count) {
+        Arrays.sort(values, 0, count);
+        long p50 = getPercentile(values, count, 50);
+        long p95 = getPercentile(values, count, 95);
+        long max = count == 0 ? -1 : values[count - 1];
+        pw.println(String.format("  %-16s %8d %8d %8d %8d", name, count, p50, p95, max));
+        return new long[] {p50, p95};
+    }
+
+    /**
+     * Dump the analysis of recent connections, followed by the raw trace points.
+     */
+    public void dump(PrintWriter pw) {
+        pw.println("Dump of ConnectionPhaseTracer");
+        analyze(pw, DEFAULT_NUM_CONNECTIONS);
+        synchronized (mLock) {
+            pw.println("Trace points (" + mSize + "):");
+            for (int i = 0; i < mSize; i++) {
+                int index = (mStart + i) % mPhases.length;
+                pw.println("  " + mTimestampsMs[index] + " " + PHASE_NAMES[mPhases[index]]
+                        + " netId=" + mNetworkIds[index] + " bssid=" + mBssids[index]);
+            }
+        }
+        pw.println();
+    }
+}
@@ -56,6 +56,7 @@ import java.util.HashSet;
 import java.util.List;
 import java.util.Map;
 import java.util.Set;
+import java.util.concurrent.atomic.AtomicInteger;
 
 /**
  * Handles device management through the HAL (HIDL) interface.
@@ -576,7 +577,8 @@ public class HalDeviceManager {
             mRttControllerLifecycleCallbacks = new HashSet<>();
     private final SparseArray<Map<InterfaceAvailableForRequestListenerProxy, Boolean>>
             mInterfaceAvailableForRequestListeners = new SparseArray<>();
-    private final SparseArray<IWifiChipEventCallback.Stub> mDebugCallbacks = new SparseArray<>();
+    private final SparseArray<IWifiChipEventCallback.Stub> mChipEventCallbacks =
+            new SparseArray<>();
     private boolean mIsReady;
 
     /*
@@ -588,6 +590,22 @@ public class HalDeviceManager {
             new HashMap<>();
     private WifiChipInfo[] mDebugChipsInfo = null;
 
+    /*
+     * Chip info last read by getAllChipInfo(), reused until a chip or interface lifecycle event
+     * invalidates it. Invalidation bumps mChipInfoGeneration - also from HIDL callback threads -
+     * and the cached info is only valid for the generation it was read in.
+     */
+    private final AtomicInteger mChipInfoGeneration = new AtomicInteger();
+    private WifiChipInfo[] mCachedChipInfos = null;
+    private int mCachedChipInfoGeneration;
+    private int mNumChipInfoCacheHits = 0;
+    private int mNumChipInfoCacheMisses = 0;
+
+    // Latency of createIface() by interface type, in microseconds.
+    private final int[] mNumCreateIfaceCalls = new int[IFACE_TYPES_BY_PRIORITY.length];
+    private final long[] mTotalCreateIfaceUs = new long[IFACE_TYPES_BY_PRIORITY.length];
+    private final long[] mMaxCreateIfaceUs = new long[IFACE_TYPES_BY_PRIORITY.length];
+
     private class InterfaceCacheEntry {
         public IWifiChip chip;
         public int chipId;
@@ -669,6 +687,7 @@ public class HalDeviceManager {
     }
 
     private void teardownInternal() {
+        invalidateChipInfoCache();
         managerStatusListenerDispatch();
         dispatchAllDestroyedListeners();
         mInterfaceAvailableForRequestListeners.get(IfaceType.STA).clear();
@@ -775,6 +794,7 @@ public class HalDeviceManager {
     private class WifiDeathRecipient implements DeathRecipient {
         @Override
         public void serviceDied(long cookie) {
+            invalidateChipInfoCache();
             mEventHandler.post(() -> {
                 Log.e(TAG, "IWifi HAL service died! Have a listener for it ... cookie=" + cookie);
                 synchronized (mLock) { // prevents race condition with surrounding method
@@ -832,19 +852,16 @@ public class HalDeviceManager {
     }
 
     /**
-     * Registers event listeners on all IWifiChips after a successful start: DEBUG only!
+     * Registers event callbacks on all IWifiChips after a successful start.
      *
-     * We don't need the listeners since any callbacks are just confirmation of status codes we
-     * obtain directly from mode changes or interface creation/deletion.
+     * The callbacks invalidate the cached chip info on chip reconfiguration and on interface
+     * creation or removal, including those not made through this manager, so they are needed
+     * whatever the debug level.
      *
      * Relies (to the degree we care) on the service removing all listeners when Wi-Fi is stopped.
      */
-    private void initIWifiChipDebugListeners() {
-        if (VDBG) Log.d(TAG, "initIWifiChipDebugListeners");
-
-        if (!VDBG) {
-            return;
-        }
+    private void initIWifiChipEventCallbacks() {
+        if (VDBG) Log.d(TAG, "initIWifiChipEventCallbacks");
 
         synchronized (mLock) {
             try {
@@ -864,7 +881,7 @@ public class HalDeviceManager {
                     return;
                 }
 
-                Log.d(TAG, "getChipIds=" + chipIdsResp.value);
+                if (VDBG) Log.d(TAG, "getChipIds=" + chipIdsResp.value);
                 if (chipIdsResp.value.size() == 0) {
                     Log.e(TAG, "Should have at least 1 chip!");
                     return;
@@ -889,7 +906,8 @@ public class HalDeviceManager {
                             new IWifiChipEventCallback.Stub() {
                                 @Override
                                 public void onChipReconfigured(int modeId) throws RemoteException {
-                                    Log.d(TAG, "onChipReconfigured: modeId=" + modeId);
+                                    if (VDBG) Log.d(TAG, "onChipReconfigured: modeId=" + modeId);
+                                    invalidateChipInfoCache();
                                 }
 
                                 @Override
@@ -902,30 +920,39 @@ public class HalDeviceManager {
                                 @Override
                                 public void onIfaceAdded(int type, String name)
                                         throws RemoteException {
-                                    Log.d(TAG, "onIfaceAdded: type=" + type + ", name=" + name);
+                                    if (VDBG) {
+                                        Log.d(TAG, "onIfaceAdded: type=" + type + ", name="
+                                                + name);
+                                    }
+                                    invalidateChipInfoCache();
                                 }
 
                                 @Override
                                 public void onIfaceRemoved(int type, String name)
                                         throws RemoteException {
-                                    Log.d(TAG, "onIfaceRemoved: type=" + type + ", name=" + name);
+                                    if (VDBG) {
+                                        Log.d(TAG, "onIfaceRemoved: type=" + type + ", name="
+                                                + name);
+                                    }
+                                    invalidateChipInfoCache();
                                 }
 
                                 @Override
                                 public void onDebugRingBufferDataAvailable(
                                         WifiDebugRingBufferStatus status,
                                         ArrayList<Byte> data) throws RemoteException {
-                                    Log.d(TAG, "onDebugRingBufferDataAvailable");
+                                    if (VDBG) Log.d(TAG, "onDebugRingBufferDataAvailable");
                                 }
 
                                 @Override
                                 public void onDebugErrorAlert(int errorCode,
                                         ArrayList<Byte> debugData)
                                         throws RemoteException {
-                                    Log.d(TAG, "onDebugErrorAlert");
+                                    if (VDBG) Log.d(TAG, "onDebugErrorAlert");
                                 }
                             };
-                    mDebugCallbacks.put(chipId, callback); // store to prevent GC: needed by HIDL
+                    // store to prevent GC: needed by HIDL
+                    mChipEventCallbacks.put(chipId, callback);
                     WifiStatus status = chipResp.value.registerEventCallback(callback);
                     if (status.code != WifiStatusCode.SUCCESS) {
                         Log.e(TAG, "registerEventCallback failed: " + statusString(status));
@@ -933,18 +960,27 @@ public class HalDeviceManager {
                     }
                 }
             } catch (RemoteException e) {
-                Log.e(TAG, "initIWifiChipDebugListeners: exception: " + e);
+                Log.e(TAG, "initIWifiChipEventCallbacks: exception: " + e);
                 return;
             }
         }
     }
 
+    /**
+     * Invalidates the chip info cached by getAllChipInfo(). Called whenever the chips may have been
+     * reconfigured, or interfaces added or removed. May be called from any thread.
+     */
+    private void invalidateChipInfoCache() {
+        mChipInfoGeneration.incrementAndGet();
+    }
+
     /**
      * Get current information about all the chips in the system: modes, current mode (if any), and
      * any existing interfaces.
      *
-     * Intended to be called whenever we need to configure the chips - information is NOT cached (to
-     * reduce the likelihood that we get out-of-sync).
+     * The information is cached until a chip or interface lifecycle event - chip reconfiguration,
+     * interface creation or removal by this manager, or the corresponding chip callbacks - or a
+     * HAL stop or death invalidates it. The returned info must not be modified.
      */
     private WifiChipInfo[] getAllChipInfo() {
         if (VDBG) Log.d(TAG, "getAllChipInfo");
@@ -955,6 +991,24 @@ public class HalDeviceManager {
                 return null;
             }
 
+            int generation = mChipInfoGeneration.get();
+            if (mCachedChipInfos != null && mCachedChipInfoGeneration == generation) {
+                mNumChipInfoCacheHits++;
+                return mCachedChipInfos;
+            }
+            mNumChipInfoCacheMisses++;
+            WifiChipInfo[] chipsInfo = readAllChipInfo();
+            mCachedChipInfos = chipsInfo;
+            mCachedChipInfoGeneration = generation;
+            return chipsInfo;
+        }
+    }
+
+    /**
+     * Reads the information returned by getAllChipInfo() from the HAL.
+     */
+    private WifiChipInfo[] readAllChipInfo() {
+        synchronized (mLock) {
             try {
                 MutableBoolean statusOk = new MutableBoolean(false);
                 Mutable<ArrayList<Integer>> chipIdsResp = new Mutable<>();
@@ -1265,7 +1319,8 @@ public class HalDeviceManager {
                     while (triedCount <= START_HAL_RETRY_TIMES) {
                         WifiStatus status = mWifi.start();
                         if (status.code == WifiStatusCode.SUCCESS) {
-                            initIWifiChipDebugListeners();
+                            invalidateChipInfoCache();
+                            initIWifiChipEventCallbacks();
                             managerStatusListenerDispatch();
                             if (triedCount != 0) {
                                 Log.d(TAG, "start IWifi succeeded after trying "
@@ -1422,6 +1477,19 @@ public class HalDeviceManager {
 
     private IWifiIface createIface(int ifaceType, InterfaceDestroyedListener destroyedListener,
             Handler handler) {
+        long startNs = mClock.getElapsedSinceBootNanos();
+        IWifiIface iface = createIfaceInternal(ifaceType, destroyedListener, handler);
+        long latencyUs = (mClock.getElapsedSinceBootNanos() - startNs) / 1000;
+        synchronized (mLock) {
+            mNumCreateIfaceCalls[ifaceType]++;
+            mTotalCreateIfaceUs[ifaceType] += latencyUs;
+            mMaxCreateIfaceUs[ifaceType] = Math.max(mMaxCreateIfaceUs[ifaceType], latencyUs);
+        }
+        return iface;
+    }
+
+    private IWifiIface createIfaceInternal(int ifaceType,
+            InterfaceDestroyedListener destroyedListener, Handler handler) {
         if (mDbg) {
             Log.d(TAG, "createIface: ifaceType=" + ifaceType);
         }
@@ -1883,6 +1951,8 @@ public class HalDeviceManager {
                     + ", ifaceType=" + ifaceType);
         }
         synchronized (mLock) {
+            // The chips change whatever the outcome.
+            invalidateChipInfoCache();
             try {
                 // is this a mode change?
                 boolean isModeConfigNeeded = !ifaceCreationData.chipInfo.currentModeIdValid
@@ -1903,6 +1973,7 @@ public class HalDeviceManager {
 
                     WifiStatus status = ifaceCreationData.chipInfo.chip.configureChip(
                             ifaceCreationData.chipModeId);
+                    invalidateChipInfoCache();
                     updateRttControllerOnModeChange();
                     if (status.code != WifiStatusCode.SUCCESS) {
                         Log.e(TAG, "executeChipReconfiguration: configureChip error: "
@@ -1950,6 +2021,7 @@ public class HalDeviceManager {
                         break;
                 }
 
+                invalidateChipInfoCache();
                 if (statusResp.value.code != WifiStatusCode.SUCCESS) {
                     Log.e(TAG, "executeChipReconfiguration: failed to create interface ifaceType="
                             + ifaceType + ": " + statusString(statusResp.value));
@@ -2013,6 +2085,7 @@ public class HalDeviceManager {
             } catch (RemoteException e) {
                 Log.e(TAG, "IWifiChip.removeXxxIface exception: " + e);
             }
+            invalidateChipInfoCache();
 
             // dispatch listeners no matter what status
             dispatchDestroyedListeners(name, type);
@@ -2382,5 +2455,15 @@ public class HalDeviceManager {
                 + mInterfaceAvailableForRequestListeners);
         pw.println("  mInterfaceInfoCache: " + mInterfaceInfoCache);
         pw.println("  mDebugChipsInfo: " + Arrays.toString(mDebugChipsInfo));
+        synchronized (mLock) {
+            pw.println("  mNumChipInfoCacheHits: " + mNumChipInfoCacheHits
+                    + ", mNumChipInfoCacheMisses: " + mNumChipInfoCacheMisses);
+            for (int type : IFACE_TYPES_BY_PRIORITY) {
+                int numCalls = mNumCreateIfaceCalls[type];
+                pw.println("  createIface latency: type=" + type + ", calls=" + numCalls
+                        + ", avgUs=" + (numCalls == 0 ? 0 : mTotalCreateIfaceUs[type] / numCalls)
+                        + ", maxUs=" + mMaxCreateIfaceUs[type]);
+            }
+        }
     }
 }
@@ -17,35 +17,55 @@
 package com.android.server.wifi;
 
 
+import android.os.Handler;
+import android.os.Looper;
+
+import com.android.internal.annotations.GuardedBy;
 import com.android.internal.annotations.VisibleForTesting;
+import com.android.server.wifi.util.Environment;
 import com.android.server.wifi.util.FileUtils;
 
 import java.io.File;
 import java.io.FileInputStream;
+import java.io.FileOutputStream;
 import java.io.IOException;
+import java.io.InputStream;
+import java.io.InputStreamReader;
+import java.io.OutputStream;
 import java.io.PrintWriter;
-import java.nio.file.Files;
-import java.nio.file.Paths;
+import java.io.Reader;
+import java.util.ArrayDeque;
+import java.util.Iterator;
 
 /**
  * Provides a facility for capturing kernel trace events related to Wifi control and data paths.
+ *
+ * When a connection attempt fails, the trace buffer is frozen by copying it, through a small
+ * fixed size buffer, to a window file in the capture directory. The last few windows are kept,
+ * and dumps stream them, so that neither capturing nor dumping loads a whole trace in the heap.
+ *
+ * All file accesses, except dumps, are done in order on the background looper, so that reporting
+ * a connection event never waits for the trace to be copied.
  */
 public class LastMileLogger {
-    public LastMileLogger(WifiInjector injector) {
+    public LastMileLogger(WifiInjector injector, Looper backgroundLooper) {
         File tracefsEnablePath = new File(WIFI_EVENT_ENABLE_PATH);
+        File captureDir = new File(Environment.getWifiSharedDirectory(), CAPTURE_DIR_NAME);
         if (tracefsEnablePath.exists()) {
             initLastMileLogger(injector, WIFI_EVENT_BUFFER_PATH, WIFI_EVENT_ENABLE_PATH,
-                    WIFI_EVENT_RELEASE_PATH);
+                    WIFI_EVENT_RELEASE_PATH, captureDir, backgroundLooper);
         } else {
             initLastMileLogger(injector, WIFI_EVENT_BUFFER_PATH_DEBUGFS,
-                    WIFI_EVENT_ENABLE_PATH_DEBUGFS, WIFI_EVENT_RELEASE_PATH_DEBUGFS);
+                    WIFI_EVENT_ENABLE_PATH_DEBUGFS, WIFI_EVENT_RELEASE_PATH_DEBUGFS, captureDir,
+                    backgroundLooper);
         }
     }
 
     @VisibleForTesting
     public LastMileLogger(WifiInjector injector, String bufferPath, String enablePath,
-                          String releasePath) {
-        initLastMileLogger(injector, bufferPath, enablePath, releasePath);
+                          String releasePath, File captureDir, Looper backgroundLooper) {
+        initLastMileLogger(injector, bufferPath, enablePath, releasePath, captureDir,
+                backgroundLooper);
     }
 
     /**
@@ -53,6 +73,10 @@ public class LastMileLogger {
      * @param event an event defined in BaseWifiDiagnostics
      */
     public void reportConnectionEvent(byte event) {
+        mBackgroundHandler.post(() -> handleConnectionEvent(event));
+    }
+
+    private void handleConnectionEvent(byte event) {
         switch (event) {
             case BaseWifiDiagnostics.CONNECTION_EVENT_STARTED:
                 enableTracing();
@@ -62,11 +86,11 @@ public class LastMileLogger {
                 return;
             case BaseWifiDiagnostics.CONNECTION_EVENT_FAILED:
                 disableTracing();
-                mLastMileLogForLastFailure = readTrace();
+                freezeTrace();
                 return;
             case BaseWifiDiagnostics.CONNECTION_EVENT_TIMEOUT:
                 disableTracing();
-                mLastMileLogForLastFailure = readTrace();
+                freezeTrace();
                 return;
         }
     }
@@ -76,8 +100,21 @@ public class LastMileLogger {
      * @param pw the PrintWriter that will receive the dump
      */
     public void dump(PrintWriter pw) {
-        dumpInternal(pw, "Last failed last-mile log", mLastMileLogForLastFailure);
-        dumpInternal(pw, "Latest last-mile log", readTrace());
+        ArrayDeque<File> frozenWindows;
+        synchronized (mLock) {
+            frozenWindows = mFrozenWindows.clone();
+        }
+        // Windows are only ever replaced by a rename, so a dump never sees one half written.
+        if (frozenWindows.isEmpty()) {
+            dumpInternal(pw, "Last failed last-mile log", null);
+        } else {
+            Iterator<File> windows = frozenWindows.descendingIterator();
+            dumpInternal(pw, "Last failed last-mile log", windows.next());
+            for (int i = 2; windows.hasNext(); i++) {
+                dumpInternal(pw, "Failed last-mile log #" + i + " from last", windows.next());
+            }
+        }
+        dumpInternal(pw, "Latest last-mile log", new File(mEventBufferPath));
     }
 
     private static final String TAG = "LastMileLogger";
@@ -93,21 +130,53 @@ public class LastMileLogger {
             "/sys/kernel/debug/tracing/instances/wifi/tracing_on";
     private static final String WIFI_EVENT_RELEASE_PATH_DEBUGFS =
             "/sys/kernel/debug/tracing/instances/wifi/free_buffer";
-
+    private static final String CAPTURE_DIR_NAME = "last_mile";
+    private static final String WINDOW_FILE_PREFIX = "failure_window_";
+    private static final String TEMP_WINDOW_FILE_NAME = WINDOW_FILE_PREFIX + "tmp";
+    // Number of frozen windows kept, and maximum size of each
+    @VisibleForTesting
+    static final int MAX_FROZEN_WINDOWS = 3;
+    @VisibleForTesting
+    static final int MAX_WINDOW_BYTES = 4 * 1024 * 1024;
+    private static final int COPY_BUFFER_BYTES = 16 * 1024;
+    private static final int DUMP_BUFFER_CHARS = 8 * 1024;
 
     private String mEventBufferPath;
     private String mEventEnablePath;
     private String mEventReleasePath;
+    private File mCaptureDir;
     private WifiLog mLog;
-    private byte[] mLastMileLogForLastFailure;
+    private Handler mBackgroundHandler;
+    private final Object mLock = new Object();
+    // Frozen windows, oldest first
+    @GuardedBy("mLock")
+    private final ArrayDeque<File> mFrozenWindows = new ArrayDeque<>();
+    private int mNumWindowsFrozen;
+    private final byte[] mCopyBuffer = new byte[COPY_BUFFER_BYTES];
     private FileInputStream mLastMileTraceHandle;
 
     private void initLastMileLogger(WifiInjector injector, String bufferPath, String enablePath,
-                          String releasePath) {
+                          String releasePath, File captureDir, Looper backgroundLooper) {
         mLog = injector.makeLog(TAG);
         mEventBufferPath = bufferPath;
         mEventEnablePath = enablePath;
         mEventReleasePath = releasePath;
+        mCaptureDir = captureDir;
+        mBackgroundHandler = new Handler(backgroundLooper);
+        mBackgroundHandler.post(this::deleteStaleWindows);
+    }
+
+    /**
+     * Deletes the windows frozen before a restart, which are not listed in mFrozenWindows.
+     */
+    private void deleteStaleWindows() {
+        File[] staleWindows = mCaptureDir.listFiles(
+                (dir, name) -> name.startsWith(WINDOW_FILE_PREFIX));
+        if (staleWindows != null) {
+            for (File window : staleWindows) {
+                window.delete();
+            }
+        }
     }
 
     private void enableTracing() {
@@ -131,13 +200,51 @@ public class LastMileLogger {
         }
     }
 
-    private byte[] readTrace() {
-        try {
-            return Files.readAllBytes(Paths.get(mEventBufferPath));
+    /**
+     * Copies the current trace into a new frozen window, evicting the oldest window if there are
+     * already MAX_FROZEN_WINDOWS of them. The trace is copied to a temporary file first, so that
+     * the oldest window is only replaced once a non-empty trace was read whole.
+     */
+    private void freezeTrace() {
+        if (!mCaptureDir.isDirectory() && !mCaptureDir.mkdirs()) {
+            mLog.warn("Failed to create capture directory %").c(mCaptureDir.getPath()).flush();
+            return;
+        }
+        File tempWindow = new File(mCaptureDir, TEMP_WINDOW_FILE_NAME);
+        long numBytes = 0;
+        try (InputStream in = new FileInputStream(mEventBufferPath);
+                OutputStream out = new FileOutputStream(tempWindow)) {
+            int count;
+            while (numBytes < MAX_WINDOW_BYTES && (count = in.read(mCopyBuffer, 0,
+                    (int) Math.min(mCopyBuffer.length, MAX_WINDOW_BYTES - numBytes))) > 0) {
+                out.write(mCopyBuffer, 0, count);
+                numBytes += count;
+            }
         } catch (IOException e) {
             mLog.warn("Failed to read event trace: %").r(e.getMessage()).flush();
-            return new byte[0];
+            tempWindow.delete();
+            return;
+        }
+        if (numBytes == 0) {
+            tempWindow.delete();
+            return;
         }
+        // Window files are reused in FIFO order, so once there are MAX_FROZEN_WINDOWS of them,
+        // this is the name of the oldest window, which the rename replaces.
+        File window = new File(mCaptureDir,
+                WINDOW_FILE_PREFIX + (mNumWindowsFrozen % MAX_FROZEN_WINDOWS));
+        if (!tempWindow.renameTo(window)) {
+            mLog.warn("Failed to rename frozen window %").c(window.getPath()).flush();
+            tempWindow.delete();
+            return;
+        }
+        synchronized (mLock) {
+            if (mFrozenWindows.size() >= MAX_FROZEN_WINDOWS) {
+                mFrozenWindows.removeFirst();
+            }
+            mFrozenWindows.addLast(window);
+        }
+        mNumWindowsFrozen++;
     }
 
     private boolean ensureFailSafeIsArmed() {
@@ -165,14 +272,31 @@ public class LastMileLogger {
         }
     }
 
-    private static void dumpInternal(PrintWriter pw, String description, byte[] lastMileLog) {
-        if (lastMileLog == null || lastMileLog.length < 1) {
+    /**
+     * Streams the contents of |lastMileLog| to |pw|, through a fixed size buffer.
+     */
+    private static void dumpInternal(PrintWriter pw, String description, File lastMileLog) {
+        char[] buffer = new char[DUMP_BUFFER_CHARS];
+        boolean headerPrinted = false;
+        if (lastMileLog != null) {
+            try (Reader reader = new InputStreamReader(new FileInputStream(lastMileLog))) {
+                int count;
+                while ((count = reader.read(buffer)) > 0) {
+                    if (!headerPrinted) {
+                        pw.format("-------------------------- %s ---------------------------\n",
+                                description);
+                        headerPrinted = true;
+                    }
+                    pw.write(buffer, 0, count);
+                }
+            } catch (IOException e) {
+                // Dumped as missing below, unless it failed part way.
+            }
+        }
+        if (!headerPrinted) {
             pw.format("No last mile log for \"%s\"\n", description);
             return;
         }
-
-        pw.format("-------------------------- %s ---------------------------\n", description);
-        pw.print(new String(lastMileLog));
         pw.println("--------------------------------------------------------------------");
     }
 }
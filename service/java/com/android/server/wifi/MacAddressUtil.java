@@ -22,6 +22,10 @@ import android.security.keystore.KeyGenParameterSpec;
 import android.security.keystore.KeyProperties;
 import android.util.Log;
 
+import com.android.internal.annotations.GuardedBy;
+import com.android.server.wifi.util.NativeUtil;
+
+import java.io.PrintWriter;
 import java.nio.ByteBuffer;
 import java.nio.charset.StandardCharsets;
 import java.security.InvalidAlgorithmParameterException;
@@ -34,6 +38,9 @@ import java.security.NoSuchProviderException;
 import java.security.ProviderException;
 import java.security.UnrecoverableKeyException;
 import java.util.Arrays;
+import java.util.Collection;
+import java.util.HashMap;
+import java.util.Map;
 
 import javax.crypto.KeyGenerator;
 import javax.crypto.Mac;
@@ -49,6 +56,24 @@ public class MacAddressUtil {
     private static final long MAC_ADDRESS_VALID_LONG_MASK = (1L << 48) - 1;
     private static final long MAC_ADDRESS_LOCALLY_ASSIGNED_MASK = 1L << 41;
     private static final long MAC_ADDRESS_MULTICAST_MASK = 1L << 40;
+    // Input hashed with the client MAC randomization secret to fingerprint it. The fingerprint is
+    // persisted with the derivation cache to detect a rotated secret.
+    private static final String SECRET_FINGERPRINT_INPUT = "MacRandSecretFingerprint";
+
+    private final Object mLock = new Object();
+    // Cache of persistent MAC addresses derived with the client MAC randomization secret, keyed
+    // by config key.
+    @GuardedBy("mLock")
+    private final Map<String, MacAddress> mPersistentMacCache = new HashMap<>();
+    // Fingerprint of the secret the cached MAC addresses were derived with, null if unknown.
+    @GuardedBy("mLock")
+    private String mSecretFingerprint;
+    @GuardedBy("mLock")
+    private int mCacheHits = 0;
+    @GuardedBy("mLock")
+    private int mCacheMisses = 0;
+    @GuardedBy("mLock")
+    private int mHashFunctionsObtained = 0;
 
     /**
      * Computes the persistent randomized MAC using the given key and hash function.
@@ -85,6 +110,205 @@ public class MacAddressUtil {
         return macAddress;
     }
 
+    /**
+     * Returns the persistent randomized MAC of the given config key for client mode, from the
+     * derivation cache if possible. Otherwise computes it with the client MAC randomization
+     * secret of the given uid and caches the result.
+     * @param key the config key to get the MAC address for
+     * @param uid the UID of the KeyStore to get the secret of the hash function from.
+     * @return The persistent randomized MAC address or null if it could not be computed.
+     */
+    public MacAddress getOrCalculatePersistentMac(String key, int uid) {
+        if (key == null) {
+            return null;
+        }
+        synchronized (mLock) {
+            MacAddress cachedMac = mPersistentMacCache.get(key);
+            if (cachedMac != null) {
+                mCacheHits++;
+                return cachedMac;
+            }
+        }
+        Mac hashFunction = obtainFingerprintedMacRandHashFunction(uid);
+        MacAddress macAddress = calculatePersistentMac(key, hashFunction);
+        synchronized (mLock) {
+            mCacheMisses++;
+            if (macAddress != null) {
+                mPersistentMacCache.put(key, macAddress);
+            }
+        }
+        return macAddress;
+    }
+
+    /**
+     * Batch version of {@link #getOrCalculatePersistentMac(String, int)}. The client MAC
+     * randomization secret is retrieved from KeyStore at most once for all the keys missing from
+     * the derivation cache.
+     * @param keys the config keys to get the MAC addresses for
+     * @param uid the UID of the KeyStore to get the secret of the hash function from.
+     * @return Map from config key to persistent randomized MAC address. Keys for which the MAC
+     * address could not be computed are omitted.
+     */
+    public Map<String, MacAddress> getOrCalculatePersistentMacs(Collection<String> keys,
+            int uid) {
+        Map<String, MacAddress> result = new HashMap<>();
+        Mac hashFunction = null;
+        for (String key : keys) {
+            if (key == null || result.containsKey(key)) {
+                continue;
+            }
+            synchronized (mLock) {
+                MacAddress cachedMac = mPersistentMacCache.get(key);
+                if (cachedMac != null) {
+                    mCacheHits++;
+                    result.put(key, cachedMac);
+                    continue;
+                }
+            }
+            if (hashFunction == null) {
+                hashFunction = obtainFingerprintedMacRandHashFunction(uid);
+                if (hashFunction == null) {
+                    break;
+                }
+            }
+            MacAddress macAddress = calculatePersistentMac(key, hashFunction);
+            synchronized (mLock) {
+                mCacheMisses++;
+                if (macAddress != null) {
+                    mPersistentMacCache.put(key, macAddress);
+                    result.put(key, macAddress);
+                }
+            }
+        }
+        return result;
+    }
+
+    /**
+     * Removes the persistent MAC address of the given config key from the derivation cache.
+     */
+    public void removePersistentMacFromCache(String key) {
+        synchronized (mLock) {
+            mPersistentMacCache.remove(key);
+        }
+    }
+
+    /**
+     * Loads the persisted derivation cache. The cache is only kept if it was derived with the
+     * current client MAC randomization secret of the given uid.
+     * @param cache Map from config key to MAC address string, as returned by
+     * {@link #getPersistentMacCacheForStore()}.
+     * @param secretFingerprint fingerprint of the secret the cache was derived with.
+     * @param uid the UID of the KeyStore to get the secret of the hash function from.
+     */
+    public void loadPersistentMacCache(Map<String, String> cache, String secretFingerprint,
+            int uid) {
+        invalidatePersistentMacCache();
+        if (cache.isEmpty() || secretFingerprint == null) {
+            return;
+        }
+        // Fingerprints the current secret.
+        obtainFingerprintedMacRandHashFunction(uid);
+        synchronized (mLock) {
+            if (!secretFingerprint.equals(mSecretFingerprint)) {
+                Log.w(TAG, "MAC randomization secret changed, dropping persisted MAC cache");
+                return;
+            }
+            for (Map.Entry<String, String> entry : cache.entrySet()) {
+                try {
+                    mPersistentMacCache.put(entry.getKey(), MacAddress.fromString(
+                            entry.getValue()));
+                } catch (IllegalArgumentException e) {
+                    Log.e(TAG, "Ignoring invalid cached MAC address for " + entry.getKey());
+                }
+            }
+        }
+    }
+
+    /**
+     * Returns a copy of the derivation cache to persist, mapping config key to MAC address
+     * string.
+     */
+    public Map<String, String> getPersistentMacCacheForStore() {
+        synchronized (mLock) {
+            Map<String, String> cache = new HashMap<>();
+            for (Map.Entry<String, MacAddress> entry : mPersistentMacCache.entrySet()) {
+                cache.put(entry.getKey(), entry.getValue().toString());
+            }
+            return cache;
+        }
+    }
+
+    /**
+     * Returns the fingerprint of the secret the derivation cache was computed with, to persist
+     * along with the cache.
+     */
+    public String getSecretFingerprintForStore() {
+        synchronized (mLock) {
+            return mSecretFingerprint;
+        }
+    }
+
+    /**
+     * Dump the derivation cache statistics.
+     */
+    public void dump(PrintWriter pw) {
+        synchronized (mLock) {
+            pw.println("MacAddressUtil - persistent MAC cache size=" + mPersistentMacCache.size()
+                    + " hits=" + mCacheHits
+                    + " misses=" + mCacheMisses
+                    + " KeyStore secret lookups=" + mHashFunctionsObtained);
+        }
+    }
+
+    /**
+     * Same as {@link #obtainMacRandHashFunction(int)}, but also records the fingerprint of the
+     * secret if it is not known yet.
+     */
+    private Mac obtainFingerprintedMacRandHashFunction(int uid) {
+        Mac hashFunction = obtainMacRandHashFunction(uid);
+        if (hashFunction == null) {
+            return null;
+        }
+        synchronized (mLock) {
+            mHashFunctionsObtained++;
+            if (mSecretFingerprint != null) {
+                return hashFunction;
+            }
+        }
+        String fingerprint = computeSecretFingerprint(hashFunction);
+        synchronized (mLock) {
+            mSecretFingerprint = fingerprint;
+        }
+        return hashFunction;
+    }
+
+    /**
+     * Drops all the cached MAC addresses along with the fingerprint of the secret they were
+     * derived with.
+     */
+    private void invalidatePersistentMacCache() {
+        synchronized (mLock) {
+            mPersistentMacCache.clear();
+            mSecretFingerprint = null;
+        }
+    }
+
+    /**
+     * Computes the fingerprint of the secret backing the given hash function.
+     */
+    private String computeSecretFingerprint(Mac hashFunction) {
+        if (hashFunction == null) {
+            return null;
+        }
+        try {
+            return NativeUtil.hexStringFromByteArray(hashFunction.doFinal(
+                    SECRET_FINGERPRINT_INPUT.getBytes(StandardCharsets.UTF_8)));
+        } catch (ProviderException | IllegalStateException e) {
+            Log.e(TAG, "Failure in computeSecretFingerprint", e);
+            return null;
+        }
+    }
+
     private Mac obtainMacRandHashFunctionInternal(int uid, String alias) {
         try {
             KeyStore keyStore = AndroidKeyStoreProvider.getKeyStoreForUid(uid);
@@ -92,6 +316,10 @@ public class MacAddressUtil {
             Key key = keyStore.getKey(alias, null);
             if (key == null) {
                 key = generateAndPersistNewMacRandomizationSecret(uid, alias);
+                if (MAC_RANDOMIZATION_ALIAS.equals(alias)) {
+                    // MAC addresses derived with the previous secret are no longer valid.
+                    invalidatePersistentMacCache();
+                }
             }
             if (key == null) {
                 Log.e(TAG, "Failed to generate secret for " + alias);
@@ -23,15 +23,32 @@ import android.net.IpMemoryStore;
 import android.net.ipmemorystore.Blob;
 import android.net.ipmemorystore.NetworkAttributes;
 import android.net.ipmemorystore.Status;
+import android.os.Handler;
 import android.util.Log;
 
+import com.android.internal.annotations.GuardedBy;
+import com.android.internal.annotations.VisibleForTesting;
 import com.android.internal.util.Preconditions;
 import com.android.server.wifi.WifiScoreCard.BlobListener;
 
+import java.io.PrintWriter;
+import java.util.ArrayList;
+import java.util.HashMap;
+import java.util.Iterator;
+import java.util.LinkedHashMap;
+import java.util.List;
+import java.util.Map;
 import java.util.Objects;
 
 /**
  * Connects WifiScoreCard to IpMemoryStore.
+ *
+ * To limit the number of IpMemoryStore calls during bursts of activity (for ex: after roaming
+ * storms), writes are held in a write-behind buffer keyed by (l2Key, name) and flushed together
+ * after {@link #WRITE_FLUSH_INTERVAL_MS}, so that repeated writes of the same blob within the
+ * interval collapse into one. Reads of the same blob are coalesced while in flight, and at most
+ * {@link #MAX_READS_IN_FLIGHT} reads are outstanding at any time. A read which gets no reply
+ * within {@link #READ_TIMEOUT_MS} is dropped, so that a lost reply does not hold its slot.
  */
 final class MemoryStoreImpl implements WifiScoreCard.MemoryStore {
     private static final String TAG = "WifiMemoryStoreImpl";
@@ -40,40 +57,203 @@ final class MemoryStoreImpl implements WifiScoreCard.MemoryStore {
     // The id of the client that stored this data
     public static final String WIFI_FRAMEWORK_IP_MEMORY_STORE_CLIENT_ID = "com.android.server.wifi";
 
+    @VisibleForTesting
+    static final long WRITE_FLUSH_INTERVAL_MS = 5_000;
+    @VisibleForTesting
+    static final int MAX_READS_IN_FLIGHT = 8;
+    @VisibleForTesting
+    static final long READ_TIMEOUT_MS = 10_000;
+
     @NonNull private final Context mContext;
     @NonNull private final WifiScoreCard mWifiScoreCard;
     @NonNull private final WifiHealthMonitor mWifiHealthMonitor;
     @NonNull private final WifiInjector mWifiInjector;
-    @Nullable private IpMemoryStore mIpMemoryStore;
+    @NonNull private final Handler mHandler;
+    @Nullable private volatile IpMemoryStore mIpMemoryStore;
+
+    // Write-behind buffers, only accessed on the handler thread.
+    private final Map<BlobKey, byte[]> mPendingWrites = new LinkedHashMap<>();
+    private final Map<String, String> mPendingClusters = new LinkedHashMap<>();
+    private boolean mFlushScheduled = false;
+    private final Runnable mFlushPendingWritesRunnable = this::flushPendingWrites;
+
+    // Reads are completed on binder threads.
+    private final Object mReadLock = new Object();
+    @GuardedBy("mReadLock")
+    private final Map<BlobKey, PendingRead> mReadsInFlight = new HashMap<>();
+    @GuardedBy("mReadLock")
+    private final Map<BlobKey, PendingRead> mQueuedReads = new LinkedHashMap<>();
+
+    // Counters of requested vs issued IpMemoryStore calls.
+    private int mBlobWritesRequested = 0;
+    private int mBlobWritesIssued = 0;
+    private int mClusterWritesRequested = 0;
+    private int mClusterWritesIssued = 0;
+    private int mReadsServedFromWriteBuffer = 0;
+    @GuardedBy("mReadLock")
+    private int mReadsRequested = 0;
+    @GuardedBy("mReadLock")
+    private int mReadsIssued = 0;
+    @GuardedBy("mReadLock")
+    private int mReadsTimedOut = 0;
 
     MemoryStoreImpl(Context context, WifiInjector wifiInjector, WifiScoreCard wifiScoreCard,
-            WifiHealthMonitor wifiHealthMonitor) {
+            WifiHealthMonitor wifiHealthMonitor, Handler handler) {
         mContext = Preconditions.checkNotNull(context);
         mWifiScoreCard = Preconditions.checkNotNull(wifiScoreCard);
         mWifiHealthMonitor = Preconditions.checkNotNull(wifiHealthMonitor);
         mWifiInjector = Preconditions.checkNotNull(wifiInjector);
+        mHandler = Preconditions.checkNotNull(handler);
         mIpMemoryStore = null;
     }
 
-    private boolean mBroken = false;
+    private volatile boolean mBroken = false;
     private void handleException(Exception e) {
         Log.wtf(TAG, "Exception using IpMemoryStore - disabling WifiScoreReport persistence", e);
         mBroken = true;
     }
 
+    /**
+     * Identifies a blob in IpMemoryStore.
+     */
+    private static final class BlobKey {
+        public final String l2Key;
+        public final String name;
+
+        BlobKey(String l2Key, String name) {
+            this.l2Key = l2Key;
+            this.name = name;
+        }
+
+        @Override
+        public boolean equals(Object o) {
+            if (this == o) return true;
+            if (!(o instanceof BlobKey)) return false;
+            BlobKey other = (BlobKey) o;
+            return Objects.equals(l2Key, other.l2Key) && Objects.equals(name, other.name);
+        }
+
+        @Override
+        public int hashCode() {
+            return Objects.hash(l2Key, name);
+        }
+    }
+
+    /**
+     * A read request, and the listeners waiting for it. Run when the read times out.
+     */
+    private final class PendingRead implements Runnable {
+        public final BlobKey blobKey;
+        // Only added to under mReadLock, while the read is queued or in flight.
+        public final List<BlobListener> listeners = new ArrayList<>(1);
+
+        PendingRead(BlobKey blobKey) {
+            this.blobKey = blobKey;
+        }
+
+        @Override
+        public void run() {
+            if (!completeRead(this)) return;
+            synchronized (mReadLock) {
+                mReadsTimedOut++;
+            }
+            Log.w(TAG, "Timed out reading blob " + blobKey.name);
+        }
+    }
 
     @Override
     public void read(final String key, final String name, final BlobListener blobListener) {
         if (mBroken) return;
-        try {
-            mIpMemoryStore.retrieveBlob(
-                    key,
-                    WIFI_FRAMEWORK_IP_MEMORY_STORE_CLIENT_ID,
-                    name,
-                    new CatchAFallingBlob(key, blobListener));
-        } catch (RuntimeException e) {
-            handleException(e);
+        final BlobKey blobKey = new BlobKey(key, name);
+        // A write which has not been flushed yet is newer than what the store would return.
+        final byte[] pendingWrite = mPendingWrites.get(blobKey);
+        if (pendingWrite != null) {
+            mReadsServedFromWriteBuffer++;
+            mHandler.post(() -> blobListener.onBlobRetrieved(pendingWrite));
+            return;
+        }
+        PendingRead read;
+        synchronized (mReadLock) {
+            mReadsRequested++;
+            read = mReadsInFlight.get(blobKey);
+            if (read == null) {
+                read = mQueuedReads.get(blobKey);
+            }
+            if (read != null) {
+                // Same blob already requested, piggyback on that request.
+                read.listeners.add(blobListener);
+                return;
+            }
+            read = new PendingRead(blobKey);
+            read.listeners.add(blobListener);
+            if (mReadsInFlight.size() >= MAX_READS_IN_FLIGHT) {
+                mQueuedReads.put(blobKey, read);
+                return;
+            }
+            mReadsInFlight.put(blobKey, read);
+            mReadsIssued++;
+        }
+        issueRead(read);
+    }
+
+    /**
+     * Issues a read which was moved in flight. A read which cannot be issued is dropped, and
+     * the next queued read is issued in its slot instead.
+     */
+    private void issueRead(PendingRead read) {
+        while (read != null) {
+            final IpMemoryStore ipMemoryStore = mIpMemoryStore;
+            if (!mBroken && ipMemoryStore != null) {
+                try {
+                    ipMemoryStore.retrieveBlob(
+                            read.blobKey.l2Key,
+                            WIFI_FRAMEWORK_IP_MEMORY_STORE_CLIENT_ID,
+                            read.blobKey.name,
+                            new CatchAFallingBlob(read));
+                    // If the reply came first, the timeout finds the read completed and is a NOP.
+                    mHandler.postDelayed(read, READ_TIMEOUT_MS);
+                    return;
+                } catch (RuntimeException e) {
+                    handleException(e);
+                }
+            }
+            synchronized (mReadLock) {
+                mReadsInFlight.remove(read.blobKey, read);
+                read = moveNextQueuedReadInFlight();
+            }
+        }
+    }
+
+    /**
+     * Moves the oldest queued read, if any, in flight.
+     *
+     * @return the read moved in flight, which the caller must issue, or null.
+     */
+    @GuardedBy("mReadLock")
+    private PendingRead moveNextQueuedReadInFlight() {
+        Iterator<PendingRead> it = mQueuedReads.values().iterator();
+        if (!it.hasNext()) return null;
+        PendingRead next = it.next();
+        it.remove();
+        mReadsInFlight.put(next.blobKey, next);
+        mReadsIssued++;
+        return next;
+    }
+
+    /**
+     * Marks the provided read as done and issues the next queued read, if any.
+     *
+     * @return false if the read was already done, because it got a reply or timed out.
+     */
+    private boolean completeRead(PendingRead read) {
+        mHandler.removeCallbacks(read);
+        PendingRead next;
+        synchronized (mReadLock) {
+            if (!mReadsInFlight.remove(read.blobKey, read)) return false;
+            next = moveNextQueuedReadInFlight();
         }
+        issueRead(next);
+        return true;
     }
 
     /**
@@ -83,28 +263,28 @@ final class MemoryStoreImpl implements WifiScoreCard.MemoryStore {
      * provided blobListener must be prepared to deal with this.
      *
      */
-    private static class CatchAFallingBlob
+    private class CatchAFallingBlob
             implements android.net.ipmemorystore.OnBlobRetrievedListener {
-        private final String mL2Key;
-        private final WifiScoreCard.BlobListener mBlobListener;
+        private final PendingRead mRead;
 
-        CatchAFallingBlob(String l2Key, WifiScoreCard.BlobListener blobListener) {
-            mL2Key = l2Key;
-            mBlobListener = blobListener;
+        CatchAFallingBlob(PendingRead read) {
+            mRead = read;
         }
 
         @Override
         public void onBlobRetrieved(Status status, String l2Key, String name, Blob data) {
-            if (!Objects.equals(mL2Key, l2Key)) {
+            if (!Objects.equals(mRead.blobKey.l2Key, l2Key)) {
                 throw new IllegalArgumentException("l2Key does not match request");
             }
+            if (!completeRead(mRead)) return;
+            List<BlobListener> listeners = mRead.listeners;
             if (status.isSuccess()) {
                 if (data == null) {
                     if (DBG) Log.i(TAG, "Blob is null");
-                    mBlobListener.onBlobRetrieved(null);
-                    return;
                 }
-                mBlobListener.onBlobRetrieved(data.data);
+                for (BlobListener blobListener : listeners) {
+                    blobListener.onBlobRetrieved(data == null ? null : data.data);
+                }
             } else {
                 if (DBG) Log.e(TAG, "android.net.ipmemorystore.Status " + status);
             }
@@ -114,37 +294,24 @@ final class MemoryStoreImpl implements WifiScoreCard.MemoryStore {
     @Override
     public void write(String key, String name, byte[] value) {
         if (mBroken) return;
-        final Blob blob = new Blob();
-        blob.data = value;
-        try {
-            mIpMemoryStore.storeBlob(
-                    key,
-                    WIFI_FRAMEWORK_IP_MEMORY_STORE_CLIENT_ID,
-                    name,
-                    blob,
-                    null /* no listener for now, just fire and forget */);
-        } catch (RuntimeException e) {
-            handleException(e);
-        }
+        mBlobWritesRequested++;
+        mPendingWrites.put(new BlobKey(key, name), value);
+        scheduleFlush();
     }
 
     @Override
     public void setCluster(String key, String cluster) {
         if (mBroken) return;
-        try {
-            NetworkAttributes attributes = new NetworkAttributes.Builder()
-                    .setCluster(cluster)
-                    .build();
-            mIpMemoryStore.storeNetworkAttributes(key, attributes, status -> {
-                Log.d(TAG, "Set cluster " + cluster + " for " + key + ": " + status);
-            });
-        } catch (RuntimeException e) {
-            handleException(e);
-        }
+        mClusterWritesRequested++;
+        mPendingClusters.put(key, cluster);
+        scheduleFlush();
     }
 
     @Override
     public void removeCluster(String cluster) {
+        if (mBroken) return;
+        // Flush first, so that buffered writes do not resurrect the removed entries.
+        flushPendingWrites();
         if (mBroken) return;
         try {
             final boolean needWipe = true;
@@ -157,6 +324,105 @@ final class MemoryStoreImpl implements WifiScoreCard.MemoryStore {
         }
     }
 
+    private void scheduleFlush() {
+        if (mFlushScheduled) return;
+        mFlushScheduled = true;
+        mHandler.postDelayed(mFlushPendingWritesRunnable, WRITE_FLUSH_INTERVAL_MS);
+    }
+
+    /**
+     * Issues all the buffered writes to IpMemoryStore.
+     */
+    private void flushPendingWrites() {
+        if (mFlushScheduled) {
+            mHandler.removeCallbacks(mFlushPendingWritesRunnable);
+            mFlushScheduled = false;
+        }
+        final IpMemoryStore ipMemoryStore = mIpMemoryStore;
+        if (mBroken || ipMemoryStore == null) {
+            mPendingClusters.clear();
+            mPendingWrites.clear();
+            return;
+        }
+        try {
+            for (Map.Entry<String, String> entry : mPendingClusters.entrySet()) {
+                final String key = entry.getKey();
+                final String cluster = entry.getValue();
+                NetworkAttributes attributes = new NetworkAttributes.Builder()
+                        .setCluster(cluster)
+                        .build();
+                mClusterWritesIssued++;
+                ipMemoryStore.storeNetworkAttributes(key, attributes, status -> {
+                    Log.d(TAG, "Set cluster " + cluster + " for " + key + ": " + status);
+                });
+            }
+            for (Map.Entry<BlobKey, byte[]> entry : mPendingWrites.entrySet()) {
+                final Blob blob = new Blob();
+                blob.data = entry.getValue();
+                mBlobWritesIssued++;
+                ipMemoryStore.storeBlob(
+                        entry.getKey().l2Key,
+                        WIFI_FRAMEWORK_IP_MEMORY_STORE_CLIENT_ID,
+                        entry.getKey().name,
+                        blob,
+                        null /* no listener for now, just fire and forget */);
+            }
+        } catch (RuntimeException e) {
+            handleException(e);
+        } finally {
+            mPendingClusters.clear();
+            mPendingWrites.clear();
+        }
+    }
+
+    /**
+     * Returns the number of IpMemoryStore calls which were avoided by collapsing and coalescing
+     * requests.
+     */
+    public int getIpcCallsSaved() {
+        synchronized (mReadLock) {
+            return getBufferedCallsSaved() + mReadsServedFromWriteBuffer
+                    + (mReadsRequested - mReadsIssued - getQueuedReadsCount());
+        }
+    }
+
+    private int getBufferedCallsSaved() {
+        // Requests still in the buffer are neither issued nor saved yet.
+        return (mBlobWritesRequested - mBlobWritesIssued - mPendingWrites.size())
+                + (mClusterWritesRequested - mClusterWritesIssued - mPendingClusters.size());
+    }
+
+    @GuardedBy("mReadLock")
+    private int getQueuedReadsCount() {
+        int count = 0;
+        for (PendingRead read : mQueuedReads.values()) {
+            count += read.listeners.size();
+        }
+        return count;
+    }
+
+    /**
+     * Dump the request counters.
+     */
+    public void dump(PrintWriter pw) {
+        pw.println("Dump of MemoryStoreImpl");
+        pw.println("Blob writes requested: " + mBlobWritesRequested
+                + " issued: " + mBlobWritesIssued
+                + " pending: " + mPendingWrites.size());
+        pw.println("Cluster writes requested: " + mClusterWritesRequested
+                + " issued: " + mClusterWritesIssued
+                + " pending: " + mPendingClusters.size());
+        synchronized (mReadLock) {
+            pw.println("Reads requested: " + mReadsRequested
+                    + " issued: " + mReadsIssued
+                    + " in flight: " + mReadsInFlight.size()
+                    + " queued: " + mQueuedReads.size()
+                    + " timed out: " + mReadsTimedOut
+                    + " served from write buffer: " + mReadsServedFromWriteBuffer);
+        }
+        pw.println("IpMemoryStore calls saved: " + getIpcCallsSaved());
+    }
+
     /**
      * Starts using IpMemoryStore.
      */
@@ -180,6 +446,7 @@ final class MemoryStoreImpl implements WifiScoreCard.MemoryStore {
         if (mIpMemoryStore == null) return;
         mWifiScoreCard.doWrites();
         mWifiHealthMonitor.doWrites();
+        flushPendingWrites();
         // TODO - Should wait for writes to complete (or time out)
         Log.i(TAG, "Disconnecting from IpMemoryStore service");
         mIpMemoryStore = null;
@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.server.wifi;
+
+import android.os.Message;
+import android.util.ArrayMap;
+import android.util.LocalLog;
+import android.util.SparseArray;
+
+import com.android.internal.annotations.GuardedBy;
+import com.android.internal.annotations.VisibleForTesting;
+import com.android.internal.util.IState;
+import com.android.server.wifi.util.IntHistogram;
+
+import java.io.FileDescriptor;
+import java.io.PrintWriter;
+import java.util.function.IntFunction;
+
+import javax.annotation.concurrent.ThreadSafe;
+
+/**
+ * Measures, for each message handled by a StateMachine, how long it waited in the queue past the
+ * time it was due, and how long it took to handle. Latencies are aggregated per message what
+ * code and per state, and messages slower than a threshold are logged.
+ *
+ * Intended to be called from StateMachine#onPreHandleMessage and #onPostHandleMessage, for every
+ * message, so it is cheap enough to leave enabled: the counters and histograms of a what code or
+ * state are allocated when its first message is handled, and are only updated afterwards.
+ */
+@ThreadSafe
+public class MessageLatencyTracker {
+    // Log-scale (powers of 2) bucket boundaries of the latency histograms, in milliseconds.
+    @VisibleForTesting
+    static final int[] LATENCY_BUCKET_BOUNDARIES_MS =
+            {1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192};
+    @VisibleForTesting
+    static final int SLOW_MESSAGE_THRESHOLD_MS = 100;
+    private static final int MAX_SLOW_MESSAGES_LOGGED = 100;
+
+    /**
+     * Latency counters of a set of messages.
+     */
+    @VisibleForTesting
+    static class Stats {
+        public int count;
+        public long totalQueueDelayMs;
+        public long totalHandlingMs;
+        public int maxQueueDelayMs;
+        public int maxHandlingMs;
+        public final IntHistogram queueDelayHistogram =
+                new IntHistogram(LATENCY_BUCKET_BOUNDARIES_MS);
+        public final IntHistogram handlingHistogram =
+                new IntHistogram(LATENCY_BUCKET_BOUNDARIES_MS);
+
+        void add(int queueDelayMs, int handlingMs) {
+            count++;
+            totalQueueDelayMs += queueDelayMs;
+            totalHandlingMs += handlingMs;
+            maxQueueDelayMs = Math.max(maxQueueDelayMs, queueDelayMs);
+            maxHandlingMs = Math.max(maxHandlingMs, handlingMs);
+            queueDelayHistogram.increment(queueDelayMs);
+            handlingHistogram.increment(handlingMs);
+        }
+
+        @Override
+        public String toString() {
+            return "count=" + count
+                    + " queue(avg=" + totalQueueDelayMs / Math.max(count, 1)
+                    + " p95=" + (int) queueDelayHistogram.quantileFunction(0.95, 0,
+                            maxQueueDelayMs)
+                    + " max=" + maxQueueDelayMs
+                    + ") handling(avg=" + totalHandlingMs / Math.max(count, 1)
+                    + " p95=" + (int) handlingHistogram.quantileFunction(0.95, 0, maxHandlingMs)
+                    + " max=" + maxHandlingMs + ")";
+        }
+    }
+
+    private final Clock mClock;
+    private final IntFunction<String> mWhatToString;
+    private final Object mLock = new Object();
+    @GuardedBy("mLock")
+    private final SparseArray<Stats> mStatsByWhat = new SparseArray<>();
+    @GuardedBy("mLock")
+    private final ArrayMap<IState, Stats> mStatsByState = new ArrayMap<>();
+    @GuardedBy("mLock")
+    private final Stats mTotalStats = new Stats();
+    private final LocalLog mSlowMessages = new LocalLog(MAX_SLOW_MESSAGES_LOGGED);
+
+    // Message being handled. Only accessed on the StateMachine thread.
+    private IState mState;
+    private int mQueueDelayMs;
+    private long mDispatchTimeMs;
+
+    /**
+     * @param whatToString names message what codes, e.g. StateMachine#getWhatToString
+     */
+    public MessageLatencyTracker(Clock clock, IntFunction<String> whatToString) {
+        mClock = clock;
+        mWhatToString = whatToString;
+    }
+
+    /**
+     * Notes that |msg| is about to be handled, with |state| as the current state.
+     */
+    public void onPreHandleMessage(Message msg, IState state) {
+        long nowMs = mClock.getUptimeSinceBootMillis();
+        // when is the uptime at which the message was due, or 0 for messages sent to the front
+        // of the queue.
+        long when = msg.getWhen();
+        mQueueDelayMs = when > 0 ? (int) Math.max(0, nowMs - when) : 0;
+        mDispatchTimeMs = nowMs;
+        mState = state;
+    }
+
+    /**
+     * Notes that |msg|, passed to the latest call to {@link #onPreHandleMessage(Message, IState)},
+     * was handled.
+     */
+    public void onPostHandleMessage(Message msg) {
+        int handlingMs = (int) (mClock.getUptimeSinceBootMillis() - mDispatchTimeMs);
+        synchronized (mLock) {
+            Stats whatStats = mStatsByWhat.get(msg.what);
+            if (whatStats == null) {
+                whatStats = new Stats();
+                mStatsByWhat.put(msg.what, whatStats);
+            }
+            whatStats.add(mQueueDelayMs, handlingMs);
+            Stats stateStats = mStatsByState.get(mState);
+            if (stateStats == null) {
+                stateStats = new Stats();
+                mStatsByState.put(mState, stateStats);
+            }
+            stateStats.add(mQueueDelayMs, handlingMs);
+            mTotalStats.add(mQueueDelayMs, handlingMs);
+        }
+        if (handlingMs >= SLOW_MESSAGE_THRESHOLD_MS
+                || mQueueDelayMs >= SLOW_MESSAGE_THRESHOLD_MS) {
+            mSlowMessages.log(getWhatName(msg.what) + " in " + getName(mState)
+                    + " queued=" + mQueueDelayMs + "ms handled=" + handlingMs + "ms");
+        }
+    }
+
+    private String getWhatName(int what) {
+        String name = mWhatToString.apply(what);
+        return name != null ? name : "what=" + what;
+    }
+
+    private static String getName(IState state) {
+        return state != null ? state.getName() : "<no state>";
+    }
+
+    @VisibleForTesting
+    Stats getStatsForWhat(int what) {
+        synchronized (mLock) {
+            return mStatsByWhat.get(what);
+        }
+    }
+
+    @VisibleForTesting
+    Stats getStatsForState(IState state) {
+        synchronized (mLock) {
+            return mStatsByState.get(state);
+        }
+    }
+
+    /**
+     * Dump the latencies per what code and per state, and the slow messages.
+     */
+    public void dump(FileDescriptor fd, PrintWriter pw, String[] args) {
+        pw.println("Message latencies (ms):");
+        synchronized (mLock) {
+            pw.println("  all: " + mTotalStats);
+            for (int i = 0; i < mStatsByWhat.size(); i++) {
+                pw.println("  " + getWhatName(mStatsByWhat.keyAt(i)) + ": "
+                        + mStatsByWhat.valueAt(i));
+            }
+            for (int i = 0; i < mStatsByState.size(); i++) {
+                pw.println("  in " + getName(mStatsByState.keyAt(i)) + ": "
+                        + mStatsByState.valueAt(i));
+            }
+        }
+        pw.println("Messages queued or handled for " + SLOW_MESSAGE_THRESHOLD_MS
+                + "ms or more:");
+        mSlowMessages.dump(fd, pw, args);
+    }
+}
@@ -32,15 +32,20 @@ import java.util.Map;
 
 /**
  * This class performs serialization and parsing of XML data block that contain the mapping
- * from configKey to randomized MAC address
+ * from configKey to randomized MAC address and the cache of persistent MAC addresses derived
+ * by {@link MacAddressUtil}
  * (XML block data inside <MacAddressMappingList> tag).
  */
 public class RandomizedMacStoreData implements WifiConfigStore.StoreData {
     private static final String TAG = "RandomizedMacStoreData";
     private static final String XML_TAG_SECTION_HEADER_MAC_ADDRESS_MAP = "MacAddressMap";
     private static final String XML_TAG_MAC_MAP = "MacMapEntry";
+    private static final String XML_TAG_PERSISTENT_MAC_CACHE = "PersistentMacCache";
+    private static final String XML_TAG_SECRET_FINGERPRINT = "SecretFingerprint";
 
     private Map<String, String> mMacMapping;
+    private Map<String, String> mPersistentMacCache;
+    private String mSecretFingerprint;
 
     RandomizedMacStoreData() {}
 
@@ -51,6 +56,10 @@ public class RandomizedMacStoreData implements WifiConfigStore.StoreData {
         if (mMacMapping != null) {
             XmlUtil.writeNextValue(out, XML_TAG_MAC_MAP, mMacMapping);
         }
+        if (mPersistentMacCache != null && mSecretFingerprint != null) {
+            XmlUtil.writeNextValue(out, XML_TAG_PERSISTENT_MAC_CACHE, mPersistentMacCache);
+            XmlUtil.writeNextValue(out, XML_TAG_SECRET_FINGERPRINT, mSecretFingerprint);
+        }
     }
 
     @Override
@@ -72,6 +81,12 @@ public class RandomizedMacStoreData implements WifiConfigStore.StoreData {
                 case XML_TAG_MAC_MAP:
                     mMacMapping = (Map<String, String>) value;
                     break;
+                case XML_TAG_PERSISTENT_MAC_CACHE:
+                    mPersistentMacCache = (Map<String, String>) value;
+                    break;
+                case XML_TAG_SECRET_FINGERPRINT:
+                    mSecretFingerprint = (String) value;
+                    break;
                 default:
                     Log.w(TAG, "Ignoring unknown tag under "
                             + XML_TAG_SECTION_HEADER_MAC_ADDRESS_MAP
@@ -84,6 +99,8 @@ public class RandomizedMacStoreData implements WifiConfigStore.StoreData {
     @Override
     public void resetData() {
         mMacMapping = null;
+        mPersistentMacCache = null;
+        mSecretFingerprint = null;
     }
 
     @Override
@@ -122,5 +139,34 @@ public class RandomizedMacStoreData implements WifiConfigStore.StoreData {
     public void setMacMapping(Map<String, String> macMapping) {
         mMacMapping = macMapping;
     }
-}
 
+    /**
+     * An empty Map will be returned for null persistent MAC address cache.
+     *
+     * @return Map from configKey to the persistent MAC address derived for it.
+     */
+    public Map<String, String> getPersistentMacCache() {
+        if (mPersistentMacCache == null) {
+            return new HashMap<String, String>();
+        }
+        return mPersistentMacCache;
+    }
+
+    /**
+     * @return Fingerprint of the secret the persistent MAC address cache was derived with.
+     */
+    public @Nullable String getSecretFingerprint() {
+        return mSecretFingerprint;
+    }
+
+    /**
+     * Sets the persistent MAC address cache to be stored to file.
+     * @param persistentMacCache Map from configKey to the persistent MAC address derived for it.
+     * @param secretFingerprint Fingerprint of the secret the cache was derived with.
+     */
+    public void setPersistentMacCache(Map<String, String> persistentMacCache,
+            @Nullable String secretFingerprint) {
+        mPersistentMacCache = persistentMacCache;
+        mSecretFingerprint = secretFingerprint;
+    }
+}
@@ -229,7 +229,7 @@ public class ScanRequestProxy {
             }
             // Register the global scan listener.
             if (mWifiScanner != null) {
-                mWifiScanner.registerScanListener(
+                mWifiInjector.getInProcessScanResultsDispatcher().registerScanListener(
                         new HandlerExecutor(mHandler), new GlobalScanListener());
             }
         }
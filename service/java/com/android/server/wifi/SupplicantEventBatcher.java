@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.server.wifi;
+
+import android.net.wifi.SupplicantState;
+import android.os.Handler;
+import android.os.Message;
+import android.util.ArrayMap;
+
+import com.android.internal.annotations.GuardedBy;
+import com.android.internal.annotations.VisibleForTesting;
+
+import java.io.PrintWriter;
+import java.util.Objects;
+
+/**
+ * Queues the events broadcast by {@link WifiMonitor} to their handlers. For the handlers which
+ * only act on the latest state, and enabled it with {@link #setCollapsingEnabled}, supplicant
+ * events which are superseded while still queued are collapsed, so that roaming and scanning
+ * storms do not flood the wifi thread:
+ * - a transient supplicant state change (SCANNING, AUTHENTICATING, ASSOCIATING, or a handshake
+ *   state) is superseded by a later, further intermediate state change for the same network;
+ * - a target BSSID event is superseded by a later target BSSID event;
+ * - an associated BSSID event is superseded by a later one for the same BSSID.
+ *
+ * A state change is only superseded if it is a step forward from the handshake state before
+ * it, so that handlers still see every step back between handshake states, e.g. from
+ * FOUR_WAY_HANDSHAKE to ASSOCIATING, which supplicant loops are detected with.
+ *
+ * An event is only superseded if it is the last WifiMonitor event queued to the handler, so the
+ * events which are delivered keep their order. Terminal supplicant state changes, such as
+ * COMPLETED or DISCONNECTED, and all other events are never superseded, and are delivered as
+ * before. Nothing is delayed: events are only collapsed while the handler is behind.
+ *
+ * Thread-safe.
+ */
+class SupplicantEventBatcher {
+    /**
+     * What and obj of the last event queued to a handler. Messages are recycled once handled, so
+     * they are not kept themselves.
+     */
+    private static class LastEvent {
+        public int what;
+        public Object obj;
+        // Number of events superseded in a row by the events queued after this one.
+        public int supersededRun;
+        // Ordinal of the handshake state the handler sees before the last event, if the last
+        // event is a state change following a handshake state, or -1.
+        public int previousStateOrdinal = -1;
+        // Ordinal of the last supplicant state queued to the handler if it is a handshake
+        // state, or -1.
+        public int lastStateOrdinal = -1;
+        public boolean collapsingEnabled;
+    }
+
+    private final Object mLock = new Object();
+    @GuardedBy("mLock")
+    private final ArrayMap<Handler, LastEvent> mLastEvents = new ArrayMap<>();
+    @GuardedBy("mLock")
+    private long mNumEventsQueued;
+    @GuardedBy("mLock")
+    private final long[] mNumBatchableEventsQueued = new long[3];
+    @GuardedBy("mLock")
+    private final long[] mNumEventsSuperseded = new long[3];
+    @GuardedBy("mLock")
+    private int mMaxSupersededRun;
+
+    /**
+     * Returns the index of the counters of a batchable event, or -1 if |what| is not batchable.
+     */
+    private static int batchableIndex(int what) {
+        switch (what) {
+            case WifiMonitor.SUPPLICANT_STATE_CHANGE_EVENT:
+                return 0;
+            case WifiMonitor.TARGET_BSSID_EVENT:
+                return 1;
+            case WifiMonitor.ASSOCIATED_BSSID_EVENT:
+                return 2;
+            default:
+                return -1;
+        }
+    }
+
+    private static String batchableName(int index) {
+        switch (index) {
+            case 0:
+                return "SUPPLICANT_STATE_CHANGE_EVENT";
+            case 1:
+                return "TARGET_BSSID_EVENT";
+            default:
+                return "ASSOCIATED_BSSID_EVENT";
+        }
+    }
+
+    private static boolean isTransientState(SupplicantState state) {
+        return state == SupplicantState.SCANNING
+                || state == SupplicantState.AUTHENTICATING
+                || state == SupplicantState.ASSOCIATING
+                || state == SupplicantState.FOUR_WAY_HANDSHAKE
+                || state == SupplicantState.GROUP_HANDSHAKE;
+    }
+
+    /**
+     * Returns whether an event with |what| and |obj| supersedes the last event queued.
+     *
+     * @param previousStateOrdinal ordinal of the handshake state seen before the last event, if
+     *                             it is a state change, or -1.
+     */
+    @VisibleForTesting
+    static boolean supersedes(int what, Object obj, int lastWhat, Object lastObj,
+            int previousStateOrdinal) {
+        if (what != lastWhat || obj == null || lastObj == null) {
+            return false;
+        }
+        switch (what) {
+            case WifiMonitor.SUPPLICANT_STATE_CHANGE_EVENT:
+                StateChangeResult result = (StateChangeResult) obj;
+                StateChangeResult lastResult = (StateChangeResult) lastObj;
+                int lastOrdinal = lastResult.state.ordinal();
+                // ASSOCIATED may supersede a transient state, but is kept itself, since it
+                // completes the association and roaming steps of ClientModeImpl. Only forward
+                // steps are collapsed, so no step back is hidden from the handler.
+                return isTransientState(lastResult.state)
+                        && (isTransientState(result.state)
+                                || result.state == SupplicantState.ASSOCIATED)
+                        && result.networkId == lastResult.networkId
+                        && previousStateOrdinal <= lastOrdinal
+                        && lastOrdinal < result.state.ordinal();
+            case WifiMonitor.TARGET_BSSID_EVENT:
+                return true;
+            case WifiMonitor.ASSOCIATED_BSSID_EVENT:
+                return Objects.equals(obj, lastObj);
+            default:
+                return false;
+        }
+    }
+
+    private LastEvent getLastEventLocked(Handler handler) {
+        LastEvent last = mLastEvents.get(handler);
+        if (last == null) {
+            last = new LastEvent();
+            mLastEvents.put(handler, last);
+        }
+        return last;
+    }
+
+    /**
+     * Enables or disables collapsing the superseded events queued to |handler|. Disabled by
+     * default, so that handlers see every event unless they only act on the latest state.
+     */
+    public void setCollapsingEnabled(Handler handler, boolean enabled) {
+        synchronized (mLock) {
+            getLastEventLocked(handler).collapsingEnabled = enabled;
+        }
+    }
+
+    /**
+     * Forgets |handler|, once it is not registered for any event anymore.
+     */
+    public void removeHandler(Handler handler) {
+        synchronized (mLock) {
+            mLastEvents.remove(handler);
+        }
+    }
+
+    /**
+     * Queues |message| to |handler|, removing the last event queued to it if still queued and
+     * superseded by |message|.
+     */
+    public void send(Handler handler, Message message) {
+        synchronized (mLock) {
+            LastEvent last = getLastEventLocked(handler);
+            int index = batchableIndex(message.what);
+            int supersededRun = 0;
+            int previousStateOrdinal = last.lastStateOrdinal;
+            if (index >= 0 && last.collapsingEnabled) {
+                if (message.obj instanceof String) {
+                    // Handler#removeMessages() removes every queued message with the same obj,
+                    // so each BSSID event gets its own instance, removing only the superseded
+                    // event.
+                    message.obj = new String((String) message.obj);
+                }
+                mNumBatchableEventsQueued[index]++;
+                if (supersedes(message.what, message.obj, last.what, last.obj,
+                        last.previousStateOrdinal)
+                        && handler.hasMessages(last.what, last.obj)) {
+                    handler.removeMessages(last.what, last.obj);
+                    mNumEventsSuperseded[index]++;
+                    supersededRun = last.supersededRun + 1;
+                    mMaxSupersededRun = Math.max(mMaxSupersededRun, supersededRun);
+                    if (message.what == WifiMonitor.SUPPLICANT_STATE_CHANGE_EVENT) {
+                        // The handler now sees this state right after the superseded one's
+                        // predecessor.
+                        previousStateOrdinal = last.previousStateOrdinal;
+                    }
+                }
+            }
+            last.what = message.what;
+            last.obj = message.obj;
+            last.supersededRun = supersededRun;
+            if (message.what == WifiMonitor.SUPPLICANT_STATE_CHANGE_EVENT
+                    && message.obj instanceof StateChangeResult) {
+                last.previousStateOrdinal = previousStateOrdinal;
+                SupplicantState state = ((StateChangeResult) message.obj).state;
+                last.lastStateOrdinal =
+                        SupplicantState.isHandshakeState(state) ? state.ordinal() : -1;
+            } else {
+                last.previousStateOrdinal = -1;
+            }
+            mNumEventsQueued++;
+            message.setTarget(handler);
+            message.sendToTarget();
+        }
+    }
+
+    /**
+     * Returns the number of events superseded while queued.
+     */
+    public long getNumEventsSuperseded() {
+        synchronized (mLock) {
+            long superseded = 0;
+            for (long count : mNumEventsSuperseded) {
+                superseded += count;
+            }
+            return superseded;
+        }
+    }
+
+    /**
+     * Dump the number of events queued, and of batchable events superseded while queued.
+     */
+    public void dump(PrintWriter pw) {
+        synchronized (mLock) {
+            pw.println("SupplicantEventBatcher: handlers=" + mLastEvents.size()
+                    + " eventsQueued=" + mNumEventsQueued
+                    + " maxSupersededRun=" + mMaxSupersededRun);
+            for (int i = 0; i < mNumEventsSuperseded.length; i++) {
+                pw.println("  " + batchableName(i) + " queued=" + mNumBatchableEventsQueued[i]
+                        + " superseded=" + mNumEventsSuperseded[i]);
+            }
+        }
+    }
+}
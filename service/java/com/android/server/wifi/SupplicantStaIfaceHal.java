@@ -935,11 +935,42 @@ public class SupplicantStaIfaceHal {
         }
     }
 
+    /**
+     * Update the current supplicant network in place if |config| is a modified version of it
+     * (e.g. changed credentials), pushing only the network variables which changed.
+     *
+     * @return true if the current network was updated, false if it needs to be removed and
+     * |config| saved to a new network instead.
+     */
+    private boolean updateCurrentNetworkConfig(@NonNull String ifaceName,
+            WifiConfiguration config) {
+        synchronized (mLock) {
+            WifiConfiguration currentConfig = getCurrentNetworkLocalConfig(ifaceName);
+            SupplicantStaNetworkHal networkHandle = getCurrentNetworkRemoteHandle(ifaceName);
+            if (currentConfig == null || networkHandle == null
+                    || currentConfig.networkId != config.networkId
+                    || !Objects.equals(currentConfig.SSID, config.SSID)) {
+                return false;
+            }
+            boolean updateSuccess = false;
+            try {
+                updateSuccess = networkHandle.updateWifiConfiguration(config);
+            } catch (IllegalArgumentException e) {
+                Log.e(TAG, "Exception while updating config params: " + config, e);
+            }
+            if (!updateSuccess) return false;
+            mCurrentNetworkLocalConfigs.put(ifaceName, new WifiConfiguration(config));
+            return true;
+        }
+    }
+
     /**
      * Add the provided network configuration to wpa_supplicant and initiate connection to it.
      * This method does the following:
      * 1. If |config| is different to the current supplicant network, removes all supplicant
-     * networks and saves |config|.
+     * networks and saves |config|. If |config| is an update of the current supplicant network,
+     * only the changed network variables are pushed to wpa_supplicant instead, and the interface
+     * is disconnected, so that the new credentials are used by the connection.
      * 2. Select the new network in wpa_supplicant.
      *
      * @param ifaceName Name of the interface.
@@ -950,6 +981,9 @@ public class SupplicantStaIfaceHal {
         synchronized (mLock) {
             logd("connectToNetwork " + config.getKey());
             WifiConfiguration currentConfig = getCurrentNetworkLocalConfig(ifaceName);
+            int numHidlCalls = 0;
+            int numHidlCallsSkipped = 0;
+            boolean updatedInPlace = false;
             if (WifiConfigurationUtil.isSameNetwork(config, currentConfig)) {
                 String networkSelectionBSSID = config.getNetworkSelectionStatus()
                         .getNetworkSelectionBSSID();
@@ -965,8 +999,15 @@ public class SupplicantStaIfaceHal {
                         loge("Failed to set current network BSSID.");
                         return false;
                     }
+                    numHidlCalls++;
                     mCurrentNetworkLocalConfigs.put(ifaceName, new WifiConfiguration(config));
                 }
+            } else if (updateCurrentNetworkConfig(ifaceName, config)) {
+                logd("Network is already saved, updated only the changed network variables.");
+                SupplicantStaNetworkHal networkHandle = getCurrentNetworkRemoteHandle(ifaceName);
+                numHidlCalls = networkHandle.getNumHidlCallsInLastSave();
+                numHidlCallsSkipped = networkHandle.getNumHidlCallsSkippedInLastSave();
+                updatedInPlace = true;
             } else {
                 mCurrentNetworkRemoteHandles.remove(ifaceName);
                 mCurrentNetworkLocalConfigs.remove(ifaceName);
@@ -982,7 +1023,9 @@ public class SupplicantStaIfaceHal {
                 }
                 mCurrentNetworkRemoteHandles.put(ifaceName, pair.first);
                 mCurrentNetworkLocalConfigs.put(ifaceName, pair.second);
+                numHidlCalls = pair.first.getNumHidlCallsInLastSave();
             }
+            mWifiMetrics.logSupplicantNetworkHidlCallsForConnect(numHidlCalls, numHidlCallsSkipped);
             SupplicantStaNetworkHal networkHandle =
                     checkSupplicantStaNetworkAndLogFailure(ifaceName, "connectToNetwork");
             if (networkHandle == null) {
@@ -1001,6 +1044,12 @@ public class SupplicantStaIfaceHal {
                 }
             }
 
+            // Only security-relevant variables differ when updating in place, and selecting the
+            // current network does not reassociate, so disconnect as removing it would have.
+            if (updatedInPlace && !disconnect(ifaceName)) {
+                loge("Failed to disconnect from updated network: " + config.getKey());
+                return false;
+            }
             if (!networkHandle.select()) {
                 loge("Failed to select network configuration: " + config.getKey());
                 return false;
@@ -41,10 +41,15 @@ import java.io.UnsupportedEncodingException;
 import java.net.URLDecoder;
 import java.net.URLEncoder;
 import java.util.ArrayList;
+import java.util.Arrays;
 import java.util.BitSet;
 import java.util.HashMap;
+import java.util.HashSet;
 import java.util.Iterator;
 import java.util.Map;
+import java.util.Objects;
+import java.util.Set;
+import java.util.function.Predicate;
 import java.util.regex.Matcher;
 import java.util.regex.Pattern;
 
@@ -131,6 +136,13 @@ public class SupplicantStaNetworkHal {
     private String mEapDomainSuffixMatch;
     private @Ocsp int mOcsp;
     private String mWapiCertSuite;
+    // Network variables last pushed to wpa_supplicant, keyed by variable name. Used to skip HIDL
+    // calls for fields which already hold the value being saved.
+    private final Map<String, Object> mLastPushedValues = new HashMap<>();
+    // Names of the network variables set (pushed or skipped) by the last save.
+    private final Set<String> mFieldsSetInLastSave = new HashSet<>();
+    private int mNumHidlCallsInLastSave = 0;
+    private int mNumHidlCallsSkippedInLastSave = 0;
 
     SupplicantStaNetworkHal(ISupplicantStaNetwork iSupplicantStaNetwork, String ifaceName,
             Context context, WifiMonitor monitor) {
@@ -287,9 +299,12 @@ public class SupplicantStaNetworkHal {
     public boolean saveWifiConfiguration(WifiConfiguration config) {
         synchronized (mLock) {
             if (config == null) return false;
+            mFieldsSetInLastSave.clear();
+            mNumHidlCallsInLastSave = 0;
+            mNumHidlCallsSkippedInLastSave = 0;
             /** SSID */
             if (config.SSID != null) {
-                if (!setSsid(NativeUtil.decodeSsid(config.SSID))) {
+                if (!pushIfChanged("ssid", NativeUtil.decodeSsid(config.SSID), this::setSsid)) {
                     Log.e(TAG, "failed to set SSID: " + config.SSID);
                     return false;
                 }
@@ -298,19 +313,19 @@ public class SupplicantStaNetworkHal {
             String bssidStr = config.getNetworkSelectionStatus().getNetworkSelectionBSSID();
             if (bssidStr != null) {
                 byte[] bssid = NativeUtil.macAddressToByteArray(bssidStr);
-                if (!setBssid(bssid)) {
+                if (!pushIfChanged("bssid", bssid, value -> setBssid(value))) {
                     Log.e(TAG, "failed to set BSSID: " + bssidStr);
                     return false;
                 }
             }
             /** HiddenSSID */
-            if (!setScanSsid(config.hiddenSSID)) {
+            if (!pushIfChanged("scan_ssid", config.hiddenSSID, this::setScanSsid)) {
                 Log.e(TAG, config.SSID + ": failed to set hiddenSSID: " + config.hiddenSSID);
                 return false;
             }
 
             /** RequirePMF */
-            if (!setRequirePmf(config.requirePmf)) {
+            if (!pushIfChanged("ieee80211w", config.requirePmf, this::setRequirePmf)) {
                 Log.e(TAG, config.SSID + ": failed to set requirePMF: " + config.requirePmf);
                 return false;
             }
@@ -320,41 +335,49 @@ public class SupplicantStaNetworkHal {
                 BitSet keyMgmtMask = addFastTransitionFlags(config.allowedKeyManagement);
                 // Add SHA256 key management flags.
                 keyMgmtMask = addSha256KeyMgmtFlags(keyMgmtMask);
-                if (!setKeyMgmt(wifiConfigurationToSupplicantKeyMgmtMask(keyMgmtMask))) {
+                if (!pushIfChanged("key_mgmt",
+                        wifiConfigurationToSupplicantKeyMgmtMask(keyMgmtMask), this::setKeyMgmt)) {
                     Log.e(TAG, "failed to set Key Management");
                     return false;
                 }
                 // Check and set SuiteB configurations.
                 if (keyMgmtMask.get(WifiConfiguration.KeyMgmt.SUITE_B_192)
-                        && !saveSuiteBConfig(config)) {
+                        && !pushIfChanged("suite_b", Arrays.asList(
+                                config.allowedGroupCiphers.clone(),
+                                config.allowedPairwiseCiphers.clone(),
+                                config.allowedGroupManagementCiphers.clone(),
+                                config.allowedSuiteBCiphers.clone()),
+                                value -> saveSuiteBConfig(config))) {
                     Log.e(TAG, "Failed to set Suite-B-192 configuration");
                     return false;
                 }
             }
             /** Security Protocol */
             if (config.allowedProtocols.cardinality() != 0
-                    && !setProto(wifiConfigurationToSupplicantProtoMask(config.allowedProtocols))) {
+                    && !pushIfChanged("proto",
+                    wifiConfigurationToSupplicantProtoMask(config.allowedProtocols),
+                    this::setProto)) {
                 Log.e(TAG, "failed to set Security Protocol");
                 return false;
             }
             /** Auth Algorithm */
             if (config.allowedAuthAlgorithms.cardinality() != 0
-                    && !setAuthAlg(wifiConfigurationToSupplicantAuthAlgMask(
-                    config.allowedAuthAlgorithms))) {
+                    && !pushIfChanged("auth_alg", wifiConfigurationToSupplicantAuthAlgMask(
+                    config.allowedAuthAlgorithms), this::setAuthAlg)) {
                 Log.e(TAG, "failed to set AuthAlgorithm");
                 return false;
             }
             /** Group Cipher */
             if (config.allowedGroupCiphers.cardinality() != 0
-                    && (!setGroupCipher(wifiConfigurationToSupplicantGroupCipherMask(
-                    config.allowedGroupCiphers)))) {
+                    && !pushIfChanged("group", wifiConfigurationToSupplicantGroupCipherMask(
+                    config.allowedGroupCiphers), this::setGroupCipher)) {
                 Log.e(TAG, "failed to set Group Cipher");
                 return false;
             }
             /** Pairwise Cipher*/
             if (config.allowedPairwiseCiphers.cardinality() != 0
-                    && !setPairwiseCipher(wifiConfigurationToSupplicantPairwiseCipherMask(
-                    config.allowedPairwiseCiphers))) {
+                    && !pushIfChanged("pairwise", wifiConfigurationToSupplicantPairwiseCipherMask(
+                    config.allowedPairwiseCiphers), this::setPairwiseCipher)) {
                 Log.e(TAG, "failed to set PairwiseCipher");
                 return false;
             }
@@ -363,21 +386,24 @@ public class SupplicantStaNetworkHal {
             // For SAE, password must be a quoted ASCII string
             if (config.preSharedKey != null) {
                 if (config.allowedKeyManagement.get(WifiConfiguration.KeyMgmt.WAPI_PSK)) {
-                    if (!setPskPassphrase(config.preSharedKey)) {
+                    if (!pushIfChanged("psk_passphrase", config.preSharedKey,
+                            this::setPskPassphrase)) {
                         Log.e(TAG, "failed to set wapi psk passphrase");
                         return false;
                     }
                 } else if (config.preSharedKey.startsWith("\"")) {
                     if (config.allowedKeyManagement.get(WifiConfiguration.KeyMgmt.SAE)) {
                         /* WPA3 case, field is SAE Password */
-                        if (!setSaePassword(
-                                NativeUtil.removeEnclosingQuotes(config.preSharedKey))) {
+                        if (!pushIfChanged("sae_password",
+                                NativeUtil.removeEnclosingQuotes(config.preSharedKey),
+                                this::setSaePassword)) {
                             Log.e(TAG, "failed to set sae password");
                             return false;
                         }
                     } else {
-                        if (!setPskPassphrase(
-                                NativeUtil.removeEnclosingQuotes(config.preSharedKey))) {
+                        if (!pushIfChanged("psk_passphrase",
+                                NativeUtil.removeEnclosingQuotes(config.preSharedKey),
+                                this::setPskPassphrase)) {
                             Log.e(TAG, "failed to set psk passphrase");
                             return false;
                         }
@@ -386,7 +412,8 @@ public class SupplicantStaNetworkHal {
                     if (config.allowedKeyManagement.get(WifiConfiguration.KeyMgmt.SAE)) {
                         return false;
                     }
-                    if (!setPsk(NativeUtil.hexStringToByteArray(config.preSharedKey))) {
+                    if (!pushIfChanged("psk", NativeUtil.hexStringToByteArray(config.preSharedKey),
+                            this::setPsk)) {
                         Log.e(TAG, "failed to set psk");
                         return false;
                     }
@@ -397,8 +424,10 @@ public class SupplicantStaNetworkHal {
             if (config.wepKeys != null) {
                 for (int i = 0; i < config.wepKeys.length; i++) {
                     if (config.wepKeys[i] != null) {
-                        if (!setWepKey(
-                                i, NativeUtil.hexOrQuotedStringToBytes(config.wepKeys[i]))) {
+                        final int keyIdx = i;
+                        if (!pushIfChanged("wep_key" + i,
+                                NativeUtil.hexOrQuotedStringToBytes(config.wepKeys[i]),
+                                value -> setWepKey(keyIdx, value))) {
                             Log.e(TAG, "failed to set wep_key " + i);
                             return false;
                         }
@@ -408,7 +437,8 @@ public class SupplicantStaNetworkHal {
             }
             /** Wep Tx Key Idx */
             if (hasSetKey) {
-                if (!setWepTxKeyIdx(config.wepTxKeyIndex)) {
+                if (!pushIfChanged("wep_tx_keyidx", config.wepTxKeyIndex,
+                        this::setWepTxKeyIdx)) {
                     Log.e(TAG, "failed to set wep_tx_keyidx: " + config.wepTxKeyIndex);
                     return false;
                 }
@@ -420,13 +450,14 @@ public class SupplicantStaNetworkHal {
             }
             metadata.put(ID_STRING_KEY_CONFIG_KEY, config.getKey());
             metadata.put(ID_STRING_KEY_CREATOR_UID, Integer.toString(config.creatorUid));
-            if (!setIdStr(createNetworkExtra(metadata))) {
+            if (!pushIfChanged("id_str", createNetworkExtra(metadata), this::setIdStr)) {
                 Log.e(TAG, "failed to set id string");
                 return false;
             }
             /** UpdateIdentifier */
             if (config.updateIdentifier != null
-                    && !setUpdateIdentifier(Integer.parseInt(config.updateIdentifier))) {
+                    && !pushIfChanged("update_identifier",
+                    Integer.parseInt(config.updateIdentifier), this::setUpdateIdentifier)) {
                 Log.e(TAG, "failed to set update identifier");
                 return false;
             }
@@ -437,7 +468,8 @@ public class SupplicantStaNetworkHal {
                     /** WAPI certificate suite name*/
                     String param = config.enterpriseConfig
                             .getFieldValue(WifiEnterpriseConfig.WAPI_CERT_SUITE_KEY);
-                    if (!TextUtils.isEmpty(param) && !setWapiCertSuite(param)) {
+                    if (!TextUtils.isEmpty(param)
+                            && !pushIfChanged("wapi_cert_suite", param, this::setWapiCertSuite)) {
                         Log.e(TAG, config.SSID + ": failed to set WAPI certificate suite: "
                                 + param);
                         return false;
@@ -449,9 +481,12 @@ public class SupplicantStaNetworkHal {
             }
 
             // Now that the network is configured fully, start listening for callback events.
-            mISupplicantStaNetworkCallback =
-                    new SupplicantStaNetworkHalCallback(config.networkId, config.SSID);
-            if (!registerCallback(mISupplicantStaNetworkCallback)) {
+            // The callback only needs to be re-registered if the network it reports for changed.
+            if (!pushIfChanged("callback", Arrays.asList(config.networkId, config.SSID), value -> {
+                mISupplicantStaNetworkCallback =
+                        new SupplicantStaNetworkHalCallback(config.networkId, config.SSID);
+                return registerCallback(mISupplicantStaNetworkCallback);
+            })) {
                 Log.e(TAG, "Failed to register callback");
                 return false;
             }
@@ -459,6 +494,71 @@ public class SupplicantStaNetworkHal {
         }
     }
 
+    /**
+     * Update the network variables of this already saved network in wpa_supplicant to match the
+     * provided WifiConfiguration, pushing only the fields which changed since the last save.
+     *
+     * This fails if any field set by the previous save is no longer set by |config|, since such a
+     * field would keep its stale value in wpa_supplicant. The caller is then expected to remove
+     * this network and save |config| to a new one.
+     *
+     * @param config WifiConfiguration object to be saved.
+     * @return true if succeeds, false otherwise.
+     * @throws IllegalArgumentException on malformed configuration params.
+     */
+    public boolean updateWifiConfiguration(WifiConfiguration config) {
+        synchronized (mLock) {
+            if (config == null || mLastPushedValues.isEmpty()) return false;
+            Set<String> previouslySetFields = new HashSet<>(mLastPushedValues.keySet());
+            if (!saveWifiConfiguration(config)) return false;
+            return mFieldsSetInLastSave.containsAll(previouslySetFields);
+        }
+    }
+
+    /**
+     * Returns the number of HIDL calls issued by the last save of this network.
+     */
+    public int getNumHidlCallsInLastSave() {
+        synchronized (mLock) {
+            return mNumHidlCallsInLastSave;
+        }
+    }
+
+    /**
+     * Returns the number of HIDL calls skipped by the last save of this network because
+     * wpa_supplicant already held the value being saved.
+     */
+    public int getNumHidlCallsSkippedInLastSave() {
+        synchronized (mLock) {
+            return mNumHidlCallsSkippedInLastSave;
+        }
+    }
+
+    /**
+     * Push a network variable to wpa_supplicant, unless the same value was already successfully
+     * pushed to this network.
+     *
+     * @param name   Name of the network variable.
+     * @param value  Value to be pushed. Must not be mutated after this call.
+     * @param setter Issues the HIDL call(s) setting |value|.
+     * @return true if the value was pushed or is already set, false otherwise.
+     */
+    private <T> boolean pushIfChanged(String name, T value, Predicate<T> setter) {
+        mFieldsSetInLastSave.add(name);
+        if (mLastPushedValues.containsKey(name)
+                && Objects.deepEquals(mLastPushedValues.get(name), value)) {
+            mNumHidlCallsSkippedInLastSave++;
+            return true;
+        }
+        mNumHidlCallsInLastSave++;
+        if (!setter.test(value)) {
+            mLastPushedValues.remove(name);
+            return false;
+        }
+        mLastPushedValues.put(name, value);
+        return true;
+    }
+
     /**
      * Read network variables from wpa_supplicant into the provided WifiEnterpriseConfig object.
      *
@@ -609,13 +709,14 @@ public class SupplicantStaNetworkHal {
         synchronized (mLock) {
             if (eapConfig == null) return false;
             /** EAP method */
-            if (!setEapMethod(wifiConfigurationToSupplicantEapMethod(eapConfig.getEapMethod()))) {
+            if (!pushIfChanged("eap", wifiConfigurationToSupplicantEapMethod(
+                    eapConfig.getEapMethod()), this::setEapMethod)) {
                 Log.e(TAG, ssid + ": failed to set eap method: " + eapConfig.getEapMethod());
                 return false;
             }
             /** EAP Phase 2 method */
-            if (!setEapPhase2Method(wifiConfigurationToSupplicantEapPhase2Method(
-                    eapConfig.getPhase2Method()))) {
+            if (!pushIfChanged("phase2", wifiConfigurationToSupplicantEapPhase2Method(
+                    eapConfig.getPhase2Method()), this::setEapPhase2Method)) {
                 Log.e(TAG, ssid + ": failed to set eap phase 2 method: "
                         + eapConfig.getPhase2Method());
                 return false;
@@ -623,77 +724,85 @@ public class SupplicantStaNetworkHal {
             String eapParam = null;
             /** EAP Identity */
             eapParam = eapConfig.getFieldValue(WifiEnterpriseConfig.IDENTITY_KEY);
-            if (!TextUtils.isEmpty(eapParam)
-                    && !setEapIdentity(NativeUtil.stringToByteArrayList(eapParam))) {
+            if (!TextUtils.isEmpty(eapParam) && !pushIfChanged("identity", eapParam,
+                    value -> setEapIdentity(NativeUtil.stringToByteArrayList(value)))) {
                 Log.e(TAG, ssid + ": failed to set eap identity: " + eapParam);
                 return false;
             }
             /** EAP Anonymous Identity */
             eapParam = eapConfig.getFieldValue(WifiEnterpriseConfig.ANON_IDENTITY_KEY);
-            if (!TextUtils.isEmpty(eapParam)
-                    && !setEapAnonymousIdentity(NativeUtil.stringToByteArrayList(eapParam))) {
+            if (!TextUtils.isEmpty(eapParam) && !pushIfChanged("anonymous_identity", eapParam,
+                    value -> setEapAnonymousIdentity(NativeUtil.stringToByteArrayList(value)))) {
                 Log.e(TAG, ssid + ": failed to set eap anonymous identity: " + eapParam);
                 return false;
             }
             /** EAP Password */
             eapParam = eapConfig.getFieldValue(WifiEnterpriseConfig.PASSWORD_KEY);
-            if (!TextUtils.isEmpty(eapParam)
-                    && !setEapPassword(NativeUtil.stringToByteArrayList(eapParam))) {
+            if (!TextUtils.isEmpty(eapParam) && !pushIfChanged("password", eapParam,
+                    value -> setEapPassword(NativeUtil.stringToByteArrayList(value)))) {
                 Log.e(TAG, ssid + ": failed to set eap password");
                 return false;
             }
             /** EAP Client Cert */
             eapParam = eapConfig.getFieldValue(WifiEnterpriseConfig.CLIENT_CERT_KEY);
-            if (!TextUtils.isEmpty(eapParam) && !setEapClientCert(eapParam)) {
+            if (!TextUtils.isEmpty(eapParam)
+                    && !pushIfChanged("client_cert", eapParam, this::setEapClientCert)) {
                 Log.e(TAG, ssid + ": failed to set eap client cert: " + eapParam);
                 return false;
             }
             /** EAP CA Cert */
             eapParam = eapConfig.getFieldValue(WifiEnterpriseConfig.CA_CERT_KEY);
-            if (!TextUtils.isEmpty(eapParam) && !setEapCACert(eapParam)) {
+            if (!TextUtils.isEmpty(eapParam)
+                    && !pushIfChanged("ca_cert", eapParam, this::setEapCACert)) {
                 Log.e(TAG, ssid + ": failed to set eap ca cert: " + eapParam);
                 return false;
             }
             /** EAP Subject Match */
             eapParam = eapConfig.getFieldValue(WifiEnterpriseConfig.SUBJECT_MATCH_KEY);
-            if (!TextUtils.isEmpty(eapParam) && !setEapSubjectMatch(eapParam)) {
+            if (!TextUtils.isEmpty(eapParam)
+                    && !pushIfChanged("subject_match", eapParam, this::setEapSubjectMatch)) {
                 Log.e(TAG, ssid + ": failed to set eap subject match: " + eapParam);
                 return false;
             }
             /** EAP Engine ID */
             eapParam = eapConfig.getFieldValue(WifiEnterpriseConfig.ENGINE_ID_KEY);
-            if (!TextUtils.isEmpty(eapParam) && !setEapEngineID(eapParam)) {
+            if (!TextUtils.isEmpty(eapParam)
+                    && !pushIfChanged("engine_id", eapParam, this::setEapEngineID)) {
                 Log.e(TAG, ssid + ": failed to set eap engine id: " + eapParam);
                 return false;
             }
             /** EAP Engine */
             eapParam = eapConfig.getFieldValue(WifiEnterpriseConfig.ENGINE_KEY);
-            if (!TextUtils.isEmpty(eapParam) && !setEapEngine(
-                    eapParam.equals(WifiEnterpriseConfig.ENGINE_ENABLE) ? true : false)) {
+            if (!TextUtils.isEmpty(eapParam) && !pushIfChanged("engine",
+                    eapParam.equals(WifiEnterpriseConfig.ENGINE_ENABLE), this::setEapEngine)) {
                 Log.e(TAG, ssid + ": failed to set eap engine: " + eapParam);
                 return false;
             }
             /** EAP Private Key */
             eapParam = eapConfig.getFieldValue(WifiEnterpriseConfig.PRIVATE_KEY_ID_KEY);
-            if (!TextUtils.isEmpty(eapParam) && !setEapPrivateKeyId(eapParam)) {
+            if (!TextUtils.isEmpty(eapParam)
+                    && !pushIfChanged("key_id", eapParam, this::setEapPrivateKeyId)) {
                 Log.e(TAG, ssid + ": failed to set eap private key: " + eapParam);
                 return false;
             }
             /** EAP Alt Subject Match */
             eapParam = eapConfig.getFieldValue(WifiEnterpriseConfig.ALTSUBJECT_MATCH_KEY);
-            if (!TextUtils.isEmpty(eapParam) && !setEapAltSubjectMatch(eapParam)) {
+            if (!TextUtils.isEmpty(eapParam)
+                    && !pushIfChanged("altsubject_match", eapParam, this::setEapAltSubjectMatch)) {
                 Log.e(TAG, ssid + ": failed to set eap alt subject match: " + eapParam);
                 return false;
             }
             /** EAP Domain Suffix Match */
             eapParam = eapConfig.getFieldValue(WifiEnterpriseConfig.DOM_SUFFIX_MATCH_KEY);
-            if (!TextUtils.isEmpty(eapParam) && !setEapDomainSuffixMatch(eapParam)) {
+            if (!TextUtils.isEmpty(eapParam) && !pushIfChanged("domain_suffix_match", eapParam,
+                    this::setEapDomainSuffixMatch)) {
                 Log.e(TAG, ssid + ": failed to set eap domain suffix match: " + eapParam);
                 return false;
             }
             /** EAP CA Path*/
             eapParam = eapConfig.getFieldValue(WifiEnterpriseConfig.CA_PATH_KEY);
-            if (!TextUtils.isEmpty(eapParam) && !setEapCAPath(eapParam)) {
+            if (!TextUtils.isEmpty(eapParam)
+                    && !pushIfChanged("ca_path", eapParam, this::setEapCAPath)) {
                 Log.e(TAG, ssid + ": failed to set eap ca path: " + eapParam);
                 return false;
             }
@@ -701,7 +810,8 @@ public class SupplicantStaNetworkHal {
             /** EAP Proactive Key Caching */
             eapParam = eapConfig.getFieldValue(WifiEnterpriseConfig.OPP_KEY_CACHING);
             if (!TextUtils.isEmpty(eapParam)
-                    && !setEapProactiveKeyCaching(eapParam.equals("1") ? true : false)) {
+                    && !pushIfChanged("proactive_key_caching", eapParam.equals("1"),
+                    this::setEapProactiveKeyCaching)) {
                 Log.e(TAG, ssid + ": failed to set proactive key caching: " + eapParam);
                 return false;
             }
@@ -711,14 +821,15 @@ public class SupplicantStaNetworkHal {
              * For older HAL compatibility, omit this step to avoid breaking
              * connection flow.
              */
-            if (getV1_3StaNetwork() != null && !setOcsp(eapConfig.getOcsp())) {
+            if (getV1_3StaNetwork() != null
+                    && !pushIfChanged("ocsp", eapConfig.getOcsp(), this::setOcsp)) {
                 Log.e(TAG, "failed to set ocsp");
                 return false;
             }
             /** EAP ERP */
             eapParam = eapConfig.getFieldValue(WifiEnterpriseConfig.EAP_ERP);
             if (!TextUtils.isEmpty(eapParam) && eapParam.equals("1")) {
-                if (!setEapErp(true)) {
+                if (!pushIfChanged("erp", true, this::setEapErp)) {
                     Log.e(TAG, ssid + ": failed to set eap erp");
                     return false;
                 }
@@ -1308,7 +1419,11 @@ public class SupplicantStaNetworkHal {
     public boolean setBssid(String bssidStr) {
         synchronized (mLock) {
             try {
-                return setBssid(NativeUtil.macAddressToByteArray(bssidStr));
+                byte[] bssid = NativeUtil.macAddressToByteArray(bssidStr);
+                mLastPushedValues.remove("bssid");
+                if (!setBssid(bssid)) return false;
+                mLastPushedValues.put("bssid", bssid);
+                return true;
             } catch (IllegalArgumentException e) {
                 Log.e(TAG, "Illegal argument " + bssidStr, e);
                 return false;
@@ -99,6 +99,9 @@ public class WakeupController {
     /** Whether this feature is enabled in Settings. */
     private boolean mWifiWakeupEnabled;
 
+    /** Called when the Settings value of this feature may have changed. */
+    private volatile Runnable mEnabledChangedListener;
+
     /** Whether the WakeupController is currently active. */
     private boolean mIsActive = false;
 
@@ -150,6 +153,10 @@ public class WakeupController {
             public void onChange(boolean selfChange) {
                 readWifiWakeupEnabledFromSettings();
                 mWakeupOnboarding.setOnboarded();
+                Runnable listener = mEnabledChangedListener;
+                if (listener != null) {
+                    listener.run();
+                }
             }
         };
         mFrameworkFacade.registerContentObserver(mContext, Settings.Global.getUriFor(
@@ -191,6 +198,14 @@ public class WakeupController {
                 mContext, Settings.Global.WIFI_WAKEUP_ENABLED, enable ? 1 : 0);
     }
 
+    /**
+     * Sets the listener called on the main Wifi thread whenever the feature is enabled or
+     * disabled in Settings, by {@link #setEnabled(boolean)} or otherwise.
+     */
+    public void setEnabledChangedListener(Runnable listener) {
+        mEnabledChangedListener = listener;
+    }
+
     /**
      * Whether the feature is currently enabled.
      */
@@ -244,7 +259,7 @@ public class WakeupController {
             Log.i(TAG, "Ignore wakeup start since there are no good networks.");
             return;
         }
-        mWifiInjector.getWifiScanner().registerScanListener(
+        mWifiInjector.getInProcessScanResultsDispatcher().registerScanListener(
                 new HandlerExecutor(mHandler), mScanListener);
 
         // If already active, we don't want to restart the session, so return early.
@@ -295,7 +310,7 @@ public class WakeupController {
         Log.d(TAG, "stop()");
         mLastDisconnectTimestampMillis = 0;
         mLastDisconnectInfo = null;
-        mWifiInjector.getWifiScanner().unregisterScanListener(mScanListener);
+        mWifiInjector.getInProcessScanResultsDispatcher().unregisterScanListener(mScanListener);
         mWakeupOnboarding.onStop();
     }
 
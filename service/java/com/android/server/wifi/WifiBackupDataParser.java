@@ -23,6 +23,7 @@ import org.xmlpull.v1.XmlPullParserException;
 
 import java.io.IOException;
 import java.util.List;
+import java.util.function.Consumer;
 
 /**
  * Interface describing parser of WiFi backup data for each major version.
@@ -43,6 +44,19 @@ interface WifiBackupDataParser {
     List<WifiConfiguration> parseNetworkConfigurationsFromXml(XmlPullParser in, int outerTagDepth,
             int minorVersion) throws XmlPullParserException, IOException;
 
+    /**
+     * Parses the configurations from the provided XML stream, handing each one to the provided
+     * consumer as soon as it has been parsed instead of accumulating them in a list.
+     *
+     * @param in            XmlPullParser instance pointing to the XML stream.
+     * @param outerTagDepth depth of the outer tag in the XML document.
+     * @param minorVersion  minor version number parsed from incoming data.
+     * @param consumer      invoked for each successfully parsed configuration.
+     */
+    void parseNetworkConfigurationsFromXml(XmlPullParser in, int outerTagDepth,
+            int minorVersion, Consumer<WifiConfiguration> consumer)
+            throws XmlPullParserException, IOException;
+
     /**
      * Get the highest supported minor version for this major version.
      * This is used for generating the version code when serializing the data.
@@ -48,6 +48,7 @@ import java.util.HashSet;
 import java.util.List;
 import java.util.Locale;
 import java.util.Set;
+import java.util.function.Consumer;
 
 /**
  * Parser for major version 1 of WiFi backup data.
@@ -144,6 +145,15 @@ class WifiBackupDataV1Parser implements WifiBackupDataParser {
     @Override
     public List<WifiConfiguration> parseNetworkConfigurationsFromXml(XmlPullParser in,
             int outerTagDepth, int minorVersion) throws XmlPullParserException, IOException {
+        List<WifiConfiguration> configurations = new ArrayList<>();
+        parseNetworkConfigurationsFromXml(in, outerTagDepth, minorVersion, configurations::add);
+        return configurations;
+    }
+
+    @Override
+    public void parseNetworkConfigurationsFromXml(XmlPullParser in, int outerTagDepth,
+            int minorVersion, Consumer<WifiConfiguration> consumer)
+            throws XmlPullParserException, IOException {
         // clamp down the minorVersion to the highest one that this parser version supports
         if (minorVersion > HIGHEST_SUPPORTED_MINOR_VERSION) {
             minorVersion = HIGHEST_SUPPORTED_MINOR_VERSION;
@@ -153,17 +163,15 @@ class WifiBackupDataV1Parser implements WifiBackupDataParser {
                 outerTagDepth);
         // Find all the configurations within the configuration list section.
         int networkListTagDepth = outerTagDepth + 1;
-        List<WifiConfiguration> configurations = new ArrayList<>();
         while (XmlUtil.gotoNextSectionWithNameOrEnd(
                 in, WifiBackupRestore.XML_TAG_SECTION_HEADER_NETWORK, networkListTagDepth)) {
             WifiConfiguration configuration =
                     parseNetworkConfigurationFromXml(in, minorVersion, networkListTagDepth);
             if (configuration != null) {
                 Log.v(TAG, "Parsed Configuration: " + configuration.getKey());
-                configurations.add(configuration);
+                consumer.accept(configuration);
             }
         }
-        return configurations;
     }
 
     @Override
@@ -39,15 +39,20 @@ import org.xmlpull.v1.XmlSerializer;
 import java.io.BufferedReader;
 import java.io.ByteArrayInputStream;
 import java.io.ByteArrayOutputStream;
-import java.io.CharArrayReader;
 import java.io.FileDescriptor;
+import java.io.FilterInputStream;
 import java.io.IOException;
+import java.io.InputStream;
+import java.io.InputStreamReader;
+import java.io.OutputStream;
 import java.io.PrintWriter;
 import java.io.UnsupportedEncodingException;
 import java.nio.charset.StandardCharsets;
 import java.util.ArrayList;
 import java.util.List;
 import java.util.Map;
+import java.util.function.Consumer;
+import java.util.regex.Pattern;
 
 /**
  * Class used to backup/restore data using the SettingsBackupAgent.
@@ -56,6 +61,9 @@ import java.util.Map;
  * 2. retrieveConfigurationsFromBackupData: Restore the configuration using the provided data.
  * The byte stream to be backed up is XML encoded and versioned to migrate the data easily across
  * revisions.
+ * Both API's also have streaming variants ({@link #writeBackupDataToStream} and
+ * {@link #retrieveConfigurationsFromBackupStream}) which never hold the whole serialized data or
+ * the whole list of restored networks in memory, for restoring large network sets.
  */
 public class WifiBackupRestore {
     private static final String TAG = "WifiBackupRestore";
@@ -103,18 +111,30 @@ public class WifiBackupRestore {
     /**
      * Regex to mask out passwords in backup data dump.
      */
-    private static final String PSK_MASK_LINE_MATCH_PATTERN =
-            "<.*" + WifiConfigurationXmlUtil.XML_TAG_PRE_SHARED_KEY + ".*>.*<.*>";
-    private static final String PSK_MASK_SEARCH_PATTERN =
-            "(<.*" + WifiConfigurationXmlUtil.XML_TAG_PRE_SHARED_KEY + ".*>)(.*)(<.*>)";
+    private static final Pattern PSK_MASK_LINE_MATCH_PATTERN = Pattern.compile(
+            "<.*" + WifiConfigurationXmlUtil.XML_TAG_PRE_SHARED_KEY + ".*>.*<.*>");
+    private static final Pattern PSK_MASK_SEARCH_PATTERN = Pattern.compile(
+            "(<.*" + WifiConfigurationXmlUtil.XML_TAG_PRE_SHARED_KEY + ".*>)(.*)(<.*>)");
     private static final String PSK_MASK_REPLACE_PATTERN = "$1*$3";
 
-    private static final String WEP_KEYS_MASK_LINE_START_MATCH_PATTERN =
-            "<string-array.*" + WifiConfigurationXmlUtil.XML_TAG_WEP_KEYS + ".*num=\"[0-9]\">";
-    private static final String WEP_KEYS_MASK_LINE_END_MATCH_PATTERN = "</string-array>";
-    private static final String WEP_KEYS_MASK_SEARCH_PATTERN = "(<.*=)(.*)(/>)";
+    private static final Pattern WEP_KEYS_MASK_LINE_START_MATCH_PATTERN = Pattern.compile(
+            "<string-array.*" + WifiConfigurationXmlUtil.XML_TAG_WEP_KEYS + ".*num=\"[0-9]\">");
+    private static final Pattern WEP_KEYS_MASK_LINE_END_MATCH_PATTERN =
+            Pattern.compile("</string-array>");
+    private static final Pattern WEP_KEYS_MASK_SEARCH_PATTERN = Pattern.compile("(<.*=)(.*)(/>)");
     private static final String WEP_KEYS_MASK_REPLACE_PATTERN = "$1*$3";
 
+    /**
+     * Size of the character buffer used when reading the legacy supplicant backup data stream.
+     */
+    private static final int SUPPLICANT_STREAM_BUFFER_SIZE = 8 * 1024;
+
+    /**
+     * Number of restored networks handed out at once by the streaming restore API's, when the
+     * caller does not specify a batch size.
+     */
+    public static final int DEFAULT_RESTORE_BATCH_SIZE = 16;
+
     private final WifiPermissionsUtil mWifiPermissionsUtil;
     /**
      * Verbose logging flag.
@@ -171,20 +191,8 @@ public class WifiBackupRestore {
         }
 
         try {
-            final XmlSerializer out = new FastXmlSerializer();
             final ByteArrayOutputStream outputStream = new ByteArrayOutputStream();
-            out.setOutput(outputStream, StandardCharsets.UTF_8.name());
-
-            // Start writing the XML stream.
-            XmlUtil.writeDocumentStart(out, XML_TAG_DOCUMENT_HEADER);
-
-            Float version = getVersion();
-            if (version == null) return null;
-            XmlUtil.writeNextValue(out, XML_TAG_VERSION, version.floatValue());
-
-            writeNetworkConfigurationsToXml(out, configurations);
-
-            XmlUtil.writeDocumentEnd(out, XML_TAG_DOCUMENT_HEADER);
+            if (!writeBackupData(configurations, outputStream)) return null;
 
             byte[] data = outputStream.toByteArray();
 
@@ -201,6 +209,55 @@ public class WifiBackupRestore {
         return new byte[0];
     }
 
+    /**
+     * Write the XML data that needs to be backed up from the provided configurations directly to
+     * the provided stream.
+     * The serializer only buffers a bounded chunk of the XML before flushing it out to the stream,
+     * so the memory used does not grow with the number of networks being backed up.
+     * Note: The data written is not retained for the verbose logging dump.
+     *
+     * @param configurations list of currently saved networks that needs to be backed up.
+     * @param outputStream stream to write the XML to. This is not closed by this method.
+     * @return true if the whole backup data was written, false otherwise.
+     */
+    public boolean writeBackupDataToStream(List<WifiConfiguration> configurations,
+            OutputStream outputStream) {
+        if (configurations == null || outputStream == null) {
+            Log.e(TAG, "Invalid configuration list or stream received");
+            return false;
+        }
+        try {
+            return writeBackupData(configurations, outputStream);
+        } catch (XmlPullParserException | IOException e) {
+            Log.e(TAG, "Error writing the backup data: " + e);
+        }
+        return false;
+    }
+
+    /**
+     * Serialize the backup data document for the provided configurations to the stream.
+     *
+     * @return false if the backup data version could not be generated, true otherwise.
+     */
+    private boolean writeBackupData(List<WifiConfiguration> configurations,
+            OutputStream outputStream) throws XmlPullParserException, IOException {
+        final XmlSerializer out = new FastXmlSerializer();
+        out.setOutput(outputStream, StandardCharsets.UTF_8.name());
+
+        // Start writing the XML stream.
+        XmlUtil.writeDocumentStart(out, XML_TAG_DOCUMENT_HEADER);
+
+        Float version = getVersion();
+        if (version == null) return false;
+        XmlUtil.writeNextValue(out, XML_TAG_VERSION, version.floatValue());
+
+        writeNetworkConfigurationsToXml(out, configurations);
+
+        // This also flushes out any data buffered in the serializer.
+        XmlUtil.writeDocumentEnd(out, XML_TAG_DOCUMENT_HEADER);
+        return true;
+    }
+
     /**
      * Write the list of configurations to the XML stream.
      */
@@ -251,13 +308,61 @@ public class WifiBackupRestore {
             Log.e(TAG, "Invalid backup data received");
             return null;
         }
-        try {
-            if (mVerboseLoggingEnabled) {
-                mDebugLastBackupDataRestored = data;
-            }
+        if (mVerboseLoggingEnabled) {
+            mDebugLastBackupDataRestored = data;
+        }
+        List<WifiConfiguration> configurations = new ArrayList<>();
+        if (!parseBackupData(new ByteArrayInputStream(data), configurations::add)) {
+            return null;
+        }
+        return configurations;
+    }
+
+    /**
+     * Parse out the configurations from the back up data stream, handing them to the provided
+     * consumer in batches of at most |batchSize| networks as the stream is being parsed.
+     * Only a single batch of parsed networks is held in memory at any time.
+     * Note: If the stream is found to be corrupt midway, the batches already handed out are not
+     * recalled.
+     *
+     * @param inputStream stream of the XML data. This is not closed by this method.
+     * @param batchSize max number of networks to hand out in a single batch.
+     * @param batchConsumer invoked with each batch of networks retrieved from the backed up data.
+     * @return true if the whole stream was parsed successfully, false otherwise.
+     */
+    public boolean retrieveConfigurationsFromBackupStream(InputStream inputStream, int batchSize,
+            Consumer<List<WifiConfiguration>> batchConsumer) {
+        if (inputStream == null || batchSize <= 0 || batchConsumer == null) {
+            Log.e(TAG, "Invalid backup stream received");
+            return false;
+        }
+        DebugCopyInputStream debugCopy = null;
+        if (mVerboseLoggingEnabled) {
+            debugCopy = new DebugCopyInputStream(inputStream);
+            inputStream = debugCopy;
+        }
+        NetworkBatcher batcher = new NetworkBatcher(batchSize, batchConsumer);
+        boolean success = parseBackupData(inputStream, batcher);
+        if (debugCopy != null) {
+            mDebugLastBackupDataRestored = debugCopy.toByteArray();
+        }
+        if (!success) {
+            return false;
+        }
+        batcher.flush();
+        return true;
+    }
 
+    /**
+     * Parse the backup data document from the stream and hand each parsed network to the
+     * consumer.
+     *
+     * @return true if the whole stream was parsed successfully, false otherwise.
+     */
+    private boolean parseBackupData(InputStream inputStream,
+            Consumer<WifiConfiguration> consumer) {
+        try {
             final XmlPullParser in = Xml.newPullParser();
-            ByteArrayInputStream inputStream = new ByteArrayInputStream(data);
             in.setInput(inputStream, StandardCharsets.UTF_8.name());
 
             // Start parsing the XML stream.
@@ -291,15 +396,15 @@ public class WifiBackupRestore {
             if (parser == null) {
                 Log.w(TAG, "Major version of backup data is unknown to this Android"
                         + " version; not restoring");
-                return null;
-            } else {
-                return parser.parseNetworkConfigurationsFromXml(in, rootTagDepth, minorVersion);
+                return false;
             }
+            parser.parseNetworkConfigurationsFromXml(in, rootTagDepth, minorVersion, consumer);
+            return true;
         } catch (XmlPullParserException | IOException | ClassCastException
                 | IllegalArgumentException e) {
             Log.e(TAG, "Error parsing the backup data: " + e);
         }
-        return null;
+        return false;
     }
 
     private WifiBackupDataParser getWifiBackupDataParser(int majorVersion) {
@@ -332,16 +437,17 @@ public class WifiBackupRestore {
             String xmlString = new String(data, StandardCharsets.UTF_8.name());
             boolean wepKeysLine = false;
             for (String line : xmlString.split("\n")) {
-                if (line.matches(PSK_MASK_LINE_MATCH_PATTERN)) {
-                    line = line.replaceAll(PSK_MASK_SEARCH_PATTERN, PSK_MASK_REPLACE_PATTERN);
+                if (PSK_MASK_LINE_MATCH_PATTERN.matcher(line).matches()) {
+                    line = PSK_MASK_SEARCH_PATTERN.matcher(line)
+                            .replaceAll(PSK_MASK_REPLACE_PATTERN);
                 }
-                if (line.matches(WEP_KEYS_MASK_LINE_START_MATCH_PATTERN)) {
+                if (WEP_KEYS_MASK_LINE_START_MATCH_PATTERN.matcher(line).matches()) {
                     wepKeysLine = true;
-                } else if (line.matches(WEP_KEYS_MASK_LINE_END_MATCH_PATTERN)) {
+                } else if (WEP_KEYS_MASK_LINE_END_MATCH_PATTERN.matcher(line).matches()) {
                     wepKeysLine = false;
                 } else if (wepKeysLine) {
-                    line = line.replaceAll(
-                            WEP_KEYS_MASK_SEARCH_PATTERN, WEP_KEYS_MASK_REPLACE_PATTERN);
+                    line = WEP_KEYS_MASK_SEARCH_PATTERN.matcher(line)
+                            .replaceAll(WEP_KEYS_MASK_REPLACE_PATTERN);
                 }
                 sb.append(line).append("\n");
             }
@@ -371,43 +477,172 @@ public class WifiBackupRestore {
             mDebugLastIpConfigBackupDataRestored = ipConfigData;
         }
 
-        SupplicantBackupMigration.SupplicantNetworks supplicantNetworks =
-                new SupplicantBackupMigration.SupplicantNetworks();
-        // Incorporate the networks present in the backup data.
-        char[] restoredAsChars = new char[supplicantData.length];
-        for (int i = 0; i < supplicantData.length; i++) {
-            restoredAsChars[i] = (char) supplicantData[i];
-        }
-
-        BufferedReader in = new BufferedReader(new CharArrayReader(restoredAsChars));
-        supplicantNetworks.readNetworksFromStream(in);
-
-        // Retrieve corresponding WifiConfiguration objects.
-        List<WifiConfiguration> configurations = supplicantNetworks.retrieveWifiConfigurations();
-
-        // Now retrieve all the IpConfiguration objects and set in the corresponding
-        // WifiConfiguration objects if ipconfig data is present.
-        if (ipConfigData != null && ipConfigData.length != 0) {
-            SparseArray<IpConfiguration> networks =
-                    IpConfigStore.readIpAndProxyConfigurations(
-                            new ByteArrayInputStream(ipConfigData));
-            if (networks != null) {
-                for (int i = 0; i < networks.size(); i++) {
-                    int id = networks.keyAt(i);
-                    for (WifiConfiguration configuration : configurations) {
-                        // This is a dangerous lookup, but that's how it is currently written.
-                        if (configuration.getKey().hashCode() == id) {
-                            configuration.setIpConfiguration(networks.valueAt(i));
-                        }
-                    }
-                }
-            } else {
+        List<WifiConfiguration> configurations = new ArrayList<>();
+        InputStream ipConfigStream = (ipConfigData != null && ipConfigData.length != 0)
+                ? new ByteArrayInputStream(ipConfigData) : null;
+        if (!parseSupplicantBackupData(new ByteArrayInputStream(supplicantData), ipConfigStream,
+                configurations::add)) {
+            return null;
+        }
+        return configurations;
+    }
+
+    /**
+     * Restore state from the older supplicant back up data streams, handing the networks to the
+     * provided consumer in batches of at most |batchSize| networks as the stream is being parsed.
+     * The wpa_supplicant.conf stream is read line by line through a bounded buffer, so only a
+     * single batch of parsed networks is held in memory at any time.
+     * Note: If the stream is found to be corrupt midway, the batches already handed out are not
+     * recalled.
+     *
+     * @param supplicantStream stream of wpa_supplicant.conf. This is not closed by this method.
+     * @param ipConfigStream   stream of ipconfig.txt, may be null.
+     * @param batchSize        max number of networks to hand out in a single batch.
+     * @param batchConsumer    invoked with each batch of networks retrieved from the backed up
+     *                         data.
+     * @return true if the whole stream was parsed successfully, false otherwise.
+     */
+    public boolean retrieveConfigurationsFromSupplicantBackupStream(
+            InputStream supplicantStream, InputStream ipConfigStream, int batchSize,
+            Consumer<List<WifiConfiguration>> batchConsumer) {
+        if (supplicantStream == null || batchSize <= 0 || batchConsumer == null) {
+            Log.e(TAG, "Invalid supplicant backup stream received");
+            return false;
+        }
+        DebugCopyInputStream supplicantDebugCopy = null;
+        DebugCopyInputStream ipConfigDebugCopy = null;
+        if (mVerboseLoggingEnabled) {
+            supplicantDebugCopy = new DebugCopyInputStream(supplicantStream);
+            supplicantStream = supplicantDebugCopy;
+            if (ipConfigStream != null) {
+                ipConfigDebugCopy = new DebugCopyInputStream(ipConfigStream);
+                ipConfigStream = ipConfigDebugCopy;
+            }
+        }
+        NetworkBatcher batcher = new NetworkBatcher(batchSize, batchConsumer);
+        boolean success = parseSupplicantBackupData(supplicantStream, ipConfigStream, batcher);
+        if (supplicantDebugCopy != null) {
+            mDebugLastSupplicantBackupDataRestored = supplicantDebugCopy.toByteArray();
+            mDebugLastIpConfigBackupDataRestored =
+                    ipConfigDebugCopy != null ? ipConfigDebugCopy.toByteArray() : null;
+        }
+        if (!success) {
+            return false;
+        }
+        batcher.flush();
+        return true;
+    }
+
+    /**
+     * Parse the networks out of the wpa_supplicant.conf stream, set the corresponding
+     * IpConfiguration from the ipconfig.txt stream (if present) and hand each one to the consumer.
+     *
+     * @return true if the whole stream was parsed successfully, false otherwise.
+     */
+    private boolean parseSupplicantBackupData(InputStream supplicantStream,
+            InputStream ipConfigStream, Consumer<WifiConfiguration> consumer) {
+        // Retrieve all the IpConfiguration objects first so that they can be set in the
+        // corresponding WifiConfiguration objects as they are parsed. Each entry is keyed by the
+        // hash of the network's config key.
+        // This is a dangerous lookup, but that's how it is currently written.
+        SparseArray<IpConfiguration> ipConfigurations = null;
+        if (ipConfigStream != null) {
+            ipConfigurations = IpConfigStore.readIpAndProxyConfigurations(ipConfigStream);
+            if (ipConfigurations == null) {
                 Log.e(TAG, "Failed to parse ipconfig data");
             }
         } else {
             Log.e(TAG, "Invalid ipconfig backup data received");
         }
-        return configurations;
+
+        // The legacy data was always decoded one byte per character.
+        BufferedReader in = new BufferedReader(
+                new InputStreamReader(supplicantStream, StandardCharsets.ISO_8859_1),
+                SUPPLICANT_STREAM_BUFFER_SIZE);
+        final SparseArray<IpConfiguration> networks = ipConfigurations;
+        return SupplicantBackupMigration.SupplicantNetworks.readWifiConfigurationsFromStream(
+                in, configuration -> {
+                    if (networks != null) {
+                        IpConfiguration ipConfiguration =
+                                networks.get(configuration.getKey().hashCode());
+                        if (ipConfiguration != null) {
+                            configuration.setIpConfiguration(ipConfiguration);
+                        }
+                    }
+                    consumer.accept(configuration);
+                });
+    }
+
+    /**
+     * Keeps a copy of the data read from the wrapped stream, for the dump of the last restored
+     * data. Only used when verbose logging is enabled, like the copies kept by the non-streaming
+     * restore API's.
+     */
+    private static class DebugCopyInputStream extends FilterInputStream {
+        private final ByteArrayOutputStream mCopy = new ByteArrayOutputStream();
+
+        DebugCopyInputStream(InputStream in) {
+            super(in);
+        }
+
+        @Override
+        public int read() throws IOException {
+            int b = super.read();
+            if (b >= 0) {
+                mCopy.write(b);
+            }
+            return b;
+        }
+
+        @Override
+        public int read(byte[] b, int off, int len) throws IOException {
+            int numRead = super.read(b, off, len);
+            if (numRead > 0) {
+                mCopy.write(b, off, numRead);
+            }
+            return numRead;
+        }
+
+        /**
+         * Returns the data read so far.
+         */
+        public byte[] toByteArray() {
+            return mCopy.toByteArray();
+        }
+    }
+
+    /**
+     * Accumulates restored networks and hands them out in fixed size batches.
+     */
+    private static class NetworkBatcher implements Consumer<WifiConfiguration> {
+        private final int mBatchSize;
+        private final Consumer<List<WifiConfiguration>> mBatchConsumer;
+        private List<WifiConfiguration> mBatch;
+
+        NetworkBatcher(int batchSize, Consumer<List<WifiConfiguration>> batchConsumer) {
+            mBatchSize = batchSize;
+            mBatchConsumer = batchConsumer;
+            mBatch = new ArrayList<>(batchSize);
+        }
+
+        @Override
+        public void accept(WifiConfiguration configuration) {
+            mBatch.add(configuration);
+            if (mBatch.size() >= mBatchSize) {
+                flush();
+            }
+        }
+
+        /**
+         * Hand out any networks accumulated so far.
+         */
+        public void flush() {
+            if (mBatch.isEmpty()) return;
+            // The consumer owns the handed out list, start a new one for the next batch.
+            List<WifiConfiguration> batch = mBatch;
+            mBatch = new ArrayList<>(mBatchSize);
+            mBatchConsumer.accept(batch);
+        }
     }
 
     /**
@@ -485,16 +720,16 @@ public class WifiBackupRestore {
         /**
          * Regex to mask out passwords in backup data dump.
          */
-        private static final String PSK_MASK_LINE_MATCH_PATTERN =
-                ".*" + SUPPLICANT_KEY_PSK + ".*=.*";
-        private static final String PSK_MASK_SEARCH_PATTERN =
-                "(.*" + SUPPLICANT_KEY_PSK + ".*=)(.*)";
+        private static final Pattern PSK_MASK_LINE_MATCH_PATTERN =
+                Pattern.compile(".*" + SUPPLICANT_KEY_PSK + ".*=.*");
+        private static final Pattern PSK_MASK_SEARCH_PATTERN =
+                Pattern.compile("(.*" + SUPPLICANT_KEY_PSK + ".*=)(.*)");
         private static final String PSK_MASK_REPLACE_PATTERN = "$1*";
 
-        private static final String WEP_KEYS_MASK_LINE_MATCH_PATTERN =
-                ".*" + SUPPLICANT_KEY_WEP_KEY0.replace("0", "") + ".*=.*";
-        private static final String WEP_KEYS_MASK_SEARCH_PATTERN =
-                "(.*" + SUPPLICANT_KEY_WEP_KEY0.replace("0", "") + ".*=)(.*)";
+        private static final Pattern WEP_KEYS_MASK_LINE_MATCH_PATTERN = Pattern.compile(
+                ".*" + SUPPLICANT_KEY_WEP_KEY0.replace("0", "") + ".*=.*");
+        private static final Pattern WEP_KEYS_MASK_SEARCH_PATTERN = Pattern.compile(
+                "(.*" + SUPPLICANT_KEY_WEP_KEY0.replace("0", "") + ".*=)(.*)");
         private static final String WEP_KEYS_MASK_REPLACE_PATTERN = "$1*";
 
         /**
@@ -515,12 +750,13 @@ public class WifiBackupRestore {
             try {
                 String supplicantConfString = new String(data, StandardCharsets.UTF_8.name());
                 for (String line : supplicantConfString.split("\n")) {
-                    if (line.matches(PSK_MASK_LINE_MATCH_PATTERN)) {
-                        line = line.replaceAll(PSK_MASK_SEARCH_PATTERN, PSK_MASK_REPLACE_PATTERN);
+                    if (PSK_MASK_LINE_MATCH_PATTERN.matcher(line).matches()) {
+                        line = PSK_MASK_SEARCH_PATTERN.matcher(line)
+                                .replaceAll(PSK_MASK_REPLACE_PATTERN);
                     }
-                    if (line.matches(WEP_KEYS_MASK_LINE_MATCH_PATTERN)) {
-                        line = line.replaceAll(
-                                WEP_KEYS_MASK_SEARCH_PATTERN, WEP_KEYS_MASK_REPLACE_PATTERN);
+                    if (WEP_KEYS_MASK_LINE_MATCH_PATTERN.matcher(line).matches()) {
+                        line = WEP_KEYS_MASK_SEARCH_PATTERN.matcher(line)
+                                .replaceAll(WEP_KEYS_MASK_REPLACE_PATTERN);
                     }
                     sb.append(line).append("\n");
                 }
@@ -552,9 +788,10 @@ public class WifiBackupRestore {
                 final SupplicantNetwork n = new SupplicantNetwork();
                 String line;
                 try {
-                    while (in.ready()) {
-                        line = in.readLine();
-                        if (line == null || line.startsWith("}")) {
+                    // Don't rely on ready() here, it may return false for streams which have
+                    // not yet buffered more data.
+                    while ((line = in.readLine()) != null) {
+                        if (line.startsWith("}")) {
                             break;
                         }
                         n.parseLine(line);
@@ -743,41 +980,38 @@ public class WifiBackupRestore {
 
         /**
          * Ingest multiple wifi config fragments from wpa_supplicant.conf, looking for network={}
-         * blocks and eliminating duplicates
+         * blocks. The networks are handed out one at a time as they are read from the stream.
          */
         static class SupplicantNetworks {
-            final ArrayList<SupplicantNetwork> mNetworks = new ArrayList<>(8);
-
             /**
-             * Parse the wpa_supplicant.conf file stream and add networks.
+             * Parse the wpa_supplicant.conf file stream and hand each restorable network to the
+             * consumer as soon as its block has been read.
              */
-            public void readNetworksFromStream(BufferedReader in) {
+            private static void readNetworksFromStream(BufferedReader in,
+                    Consumer<SupplicantNetwork> consumer) {
                 try {
                     String line;
-                    while (in.ready()) {
-                        line = in.readLine();
-                        if (line != null) {
-                            if (line.startsWith("network")) {
-                                SupplicantNetwork net = SupplicantNetwork.readNetworkFromStream(in);
-
-                                // An IOException occurred while trying to read the network.
-                                if (net == null) {
-                                    Log.e(TAG, "Error while parsing the network.");
-                                    continue;
-                                }
-
-                                // Networks that use certificates for authentication can't be
-                                // restored because the certificates they need don't get restored
-                                // (because they are stored in keystore, and can't be restored).
-                                // Similarly, omit EAP network definitions to avoid propagating
-                                // controlled enterprise network definitions.
-                                if (net.isEap || net.certUsed) {
-                                    Log.d(TAG, "Skipping enterprise network for restore: "
-                                            + net.mParsedSSIDLine + " / " + net.mParsedKeyMgmtLine);
-                                    continue;
-                                }
-                                mNetworks.add(net);
+                    while ((line = in.readLine()) != null) {
+                        if (line.startsWith("network")) {
+                            SupplicantNetwork net = SupplicantNetwork.readNetworkFromStream(in);
+
+                            // An IOException occurred while trying to read the network.
+                            if (net == null) {
+                                Log.e(TAG, "Error while parsing the network.");
+                                continue;
                             }
+
+                            // Networks that use certificates for authentication can't be
+                            // restored because the certificates they need don't get restored
+                            // (because they are stored in keystore, and can't be restored).
+                            // Similarly, omit EAP network definitions to avoid propagating
+                            // controlled enterprise network definitions.
+                            if (net.isEap || net.certUsed) {
+                                Log.d(TAG, "Skipping enterprise network for restore: "
+                                        + net.mParsedSSIDLine + " / " + net.mParsedKeyMgmtLine);
+                                continue;
+                            }
+                            consumer.accept(net);
                         }
                     }
                 } catch (IOException e) {
@@ -786,25 +1020,28 @@ public class WifiBackupRestore {
             }
 
             /**
-             * Retrieve a list of WifiConfiguration objects parsed from wpa_supplicant.conf
+             * Parse the wpa_supplicant.conf file stream and hand each WifiConfiguration object
+             * created from it to the consumer, without retaining any of the parsed networks.
+             *
+             * @return false if any of the networks could not be parsed, true otherwise.
              */
-            public List<WifiConfiguration> retrieveWifiConfigurations() {
-                ArrayList<WifiConfiguration> wifiConfigurations = new ArrayList<>();
-                for (SupplicantNetwork net : mNetworks) {
-                    try {
+            public static boolean readWifiConfigurationsFromStream(BufferedReader in,
+                    Consumer<WifiConfiguration> consumer) {
+                try {
+                    readNetworksFromStream(in, net -> {
                         WifiConfiguration wifiConfiguration = net.createWifiConfiguration();
                         if (wifiConfiguration != null) {
                             Log.v(TAG, "Parsed Configuration: " + wifiConfiguration.getKey());
-                            wifiConfigurations.add(wifiConfiguration);
+                            consumer.accept(wifiConfiguration);
                         }
-                    } catch (NumberFormatException e) {
-                        // Occurs if we are unable to parse the hidden SSID, WEP Key index or
-                        // creator UID.
-                        Log.e(TAG, "Error parsing wifi configuration: " + e);
-                        return null;
-                    }
+                    });
+                } catch (NumberFormatException e) {
+                    // Occurs if we are unable to parse the hidden SSID, WEP Key index or
+                    // creator UID.
+                    Log.e(TAG, "Error parsing wifi configuration: " + e);
+                    return false;
                 }
-                return wifiConfigurations;
+                return true;
             }
         }
     }
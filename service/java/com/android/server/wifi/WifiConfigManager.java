@@ -284,6 +284,7 @@ public class WifiConfigManager {
 
     private final FrameworkFacade mFrameworkFacade;
     private final DeviceConfigFacade mDeviceConfigFacade;
+    private final WifiStateSnapshotPublisher mWifiStateSnapshotPublisher;
 
     /**
      * Verbose logging flag. Toggled by developer options.
@@ -309,6 +310,22 @@ public class WifiConfigManager {
      * Flag to indicate if the user unlock was deferred until the store load occurs.
      */
     private boolean mDeferredUserUnlockRead = false;
+    /**
+     * Nesting depth of {@link #startBatchedStoreWrites()} calls. Store writes are deferred until
+     * the outermost batch is ended.
+     */
+    private int mBatchedStoreWritesDepth = 0;
+    /**
+     * Flags to indicate if a store write (and whether a forced one) was requested while writes
+     * were being batched.
+     */
+    private boolean mPendingBatchedStoreWrite = false;
+    private boolean mPendingBatchedStoreForceWrite = false;
+    /**
+     * Flag to indicate if the saved networks changed while writes were being batched, so that
+     * they are published once when the outermost batch is ended.
+     */
+    private boolean mPendingBatchedPublish = false;
     /**
      * This is keeping track of the next network ID to be assigned. Any new networks will be
      * assigned |mNextNetworkId| as network ID.
@@ -380,6 +397,7 @@ public class WifiConfigManager {
                 context.getSystemService(ActivityManager.class).isLowRamDevice() ? 128 : 256);
         mMacAddressUtil = mWifiInjector.getMacAddressUtil();
         mLruConnectionTracker = lruConnectionTracker;
+        mWifiStateSnapshotPublisher = mWifiInjector.getWifiStateSnapshotPublisher();
     }
 
     /**
@@ -488,11 +506,11 @@ public class WifiConfigManager {
                 mRandomizedMacAddressMapping.remove(config.getKey());
             }
         }
-        MacAddress result = mMacAddressUtil.calculatePersistentMac(config.getKey(),
-                mMacAddressUtil.obtainMacRandHashFunction(Process.WIFI_UID));
+        MacAddress result = mMacAddressUtil.getOrCalculatePersistentMac(config.getKey(),
+                Process.WIFI_UID);
         if (result == null) {
-            result = mMacAddressUtil.calculatePersistentMac(config.getKey(),
-                    mMacAddressUtil.obtainMacRandHashFunction(Process.WIFI_UID));
+            result = mMacAddressUtil.getOrCalculatePersistentMac(config.getKey(),
+                    Process.WIFI_UID);
         }
         if (result == null) {
             Log.wtf(TAG, "Failed to generate MAC address from KeyStore even after retrying. "
@@ -611,7 +629,7 @@ public class WifiConfigManager {
      * WifiManager API's. This method puts "02:00:00:00:00:00" as the MAC address.
      * @param configuration WifiConfiguration to hide the MAC address
      */
-    private void maskRandomizedMacAddressInWifiConfiguration(WifiConfiguration configuration) {
+    static void maskRandomizedMacAddressInWifiConfiguration(WifiConfiguration configuration) {
         configuration.setRandomizedMacAddress(DEFAULT_MAC_ADDRESS);
     }
 
@@ -847,6 +865,9 @@ public class WifiConfigManager {
      *                WifiManager.CHANGE_REASON_REMOVED, or WifiManager.CHANGE_REASON_CHANGE.
      */
     private void sendConfiguredNetworkChangedBroadcast(int reason) {
+        // Publish the saved networks before the broadcast, so that apps refreshing their list
+        // on the broadcast read the change.
+        publishSavedNetworks();
         Intent intent = new Intent(WifiManager.CONFIGURED_NETWORKS_CHANGED_ACTION);
         intent.addFlags(Intent.FLAG_RECEIVER_REGISTERED_ONLY_BEFORE_BOOT);
         intent.putExtra(WifiManager.EXTRA_MULTIPLE_NETWORKS_CHANGED, true);
@@ -854,6 +875,23 @@ public class WifiConfigManager {
         mContext.sendBroadcastAsUser(intent, UserHandle.ALL, Manifest.permission.ACCESS_WIFI_STATE);
     }
 
+    /**
+     * Publishes the saved networks to the state snapshot read by the WifiServiceImpl getters.
+     *
+     * This is the choke point for every change to the saved networks: it is called before the
+     * configured networks changed broadcast, on every {@link #saveToStore(boolean)}, and by the
+     * setters of the fields which are not persisted. Only the list readable by the wifi UID is
+     * copied; the snapshot masks the randomized MAC addresses for other callers when read.
+     */
+    private void publishSavedNetworks() {
+        if (mBatchedStoreWritesDepth > 0) {
+            mPendingBatchedPublish = true;
+            return;
+        }
+        mPendingBatchedPublish = false;
+        mWifiStateSnapshotPublisher.publishSavedNetworks(getSavedNetworks(Process.WIFI_UID));
+    }
+
     /**
      * Checks if |uid| has permission to modify the provided configuration.
      *
@@ -1419,6 +1457,7 @@ public class WifiConfigManager {
         removeConnectChoiceFromAllNetworks(config.getKey());
         mConfiguredNetworks.remove(config.networkId);
         mScanDetailCaches.remove(config.networkId);
+        mMacAddressUtil.removePersistentMacFromCache(config.getKey());
         // Stage the backup of the SettingsProvider package which backs this up.
         mBackupManagerProxy.notifyDataChanged();
         mWifiInjector.getBssidBlocklistMonitor().handleNetworkRemoved(config.SSID);
@@ -2044,6 +2083,7 @@ public class WifiConfigManager {
             return false;
         }
         config.defaultGwMacAddress = macAddress;
+        publishSavedNetworks();
         return true;
     }
 
@@ -3016,6 +3056,19 @@ public class WifiConfigManager {
      * we load configuration at boot.
      */
     private void generateRandomizedMacAddresses() {
+        // Derive the persistent MAC addresses of all the networks needing one in a single batch,
+        // so that the MAC randomization secret is retrieved from KeyStore at most once.
+        List<String> keysToDerive = new ArrayList<>();
+        for (WifiConfiguration config : getInternalConfiguredNetworks()) {
+            if (DEFAULT_MAC_ADDRESS.equals(config.getRandomizedMacAddress())
+                    && !shouldUseAggressiveRandomization(config)
+                    && !mRandomizedMacAddressMapping.containsKey(config.getKey())) {
+                keysToDerive.add(config.getKey());
+            }
+        }
+        if (!keysToDerive.isEmpty()) {
+            mMacAddressUtil.getOrCalculatePersistentMacs(keysToDerive, Process.WIFI_UID);
+        }
         for (WifiConfiguration config : getInternalConfiguredNetworks()) {
             if (DEFAULT_MAC_ADDRESS.equals(config.getRandomizedMacAddress())) {
                 initRandomizedMacForInternalConfig(config);
@@ -3090,6 +3143,8 @@ public class WifiConfigManager {
             Log.wtf(TAG, "XML deserialization of store failed. All saved networks are lost!", e);
             return false;
         }
+        mMacAddressUtil.loadPersistentMacCache(mRandomizedMacStoreData.getPersistentMacCache(),
+                mRandomizedMacStoreData.getSecretFingerprint(), Process.WIFI_UID);
         loadInternalData(mNetworkListSharedStoreData.getConfigurations(),
                 mNetworkListUserStoreData.getConfigurations(),
                 mRandomizedMacStoreData.getMacMapping());
@@ -3137,10 +3192,19 @@ public class WifiConfigManager {
      * @return Whether the write was successful or not, this is applicable only for force writes.
      */
     public boolean saveToStore(boolean forceWrite) {
+        // Most changes to the saved networks end with a save, including changes to fields which
+        // are not persisted (network selection status, last disconnect time).
+        publishSavedNetworks();
         if (mPendingStoreRead) {
             Log.e(TAG, "Cannot save to store before store is read!");
             return false;
         }
+        if (mBatchedStoreWritesDepth > 0) {
+            // Coalesce all the writes in this batch into a single write when the batch ends.
+            mPendingBatchedStoreWrite = true;
+            mPendingBatchedStoreForceWrite |= forceWrite;
+            return true;
+        }
         ArrayList<WifiConfiguration> sharedConfigurations = new ArrayList<>();
         ArrayList<WifiConfiguration> userConfigurations = new ArrayList<>();
         // List of network IDs for legacy Passpoint configuration to be removed.
@@ -3189,6 +3253,9 @@ public class WifiConfigManager {
         mNetworkListSharedStoreData.setConfigurations(sharedConfigurations);
         mNetworkListUserStoreData.setConfigurations(userConfigurations);
         mRandomizedMacStoreData.setMacMapping(mRandomizedMacAddressMapping);
+        mRandomizedMacStoreData.setPersistentMacCache(
+                mMacAddressUtil.getPersistentMacCacheForStore(),
+                mMacAddressUtil.getSecretFingerprintForStore());
 
         try {
             mWifiConfigStore.write(forceWrite);
@@ -3202,6 +3269,44 @@ public class WifiConfigManager {
         return true;
     }
 
+    /**
+     * Start batching store writes. All the writes requested via {@link #saveToStore(boolean)}
+     * until the matching {@link #endBatchedStoreWrites()} call are coalesced into a single write.
+     * This is used when applying a large number of network updates at once (for ex: restoring
+     * networks from backup data) to avoid rewriting the whole store for every network.
+     * Batches may be nested, the write happens when the outermost batch is ended.
+     */
+    public void startBatchedStoreWrites() {
+        mBatchedStoreWritesDepth++;
+    }
+
+    /**
+     * End a batch started via {@link #startBatchedStoreWrites()} and perform the deferred store
+     * write (if any was requested) when the outermost batch is ended.
+     *
+     * @return Whether the write was successful or not, this is applicable only for force writes.
+     */
+    public boolean endBatchedStoreWrites() {
+        if (mBatchedStoreWritesDepth == 0) {
+            Log.e(TAG, "endBatchedStoreWrites called without a matching start");
+            return false;
+        }
+        mBatchedStoreWritesDepth--;
+        if (mBatchedStoreWritesDepth > 0) {
+            return true;
+        }
+        if (!mPendingBatchedStoreWrite) {
+            if (mPendingBatchedPublish) {
+                publishSavedNetworks();
+            }
+            return true;
+        }
+        boolean forceWrite = mPendingBatchedStoreForceWrite;
+        mPendingBatchedStoreWrite = false;
+        mPendingBatchedStoreForceWrite = false;
+        return saveToStore(forceWrite);
+    }
+
     /**
      * Helper method for logging into local log buffer.
      */
@@ -3233,6 +3338,7 @@ public class WifiConfigManager {
                 + mContext.getResources().getBoolean(R.bool.config_wifiPnoFrequencyCullingEnabled));
         pw.println("WifiConfigManager - PNO scan recency sorting enabled = "
                 + mContext.getResources().getBoolean(R.bool.config_wifiPnoRecencySortingEnabled));
+        mMacAddressUtil.dump(pw);
         mWifiConfigStore.dump(fd, pw, args);
         mWifiCarrierInfoManager.dump(fd, pw, args);
     }
@@ -3283,6 +3389,7 @@ public class WifiConfigManager {
             return;
         }
         config.recentFailure.setAssociationStatus(reason);
+        publishSavedNetworks();
     }
 
     /**
@@ -3294,6 +3401,7 @@ public class WifiConfigManager {
             return;
         }
         config.recentFailure.clear();
+        publishSavedNetworks();
     }
 
     /**
@@ -136,6 +136,7 @@ public class WifiConnectivityManager {
     private final Context mContext;
     private final ClientModeImpl mStateMachine;
     private final WifiInjector mWifiInjector;
+    private final ConnectionPhaseTracer mConnectionPhaseTracer;
     private final WifiConfigManager mConfigManager;
     private final WifiNetworkSuggestionsManager mWifiNetworkSuggestionsManager;
     private final WifiInfo mWifiInfo;
@@ -791,6 +792,7 @@ public class WifiConnectivityManager {
                 new OnSuggestionUpdateListener());
         mBssidBlocklistMonitor = mWifiInjector.getBssidBlocklistMonitor();
         mWifiChannelUtilization = mWifiInjector.getWifiChannelUtilizationScan();
+        mConnectionPhaseTracer = mWifiInjector.getConnectionPhaseTracer();
         mNetworkSelector.setWifiChannelUtilization(mWifiChannelUtilization);
         mWifiScoreCard = scoreCard;
     }
@@ -911,6 +913,8 @@ public class WifiConnectivityManager {
             return;
         }
         noteConnectionAttempt(elapsedTimeMillis);
+        mConnectionPhaseTracer.trace(ConnectionPhaseTracer.PHASE_NETWORK_SELECTED,
+                candidate.networkId, targetBssid);
 
         mLastConnectionAttemptBssid = targetBssid;
 
@@ -1864,7 +1868,8 @@ public class WifiConnectivityManager {
         mScanner = mWifiInjector.getWifiScanner();
         checkNotNull(mScanner);
         // Register for all single scan results
-        mScanner.registerScanListener(new HandlerExecutor(mEventHandler), mAllSingleScanListener);
+        mWifiInjector.getInProcessScanResultsDispatcher().registerScanListener(
+                new HandlerExecutor(mEventHandler), mAllSingleScanListener);
     }
 
     /**
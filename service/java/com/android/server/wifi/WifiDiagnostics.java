@@ -20,6 +20,8 @@ import android.annotation.NonNull;
 import android.content.Context;
 import android.os.BugreportManager;
 import android.os.BugreportParams;
+import android.os.Handler;
+import android.os.Looper;
 import android.util.ArraySet;
 import android.util.Base64;
 import android.util.Log;
@@ -27,6 +29,7 @@ import android.util.SparseLongArray;
 
 import com.android.internal.annotations.VisibleForTesting;
 import com.android.server.wifi.util.ByteArrayRingBuffer;
+import com.android.server.wifi.util.CompressedRingBuffer;
 import com.android.server.wifi.util.StringUtil;
 import com.android.wifi.resources.R;
 
@@ -115,6 +118,9 @@ class WifiDiagnostics extends BaseWifiDiagnostics {
     @VisibleForTesting
     public static final long LOGCAT_READ_TIMEOUT_MILLIS = 50;
 
+    // Number of ring buffer bytes compressed together in incremental snapshot mode
+    private static final int SNAPSHOT_SEGMENT_BYTES = 16 * 1024;
+
     private long mLastBugReportTime;
 
     @VisibleForTesting public static final String FIRMWARE_DUMP_SECTION_HEADER =
@@ -135,13 +141,29 @@ class WifiDiagnostics extends BaseWifiDiagnostics {
     private int mMaxRingBufferSizeBytes;
     private WifiInjector mWifiInjector;
     private Clock mClock;
+    private final Handler mBackgroundHandler;
+    /**
+     * In incremental snapshot mode, ring buffer data is compressed as it arrives into a rolling
+     * snapshot, and capturing bug report data only requests the latest ring buffer data, then
+     * freezes the snapshot once it arrived. The latest data and the firmware and driver dumps are
+     * requested on the async call lane of the HAL, and logs are collected in the background, on
+     * |mBackgroundHandler|, except for dumps, which wait for the report anyway.
+     */
+    private final boolean mIncrementalSnapshotEnabled;
+
+    /** Latency of captureBugReportData() and captureAlertData() */
+    private int mNumCaptures;
+    private long mTotalCaptureLatencyMicros;
+    private long mMaxCaptureLatencyMicros;
+    private long mLastCaptureLatencyMicros;
 
     /** Interfaces started logging */
     private final Set<String> mActiveInterfaces = new ArraySet<>();
 
     public WifiDiagnostics(Context context, WifiInjector wifiInjector,
                            WifiNative wifiNative, BuildProperties buildProperties,
-                           LastMileLogger lastMileLogger, Clock clock) {
+                           LastMileLogger lastMileLogger, Clock clock,
+                           Looper backgroundLooper) {
         super(wifiNative);
 
         mContext = context;
@@ -153,6 +175,9 @@ class WifiDiagnostics extends BaseWifiDiagnostics {
         mWifiMetrics = wifiInjector.getWifiMetrics();
         mWifiInjector = wifiInjector;
         mClock = clock;
+        mBackgroundHandler = new Handler(backgroundLooper);
+        mIncrementalSnapshotEnabled = context.getResources().getBoolean(
+                R.bool.config_wifiDiagnosticsIncrementalSnapshotEnabled);
     }
 
     /**
@@ -252,13 +277,16 @@ class WifiDiagnostics extends BaseWifiDiagnostics {
 
     @Override
     public synchronized void captureBugReportData(int reason) {
+        long startNanos = mClock.getElapsedSinceBootNanos();
         BugReport report = captureBugreport(reason, isVerboseLoggingEnabled());
         mLastBugReports.addLast(report);
         flushDump(reason);
+        noteCaptureLatency(startNanos);
     }
 
     @Override
     public synchronized void captureAlertData(int errorCode, byte[] alertData) {
+        long startNanos = mClock.getElapsedSinceBootNanos();
         BugReport report = captureBugreport(errorCode, isVerboseLoggingEnabled());
         report.alertData = alertData;
         mLastAlerts.addLast(report);
@@ -268,6 +296,15 @@ class WifiDiagnostics extends BaseWifiDiagnostics {
                 .boxed().collect(Collectors.toList()).contains(errorCode)) {
             flushDump(REPORT_REASON_FATAL_FW_ALERT);
         }
+        noteCaptureLatency(startNanos);
+    }
+
+    private void noteCaptureLatency(long startNanos) {
+        long latencyMicros = (mClock.getElapsedSinceBootNanos() - startNanos) / 1000;
+        mNumCaptures++;
+        mTotalCaptureLatencyMicros += latencyMicros;
+        mMaxCaptureLatencyMicros = Math.max(mMaxCaptureLatencyMicros, latencyMicros);
+        mLastCaptureLatencyMicros = latencyMicros;
     }
 
     @Override
@@ -289,6 +326,11 @@ class WifiDiagnostics extends BaseWifiDiagnostics {
         }
 
         pw.println("Last Flush Time: " + mLastDumpTime.toString());
+        pw.println("Bug report capture latency (incremental snapshot "
+                + (mIncrementalSnapshotEnabled ? "enabled" : "disabled") + "): count="
+                + mNumCaptures + " avg=" + mTotalCaptureLatencyMicros / Math.max(mNumCaptures, 1)
+                + "us max=" + mMaxCaptureLatencyMicros + "us last=" + mLastCaptureLatencyMicros
+                + "us");
         pw.println("--------------------------------------------------------------------");
 
         dumpPacketFates(pw);
@@ -330,6 +372,9 @@ class WifiDiagnostics extends BaseWifiDiagnostics {
         long kernelTimeNanos;
         int errorCode;
         HashMap<String, byte[][]> ringBuffers = new HashMap();
+        // Frozen snapshots of the ring buffers, in incremental snapshot mode. Each segment is an
+        // independent zlib stream.
+        HashMap<String, byte[][]> compressedRingBuffers = new HashMap();
         byte[] fwMemoryDump;
         byte[] mDriverStateDump;
         byte[] alertData;
@@ -398,6 +443,16 @@ class WifiDiagnostics extends BaseWifiDiagnostics {
                 builder.append("\n");
             }
 
+            for (HashMap.Entry<String, byte[][]> e : compressedRingBuffers.entrySet()) {
+                byte[][] segments = e.getValue();
+                builder.append("ring-buffer = ").append(e.getKey()).append(" (")
+                        .append(segments.length).append(" compressed segments)\n");
+                for (byte[] segment : segments) {
+                    builder.append(Base64.encodeToString(segment, Base64.DEFAULT));
+                }
+                builder.append("\n");
+            }
+
             if (fwMemoryDump != null) {
                 builder.append(FIRMWARE_DUMP_SECTION_HEADER);
                 builder.append("\n");
@@ -449,6 +504,7 @@ class WifiDiagnostics extends BaseWifiDiagnostics {
     private final LimitedCircularArray<BugReport> mLastBugReports =
             new LimitedCircularArray<BugReport>(MAX_BUG_REPORTS);
     private final HashMap<String, ByteArrayRingBuffer> mRingBufferData = new HashMap();
+    private final HashMap<String, CompressedRingBuffer> mRingBufferSnapshots = new HashMap();
 
     private final WifiNative.WifiLoggerEventHandler mHandler =
             new WifiNative.WifiLoggerEventHandler() {
@@ -464,6 +520,13 @@ class WifiDiagnostics extends BaseWifiDiagnostics {
     };
 
     synchronized void onRingBufferData(WifiNative.RingBufferStatus status, byte[] buffer) {
+        if (mIncrementalSnapshotEnabled) {
+            CompressedRingBuffer snapshot = mRingBufferSnapshots.get(status.name);
+            if (snapshot != null) {
+                snapshot.append(buffer);
+            }
+            return;
+        }
         ByteArrayRingBuffer ring = mRingBufferData.get(status.name);
         if (ring != null) {
             ring.appendBuffer(buffer);
@@ -524,7 +587,12 @@ class WifiDiagnostics extends BaseWifiDiagnostics {
         if (mRingBuffers != null) {
             for (WifiNative.RingBufferStatus buffer : mRingBuffers) {
                 if (DBG) mLog.trace("RingBufferStatus is: %").c(buffer.name).flush();
-                if (mRingBufferData.containsKey(buffer.name) == false) {
+                if (mIncrementalSnapshotEnabled) {
+                    if (!mRingBufferSnapshots.containsKey(buffer.name)) {
+                        mRingBufferSnapshots.put(buffer.name, new CompressedRingBuffer(
+                                mMaxRingBufferSizeBytes, SNAPSHOT_SEGMENT_BYTES));
+                    }
+                } else if (mRingBufferData.containsKey(buffer.name) == false) {
                     mRingBufferData.put(buffer.name,
                             new ByteArrayRingBuffer(mMaxRingBufferSizeBytes));
                 }
@@ -543,6 +611,9 @@ class WifiDiagnostics extends BaseWifiDiagnostics {
         for (ByteArrayRingBuffer byteArrayRingBuffer : mRingBufferData.values()) {
             byteArrayRingBuffer.resize(mMaxRingBufferSizeBytes);
         }
+        for (CompressedRingBuffer snapshot : mRingBufferSnapshots.values()) {
+            snapshot.resize(mMaxRingBufferSizeBytes);
+        }
     }
 
     private void startLoggingRingBuffers() {
@@ -640,11 +711,29 @@ class WifiDiagnostics extends BaseWifiDiagnostics {
         report.systemTimeMs = System.currentTimeMillis();
         report.kernelTimeNanos = System.nanoTime();
 
+        // A dump (user action) waits for the report anyway, so complete it right away.
+        final boolean completeInBackground =
+                mIncrementalSnapshotEnabled && errorCode != REPORT_REASON_USER_ACTION;
         if (mRingBuffers != null) {
             for (WifiNative.RingBufferStatus buffer : mRingBuffers) {
+                final String ringName = buffer.name;
+                if (completeInBackground) {
+                    // The snapshot is frozen once the latest data was fetched, on the async call
+                    // lane, or right away if too many HAL calls are pending.
+                    if (!mWifiNative.getRingBufferDataAsync(ringName,
+                            success -> freezeRingBufferSnapshot(report, ringName))) {
+                        freezeRingBufferSnapshot(report, ringName);
+                    }
+                    continue;
+                }
                 /* this will push data in mRingBuffers */
-                mWifiNative.getRingBufferData(buffer.name);
+                mWifiNative.getRingBufferData(ringName);
+                if (mIncrementalSnapshotEnabled) {
+                    freezeRingBufferSnapshot(report, ringName);
+                    continue;
+                }
                 ByteArrayRingBuffer data = mRingBufferData.get(buffer.name);
+                if (data == null) continue;
                 byte[][] buffers = new byte[data.getNumBuffers()][];
                 for (int i = 0; i < data.getNumBuffers(); i++) {
                     buffers[i] = data.getBuffer(i).clone();
@@ -653,6 +742,23 @@ class WifiDiagnostics extends BaseWifiDiagnostics {
             }
         }
 
+        if (completeInBackground) {
+            mBackgroundHandler.post(() -> collectLogs(report));
+            if (captureFWDump) {
+                mWifiNative.getFwMemoryDumpAsync(dump -> {
+                    synchronized (this) {
+                        report.fwMemoryDump = dump;
+                    }
+                });
+                mWifiNative.getDriverStateDumpAsync(dump -> {
+                    synchronized (this) {
+                        report.mDriverStateDump = dump;
+                    }
+                });
+            }
+            return report;
+        }
+
         report.logcatLines = getLogcatSystem(127);
         report.kernelLogLines = getLogcatKernel(127);
 
@@ -663,6 +769,31 @@ class WifiDiagnostics extends BaseWifiDiagnostics {
         return report;
     }
 
+    /**
+     * Freezes the snapshot of ring |ringName| into |report|, captured in incremental snapshot
+     * mode. Called on the wifi thread once the latest ring data was fetched.
+     */
+    synchronized void freezeRingBufferSnapshot(BugReport report, String ringName) {
+        CompressedRingBuffer snapshot = mRingBufferSnapshots.get(ringName);
+        if (snapshot != null) {
+            report.compressedRingBuffers.put(ringName, snapshot.freeze());
+        }
+    }
+
+    /**
+     * Collects the logs of |report| captured in incremental snapshot mode. Runs on
+     * |mBackgroundHandler|, so that capturing the report does not wait for them. The firmware
+     * and driver dumps are requested on the async call lane of the HAL instead.
+     */
+    private void collectLogs(BugReport report) {
+        ArrayList<String> logcatLines = getLogcatSystem(127);
+        ArrayList<String> kernelLogLines = getLogcatKernel(127);
+        synchronized (this) {
+            report.logcatLines = logcatLines;
+            report.kernelLogLines = kernelLogLines;
+        }
+    }
+
     @VisibleForTesting
     LimitedCircularArray<BugReport> getBugReports() {
         return mLastBugReports;
@@ -34,6 +34,7 @@ import android.net.wifi.WifiManager.DeviceMobilityState;
 import android.net.wifi.WifiScanner;
 import android.os.Build;
 import android.os.Handler;
+import android.os.HandlerExecutor;
 import android.util.Log;
 
 import com.android.internal.annotations.VisibleForTesting;
@@ -243,7 +244,8 @@ public class WifiHealthMonitor {
         mScanner = mWifiInjector.getWifiScanner();
         if (mScanner == null) return;
         // Register for all single scan results
-        mScanner.registerScanListener(new ScanListener());
+        mWifiInjector.getInProcessScanResultsDispatcher().registerScanListener(
+                new HandlerExecutor(mHandler), new ScanListener());
     }
 
     /**
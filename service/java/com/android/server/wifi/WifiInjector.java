@@ -53,16 +53,19 @@ import com.android.server.wifi.p2p.WifiP2pMetrics;
 import com.android.server.wifi.p2p.WifiP2pMonitor;
 import com.android.server.wifi.p2p.WifiP2pNative;
 import com.android.server.wifi.rtt.RttMetrics;
+import com.android.server.wifi.scanner.InProcessScanResultsDispatcher;
 import com.android.server.wifi.util.LruConnectionTracker;
 import com.android.server.wifi.util.NetdWrapper;
 import com.android.server.wifi.util.SettingsMigrationDataHolder;
 import com.android.server.wifi.util.WifiPermissionsUtil;
 import com.android.server.wifi.util.WifiPermissionsWrapper;
 
+import java.io.PrintWriter;
 import java.security.KeyStore;
 import java.security.KeyStoreException;
 import java.security.NoSuchProviderException;
 import java.util.Random;
+import java.util.concurrent.Executor;
 
 /**
  *  WiFi dependency injector. To be used for accessing various WiFi class instances and as a
@@ -79,6 +82,8 @@ public class WifiInjector {
      * Maximum number in-memory store network connection order;
      */
     private static final int MAX_RECENTLY_CONNECTED_NETWORK = 100;
+    // Number of messages kept by the WifiLog instances created by makeBinaryLog()
+    private static final int BINARY_LOG_CAPACITY = 1024;
 
     static WifiInjector sWifiInjector = null;
 
@@ -91,6 +96,10 @@ public class WifiInjector {
     private final HandlerThread mWifiHandlerThread;
     private final HandlerThread mWifiP2pServiceHandlerThread;
     private final HandlerThread mPasspointProvisionerHandlerThread;
+    private final HandlerThread mWifiDiagnosticsHandlerThread;
+    private final HandlerThread mWifiVendorHalAsyncCallHandlerThread;
+    private final HandlerThread mCallbackBroadcastHandlerThread;
+    private final Executor mCallbackBroadcastExecutor;
     private final WifiTrafficPoller mWifiTrafficPoller;
     private final WifiCountryCode mCountryCode;
     private final BackupManagerProxy mBackupManagerProxy = new BackupManagerProxy();
@@ -103,6 +112,7 @@ public class WifiInjector {
     private final SupplicantP2pIfaceHal mSupplicantP2pIfaceHal;
     private final HostapdHal mHostapdHal;
     private final WifiVendorHal mWifiVendorHal;
+    private final BinaryLog.Buffer mBinaryLogBuffer = new BinaryLog.Buffer(BINARY_LOG_CAPACITY);
     private final ScoringParams mScoringParams;
     private final ClientModeImpl mClientModeImpl;
     private final ActiveModeWarden mActiveModeWarden;
@@ -113,6 +123,8 @@ public class WifiInjector {
     private final Clock mClock = new Clock();
     private final WifiMetrics mWifiMetrics;
     private final WifiP2pMetrics mWifiP2pMetrics;
+    private final ConnectionPhaseTracer mConnectionPhaseTracer =
+            new ConnectionPhaseTracer(mClock);
     private WifiLastResortWatchdog mWifiLastResortWatchdog;
     private final PropertyService mPropertyService = new SystemPropertyService();
     private final BuildProperties mBuildProperties = new SystemBuildProperties();
@@ -131,6 +143,7 @@ public class WifiInjector {
     private final WifiNetworkScoreCache mWifiNetworkScoreCache;
     private final NetworkScoreManager mNetworkScoreManager;
     private WifiScanner mWifiScanner;
+    private final InProcessScanResultsDispatcher mInProcessScanResultsDispatcher;
     private final WifiPermissionsWrapper mWifiPermissionsWrapper;
     private final WifiPermissionsUtil mWifiPermissionsUtil;
     private final PasspointManager mPasspointManager;
@@ -151,6 +164,7 @@ public class WifiInjector {
     private final LinkProbeManager mLinkProbeManager;
     private IpMemoryStore mIpMemoryStore;
     private final WifiThreadRunner mWifiThreadRunner;
+    private final WifiStateSnapshotPublisher mWifiStateSnapshotPublisher;
     private BssidBlocklistMonitor mBssidBlocklistMonitor;
     private final MacAddressUtil mMacAddressUtil;
     private final MboOceController mMboOceController;
@@ -210,11 +224,22 @@ public class WifiInjector {
         mSoftApBackupRestore = new SoftApBackupRestore(mContext, mSettingsMigrationDataHolder);
         mWifiStateTracker = new WifiStateTracker(mBatteryStats);
         mWifiThreadRunner = new WifiThreadRunner(wifiHandler);
+        mWifiStateSnapshotPublisher = new WifiStateSnapshotPublisher();
+        mInProcessScanResultsDispatcher = new InProcessScanResultsDispatcher();
         mWifiP2pServiceHandlerThread = new HandlerThread("WifiP2pService");
         mWifiP2pServiceHandlerThread.start();
         mPasspointProvisionerHandlerThread =
                 new HandlerThread("PasspointProvisionerHandlerThread");
         mPasspointProvisionerHandlerThread.start();
+        mWifiDiagnosticsHandlerThread = new HandlerThread("WifiDiagnosticsHandlerThread");
+        mWifiDiagnosticsHandlerThread.start();
+        mWifiVendorHalAsyncCallHandlerThread =
+                new HandlerThread("WifiVendorHalAsyncCallHandlerThread");
+        mWifiVendorHalAsyncCallHandlerThread.start();
+        mCallbackBroadcastHandlerThread = new HandlerThread("WifiCallbackBroadcastHandlerThread");
+        mCallbackBroadcastHandlerThread.start();
+        mCallbackBroadcastExecutor =
+                new HandlerExecutor(new Handler(mCallbackBroadcastHandlerThread.getLooper()));
         WifiAwareMetrics awareMetrics = new WifiAwareMetrics(mClock);
         RttMetrics rttMetrics = new RttMetrics(mClock);
         mWifiP2pMetrics = new WifiP2pMetrics(mClock);
@@ -226,7 +251,9 @@ public class WifiInjector {
         // Modules interacting with Native.
         mWifiMonitor = new WifiMonitor(this);
         mHalDeviceManager = new HalDeviceManager(mClock, wifiHandler);
-        mWifiVendorHal = new WifiVendorHal(mHalDeviceManager, wifiHandler);
+        mWifiVendorHal = new WifiVendorHal(mHalDeviceManager, wifiHandler,
+                new Handler(mWifiVendorHalAsyncCallHandlerThread.getLooper()));
+        mWifiVendorHal.setRecordingLog(makeBinaryLog("WifiVendorHal"));
         mSupplicantStaIfaceHal = new SupplicantStaIfaceHal(
                 mContext, mWifiMonitor, mFrameworkFacade, wifiHandler, mClock, mWifiMetrics);
         mHostapdHal = new HostapdHal(mContext, wifiHandler);
@@ -243,7 +270,8 @@ public class WifiInjector {
                 mPropertyService);
 
         // Now get instances of all the objects that depend on the HandlerThreads
-        mWifiTrafficPoller = new WifiTrafficPoller(wifiHandler);
+        mWifiTrafficPoller = new WifiTrafficPoller(mContext, wifiHandler,
+                mCallbackBroadcastExecutor, mClock);
         mCountryCode = new WifiCountryCode(mContext, wifiHandler, mWifiNative,
                 SystemProperties.get(BOOT_DEFAULT_WIFI_COUNTRY_CODE));
         // WifiConfigManager/Store objects and their dependencies.
@@ -329,7 +357,8 @@ public class WifiInjector {
                 mWifiNative);
         mWifiDiagnostics = new WifiDiagnostics(
                 mContext, this, mWifiNative, mBuildProperties,
-                new LastMileLogger(this), mClock);
+                new LastMileLogger(this, mWifiDiagnosticsHandlerThread.getLooper()), mClock,
+                mWifiDiagnosticsHandlerThread.getLooper());
         mWifiChannelUtilizationConnected = new WifiChannelUtilization(mClock, mContext);
         mWifiDataStall = new WifiDataStall(mFrameworkFacade, mWifiMetrics, mContext,
                 mDeviceConfigFacade, mWifiChannelUtilizationConnected, mClock, wifiHandler,
@@ -411,6 +440,7 @@ public class WifiInjector {
         mWakeupController.enableVerboseLogging(verbose);
         mWifiNetworkSuggestionsManager.enableVerboseLogging(verbose);
         LogcatLog.enableVerboseLogging(verbose);
+        BinaryLog.enableVerboseLogging(verbose);
         mDppManager.enableVerboseLogging(verbose);
         mWifiCarrierInfoManager.enableVerboseLogging(verbose);
     }
@@ -455,6 +485,14 @@ public class WifiInjector {
         return mWifiHandlerThread;
     }
 
+    /**
+     * Returns the executor which invokes the external callbacks broadcast by
+     * {@link com.android.server.wifi.util.ExternalCallbackTracker}s, off the wifi thread.
+     */
+    public Executor getCallbackBroadcastExecutor() {
+        return mCallbackBroadcastExecutor;
+    }
+
     public WifiTrafficPoller getWifiTrafficPoller() {
         return mWifiTrafficPoller;
     }
@@ -495,6 +533,10 @@ public class WifiInjector {
         return mClock;
     }
 
+    public ConnectionPhaseTracer getConnectionPhaseTracer() {
+        return mConnectionPhaseTracer;
+    }
+
     public PropertyService getPropertyService() {
         return mPropertyService;
     }
@@ -584,6 +626,22 @@ public class WifiInjector {
         return new LogcatLog(tag);
     }
 
+    /**
+     * Create a WifiLog instance which records messages into an in-memory ring, formatted only
+     * when dumped. Suited to chatty modules; see {@link BinaryLog}.
+     * @param tag module name to include in all log messages
+     */
+    public WifiLog makeBinaryLog(String tag) {
+        return new BinaryLog(tag, mBinaryLogBuffer);
+    }
+
+    /**
+     * Dump the messages logged to the WifiLog instances created by {@link #makeBinaryLog(String)}.
+     */
+    public void dumpBinaryLog(PrintWriter pw) {
+        mBinaryLogBuffer.dump(pw);
+    }
+
     public BaseWifiDiagnostics getWifiDiagnostics() {
         return mWifiDiagnostics;
     }
@@ -600,6 +658,14 @@ public class WifiInjector {
         return mWifiScanner;
     }
 
+    /**
+     * Obtain the dispatcher of scan results to listeners in the wifi service process. Unlike
+     * {@link #getWifiScanner()}, it is available before WifiScanningService is created.
+     */
+    public InProcessScanResultsDispatcher getInProcessScanResultsDispatcher() {
+        return mInProcessScanResultsDispatcher;
+    }
+
     /**
      * Construct a new instance of WifiConnectivityManager & its dependencies.
      *
@@ -809,6 +875,10 @@ public class WifiInjector {
         return mWifiThreadRunner;
     }
 
+    public WifiStateSnapshotPublisher getWifiStateSnapshotPublisher() {
+        return mWifiStateSnapshotPublisher;
+    }
+
     public WifiChannelUtilization getWifiChannelUtilizationScan() {
         return mWifiChannelUtilizationScan;
     }
@@ -19,6 +19,7 @@ package com.android.server.wifi;
 import android.content.Context;
 import android.net.wifi.ScanResult;
 import android.net.wifi.WifiConfiguration;
+import android.net.wifi.WifiInfo;
 import android.os.Handler;
 import android.os.Looper;
 import android.os.Message;
@@ -28,6 +29,7 @@ import android.util.Log;
 import android.util.Pair;
 
 import com.android.internal.annotations.VisibleForTesting;
+import com.android.server.wifi.util.BssidHistoryRecorder;
 import com.android.wifi.resources.R;
 
 import java.io.FileDescriptor;
@@ -76,6 +78,11 @@ public class WifiLastResortWatchdog {
     public static final String BUGREPORT_TITLE = "Wifi watchdog triggered";
     public static final double PROB_TAKE_BUGREPORT_DEFAULT = 1;
 
+    // Events recorded in the connection failure history.
+    private static final int HISTORY_EVENT_CONNECTION_FAILURE = 0;
+    private static final int HISTORY_EVENT_TRIGGER = 1;
+    private static final int HISTORY_SIZE = 100;
+
     // Number of milliseconds to wait before re-enable Watchdog triger
     @VisibleForTesting
     public static final long LAST_TRIGGER_TIMEOUT_MILLIS = 2 * 3600 * 1000; // 2 hours
@@ -127,6 +134,13 @@ public class WifiLastResortWatchdog {
      */
     private final LocalLog mLocalLog = new LocalLog(100);
 
+    /**
+     * History of the connection failures noted, and of the triggers they caused.
+     */
+    private final BssidHistoryRecorder mFailureHistory = new BssidHistoryRecorder(HISTORY_SIZE,
+            event -> event == HISTORY_EVENT_TRIGGER ? "trigger" : "connection failure",
+            WifiLastResortWatchdog::getFailureCodeString);
+
     WifiLastResortWatchdog(WifiInjector wifiInjector, Context context, Clock clock,
             WifiMetrics wifiMetrics, ClientModeImpl clientModeImpl, Looper clientModeImplLooper,
             DeviceConfigFacade deviceConfigFacade, WifiThreadRunner wifiThreadRunner) {
@@ -299,6 +313,9 @@ public class WifiLastResortWatchdog {
 
         // Update failure count for the failing network
         updateFailureCountForNetwork(ssid, bssid, reason);
+        mFailureHistory.record(mClock.getWallClockMillis(), ssid,
+                BssidHistoryRecorder.packBssid(bssid), HISTORY_EVENT_CONNECTION_FAILURE, reason,
+                WifiInfo.INVALID_RSSI, getSsidFailureCount(ssid));
 
         // If watchdog is not allowed to trigger it means a wifi restart is already triggered
         if (!mWatchdogAllowedToTrigger) {
@@ -319,6 +336,9 @@ public class WifiLastResortWatchdog {
                 loge("Watchdog triggering recovery");
                 mSsidLastTrigger = ssid;
                 mTimeLastTrigger = mClock.getElapsedSinceBootMillis();
+                mFailureHistory.record(mClock.getWallClockMillis(), ssid,
+                        BssidHistoryRecorder.packBssid(bssid), HISTORY_EVENT_TRIGGER, reason,
+                        WifiInfo.INVALID_RSSI, getSsidFailureCount(ssid));
                 localLog(toString());
                 mWifiInjector.getSelfRecovery().trigger(SelfRecovery.REASON_LAST_RESORT_WATCHDOG);
                 incrementWifiMetricsTriggerCounts();
@@ -417,6 +437,32 @@ public class WifiLastResortWatchdog {
         }
     }
 
+    /**
+     * Returns the number of failures counted for the given ssid, of all failure types.
+     */
+    private int getSsidFailureCount(String ssid) {
+        Pair<AvailableNetworkFailureCount, Integer> ssidFails = mSsidFailureCount.get(ssid);
+        if (ssidFails == null) {
+            return 0;
+        }
+        AvailableNetworkFailureCount failureCount = ssidFails.first;
+        return failureCount.associationRejection + failureCount.authenticationFailure
+                + failureCount.dhcpFailure;
+    }
+
+    private static String getFailureCodeString(int reason) {
+        switch (reason) {
+            case FAILURE_CODE_ASSOCIATION:
+                return "FAILURE_CODE_ASSOCIATION";
+            case FAILURE_CODE_AUTHENTICATION:
+                return "FAILURE_CODE_AUTHENTICATION";
+            case FAILURE_CODE_DHCP:
+                return "FAILURE_CODE_DHCP";
+            default:
+                return "FAILURE_CODE_UNKNOWN(" + reason + ")";
+        }
+    }
+
     /**
      * Update the per-SSID failure count
      * @param ssid the ssid to increment failure count for
@@ -827,5 +873,8 @@ public class WifiLastResortWatchdog {
         pw.println("WifiLastResortWatchdog - Log Begin ----");
         mLocalLog.dump(fd, pw, args);
         pw.println("WifiLastResortWatchdog - Log End ----");
+        pw.println("WifiLastResortWatchdog - Failure history begin ----");
+        mFailureHistory.dump(pw);
+        pw.println("WifiLastResortWatchdog - Failure history end ----");
     }
 }
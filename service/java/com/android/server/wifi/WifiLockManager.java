@@ -26,6 +26,7 @@ import android.os.IBinder;
 import android.os.RemoteException;
 import android.os.WorkSource;
 import android.os.WorkSource.WorkChain;
+import android.util.ArrayMap;
 import android.util.Log;
 import android.util.Pair;
 import android.util.SparseArray;
@@ -34,7 +35,7 @@ import com.android.server.wifi.proto.WifiStatsLog;
 import com.android.server.wifi.util.WorkSourceUtil;
 
 import java.io.PrintWriter;
-import java.util.ArrayList;
+import java.util.LinkedHashMap;
 import java.util.List;
 import java.util.NoSuchElementException;
 
@@ -65,9 +66,19 @@ public class WifiLockManager {
     private final WifiMetrics mWifiMetrics;
     private final WifiNative mWifiNative;
 
-    private final List<WifiLock> mWifiLocks = new ArrayList<>();
+    // Held locks by binder, in the order they were acquired
+    private final LinkedHashMap<IBinder, WifiLock> mWifiLocks = new LinkedHashMap<>();
     // map UIDs to their corresponding records (for low-latency locks)
     private final SparseArray<UidRec> mLowLatencyUidWatchList = new SparseArray<>();
+    // Number of UIDs in the low-latency watch list running in foreground
+    private int mFgLowLatencyUidCount;
+    // Number of held locks attributed to each WorkSource entry, keyed by (uid, name) pairs for
+    // plain entries and by WorkChain for chained ones.
+    private final ArrayMap<Object, Integer> mAttributionLockCounts = new ArrayMap<>();
+    // Union of the WorkSources of all held locks. Replaced, never modified, when it changes.
+    private volatile WorkSource mMergedWorkSource = new WorkSource();
+    // Strongest lock mode, published whenever the op mode is recalculated.
+    private volatile int mStrongestLockMode = WifiManager.WIFI_MODE_NO_LOCKS_HELD;
     private int mCurrentOpMode;
     private boolean mScreenOn = false;
     private boolean mWifiConnected = false;
@@ -161,6 +172,7 @@ public class WifiLockManager {
                     }
 
                     uidRec.mIsFg = newModeIsFg;
+                    mFgLowLatencyUidCount += newModeIsFg ? 1 : -1;
                     updateOpMode();
 
                     // If conditions for lock activation are met,
@@ -208,9 +220,17 @@ public class WifiLockManager {
      *
      * If no locks are held, WifiManager.WIFI_MODE_NO_LOCKS_HELD is returned.
      *
+     * The mode is published whenever the lock state changes, so this can be called from any
+     * thread without locking.
+     *
      * @return int representing the currently held (highest power consumption) lock.
      */
-    public synchronized int getStrongestLockMode() {
+    public int getStrongestLockMode() {
+        return mStrongestLockMode;
+    }
+
+    // Recalculates the strongest lock mode from the lock counts, in constant time.
+    private int computeStrongestLockMode() {
         // If Wifi Client is not connected, then all locks are not effective
         if (!mWifiConnected) {
             return WifiManager.WIFI_MODE_NO_LOCKS_HELD;
@@ -226,7 +246,7 @@ public class WifiLockManager {
             return WifiManager.WIFI_MODE_FULL_LOW_LATENCY;
         }
 
-        if (mScreenOn && countFgLowLatencyUids() > 0) {
+        if (mScreenOn && mFgLowLatencyUidCount > 0) {
             return WifiManager.WIFI_MODE_FULL_LOW_LATENCY;
         }
 
@@ -239,13 +259,12 @@ public class WifiLockManager {
 
     /**
      * Method to create a WorkSource containing all active WifiLock WorkSources.
+     *
+     * The union is maintained as locks are acquired and released, so this only copies it, and
+     * can be called from any thread without locking.
      */
-    public synchronized WorkSource createMergedWorkSource() {
-        WorkSource mergedWS = new WorkSource();
-        for (WifiLock lock : mWifiLocks) {
-            mergedWS.add(lock.getWorkSource());
-        }
-        return mergedWS;
+    public WorkSource createMergedWorkSource() {
+        return new WorkSource(mMergedWorkSource);
     }
 
     /**
@@ -294,7 +313,10 @@ public class WifiLockManager {
                 break;
         }
 
+        WorkSource oldWorkSource = wl.mWorkSource;
         wl.mWorkSource = newWorkSource;
+        addToMergedWorkSource(newWorkSource);
+        removeFromMergedWorkSource(oldWorkSource);
     }
 
     /**
@@ -309,6 +331,7 @@ public class WifiLockManager {
         if (!updateOpMode()) {
             Log.e(TAG, "Failed to force hi-perf mode, returning to normal mode");
             mForceHiPerfMode = false;
+            mStrongestLockMode = computeStrongestLockMode();
             return false;
         }
         return true;
@@ -326,6 +349,7 @@ public class WifiLockManager {
         if (!updateOpMode()) {
             Log.e(TAG, "Failed to force low-latency mode, returning to normal mode");
             mForceLowLatencyMode = false;
+            mStrongestLockMode = computeStrongestLockMode();
             return false;
         }
         return true;
@@ -375,7 +399,7 @@ public class WifiLockManager {
     }
 
     private void setBlameHiPerfLocks(boolean shouldBlame) {
-        for (WifiLock lock : mWifiLocks) {
+        for (WifiLock lock : mWifiLocks.values()) {
             if (lock.mMode == WifiManager.WIFI_MODE_FULL_HIGH_PERF) {
                 setBlameHiPerfWs(lock.getWorkSource(), shouldBlame);
             }
@@ -410,6 +434,7 @@ public class WifiLockManager {
             // Now check if the uid is running in foreground
             if (mFrameworkFacade.isAppForeground(mContext, uid)) {
                 uidRec.mIsFg = true;
+                mFgLowLatencyUidCount++;
             }
 
             if (canActivateLowLatencyLock(0, uidRec)) {
@@ -433,6 +458,9 @@ public class WifiLockManager {
         }
         if (uidRec.mLockCount == 0) {
             mLowLatencyUidWatchList.remove(uid);
+            if (uidRec.mIsFg) {
+                mFgLowLatencyUidCount--;
+            }
 
             // Remove blame for this UID if it was alerady set
             // Note that blame needs to be stopped only if it was started before
@@ -489,7 +517,8 @@ public class WifiLockManager {
             return false;
         }
 
-        mWifiLocks.add(lock);
+        mWifiLocks.put(lock.getBinder(), lock);
+        addToMergedWorkSource(lock.getWorkSource());
 
         switch(lock.mMode) {
             case WifiManager.WIFI_MODE_FULL_HIGH_PERF:
@@ -515,14 +544,84 @@ public class WifiLockManager {
     }
 
     private synchronized WifiLock removeLock(IBinder binder) {
-        WifiLock lock = findLockByBinder(binder);
+        WifiLock lock = mWifiLocks.remove(binder);
         if (lock != null) {
-            mWifiLocks.remove(lock);
+            removeFromMergedWorkSource(lock.getWorkSource());
             lock.unlinkDeathRecipient();
         }
         return lock;
     }
 
+    /**
+     * Counts the entries of |ws| as attributed to one more lock, and adds |ws| to the merged
+     * WorkSource if any of them was not attributed to a lock yet.
+     */
+    private void addToMergedWorkSource(WorkSource ws) {
+        boolean added = false;
+        for (int i = 0; i < ws.size(); i++) {
+            added |= incrementAttributionLockCount(Pair.create(ws.getUid(i),
+                    ws.getPackageName(i)));
+        }
+        final List<WorkChain> workChains = ws.getWorkChains();
+        if (workChains != null) {
+            for (int i = 0; i < workChains.size(); i++) {
+                added |= incrementAttributionLockCount(workChains.get(i));
+            }
+        }
+        if (added) {
+            WorkSource merged = new WorkSource(mMergedWorkSource);
+            merged.add(ws);
+            mMergedWorkSource = merged;
+        }
+    }
+
+    /**
+     * Counts the entries of |ws| as attributed to one less lock, and rebuilds the merged
+     * WorkSource from the locks still held if any of them is no longer attributed to a lock.
+     */
+    private void removeFromMergedWorkSource(WorkSource ws) {
+        boolean removed = false;
+        for (int i = 0; i < ws.size(); i++) {
+            removed |= decrementAttributionLockCount(Pair.create(ws.getUid(i),
+                    ws.getPackageName(i)));
+        }
+        final List<WorkChain> workChains = ws.getWorkChains();
+        if (workChains != null) {
+            for (int i = 0; i < workChains.size(); i++) {
+                removed |= decrementAttributionLockCount(workChains.get(i));
+            }
+        }
+        if (removed) {
+            WorkSource merged = new WorkSource();
+            for (WifiLock lock : mWifiLocks.values()) {
+                merged.add(lock.getWorkSource());
+            }
+            mMergedWorkSource = merged;
+        }
+    }
+
+    // Returns true if |attribution| was not attributed to any lock before.
+    private boolean incrementAttributionLockCount(Object attribution) {
+        Integer count = mAttributionLockCounts.get(attribution);
+        mAttributionLockCounts.put(attribution, count == null ? 1 : count + 1);
+        return count == null;
+    }
+
+    // Returns true if |attribution| is no longer attributed to any lock.
+    private boolean decrementAttributionLockCount(Object attribution) {
+        Integer count = mAttributionLockCounts.get(attribution);
+        if (count == null) {
+            Log.e(TAG, "Failed to find attribution of released lock");
+            return false;
+        }
+        if (count > 1) {
+            mAttributionLockCounts.put(attribution, count - 1);
+            return false;
+        }
+        mAttributionLockCounts.remove(attribution);
+        return true;
+    }
+
     private synchronized boolean releaseLock(IBinder binder) {
         WifiLock wifiLock = removeLock(binder);
         if (wifiLock == null) {
@@ -564,7 +663,8 @@ public class WifiLockManager {
     }
 
     private synchronized boolean updateOpMode() {
-        final int newLockMode = getStrongestLockMode();
+        final int newLockMode = computeStrongestLockMode();
+        mStrongestLockMode = newLockMode;
 
         if (newLockMode == mCurrentOpMode) {
             // No action is needed
@@ -689,24 +789,7 @@ public class WifiLockManager {
     }
 
     private synchronized WifiLock findLockByBinder(IBinder binder) {
-        for (WifiLock lock : mWifiLocks) {
-            if (lock.getBinder() == binder) {
-                return lock;
-            }
-        }
-        return null;
-    }
-
-    private int countFgLowLatencyUids() {
-        int uidCount = 0;
-        int listSize = mLowLatencyUidWatchList.size();
-        for (int idx = 0; idx < listSize; idx++) {
-            UidRec uidRec = mLowLatencyUidWatchList.valueAt(idx);
-            if (uidRec.mIsFg) {
-                uidCount++;
-            }
-        }
-        return uidCount;
+        return mWifiLocks.get(binder);
     }
 
     private void setBlameHiPerfWs(WorkSource ws, boolean shouldBlame) {
@@ -772,7 +855,7 @@ public class WifiLockManager {
 
         pw.println();
         pw.println("Locks held:");
-        for (WifiLock lock : mWifiLocks) {
+        for (WifiLock lock : mWifiLocks.values()) {
             pw.print("    ");
             pw.println(lock);
         }
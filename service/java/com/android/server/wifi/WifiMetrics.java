@@ -48,6 +48,7 @@ import android.telephony.TelephonyManager;
 import android.text.TextUtils;
 import android.util.ArrayMap;
 import android.util.Base64;
+import android.util.Base64OutputStream;
 import android.util.Log;
 import android.util.Pair;
 import android.util.SparseArray;
@@ -106,14 +107,22 @@ import com.android.server.wifi.util.IntCounter;
 import com.android.server.wifi.util.IntHistogram;
 import com.android.server.wifi.util.MetricsUtils;
 import com.android.server.wifi.util.ObjectCounter;
+import com.android.server.wifi.util.ObjectRingBuffer;
+import com.android.server.wifi.util.QuantileSketch;
 import com.android.server.wifi.util.ScanResultUtil;
+import com.android.server.wifi.util.ShardedCounters;
+import com.android.server.wifi.util.StreamingProtoWriter;
 import com.android.wifi.resources.R;
 
+import com.google.protobuf.nano.MessageNano;
+
 import org.json.JSONArray;
 import org.json.JSONException;
 import org.json.JSONObject;
 
 import java.io.FileDescriptor;
+import java.io.IOException;
+import java.io.OutputStream;
 import java.io.PrintWriter;
 import java.util.ArrayList;
 import java.util.Arrays;
@@ -126,6 +135,7 @@ import java.util.List;
 import java.util.Map;
 import java.util.Random;
 import java.util.Set;
+import java.util.concurrent.ConcurrentHashMap;
 
 /**
  * Provides storage for wireless connectivity metrics, as they are generated.
@@ -159,6 +169,14 @@ public class WifiMetrics {
     static final int LOW_WIFI_USABILITY_SCORE = 50; // Mobile data score
     private final Object mLock = new Object();
     private static final int MAX_CONNECTION_EVENTS = 256;
+    // Field numbers of the WifiLog repeated fields encoded one element at a time when dumping
+    private static final int WIFI_LOG_CONNECTION_EVENT_FIELD = 1;
+    private static final int WIFI_LOG_RSSI_POLL_RSSI_COUNT_FIELD = 35;
+    private static final int WIFI_LOG_STA_EVENT_LIST_FIELD = 52;
+    private static final int WIFI_LOG_WIFI_IS_UNUSABLE_EVENT_LIST_FIELD = 120;
+    private static final int WIFI_LOG_LINK_SPEED_COUNTS_FIELD = 121;
+    private static final int WIFI_LOG_WIFI_USABILITY_STATS_LIST_FIELD = 126;
+    private static final int WIFI_LOG_USER_ACTION_EVENTS_FIELD = 192;
     // Largest bucket in the NumConnectableNetworkCount histogram,
     // anything large will be stored in this bucket
     public static final int MAX_CONNECTABLE_SSID_NETWORK_BUCKET = 20;
@@ -234,8 +252,10 @@ public class WifiMetrics {
 
     public static final int MAX_STA_EVENTS = 768;
     @VisibleForTesting static final int MAX_USER_ACTION_EVENTS = 200;
-    private LinkedList<StaEventWithTime> mStaEventList = new LinkedList<>();
-    private LinkedList<UserActionEventWithTime> mUserActionEventList = new LinkedList<>();
+    private final ObjectRingBuffer<StaEventWithTime> mStaEventList =
+            new ObjectRingBuffer<>(MAX_STA_EVENTS);
+    private final ObjectRingBuffer<UserActionEventWithTime> mUserActionEventList =
+            new ObjectRingBuffer<>(MAX_USER_ACTION_EVENTS);
     private WifiStatusBuilder mWifiStatusBuilder = new WifiStatusBuilder();
     private int mLastPollRssi = -127;
     private int mLastPollLinkSpeed = -1;
@@ -254,7 +274,8 @@ public class WifiMetrics {
     /**
      * Session information that gets logged for every Wifi connection attempt.
      */
-    private final List<ConnectionEvent> mConnectionEventList = new ArrayList<>();
+    private final ObjectRingBuffer<ConnectionEvent> mConnectionEventList =
+            new ObjectRingBuffer<>(MAX_CONNECTION_EVENTS);
     /**
      * The latest started (but un-ended) connection attempt
      */
@@ -270,6 +291,44 @@ public class WifiMetrics {
     private final SparseIntArray mWifiSystemStateEntries = new SparseIntArray();
     /** Mapping of channel frequency to its RSSI distribution histogram **/
     private final Map<Integer, SparseIntArray> mRssiPollCountsMap = new HashMap<>();
+
+    // Ids of the high frequency counters kept in mHotCounters. These are updated without holding
+    // mLock and merged into mWifiLogProto and the maps above by mergeHotCountersLocked().
+    private static final int HOT_COUNTER_NON_EMPTY_SCAN_RESULTS = 0;
+    private static final int HOT_COUNTER_EMPTY_SCAN_RESULTS = 1;
+    private static final int HOT_COUNTER_BACKGROUND_SCANS = 2;
+    private static final int HOT_COUNTER_ONESHOT_SCANS = 3;
+    private static final int HOT_COUNTER_ONESHOT_HAS_DFS_CHANNEL_SCANS = 4;
+    private static final int HOT_COUNTER_CONNECTIVITY_ONESHOT_SCANS = 5;
+    private static final int HOT_COUNTER_EXTERNAL_APP_ONESHOT_SCAN_REQUESTS = 6;
+    private static final int HOT_COUNTER_EXTERNAL_FOREGROUND_APP_SCANS_THROTTLED = 7;
+    private static final int HOT_COUNTER_EXTERNAL_BACKGROUND_APP_SCANS_THROTTLED = 8;
+    private static final int HOT_COUNTER_PNO_SCAN_ATTEMPTS = 9;
+    private static final int HOT_COUNTER_PNO_SCAN_FAILED = 10;
+    private static final int HOT_COUNTER_PNO_FOUND_NETWORK_EVENTS = 11;
+    // Followed by one counter per WifiLog.ScanReturnCode.
+    private static final int HOT_COUNTER_SCAN_RETURN_ENTRY_BASE = 12;
+    private static final int NUM_SCAN_RETURN_CODES =
+            WifiMetricsProto.WifiLog.FAILURE_WIFI_DISABLED + 1;
+    // Followed by one counter per mWifiSystemStateEntries index.
+    private static final int HOT_COUNTER_SYSTEM_STATE_ENTRY_BASE =
+            HOT_COUNTER_SCAN_RETURN_ENTRY_BASE + NUM_SCAN_RETURN_CODES;
+    private static final int NUM_SYSTEM_STATE_ENTRIES =
+            (WifiMetricsProto.WifiLog.WIFI_ASSOCIATED + 1) * 2;
+    private static final int NUM_HOT_COUNTERS =
+            HOT_COUNTER_SYSTEM_STATE_ENTRY_BASE + NUM_SYSTEM_STATE_ENTRIES;
+    private final ShardedCounters mHotCounters = new ShardedCounters(NUM_HOT_COUNTERS);
+    /**
+     * Mapping of channel frequency to its RSSI poll counts, indexed by (rssi - MIN_RSSI_POLL).
+     * Merged into mRssiPollCountsMap by mergeHotCountersLocked().
+     * Counters are kept for at most MAX_RSSI_POLL_HOT_FREQUENCIES frequencies, the polls on
+     * other frequencies are counted in mRssiPollCountsMap directly.
+     */
+    private final Map<Integer, ShardedCounters> mRssiPollHotCounters = new ConcurrentHashMap<>();
+    @VisibleForTesting
+    static final int MAX_RSSI_POLL_HOT_FREQUENCIES = 16;
+    // RSSI polls are mostly made from the wifi thread, so a couple of stripes are enough.
+    private static final int RSSI_POLL_HOT_COUNTER_STRIPES = 2;
     /** Mapping of RSSI scan-poll delta values to counts. */
     private final SparseIntArray mRssiDeltaCounts = new SparseIntArray();
     /** Mapping of link speed values to LinkSpeedCount objects. */
@@ -291,11 +350,20 @@ public class WifiMetrics {
     private final IntCounter mRxLinkSpeedCount6gMid = new IntCounter();
     private final IntCounter mRxLinkSpeedCount6gHigh = new IntCounter();
 
+    /** Number of supplicant network HIDL calls issued per connection attempt */
+    private final IntCounter mSupplicantNetworkHidlCallsPerConnect = new IntCounter();
+
+    // Relative accuracy of the latency sketches, 1%
+    private static final int LATENCY_SKETCH_ACCURACY_PPM = 10000;
+    /** Time taken by successful connection attempts, in milliseconds */
+    private final QuantileSketch mSuccessfulConnectionDurationMsSketch =
+            new QuantileSketch(LATENCY_SKETCH_ACCURACY_PPM);
+
     /** RSSI of the scan result for the last connection event*/
     private int mScanResultRssi = 0;
     /** Boot-relative timestamp when the last candidate scanresult was received, used to calculate
         RSSI deltas. -1 designates no candidate scanResult being tracked */
-    private long mScanResultRssiTimestampMillis = -1;
+    private volatile long mScanResultRssiTimestampMillis = -1;
     /** Mapping of alert reason to the respective alert count. */
     private final SparseIntArray mWifiAlertReasonCounts = new SparseIntArray();
     /**
@@ -380,8 +448,8 @@ public class WifiMetrics {
     private int mLinkProbeStaEventCount = 0;
     @VisibleForTesting static final int MAX_LINK_PROBE_STA_EVENTS = MAX_STA_EVENTS / 4;
 
-    private final LinkedList<WifiUsabilityStatsEntry> mWifiUsabilityStatsEntriesList =
-            new LinkedList<>();
+    private final ObjectRingBuffer<WifiUsabilityStatsEntry> mWifiUsabilityStatsEntriesList =
+            new ObjectRingBuffer<>(MAX_WIFI_USABILITY_STATS_ENTRIES_LIST_SIZE);
     private final LinkedList<WifiUsabilityStats> mWifiUsabilityStatsListBad = new LinkedList<>();
     private final LinkedList<WifiUsabilityStats> mWifiUsabilityStatsListGood = new LinkedList<>();
     private int mWifiUsabilityStatsCounter = 0;
@@ -1470,27 +1538,21 @@ public class WifiMetrics {
      * Increment total number of attempts to start a pno scan
      */
     public void incrementPnoScanStartAttemptCount() {
-        synchronized (mLock) {
-            mPnoScanMetrics.numPnoScanAttempts++;
-        }
+        mHotCounters.increment(HOT_COUNTER_PNO_SCAN_ATTEMPTS);
     }
 
     /**
      * Increment total number of attempts with pno scan failed
      */
     public void incrementPnoScanFailedCount() {
-        synchronized (mLock) {
-            mPnoScanMetrics.numPnoScanFailed++;
-        }
+        mHotCounters.increment(HOT_COUNTER_PNO_SCAN_FAILED);
     }
 
     /**
      * Increment number of times pno scan found a result
      */
     public void incrementPnoFoundNetworkEventCount() {
-        synchronized (mLock) {
-            mPnoScanMetrics.numPnoFoundNetworkEvents++;
-        }
+        mHotCounters.increment(HOT_COUNTER_PNO_FOUND_NETWORK_EVENTS);
     }
 
     // Values used for indexing SystemStateEntries
@@ -1535,10 +1597,6 @@ public class WifiMetrics {
                             WifiMetricsProto.ConnectionEvent.FAILURE_REASON_UNKNOWN);
                 }
             }
-            //If past maximum connection events, start removing the oldest
-            while(mConnectionEventList.size() >= MAX_CONNECTION_EVENTS) {
-                mConnectionEventList.remove(0);
-            }
             mCurrentConnectionEvent = new ConnectionEvent();
             mCurrentConnectionEvent.mConnectionEvent.startTimeMillis =
                     mClock.getWallClockMillis();
@@ -1551,6 +1609,7 @@ public class WifiMetrics {
             mCurrentConnectionEvent.mRealStartTime = mClock.getElapsedSinceBootMillis();
             mCurrentConnectionEvent.mWifiState = mWifiState;
             mCurrentConnectionEvent.mScreenOn = mScreenOn;
+            // If past maximum connection events, this evicts the oldest
             mConnectionEventList.add(mCurrentConnectionEvent);
             mScanResultRssiTimestampMillis = -1;
             if (config != null) {
@@ -1669,6 +1728,20 @@ public class WifiMetrics {
         }
     }
 
+    /**
+     * Log the supplicant network HIDL calls made to configure the network for a connection
+     * attempt.
+     *
+     * @param numCallsIssued number of HIDL calls sent to supplicant.
+     * @param numCallsSkipped number of HIDL calls elided because supplicant already held the value.
+     */
+    public void logSupplicantNetworkHidlCallsForConnect(int numCallsIssued, int numCallsSkipped) {
+        synchronized (mLock) {
+            mSupplicantNetworkHidlCallsPerConnect.increment(numCallsIssued);
+            mWifiLogProto.numSupplicantNetworkHidlCallsSkipped += numCallsSkipped;
+        }
+    }
+
     /**
      * Set the max link speed supported by current network
      */
@@ -1706,6 +1779,10 @@ public class WifiMetrics {
                 mCurrentConnectionEvent.mConnectionEvent.connectivityLevelFailureCode =
                         connectivityFailureCode;
                 mCurrentConnectionEvent.mConnectionEvent.level2FailureReason = level2FailureReason;
+                if (result) {
+                    mSuccessfulConnectionDurationMsSketch.increment(
+                            mCurrentConnectionEvent.mConnectionEvent.durationTakenToConnectMillis);
+                }
 
                 // Write metrics to statsd
                 int wwFailureCode = getConnectionResultFailureCode(level2FailureCode,
@@ -1872,9 +1949,7 @@ public class WifiMetrics {
      */
     public void incrementNonEmptyScanResultCount() {
         if (DBG) Log.v(TAG, "incrementNonEmptyScanResultCount");
-        synchronized (mLock) {
-            mWifiLogProto.numNonEmptyScanResults++;
-        }
+        mHotCounters.increment(HOT_COUNTER_NON_EMPTY_SCAN_RESULTS);
     }
 
     /**
@@ -1882,9 +1957,7 @@ public class WifiMetrics {
      */
     public void incrementEmptyScanResultCount() {
         if (DBG) Log.v(TAG, "incrementEmptyScanResultCount");
-        synchronized (mLock) {
-            mWifiLogProto.numEmptyScanResults++;
-        }
+        mHotCounters.increment(HOT_COUNTER_EMPTY_SCAN_RESULTS);
     }
 
     /**
@@ -1892,9 +1965,7 @@ public class WifiMetrics {
      */
     public void incrementBackgroundScanCount() {
         if (DBG) Log.v(TAG, "incrementBackgroundScanCount");
-        synchronized (mLock) {
-            mWifiLogProto.numBackgroundScans++;
-        }
+        mHotCounters.increment(HOT_COUNTER_BACKGROUND_SCANS);
     }
 
     /**
@@ -1902,6 +1973,7 @@ public class WifiMetrics {
      */
     public int getBackgroundScanCount() {
         synchronized (mLock) {
+            mergeHotCountersLocked();
             return mWifiLogProto.numBackgroundScans;
         }
     }
@@ -1910,9 +1982,7 @@ public class WifiMetrics {
      * Increment oneshot scan count, and the associated WifiSystemScanStateCount entry
      */
     public void incrementOneshotScanCount() {
-        synchronized (mLock) {
-            mWifiLogProto.numOneshotScans++;
-        }
+        mHotCounters.increment(HOT_COUNTER_ONESHOT_SCANS);
         incrementWifiSystemScanStateCount(mWifiState, mScreenOn);
     }
 
@@ -1920,18 +1990,14 @@ public class WifiMetrics {
      * Increment the count of oneshot scans that include DFS channels.
      */
     public void incrementOneshotScanWithDfsCount() {
-        synchronized (mLock) {
-            mWifiLogProto.numOneshotHasDfsChannelScans++;
-        }
+        mHotCounters.increment(HOT_COUNTER_ONESHOT_HAS_DFS_CHANNEL_SCANS);
     }
 
     /**
      * Increment connectivity oneshot scan count.
      */
     public void incrementConnectivityOneshotScanCount() {
-        synchronized (mLock) {
-            mWifiLogProto.numConnectivityOneshotScans++;
-        }
+        mHotCounters.increment(HOT_COUNTER_CONNECTIVITY_ONESHOT_SCANS);
     }
 
     /**
@@ -1939,6 +2005,7 @@ public class WifiMetrics {
      */
     public int getOneshotScanCount() {
         synchronized (mLock) {
+            mergeHotCountersLocked();
             return mWifiLogProto.numOneshotScans;
         }
     }
@@ -1948,6 +2015,7 @@ public class WifiMetrics {
      */
     public int getConnectivityOneshotScanCount() {
         synchronized (mLock) {
+            mergeHotCountersLocked();
             return mWifiLogProto.numConnectivityOneshotScans;
         }
     }
@@ -1957,6 +2025,7 @@ public class WifiMetrics {
      */
     public int getOneshotScanWithDfsCount() {
         synchronized (mLock) {
+            mergeHotCountersLocked();
             return mWifiLogProto.numOneshotHasDfsChannelScans;
         }
     }
@@ -1965,26 +2034,20 @@ public class WifiMetrics {
      * Increment oneshot scan count for external apps.
      */
     public void incrementExternalAppOneshotScanRequestsCount() {
-        synchronized (mLock) {
-            mWifiLogProto.numExternalAppOneshotScanRequests++;
-        }
+        mHotCounters.increment(HOT_COUNTER_EXTERNAL_APP_ONESHOT_SCAN_REQUESTS);
     }
     /**
      * Increment oneshot scan throttle count for external foreground apps.
      */
     public void incrementExternalForegroundAppOneshotScanRequestsThrottledCount() {
-        synchronized (mLock) {
-            mWifiLogProto.numExternalForegroundAppOneshotScanRequestsThrottled++;
-        }
+        mHotCounters.increment(HOT_COUNTER_EXTERNAL_FOREGROUND_APP_SCANS_THROTTLED);
     }
 
     /**
      * Increment oneshot scan throttle count for external background apps.
      */
     public void incrementExternalBackgroundAppOneshotScanRequestsThrottledCount() {
-        synchronized (mLock) {
-            mWifiLogProto.numExternalBackgroundAppOneshotScanRequestsThrottled++;
-        }
+        mHotCounters.increment(HOT_COUNTER_EXTERNAL_BACKGROUND_APP_SCANS_THROTTLED);
     }
 
     private String returnCodeToString(int scanReturnCode) {
@@ -2010,8 +2073,12 @@ public class WifiMetrics {
      * @param scanReturnCode Return code from scan attempt WifiMetricsProto.WifiLog.SCAN_X
      */
     public void incrementScanReturnEntry(int scanReturnCode, int countToAdd) {
+        if (DBG) Log.v(TAG, "incrementScanReturnEntry " + returnCodeToString(scanReturnCode));
+        if (scanReturnCode >= 0 && scanReturnCode < NUM_SCAN_RETURN_CODES && countToAdd > 0) {
+            mHotCounters.add(HOT_COUNTER_SCAN_RETURN_ENTRY_BASE + scanReturnCode, countToAdd);
+            return;
+        }
         synchronized (mLock) {
-            if (DBG) Log.v(TAG, "incrementScanReturnEntry " + returnCodeToString(scanReturnCode));
             int entry = mScanReturnEntries.get(scanReturnCode);
             entry += countToAdd;
             mScanReturnEntries.put(scanReturnCode, entry);
@@ -2023,6 +2090,7 @@ public class WifiMetrics {
      */
     public int getScanReturnEntry(int scanReturnCode) {
         synchronized (mLock) {
+            mergeHotCountersLocked();
             return mScanReturnEntries.get(scanReturnCode);
         }
     }
@@ -2049,12 +2117,16 @@ public class WifiMetrics {
      * @param screenOn Is the screen on
      */
     public void incrementWifiSystemScanStateCount(int state, boolean screenOn) {
+        if (DBG) {
+            Log.v(TAG, "incrementWifiSystemScanStateCount " + wifiSystemStateToString(state)
+                    + " " + screenOn);
+        }
+        int index = (state * 2) + (screenOn ? SCREEN_ON : SCREEN_OFF);
+        if (index >= 0 && index < NUM_SYSTEM_STATE_ENTRIES) {
+            mHotCounters.increment(HOT_COUNTER_SYSTEM_STATE_ENTRY_BASE + index);
+            return;
+        }
         synchronized (mLock) {
-            if (DBG) {
-                Log.v(TAG, "incrementWifiSystemScanStateCount " + wifiSystemStateToString(state)
-                        + " " + screenOn);
-            }
-            int index = (state * 2) + (screenOn ? SCREEN_ON : SCREEN_OFF);
             int entry = mWifiSystemStateEntries.get(index);
             entry++;
             mWifiSystemStateEntries.put(index, entry);
@@ -2066,6 +2138,7 @@ public class WifiMetrics {
      */
     public int getSystemStateCount(int state, boolean screenOn) {
         synchronized (mLock) {
+            mergeHotCountersLocked();
             int index = state * 2 + (screenOn ? SCREEN_ON : SCREEN_OFF);
             return mWifiSystemStateEntries.get(index);
         }
@@ -2211,14 +2284,87 @@ public class WifiMetrics {
         if (!(rssi >= MIN_RSSI_POLL && rssi <= MAX_RSSI_POLL)) {
             return;
         }
-        synchronized (mLock) {
-            if (!mRssiPollCountsMap.containsKey(frequency)) {
-                mRssiPollCountsMap.put(frequency, new SparseIntArray());
+        ShardedCounters counters = mRssiPollHotCounters.get(frequency);
+        if (counters == null && mRssiPollHotCounters.size() < MAX_RSSI_POLL_HOT_FREQUENCIES) {
+            counters = mRssiPollHotCounters.computeIfAbsent(frequency,
+                    k -> new ShardedCounters(MAX_RSSI_POLL - MIN_RSSI_POLL + 1,
+                            RSSI_POLL_HOT_COUNTER_STRIPES));
+        }
+        if (counters == null) {
+            synchronized (mLock) {
+                SparseIntArray histogram = mRssiPollCountsMap.get(frequency);
+                if (histogram == null) {
+                    histogram = new SparseIntArray();
+                    mRssiPollCountsMap.put(frequency, histogram);
+                }
+                histogram.put(rssi, histogram.get(rssi) + 1);
+                maybeIncrementRssiDeltaCount(rssi - mScanResultRssi);
+            }
+            return;
+        }
+        counters.increment(rssi - MIN_RSSI_POLL);
+        // Only take the lock if a scan result RSSI is pending to compute the delta with.
+        if (mScanResultRssiTimestampMillis >= 0) {
+            synchronized (mLock) {
+                maybeIncrementRssiDeltaCount(rssi - mScanResultRssi);
+            }
+        }
+    }
+
+    /**
+     * Merge the lock-free high frequency counters into mWifiLogProto and the maps they are
+     * reported from, resetting them.
+     * mLock must be held when calling this method.
+     */
+    private void mergeHotCountersLocked() {
+        mWifiLogProto.numNonEmptyScanResults +=
+                (int) mHotCounters.drain(HOT_COUNTER_NON_EMPTY_SCAN_RESULTS);
+        mWifiLogProto.numEmptyScanResults +=
+                (int) mHotCounters.drain(HOT_COUNTER_EMPTY_SCAN_RESULTS);
+        mWifiLogProto.numBackgroundScans += (int) mHotCounters.drain(HOT_COUNTER_BACKGROUND_SCANS);
+        mWifiLogProto.numOneshotScans += (int) mHotCounters.drain(HOT_COUNTER_ONESHOT_SCANS);
+        mWifiLogProto.numOneshotHasDfsChannelScans +=
+                (int) mHotCounters.drain(HOT_COUNTER_ONESHOT_HAS_DFS_CHANNEL_SCANS);
+        mWifiLogProto.numConnectivityOneshotScans +=
+                (int) mHotCounters.drain(HOT_COUNTER_CONNECTIVITY_ONESHOT_SCANS);
+        mWifiLogProto.numExternalAppOneshotScanRequests +=
+                (int) mHotCounters.drain(HOT_COUNTER_EXTERNAL_APP_ONESHOT_SCAN_REQUESTS);
+        mWifiLogProto.numExternalForegroundAppOneshotScanRequestsThrottled +=
+                (int) mHotCounters.drain(HOT_COUNTER_EXTERNAL_FOREGROUND_APP_SCANS_THROTTLED);
+        mWifiLogProto.numExternalBackgroundAppOneshotScanRequestsThrottled +=
+                (int) mHotCounters.drain(HOT_COUNTER_EXTERNAL_BACKGROUND_APP_SCANS_THROTTLED);
+        mPnoScanMetrics.numPnoScanAttempts +=
+                (int) mHotCounters.drain(HOT_COUNTER_PNO_SCAN_ATTEMPTS);
+        mPnoScanMetrics.numPnoScanFailed += (int) mHotCounters.drain(HOT_COUNTER_PNO_SCAN_FAILED);
+        mPnoScanMetrics.numPnoFoundNetworkEvents +=
+                (int) mHotCounters.drain(HOT_COUNTER_PNO_FOUND_NETWORK_EVENTS);
+        for (int code = 0; code < NUM_SCAN_RETURN_CODES; code++) {
+            int count = (int) mHotCounters.drain(HOT_COUNTER_SCAN_RETURN_ENTRY_BASE + code);
+            if (count > 0) {
+                mScanReturnEntries.put(code, mScanReturnEntries.get(code) + count);
+            }
+        }
+        for (int index = 0; index < NUM_SYSTEM_STATE_ENTRIES; index++) {
+            int count = (int) mHotCounters.drain(HOT_COUNTER_SYSTEM_STATE_ENTRY_BASE + index);
+            if (count > 0) {
+                mWifiSystemStateEntries.put(index, mWifiSystemStateEntries.get(index) + count);
+            }
+        }
+        for (Map.Entry<Integer, ShardedCounters> entry : mRssiPollHotCounters.entrySet()) {
+            ShardedCounters counters = entry.getValue();
+            SparseIntArray histogram = mRssiPollCountsMap.get(entry.getKey());
+            for (int i = 0; i < counters.size(); i++) {
+                int count = (int) counters.drain(i);
+                if (count == 0) {
+                    continue;
+                }
+                if (histogram == null) {
+                    histogram = new SparseIntArray();
+                    mRssiPollCountsMap.put(entry.getKey(), histogram);
+                }
+                int rssi = i + MIN_RSSI_POLL;
+                histogram.put(rssi, histogram.get(rssi) + count);
             }
-            SparseIntArray sparseIntArray = mRssiPollCountsMap.get(frequency);
-            int count = sparseIntArray.get(rssi);
-            sparseIntArray.put(rssi, count + 1);
-            maybeIncrementRssiDeltaCount(rssi - mScanResultRssi);
         }
     }
 
@@ -3196,20 +3342,26 @@ public class WifiMetrics {
      */
     public void dump(FileDescriptor fd, PrintWriter pw, String[] args) {
         synchronized (mLock) {
+            mergeHotCountersLocked();
             consolidateScoringParams();
             if (args != null && args.length > 0 && PROTO_DUMP_ARG.equals(args[0])) {
                 // Dump serialized WifiLog proto
                 consolidateProto();
 
-                byte[] wifiMetricsProto = WifiMetricsProto.WifiLog.toByteArray(mWifiLogProto);
-                String metricsProtoDump = Base64.encodeToString(wifiMetricsProto, Base64.DEFAULT);
-                if (args.length > 1 && CLEAN_DUMP_ARG.equals(args[1])) {
-                    // Output metrics proto bytes (base64) and nothing else
-                    pw.print(metricsProtoDump);
-                } else {
+                boolean cleanDump = args.length > 1 && CLEAN_DUMP_ARG.equals(args[1]);
+                if (!cleanDump) {
                     // Tag the start and end of the metrics proto bytes
                     pw.println("WifiMetrics:");
-                    pw.println(metricsProtoDump);
+                }
+                // Output metrics proto bytes (base64), encoded as they are serialized
+                try (Base64OutputStream base64Out = new Base64OutputStream(
+                        new PrintWriterOutputStream(pw), Base64.DEFAULT)) {
+                    writeWifiLogProtoLocked(base64Out);
+                } catch (IOException e) {
+                    Log.e(TAG, "Failed to write metrics proto", e);
+                }
+                if (!cleanDump) {
+                    pw.println();
                     pw.println("EndWifiMetrics");
                 }
                 clear();
@@ -3809,6 +3961,13 @@ public class WifiMetrics {
                 pw.println("mWifiLogProto.rxLinkSpeedCount6gMid=" + mRxLinkSpeedCount6gMid);
                 pw.println("mWifiLogProto.rxLinkSpeedCount6gHigh=" + mRxLinkSpeedCount6gHigh);
 
+                pw.println("mWifiLogProto.supplicantNetworkHidlCallsPerConnect="
+                        + mSupplicantNetworkHidlCallsPerConnect);
+                pw.println("mWifiLogProto.numSupplicantNetworkHidlCallsSkipped="
+                        + mWifiLogProto.numSupplicantNetworkHidlCallsSkipped);
+                pw.println("mWifiLogProto.successfulConnectionDurationMillisSketch="
+                        + mSuccessfulConnectionDurationMsSketch);
+
                 pw.println("mWifiLogProto.numIpRenewalFailure="
                         + mWifiLogProto.numIpRenewalFailure);
                 pw.println("mWifiLogProto.connectionDurationStats="
@@ -4065,6 +4224,7 @@ public class WifiMetrics {
     private void consolidateProto() {
         List<WifiMetricsProto.RssiPollCount> rssis = new ArrayList<>();
         synchronized (mLock) {
+            mergeHotCountersLocked();
             int connectionEventCount = mConnectionEventList.size();
             // Exclude the current active un-ended connection event
             if (mCurrentConnectionEvent != null) {
@@ -4479,6 +4639,10 @@ public class WifiMetrics {
             mWifiLogProto.rxLinkSpeedCount6GLow = mRxLinkSpeedCount6gLow.toProto();
             mWifiLogProto.rxLinkSpeedCount6GMid = mRxLinkSpeedCount6gMid.toProto();
             mWifiLogProto.rxLinkSpeedCount6GHigh = mRxLinkSpeedCount6gHigh.toProto();
+            mWifiLogProto.supplicantNetworkHidlCallsPerConnect =
+                    mSupplicantNetworkHidlCallsPerConnect.toProto();
+            mWifiLogProto.successfulConnectionDurationMillisSketch =
+                    mSuccessfulConnectionDurationMsSketch.toProto();
 
             HealthMonitorMetrics healthMonitorMetrics = mWifiHealthMonitor.buildProto();
             if (healthMonitorMetrics != null) {
@@ -4605,12 +4769,87 @@ public class WifiMetrics {
         return array;
     }
 
+    /**
+     * Writes the serialized mWifiLogProto to |out|, encoding the largest repeated fields one
+     * element at a time rather than serializing the whole proto to a byte array first. The output
+     * is identical to WifiMetricsProto.WifiLog.toByteArray(mWifiLogProto).
+     * mLock must be held, and consolidateProto() called, before calling this method.
+     */
+    private void writeWifiLogProtoLocked(OutputStream out) throws IOException {
+        SparseArray<MessageNano[]> streamedFields = new SparseArray<>();
+        streamedFields.put(WIFI_LOG_CONNECTION_EVENT_FIELD, mWifiLogProto.connectionEvent);
+        streamedFields.put(WIFI_LOG_RSSI_POLL_RSSI_COUNT_FIELD, mWifiLogProto.rssiPollRssiCount);
+        streamedFields.put(WIFI_LOG_STA_EVENT_LIST_FIELD, mWifiLogProto.staEventList);
+        streamedFields.put(WIFI_LOG_WIFI_IS_UNUSABLE_EVENT_LIST_FIELD,
+                mWifiLogProto.wifiIsUnusableEventList);
+        streamedFields.put(WIFI_LOG_LINK_SPEED_COUNTS_FIELD, mWifiLogProto.linkSpeedCounts);
+        streamedFields.put(WIFI_LOG_WIFI_USABILITY_STATS_LIST_FIELD,
+                mWifiLogProto.wifiUsabilityStatsList);
+        streamedFields.put(WIFI_LOG_USER_ACTION_EVENTS_FIELD, mWifiLogProto.userActionEvents);
+        WifiMetricsProto.ConnectionEvent[] connectionEvents = mWifiLogProto.connectionEvent;
+        WifiMetricsProto.RssiPollCount[] rssiPollCounts = mWifiLogProto.rssiPollRssiCount;
+        StaEvent[] staEvents = mWifiLogProto.staEventList;
+        WifiIsUnusableEvent[] wifiIsUnusableEvents = mWifiLogProto.wifiIsUnusableEventList;
+        LinkSpeedCount[] linkSpeedCounts = mWifiLogProto.linkSpeedCounts;
+        WifiUsabilityStats[] wifiUsabilityStats = mWifiLogProto.wifiUsabilityStatsList;
+        UserActionEvent[] userActionEvents = mWifiLogProto.userActionEvents;
+        mWifiLogProto.connectionEvent = WifiMetricsProto.ConnectionEvent.emptyArray();
+        mWifiLogProto.rssiPollRssiCount = WifiMetricsProto.RssiPollCount.emptyArray();
+        mWifiLogProto.staEventList = StaEvent.emptyArray();
+        mWifiLogProto.wifiIsUnusableEventList = WifiIsUnusableEvent.emptyArray();
+        mWifiLogProto.linkSpeedCounts = LinkSpeedCount.emptyArray();
+        mWifiLogProto.wifiUsabilityStatsList = WifiUsabilityStats.emptyArray();
+        mWifiLogProto.userActionEvents = UserActionEvent.emptyArray();
+        try {
+            new StreamingProtoWriter(out).write(mWifiLogProto, streamedFields);
+        } finally {
+            mWifiLogProto.connectionEvent = connectionEvents;
+            mWifiLogProto.rssiPollRssiCount = rssiPollCounts;
+            mWifiLogProto.staEventList = staEvents;
+            mWifiLogProto.wifiIsUnusableEventList = wifiIsUnusableEvents;
+            mWifiLogProto.linkSpeedCounts = linkSpeedCounts;
+            mWifiLogProto.wifiUsabilityStatsList = wifiUsabilityStats;
+            mWifiLogProto.userActionEvents = userActionEvents;
+        }
+    }
+
+    /**
+     * Passes the bytes written to it, which must be ASCII, to a PrintWriter as chars.
+     */
+    private static class PrintWriterOutputStream extends OutputStream {
+        private final PrintWriter mPw;
+        private final char[] mChars = new char[1024];
+
+        PrintWriterOutputStream(PrintWriter pw) {
+            mPw = pw;
+        }
+
+        @Override
+        public void write(int b) {
+            mPw.write((char) (b & 0xff));
+        }
+
+        @Override
+        public void write(byte[] b, int off, int len) {
+            while (len > 0) {
+                int count = Math.min(len, mChars.length);
+                for (int i = 0; i < count; i++) {
+                    mChars[i] = (char) (b[off + i] & 0xff);
+                }
+                mPw.write(mChars, 0, count);
+                off += count;
+                len -= count;
+            }
+        }
+    }
+
     /**
      * Clear all WifiMetrics, except for currentConnectionEvent and Open Network Notification
      * feature enabled state, blacklist size.
      */
     private void clear() {
         synchronized (mLock) {
+            mergeHotCountersLocked();
             mConnectionEventList.clear();
             if (mCurrentConnectionEvent != null) {
                 mConnectionEventList.add(mCurrentConnectionEvent);
@@ -4635,6 +4874,8 @@ public class WifiMetrics {
             mRxLinkSpeedCount6gLow.clear();
             mRxLinkSpeedCount6gMid.clear();
             mRxLinkSpeedCount6gHigh.clear();
+            mSupplicantNetworkHidlCallsPerConnect.clear();
+            mSuccessfulConnectionDurationMsSketch.clear();
             mWifiAlertReasonCounts.clear();
             mWifiScoreCounts.clear();
             mWifiUsabilityScoreCounts.clear();
@@ -4919,9 +5160,15 @@ public class WifiMetrics {
         mLastWifiUsabilityScore = -1;
         mLastPredictionHorizonSec = -1;
         synchronized (mLock) {
-            mStaEventList.add(new StaEventWithTime(staEvent, mClock.getWallClockMillis()));
-            // Prune StaEventList if it gets too long
-            if (mStaEventList.size() > MAX_STA_EVENTS) mStaEventList.remove();
+            // Once StaEventList is full, reuse the record of the event it evicts
+            StaEventWithTime eventWithTime = mStaEventList.recycleOldestIfFull();
+            if (eventWithTime == null) {
+                eventWithTime = new StaEventWithTime(staEvent, mClock.getWallClockMillis());
+            } else {
+                eventWithTime.staEvent = staEvent;
+                eventWithTime.wallClockMillis = mClock.getWallClockMillis();
+            }
+            mStaEventList.add(eventWithTime);
         }
     }
 
@@ -5436,9 +5683,6 @@ public class WifiMetrics {
     public void logUserActionEvent(int eventType, int networkId) {
         synchronized (mLock) {
             mUserActionEventList.add(new UserActionEventWithTime(eventType, networkId));
-            if (mUserActionEventList.size() > MAX_USER_ACTION_EVENTS) {
-                mUserActionEventList.remove();
-            }
         }
     }
 
@@ -5454,9 +5698,6 @@ public class WifiMetrics {
             networkInfo.isEphemeral = isEphemeral;
             networkInfo.isPasspoint = isPasspoint;
             mUserActionEventList.add(new UserActionEventWithTime(eventType, networkInfo));
-            if (mUserActionEventList.size() > MAX_USER_ACTION_EVENTS) {
-                mUserActionEventList.remove();
-            }
         }
     }
 
@@ -5573,9 +5814,10 @@ public class WifiMetrics {
                 stats.rxmpdu_be = info.rxSuccess;
             }
             WifiUsabilityStatsEntry wifiUsabilityStatsEntry =
-                    mWifiUsabilityStatsEntriesList.size()
-                    < MAX_WIFI_USABILITY_STATS_ENTRIES_LIST_SIZE
-                    ? new WifiUsabilityStatsEntry() : mWifiUsabilityStatsEntriesList.remove();
+                    mWifiUsabilityStatsEntriesList.recycleOldestIfFull();
+            if (wifiUsabilityStatsEntry == null) {
+                wifiUsabilityStatsEntry = new WifiUsabilityStatsEntry();
+            }
             wifiUsabilityStatsEntry.timeStampMs = stats.timeStampInMs;
             wifiUsabilityStatsEntry.totalTxSuccess = stats.txmpdu_be + stats.txmpdu_bk
                     + stats.txmpdu_vi + stats.txmpdu_vo;
@@ -22,6 +22,7 @@ import android.net.wifi.WifiManager;
 import android.net.wifi.WifiSsid;
 import android.os.Handler;
 import android.os.Message;
+import android.util.ArrayMap;
 import android.util.ArraySet;
 import android.util.Log;
 import android.util.SparseArray;
@@ -34,6 +35,7 @@ import com.android.server.wifi.hotspot2.AnqpEvent;
 import com.android.server.wifi.hotspot2.IconEvent;
 import com.android.server.wifi.hotspot2.WnmData;
 
+import java.io.PrintWriter;
 import java.util.HashMap;
 import java.util.Map;
 import java.util.Set;
@@ -109,6 +111,7 @@ public class WifiMonitor {
     private static final int REASON_WEP_PROHIBITED = 2;
 
     private final WifiInjector mWifiInjector;
+    private final SupplicantEventBatcher mEventBatcher = new SupplicantEventBatcher();
     private boolean mVerboseLoggingEnabled = false;
     private boolean mConnected = false;
 
@@ -124,7 +127,65 @@ public class WifiMonitor {
         }
     }
 
+    /**
+     * Handlers registered for the events of an interface, and whether it is monitored.
+     * Immutable, so that events can be delivered without holding the WifiMonitor class lock.
+     */
+    private static class IfaceDispatchTable {
+        public final boolean monitoring;
+        // Handlers registered for each event, indexed by event what - BASE.
+        private final Handler[][] mHandlers;
+
+        IfaceDispatchTable(SparseArray<Set<Handler>> ifaceHandlers, boolean monitoring) {
+            this.monitoring = monitoring;
+            int size = 0;
+            for (int i = 0; i < ifaceHandlers.size(); i++) {
+                size = Math.max(size, ifaceHandlers.keyAt(i) - BASE + 1);
+            }
+            mHandlers = new Handler[size][];
+            for (int i = 0; i < ifaceHandlers.size(); i++) {
+                int index = ifaceHandlers.keyAt(i) - BASE;
+                Set<Handler> ifaceWhatHandlers = ifaceHandlers.valueAt(i);
+                if (index >= 0 && !ifaceWhatHandlers.isEmpty()) {
+                    mHandlers[index] = ifaceWhatHandlers.toArray(
+                            new Handler[ifaceWhatHandlers.size()]);
+                }
+            }
+        }
+
+        /**
+         * Returns the handlers registered for |what|, or null if there are none.
+         */
+        public Handler[] getHandlers(int what) {
+            int index = what - BASE;
+            return index >= 0 && index < mHandlers.length ? mHandlers[index] : null;
+        }
+    }
+
     private final Map<String, SparseArray<Set<Handler>>> mHandlerMap = new HashMap<>();
+    // Dispatch tables of the interfaces in mHandlerMap, rebuilt from mHandlerMap and
+    // mMonitoringMap whenever either changes, and never modified once published.
+    private volatile ArrayMap<String, IfaceDispatchTable> mDispatchTables = new ArrayMap<>();
+
+    /**
+     * Rebuild and publish the dispatch tables. Must be called with the WifiMonitor class lock
+     * after each change to mHandlerMap or mMonitoringMap.
+     */
+    private void publishDispatchTables() {
+        ArrayMap<String, IfaceDispatchTable> dispatchTables = new ArrayMap<>(mHandlerMap.size());
+        for (Map.Entry<String, SparseArray<Set<Handler>>> entry : mHandlerMap.entrySet()) {
+            dispatchTables.put(entry.getKey(),
+                    new IfaceDispatchTable(entry.getValue(), isMonitoring(entry.getKey())));
+        }
+        mDispatchTables = dispatchTables;
+    }
+
+    /**
+     * Register the given |handler| for the event |what| on |iface|.
+     * @param iface
+     * @param what
+     * @param handler
+     */
     public synchronized void registerHandler(String iface, int what, Handler handler) {
         SparseArray<Set<Handler>> ifaceHandlers = mHandlerMap.get(iface);
         if (ifaceHandlers == null) {
@@ -137,6 +198,7 @@ public class WifiMonitor {
             ifaceHandlers.put(what, ifaceWhatHandlers);
         }
         ifaceWhatHandlers.add(handler);
+        publishDispatchTables();
     }
 
     /**
@@ -155,6 +217,27 @@ public class WifiMonitor {
             return;
         }
         ifaceWhatHandlers.remove(handler);
+        publishDispatchTables();
+        if (!isRegistered(handler)) {
+            mEventBatcher.removeHandler(handler);
+        }
+    }
+
+    private boolean isRegistered(Handler handler) {
+        for (SparseArray<Set<Handler>> ifaceHandlers : mHandlerMap.values()) {
+            for (int i = 0; i < ifaceHandlers.size(); i++) {
+                if (ifaceHandlers.valueAt(i).contains(handler)) return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Enables or disables collapsing the supplicant events superseded while queued to |handler|,
+     * for handlers which only act on the latest supplicant state. Disabled by default.
+     */
+    public void setEventCollapsingEnabled(Handler handler, boolean enabled) {
+        mEventBatcher.setCollapsingEnabled(handler, enabled);
     }
 
     private final Map<String, Boolean> mMonitoringMap = new HashMap<>();
@@ -174,8 +257,9 @@ public class WifiMonitor {
      * @param enabled true to enable, false to disable.
      */
     @VisibleForTesting
-    public void setMonitoring(String iface, boolean enabled) {
+    public synchronized void setMonitoring(String iface, boolean enabled) {
         mMonitoringMap.put(iface, enabled);
+        publishDispatchTables();
     }
 
     private void setMonitoringNone() {
@@ -221,7 +305,8 @@ public class WifiMonitor {
     /**
      * Similar functions to Handler#sendMessage that send the message to the registered handler
      * for the given interface and message what.
-     * All of these should be called with the WifiMonitor class lock
+     * These deliver the message using the published dispatch tables, so they do not need the
+     * WifiMonitor class lock.
      */
     private void sendMessage(String iface, int what) {
         sendMessage(iface, Message.obtain(null, what));
@@ -244,17 +329,11 @@ public class WifiMonitor {
     }
 
     private void sendMessage(String iface, Message message) {
-        SparseArray<Set<Handler>> ifaceHandlers = mHandlerMap.get(iface);
-        if (iface != null && ifaceHandlers != null) {
-            if (isMonitoring(iface)) {
-                Set<Handler> ifaceWhatHandlers = ifaceHandlers.get(message.what);
-                if (ifaceWhatHandlers != null) {
-                    for (Handler handler : ifaceWhatHandlers) {
-                        if (handler != null) {
-                            sendMessage(handler, Message.obtain(message));
-                        }
-                    }
-                }
+        ArrayMap<String, IfaceDispatchTable> dispatchTables = mDispatchTables;
+        IfaceDispatchTable ifaceTable = iface != null ? dispatchTables.get(iface) : null;
+        if (ifaceTable != null) {
+            if (ifaceTable.monitoring) {
+                sendMessage(ifaceTable.getHandlers(message.what), message);
             } else {
                 if (mVerboseLoggingEnabled) {
                     Log.d(TAG, "Dropping event because (" + iface + ") is stopped");
@@ -264,14 +343,10 @@ public class WifiMonitor {
             if (mVerboseLoggingEnabled) {
                 Log.d(TAG, "Sending to all monitors because there's no matching iface");
             }
-            for (Map.Entry<String, SparseArray<Set<Handler>>> entry : mHandlerMap.entrySet()) {
-                if (isMonitoring(entry.getKey())) {
-                    Set<Handler> ifaceWhatHandlers = entry.getValue().get(message.what);
-                    for (Handler handler : ifaceWhatHandlers) {
-                        if (handler != null) {
-                            sendMessage(handler, Message.obtain(message));
-                        }
-                    }
+            for (int i = 0; i < dispatchTables.size(); i++) {
+                IfaceDispatchTable table = dispatchTables.valueAt(i);
+                if (table.monitoring) {
+                    sendMessage(table.getHandlers(message.what), message);
                 }
             }
         }
@@ -279,9 +354,26 @@ public class WifiMonitor {
         message.recycle();
     }
 
+    private void sendMessage(Handler[] handlers, Message message) {
+        if (handlers == null) {
+            return;
+        }
+        for (Handler handler : handlers) {
+            if (handler != null) {
+                sendMessage(handler, Message.obtain(message));
+            }
+        }
+    }
+
     private void sendMessage(Handler handler, Message message) {
-        message.setTarget(handler);
-        message.sendToTarget();
+        mEventBatcher.send(handler, message);
+    }
+
+    /**
+     * Dump the number of events queued to the handlers, and of events superseded while queued.
+     */
+    public void dump(PrintWriter pw) {
+        mEventBatcher.dump(pw);
     }
 
     /**
@@ -67,6 +67,7 @@ import java.util.Objects;
 import java.util.Random;
 import java.util.Set;
 import java.util.TimeZone;
+import java.util.function.Consumer;
 
 /**
  * Native calls for bring up/shut down of the supplicant daemon and for
@@ -2890,6 +2891,17 @@ public class WifiNative {
         return mWifiVendorHal.getWifiLinkLayerStats(ifaceName);
     }
 
+    /**
+     * Gets the latest link layer stats, without blocking the caller on the HAL.
+     * @param ifaceName Name of the interface.
+     * @param onComplete called on the wifi thread with the stats, or null.
+     * @return true if the request was queued, false if too many requests are pending.
+     */
+    public boolean getWifiLinkLayerStatsAsync(@NonNull String ifaceName,
+            @NonNull Consumer<WifiLinkLayerStats> onComplete) {
+        return mWifiVendorHal.getWifiLinkLayerStatsAsync(ifaceName, onComplete);
+    }
+
     /**
      * Returns whether STA/AP concurrency is supported or not.
      */
@@ -3106,6 +3118,18 @@ public class WifiNative {
         return mWifiVendorHal.getRingBufferData(ringName);
     }
 
+    /**
+     * Indicates to driver that all the data has to be uploaded urgently, without blocking the
+     * caller on the HAL.
+     *
+     * @param ringName Name of the ring buffer requested.
+     * @param onComplete called on the wifi thread once the data was requested.
+     * @return true if the request was queued, false if too many requests are pending.
+     */
+    public boolean getRingBufferDataAsync(String ringName, @NonNull Consumer<Boolean> onComplete) {
+        return mWifiVendorHal.getRingBufferDataAsync(ringName, onComplete);
+    }
+
     /**
      * Request hal to flush ring buffers to files
      *
@@ -3133,6 +3157,26 @@ public class WifiNative {
         return mWifiVendorHal.getDriverStateDump();
     }
 
+    /**
+     * Request vendor debug info from the firmware, without blocking the caller on the HAL.
+     *
+     * @param onComplete called on the wifi thread with the raw data, or null.
+     * @return true if the request was queued, false if too many requests are pending.
+     */
+    public boolean getFwMemoryDumpAsync(@NonNull Consumer<byte[]> onComplete) {
+        return mWifiVendorHal.getFwMemoryDumpAsync(onComplete);
+    }
+
+    /**
+     * Request vendor debug info from the driver, without blocking the caller on the HAL.
+     *
+     * @param onComplete called on the wifi thread with the raw data, or null.
+     * @return true if the request was queued, false if too many requests are pending.
+     */
+    public boolean getDriverStateDumpAsync(@NonNull Consumer<byte[]> onComplete) {
+        return mWifiVendorHal.getDriverStateDumpAsync(onComplete);
+    }
+
     //---------------------------------------------------------------------------------
     /* Packet fate API */
 
@@ -3450,6 +3494,13 @@ public class WifiNative {
         return mWifiVendorHal.getWlanWakeReasonCount();
     }
 
+    /**
+     * Dump the latencies of the vendor HAL calls made on its async call lane.
+     */
+    public void dumpVendorHalAsyncCalls(PrintWriter pw) {
+        mWifiVendorHal.dump(pw);
+    }
+
     /**
      * Enable/Disable Neighbour discovery offload functionality in the firmware.
      *
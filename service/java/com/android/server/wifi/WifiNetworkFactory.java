@@ -383,7 +383,8 @@ public class WifiNetworkFactory extends NetworkFactory {
         mScanListener = new NetworkFactoryScanListener();
         mPeriodicScanTimerListener = new PeriodicScanAlarmListener();
         mConnectionTimeoutAlarmListener = new ConnectionTimeoutAlarmListener();
-        mRegisteredCallbacks = new ExternalCallbackTracker<INetworkRequestMatchCallback>(mHandler);
+        mRegisteredCallbacks = new ExternalCallbackTracker<INetworkRequestMatchCallback>(mHandler,
+                wifiInjector.getCallbackBroadcastExecutor());
         mUserApprovedAccessPointMap = new HashMap<>();
 
         // register the data store for serializing/deserializing data.
@@ -679,6 +680,7 @@ public class WifiNetworkFactory extends NetworkFactory {
         pw.println(TAG + ": mGenericConnectionReqCount " + mGenericConnectionReqCount);
         pw.println(TAG + ": mActiveSpecificNetworkRequest " + mActiveSpecificNetworkRequest);
         pw.println(TAG + ": mUserApprovedAccessPointMap " + mUserApprovedAccessPointMap);
+        mRegisteredCallbacks.dump(pw);
     }
 
     /**
@@ -887,14 +889,9 @@ public class WifiNetworkFactory extends NetworkFactory {
             return;
         }
         Log.d(TAG, "Connected to network " + mUserSelectedNetwork);
-        for (INetworkRequestMatchCallback callback : mRegisteredCallbacks.getCallbacks()) {
-            try {
-                callback.onUserSelectionConnectSuccess(mUserSelectedNetwork);
-            } catch (RemoteException e) {
-                Log.e(TAG, "Unable to invoke network request connect failure callback "
-                        + callback, e);
-            }
-        }
+        WifiConfiguration userSelectedNetwork = mUserSelectedNetwork;
+        mRegisteredCallbacks.broadcast("onUserSelectionConnectSuccess",
+                callback -> callback.onUserSelectionConnectSuccess(userSelectedNetwork));
         // transition the request from "active" to "connected".
         setupForConnectedRequest();
         mWifiMetrics.incrementNetworkRequestApiNumConnectSuccess();
@@ -919,14 +916,9 @@ public class WifiNetworkFactory extends NetworkFactory {
             return;
         }
         Log.e(TAG, "Connection failures, cancelling " + mUserSelectedNetwork);
-        for (INetworkRequestMatchCallback callback : mRegisteredCallbacks.getCallbacks()) {
-            try {
-                callback.onUserSelectionConnectFailure(mUserSelectedNetwork);
-            } catch (RemoteException e) {
-                Log.e(TAG, "Unable to invoke network request connect failure callback "
-                        + callback, e);
-            }
-        }
+        WifiConfiguration userSelectedNetwork = mUserSelectedNetwork;
+        mRegisteredCallbacks.broadcast("onUserSelectionConnectFailure",
+                callback -> callback.onUserSelectionConnectFailure(userSelectedNetwork));
         teardownForActiveRequest();
     }
 
@@ -973,13 +965,7 @@ public class WifiNetworkFactory extends NetworkFactory {
     // Common helper method for start/end of active request processing.
     private void cleanupActiveRequest() {
         // Send the abort to the UI for the current active request.
-        for (INetworkRequestMatchCallback callback : mRegisteredCallbacks.getCallbacks()) {
-            try {
-                callback.onAbort();
-            } catch (RemoteException e) {
-                Log.e(TAG, "Unable to invoke network request abort callback " + callback, e);
-            }
-        }
+        mRegisteredCallbacks.broadcast("onAbort", callback -> callback.onAbort());
         // Force-release the network request to let the app know early that the attempt failed.
         if (mActiveSpecificNetworkRequest != null) {
             releaseRequestAsUnfulfillableByAnyFactory(mActiveSpecificNetworkRequest);
@@ -1184,13 +1170,9 @@ public class WifiNetworkFactory extends NetworkFactory {
                     + "Ignoring...");
             return;
         }
-        for (INetworkRequestMatchCallback callback : mRegisteredCallbacks.getCallbacks()) {
-            try {
-                callback.onMatch(new ArrayList<>(matchedScanResults));
-            } catch (RemoteException e) {
-                Log.e(TAG, "Unable to invoke network request match callback " + callback, e);
-            }
-        }
+        // The list is parceled, not modified, by each callback, so it is shared by all of them.
+        List<ScanResult> scanResults = new ArrayList<>(matchedScanResults);
+        mRegisteredCallbacks.broadcast("onMatch", callback -> callback.onMatch(scanResults));
     }
 
     private void cancelConnectionTimeout() {
@@ -122,6 +122,7 @@ import com.android.server.wifi.util.WifiPermissionsUtil;
 import com.android.wifi.resources.R;
 
 import java.io.BufferedReader;
+import java.io.ByteArrayInputStream;
 import java.io.FileDescriptor;
 import java.io.FileNotFoundException;
 import java.io.FileReader;
@@ -140,12 +141,13 @@ import java.util.ArrayList;
 import java.util.Arrays;
 import java.util.Collections;
 import java.util.HashMap;
-import java.util.Iterator;
 import java.util.List;
 import java.util.Map;
 import java.util.concurrent.CountDownLatch;
 import java.util.concurrent.Executor;
 import java.util.concurrent.TimeUnit;
+import java.util.function.Consumer;
+import java.util.function.Predicate;
 
 /**
  * WifiService handles remote WiFi operation requests by implementing
@@ -159,6 +161,10 @@ public class WifiServiceImpl extends BaseWifiService {
 
     /** Max wait time for posting blocking runnables */
     private static final int RUN_WITH_SCISSORS_TIMEOUT_MILLIS = 4000;
+    /** Age after which the settings served from a cached value are refreshed */
+    private static final long SETTING_CACHE_REFRESH_AGE_MS = 1000;
+    /** Max age of the settings served from a cached value */
+    private static final long SETTING_CACHE_MAX_AGE_MS = 10_000;
 
     private final ClientModeImpl mClientModeImpl;
     private final ActiveModeWarden mActiveModeWarden;
@@ -288,6 +294,12 @@ public class WifiServiceImpl extends BaseWifiService {
     private final DppManager mDppManager;
     private final WifiApConfigStore mWifiApConfigStore;
     private final WifiThreadRunner mWifiThreadRunner;
+    private final WifiStateSnapshotPublisher mWifiStateSnapshotPublisher;
+    // Settings served from a recent value rather than blocking behind the main Wifi thread.
+    // They are invalidated once changed, and refreshed asynchronously once older than
+    // SETTING_CACHE_REFRESH_AGE_MS otherwise.
+    private final WifiThreadRunner.CachedValue<Boolean> mScanThrottleEnabled;
+    private final WifiThreadRunner.CachedValue<Boolean> mAutoWakeupEnabled;
     private final MemoryStoreImpl mMemoryStoreImpl;
     private final WifiScoreCard mWifiScoreCard;
 
@@ -324,11 +336,22 @@ public class WifiServiceImpl extends BaseWifiService {
         mWifiNetworkSuggestionsManager = mWifiInjector.getWifiNetworkSuggestionsManager();
         mDppManager = mWifiInjector.getDppManager();
         mWifiThreadRunner = mWifiInjector.getWifiThreadRunner();
+        mWifiStateSnapshotPublisher = mWifiInjector.getWifiStateSnapshotPublisher();
+        mScanThrottleEnabled = mWifiThreadRunner.newCachedValue(
+                () -> mScanRequestProxy.isScanThrottleEnabled(), SETTING_CACHE_REFRESH_AGE_MS,
+                SETTING_CACHE_MAX_AGE_MS, "isScanThrottleEnabled");
+        mAutoWakeupEnabled = mWifiThreadRunner.newCachedValue(
+                () -> mWifiInjector.getWakeupController().isEnabled(),
+                SETTING_CACHE_REFRESH_AGE_MS, SETTING_CACHE_MAX_AGE_MS, "isAutoWakeupEnabled");
+        // The setting may also be changed directly in Settings.
+        mWifiInjector.getWakeupController().setEnabledChangedListener(
+                () -> mAutoWakeupEnabled.invalidate());
         mWifiConfigManager = mWifiInjector.getWifiConfigManager();
         mPasspointManager = mWifiInjector.getPasspointManager();
         mWifiScoreCard = mWifiInjector.getWifiScoreCard();
         mMemoryStoreImpl = new MemoryStoreImpl(mContext, mWifiInjector,
-                mWifiScoreCard,  mWifiInjector.getWifiHealthMonitor());
+                mWifiScoreCard,  mWifiInjector.getWifiHealthMonitor(),
+                new Handler(mWifiInjector.getWifiHandlerThread().getLooper()));
     }
 
     /**
@@ -495,7 +518,7 @@ public class WifiServiceImpl extends BaseWifiService {
             mWifiPermissionsUtil.enforceCanAccessScanResults(packageName, featureId, callingUid,
                     null);
             Boolean scanSuccess = mWifiThreadRunner.call(() ->
-                    mScanRequestProxy.startScan(callingUid, packageName), null);
+                    mScanRequestProxy.startScan(callingUid, packageName), null, "startScan");
             if (scanSuccess == null) {
                 sendFailedScanBroadcast();
                 return false;
@@ -829,7 +852,7 @@ public class WifiServiceImpl extends BaseWifiService {
         if (mVerboseLoggingEnabled) {
             mLog.info("getWifiEnabledState uid=%").c(Binder.getCallingUid()).flush();
         }
-        return mClientModeImpl.syncGetWifiState();
+        return mWifiStateSnapshotPublisher.getSnapshot().getWifiState();
     }
 
     /**
@@ -898,7 +921,7 @@ public class WifiServiceImpl extends BaseWifiService {
         }
 
         if (!mWifiThreadRunner.call(
-                () -> mActiveModeWarden.canRequestMoreSoftApManagers(), false)) {
+                () -> mActiveModeWarden.canRequestMoreSoftApManagers(), false, "startSoftAp")) {
             // Take down LOHS if it is up.
             mLohsSoftApTracker.stopAll();
         }
@@ -956,7 +979,8 @@ public class WifiServiceImpl extends BaseWifiService {
         }
 
         if (!mWifiThreadRunner.call(
-                () -> mActiveModeWarden.canRequestMoreSoftApManagers(), false)) {
+                () -> mActiveModeWarden.canRequestMoreSoftApManagers(), false,
+                "startTetheredHotspot")) {
             // Take down LOHS if it is up.
             mLohsSoftApTracker.stopAll();
         }
@@ -1122,7 +1146,8 @@ public class WifiServiceImpl extends BaseWifiService {
         }
 
         private final ExternalCallbackTracker<ISoftApCallback> mRegisteredSoftApCallbacks =
-                new ExternalCallbackTracker<>(mClientModeImplHandler);
+                new ExternalCallbackTracker<>(mClientModeImplHandler,
+                        mWifiInjector.getCallbackBroadcastExecutor());
 
         public boolean registerSoftApCallback(IBinder binder, ISoftApCallback callback,
                 int callbackIdentifier) {
@@ -1133,6 +1158,14 @@ public class WifiServiceImpl extends BaseWifiService {
             mRegisteredSoftApCallbacks.remove(callbackIdentifier);
         }
 
+        /**
+         * Dump the stats of the registered callbacks.
+         */
+        public void dump(PrintWriter pw) {
+            pw.println("TetheredSoftApTracker callbacks:");
+            mRegisteredSoftApCallbacks.dump(pw);
+        }
+
         /**
          * Called when soft AP state changes.
          *
@@ -1148,18 +1181,8 @@ public class WifiServiceImpl extends BaseWifiService {
                 mTetheredSoftApState = state;
             }
 
-            Iterator<ISoftApCallback> iterator =
-                    mRegisteredSoftApCallbacks.getCallbacks().iterator();
-            while (iterator.hasNext()) {
-                ISoftApCallback callback = iterator.next();
-                try {
-                    callback.onStateChanged(state, failureReason);
-                } catch (RemoteException e) {
-                    Log.e(TAG, "onStateChanged: remote exception -- " + e);
-                    // TODO(b/138863863) remove does nothing, getCallbacks() returns a copy
-                    iterator.remove();
-                }
-            }
+            mRegisteredSoftApCallbacks.broadcast("onStateChanged",
+                    callback -> callback.onStateChanged(state, failureReason));
         }
 
         /**
@@ -1169,22 +1192,13 @@ public class WifiServiceImpl extends BaseWifiService {
          */
         @Override
         public void onConnectedClientsChanged(List<WifiClient> clients) {
+            List<WifiClient> connectedClients = new ArrayList<>(clients);
             synchronized (mLock) {
-                mTetheredSoftApConnectedClients = new ArrayList<>(clients);
+                mTetheredSoftApConnectedClients = connectedClients;
             }
 
-            Iterator<ISoftApCallback> iterator =
-                    mRegisteredSoftApCallbacks.getCallbacks().iterator();
-            while (iterator.hasNext()) {
-                ISoftApCallback callback = iterator.next();
-                try {
-                    callback.onConnectedClientsChanged(mTetheredSoftApConnectedClients);
-                } catch (RemoteException e) {
-                    Log.e(TAG, "onConnectedClientsChanged: remote exception -- " + e);
-                    // TODO(b/138863863) remove does nothing, getCallbacks() returns a copy
-                    iterator.remove();
-                }
-            }
+            mRegisteredSoftApCallbacks.broadcast("onConnectedClientsChanged",
+                    callback -> callback.onConnectedClientsChanged(connectedClients));
         }
 
         /**
@@ -1194,20 +1208,13 @@ public class WifiServiceImpl extends BaseWifiService {
          */
         @Override
         public void onInfoChanged(SoftApInfo softApInfo) {
+            SoftApInfo info = new SoftApInfo(softApInfo);
             synchronized (mLock) {
-                mTetheredSoftApInfo = new SoftApInfo(softApInfo);
+                mTetheredSoftApInfo = info;
             }
 
-            Iterator<ISoftApCallback> iterator =
-                    mRegisteredSoftApCallbacks.getCallbacks().iterator();
-            while (iterator.hasNext()) {
-                ISoftApCallback callback = iterator.next();
-                try {
-                    callback.onInfoChanged(mTetheredSoftApInfo);
-                } catch (RemoteException e) {
-                    Log.e(TAG, "onInfoChanged: remote exception -- " + e);
-                }
-            }
+            mRegisteredSoftApCallbacks.broadcast("onInfoChanged",
+                    callback -> callback.onInfoChanged(info));
         }
 
         /**
@@ -1217,20 +1224,13 @@ public class WifiServiceImpl extends BaseWifiService {
          */
         @Override
         public void onCapabilityChanged(SoftApCapability capability) {
+            SoftApCapability softApCapability = new SoftApCapability(capability);
             synchronized (mLock) {
-                mTetheredSoftApCapability = new SoftApCapability(capability);
+                mTetheredSoftApCapability = softApCapability;
             }
 
-            Iterator<ISoftApCallback> iterator =
-                    mRegisteredSoftApCallbacks.getCallbacks().iterator();
-            while (iterator.hasNext()) {
-                ISoftApCallback callback = iterator.next();
-                try {
-                    callback.onCapabilityChanged(mTetheredSoftApCapability);
-                } catch (RemoteException e) {
-                    Log.e(TAG, "onCapabiliyChanged: remote exception -- " + e);
-                }
-            }
+            mRegisteredSoftApCallbacks.broadcast("onCapabilityChanged",
+                    callback -> callback.onCapabilityChanged(softApCapability));
         }
 
         /**
@@ -1242,16 +1242,8 @@ public class WifiServiceImpl extends BaseWifiService {
          */
         @Override
         public void onBlockedClientConnecting(WifiClient client, int blockedReason) {
-            Iterator<ISoftApCallback> iterator =
-                    mRegisteredSoftApCallbacks.getCallbacks().iterator();
-            while (iterator.hasNext()) {
-                ISoftApCallback callback = iterator.next();
-                try {
-                    callback.onBlockedClientConnecting(client, blockedReason);
-                } catch (RemoteException e) {
-                    Log.e(TAG, "onBlockedClientConnecting: remote exception -- " + e);
-                }
-            }
+            mRegisteredSoftApCallbacks.broadcast("onBlockedClientConnecting",
+                    callback -> callback.onBlockedClientConnecting(client, blockedReason));
         }
     }
 
@@ -1871,7 +1863,8 @@ public class WifiServiceImpl extends BaseWifiService {
         // hand off work to the ClientModeImpl handler thread to sync work between calls
         // and SoftApManager starting up softap
         return (mWifiThreadRunner.call(mWifiApConfigStore::getApConfiguration,
-                new SoftApConfiguration.Builder().build())).toWifiConfiguration();
+                new SoftApConfiguration.Builder().build(),
+                "getWifiApConfiguration")).toWifiConfiguration();
     }
 
     /**
@@ -1892,7 +1885,7 @@ public class WifiServiceImpl extends BaseWifiService {
         // hand off work to the ClientModeImpl handler thread to sync work between calls
         // and SoftApManager starting up softap
         return mWifiThreadRunner.call(mWifiApConfigStore::getApConfiguration,
-                new SoftApConfiguration.Builder().build());
+                new SoftApConfiguration.Builder().build(), "getSoftApConfiguration");
     }
 
     /**
@@ -2165,10 +2158,8 @@ public class WifiServiceImpl extends BaseWifiService {
         } else if (isCarrierApp) {
             targetConfigUid = callingUid; // expose only those configs created by the Carrier App
         }
-        int finalTargetConfigUid = targetConfigUid;
-        List<WifiConfiguration> configs = mWifiThreadRunner.call(
-                () -> mWifiConfigManager.getSavedNetworks(finalTargetConfigUid),
-                Collections.emptyList());
+        List<WifiConfiguration> configs =
+                mWifiStateSnapshotPublisher.getSnapshot().getSavedNetworks(targetConfigUid);
         if (isTargetSdkLessThanQOrPrivileged) {
             return new ParceledListSlice<>(configs);
         }
@@ -2211,7 +2202,7 @@ public class WifiServiceImpl extends BaseWifiService {
         }
         List<WifiConfiguration> configs = mWifiThreadRunner.call(
                 () -> mWifiConfigManager.getConfiguredNetworksWithPasswords(),
-                Collections.emptyList());
+                Collections.emptyList(), "getPrivilegedConfiguredNetworks");
         return new ParceledListSlice<>(configs);
     }
 
@@ -2239,7 +2230,7 @@ public class WifiServiceImpl extends BaseWifiService {
         }
         return mWifiThreadRunner.call(
             () -> mPasspointManager.getAllMatchingPasspointProfilesForScanResults(scanResults),
-                Collections.emptyMap());
+                Collections.emptyMap(), "getAllMatchingPasspointProfilesForScanResults");
     }
 
     /**
@@ -2263,7 +2254,8 @@ public class WifiServiceImpl extends BaseWifiService {
             return Collections.emptyMap();
         }
         return mWifiThreadRunner.call(
-            () -> mPasspointManager.getMatchingOsuProviders(scanResults), Collections.emptyMap());
+            () -> mPasspointManager.getMatchingOsuProviders(scanResults), Collections.emptyMap(),
+            "getMatchingOsuProviders");
     }
 
     /**
@@ -2288,7 +2280,7 @@ public class WifiServiceImpl extends BaseWifiService {
         }
         return mWifiThreadRunner.call(
             () -> mPasspointManager.getMatchingPasspointConfigsForOsuProviders(osuProviders),
-                Collections.emptyMap());
+                Collections.emptyMap(), "getMatchingPasspointConfigsForOsuProviders");
     }
 
     /**
@@ -2315,7 +2307,7 @@ public class WifiServiceImpl extends BaseWifiService {
         }
         return mWifiThreadRunner.call(
             () -> mPasspointManager.getWifiConfigsForPasspointProfiles(fqdnList),
-                Collections.emptyList());
+                Collections.emptyList(), "getWifiConfigsForPasspointProfiles");
     }
 
     /**
@@ -2345,7 +2337,7 @@ public class WifiServiceImpl extends BaseWifiService {
         return mWifiThreadRunner.call(
                 () -> mWifiNetworkSuggestionsManager
                         .getWifiConfigForMatchedNetworkSuggestionsSharedWithUser(scanResults),
-                Collections.emptyList());
+                Collections.emptyList(), "getWifiConfigForMatchedNetworkSuggestionsSharedWithUser");
     }
 
     /**
@@ -2408,7 +2400,7 @@ public class WifiServiceImpl extends BaseWifiService {
         return mWifiThreadRunner.call(
             () -> mWifiConfigManager.addOrUpdateNetwork(config, callingUid, packageName)
                     .getNetworkId(),
-                WifiConfiguration.INVALID_NETWORK_ID);
+                WifiConfiguration.INVALID_NETWORK_ID, "addOrUpdateNetwork");
     }
 
     public static void verifyCert(X509Certificate caCert)
@@ -2445,7 +2437,8 @@ public class WifiServiceImpl extends BaseWifiService {
         int callingUid = Binder.getCallingUid();
         mLog.info("removeNetwork uid=%").c(callingUid).flush();
         return mWifiThreadRunner.call(
-                () -> mWifiConfigManager.removeNetwork(netId, callingUid, packageName), false);
+                () -> mWifiConfigManager.removeNetwork(netId, callingUid, packageName), false,
+                "removeNetwork");
     }
 
     /**
@@ -2510,7 +2503,7 @@ public class WifiServiceImpl extends BaseWifiService {
         } else {
             return mWifiThreadRunner.call(
                     () -> mWifiConfigManager.enableNetwork(netId, false, callingUid, packageName),
-                    false);
+                    false, "enableNetwork");
         }
     }
 
@@ -2534,7 +2527,8 @@ public class WifiServiceImpl extends BaseWifiService {
         int callingUid = Binder.getCallingUid();
         mLog.info("disableNetwork uid=%").c(callingUid).flush();
         return mWifiThreadRunner.call(
-                () -> mWifiConfigManager.disableNetwork(netId, callingUid, packageName), false);
+                () -> mWifiConfigManager.disableNetwork(netId, callingUid, packageName), false,
+                "disableNetwork");
     }
 
     /**
@@ -2672,7 +2666,7 @@ public class WifiServiceImpl extends BaseWifiService {
         }
         long ident = Binder.clearCallingIdentity();
         try {
-            WifiInfo result = mClientModeImpl.syncRequestConnectionInfo();
+            WifiInfo result = mWifiStateSnapshotPublisher.getSnapshot().getConnectionInfo();
             boolean hideDefaultMacAddress = true;
             boolean hideBssidSsidNetworkIdAndFqdn = true;
 
@@ -2728,7 +2722,7 @@ public class WifiServiceImpl extends BaseWifiService {
             mWifiPermissionsUtil.enforceCanAccessScanResults(callingPackage, callingFeatureId,
                     uid, null);
             List<ScanResult> scanResults = mWifiThreadRunner.call(
-                    mScanRequestProxy::getScanResults, Collections.emptyList());
+                    mScanRequestProxy::getScanResults, Collections.emptyList(), "getScanResults");
             return scanResults;
         } catch (SecurityException e) {
             Log.e(TAG, "Permission violation - getScanResults not allowed for uid="
@@ -2768,7 +2762,7 @@ public class WifiServiceImpl extends BaseWifiService {
                                     networkSuggestions, scanResults);
                         }
                     },
-                    Collections.emptyMap());
+                    Collections.emptyMap(), "getMatchingScanResults");
         } catch (SecurityException e) {
             Log.e(TAG, "Permission violation - getMatchingScanResults not allowed for uid="
                     + uid + ", packageName=" + callingPackage + ", reason + e");
@@ -2801,7 +2795,7 @@ public class WifiServiceImpl extends BaseWifiService {
         mLog.info("addorUpdatePasspointConfiguration uid=%").c(callingUid).flush();
         return mWifiThreadRunner.call(
                 () -> mPasspointManager.addOrUpdateProvider(config, callingUid, packageName,
-                        false, true), false);
+                        false, true), false, "addOrUpdatePasspointConfiguration");
     }
 
     /**
@@ -2834,7 +2828,7 @@ public class WifiServiceImpl extends BaseWifiService {
         final boolean privilegedFinal = privileged;
         return mWifiThreadRunner.call(
                 () -> mPasspointManager.removeProvider(uid, privilegedFinal, uniqueId, fqdn),
-                false);
+                false, "removePasspointConfigurationInternal");
     }
 
     /**
@@ -2858,7 +2852,7 @@ public class WifiServiceImpl extends BaseWifiService {
         final boolean privilegedFinal = privileged;
         return mWifiThreadRunner.call(
             () -> mPasspointManager.getProviderConfigs(uid, privilegedFinal),
-            Collections.emptyList());
+            Collections.emptyList(), "getPasspointConfigurations");
     }
 
     /**
@@ -2921,7 +2915,8 @@ public class WifiServiceImpl extends BaseWifiService {
 
     private boolean is5GhzBandSupportedInternal() {
         return mWifiThreadRunner.call(
-                () -> mClientModeImpl.isWifiBandSupported(WifiScanner.WIFI_BAND_5_GHZ), false);
+                () -> mClientModeImpl.isWifiBandSupported(WifiScanner.WIFI_BAND_5_GHZ), false,
+                "is5GhzBandSupportedInternal");
     }
 
     @Override
@@ -2935,13 +2930,15 @@ public class WifiServiceImpl extends BaseWifiService {
 
     private boolean is6GhzBandSupportedInternal() {
         return mWifiThreadRunner.call(
-                () -> mClientModeImpl.isWifiBandSupported(WifiScanner.WIFI_BAND_6_GHZ), false);
+                () -> mClientModeImpl.isWifiBandSupported(WifiScanner.WIFI_BAND_6_GHZ), false,
+                "is6GhzBandSupportedInternal");
     }
 
     @Override
     public boolean isWifiStandardSupported(@WifiStandard int standard) {
         return mWifiThreadRunner.call(
-                () -> mClientModeImpl.isWifiStandardSupported(standard), false);
+                () -> mClientModeImpl.isWifiStandardSupported(standard), false,
+                "isWifiStandardSupported");
     }
 
     /**
@@ -3224,7 +3221,7 @@ public class WifiServiceImpl extends BaseWifiService {
             mWifiMetrics.updateSavedNetworks(
                     mWifiConfigManager.getSavedNetworks(Process.WIFI_UID));
             mPasspointManager.updateMetrics();
-        });
+        }, "updateWifiMetrics");
         boolean isEnhancedMacRandEnabled = mFrameworkFacade.getIntegerSetting(mContext,
                 WifiConfigManager.ENHANCED_MAC_RANDOMIZATION_FEATURE_FORCE_ENABLE_FLAG, 0) == 1
                 ? true : false;
@@ -3258,7 +3255,7 @@ public class WifiServiceImpl extends BaseWifiService {
         } else if (args != null && args.length > 0 && WifiScoreCard.DUMP_ARG.equals(args[0])) {
             WifiScoreCard wifiScoreCard = mWifiInjector.getWifiScoreCard();
             String networkListBase64 = mWifiThreadRunner.call(() ->
-                    wifiScoreCard.getNetworkListBase64(true), "");
+                    wifiScoreCard.getNetworkListBase64(true), "", "dump");
             pw.println(networkListBase64);
         } else {
             // Polls link layer stats and RSSI. This allows the stats to show up in
@@ -3273,6 +3270,7 @@ public class WifiServiceImpl extends BaseWifiService {
             pw.println("mScanPending " + mScanPending);
             mSettingsStore.dump(fd, pw, args);
             mWifiTrafficPoller.dump(fd, pw, args);
+            mTetheredSoftApTracker.dump(pw);
             pw.println();
             pw.println("Locks held:");
             mWifiLockManager.dump(pw);
@@ -3285,15 +3283,16 @@ public class WifiServiceImpl extends BaseWifiService {
             pw.println();
             WifiScoreCard wifiScoreCard = mWifiInjector.getWifiScoreCard();
             String networkListBase64 = mWifiThreadRunner.call(() ->
-                    wifiScoreCard.getNetworkListBase64(true), "");
+                    wifiScoreCard.getNetworkListBase64(true), "", "dump");
             pw.println("WifiScoreCard:");
             pw.println(networkListBase64);
+            mWifiThreadRunner.run(() -> mMemoryStoreImpl.dump(pw), "dump");
 
             updateWifiMetrics();
             mWifiMetrics.dump(fd, pw, args);
 
             pw.println();
-            mWifiThreadRunner.run(() -> mWifiNetworkSuggestionsManager.dump(fd, pw, args));
+            mWifiThreadRunner.run(() -> mWifiNetworkSuggestionsManager.dump(fd, pw, args), "dump");
             pw.println();
             mWifiBackupRestore.dump(fd, pw, args);
             pw.println();
@@ -3306,11 +3305,16 @@ public class WifiServiceImpl extends BaseWifiService {
             SarManager sarManager = mWifiInjector.getSarManager();
             sarManager.dump(fd, pw, args);
             pw.println();
+            mWifiInjector.dumpBinaryLog(pw);
+            pw.println();
+            mWifiInjector.getConnectionPhaseTracer().dump(pw);
+            mWifiThreadRunner.dump(pw);
+            mWifiStateSnapshotPublisher.dump(pw);
             mWifiThreadRunner.run(() -> {
                 mWifiInjector.getWifiNetworkScoreCache().dumpWithLatestScanResults(
                         fd, pw, args, mScanRequestProxy.getScanResults());
                 mWifiInjector.getSettingsConfigStore().dump(fd, pw, args);
-            });
+            }, "dump");
             pw.println();
         }
     }
@@ -3333,7 +3337,8 @@ public class WifiServiceImpl extends BaseWifiService {
         }
 
         return mWifiThreadRunner.call(() ->
-                mWifiLockManager.acquireWifiLock(lockMode, tag, binder, updatedWs), false);
+                mWifiLockManager.acquireWifiLock(lockMode, tag, binder, updatedWs), false,
+                "acquireWifiLock");
     }
 
     @Override
@@ -3349,7 +3354,8 @@ public class WifiServiceImpl extends BaseWifiService {
                 ? new WorkSource(Binder.getCallingUid()) : ws;
 
         mWifiThreadRunner.run(() ->
-                mWifiLockManager.updateWifiLockWorkSource(binder, updatedWs));
+                mWifiLockManager.updateWifiLockWorkSource(binder, updatedWs),
+                "updateWifiLockWorkSource");
     }
 
     @Override
@@ -3360,7 +3366,7 @@ public class WifiServiceImpl extends BaseWifiService {
         mContext.enforceCallingOrSelfPermission(android.Manifest.permission.WAKE_LOCK, null);
 
         return mWifiThreadRunner.call(() ->
-                mWifiLockManager.releaseWifiLock(binder), false);
+                mWifiLockManager.releaseWifiLock(binder), false, "releaseWifiLock");
     }
 
     @Override
@@ -3447,14 +3453,14 @@ public class WifiServiceImpl extends BaseWifiService {
         // Delete all Wifi SSIDs
         List<WifiConfiguration> networks = mWifiThreadRunner.call(
                 () -> mWifiConfigManager.getSavedNetworks(Process.WIFI_UID),
-                Collections.emptyList());
+                Collections.emptyList(), "factoryReset");
         for (WifiConfiguration network : networks) {
             removeNetwork(network.networkId, packageName);
         }
         // Delete all Passpoint configurations
         List<PasspointConfiguration> configs = mWifiThreadRunner.call(
                 () -> mPasspointManager.getProviderConfigs(Process.WIFI_UID /* ignored */, true),
-                Collections.emptyList());
+                Collections.emptyList(), "factoryReset");
         for (PasspointConfiguration config : configs) {
             removePasspointConfigurationInternal(null, config.getUniqueId());
         }
@@ -3502,7 +3508,7 @@ public class WifiServiceImpl extends BaseWifiService {
         if (mVerboseLoggingEnabled) {
             mLog.info("getCurrentNetwork uid=%").c(Binder.getCallingUid()).flush();
         }
-        return mClientModeImpl.syncGetCurrentNetwork(mClientModeImplChannel);
+        return mWifiStateSnapshotPublisher.getSnapshot().getCurrentNetwork();
     }
 
     public static String toHexString(String s) {
@@ -3533,7 +3539,8 @@ public class WifiServiceImpl extends BaseWifiService {
 
         Log.d(TAG, "Retrieving backup data");
         List<WifiConfiguration> wifiConfigurations = mWifiThreadRunner.call(
-                () -> mWifiConfigManager.getConfiguredNetworksWithPasswords(), null);
+                () -> mWifiConfigManager.getConfiguredNetworksWithPasswords(), null,
+                "retrieveBackupData");
         byte[] backupData =
                 mWifiBackupRestore.retrieveBackupDataFromConfigurations(wifiConfigurations);
         Log.d(TAG, "Retrieved backup data");
@@ -3545,12 +3552,7 @@ public class WifiServiceImpl extends BaseWifiService {
      *
      * @param configurations list of WifiConfiguration objects parsed from the backup data.
      */
-    private void restoreNetworks(List<WifiConfiguration> configurations) {
-        if (configurations == null) {
-            Log.e(TAG, "Backup data parse failed");
-            return;
-        }
-        int callingUid = Binder.getCallingUid();
+    private void restoreNetworks(List<WifiConfiguration> configurations, int callingUid) {
         mWifiThreadRunner.run(
                 () -> {
                     for (WifiConfiguration configuration : configurations) {
@@ -3566,7 +3568,34 @@ public class WifiServiceImpl extends BaseWifiService {
                         // Restore auto-join param.
                         mWifiConfigManager.allowAutojoin(networkId, configuration.allowAutojoin);
                     }
-                });
+                }, "restoreNetworks");
+    }
+
+    /**
+     * Helper method to restore networks streamed out of backup data in batches.
+     * The whole backup data is parsed once without applying anything, so that corrupt data never
+     * leaves a partial restore behind. It is then parsed again and the networks are applied one
+     * batch at a time (blocking the parse until each batch is applied, so only one batch is held
+     * in memory), and all the config store writes are coalesced into a single write after the
+     * last batch.
+     *
+     * @param streamParser parses the backup data from a new stream on every call and hands out
+     *                     batches of networks to apply.
+     */
+    private void restoreNetworksInBatches(
+            Predicate<Consumer<List<WifiConfiguration>>> streamParser) {
+        if (!streamParser.test(batch -> { })) {
+            Log.e(TAG, "Backup data parse failed");
+            return;
+        }
+        int callingUid = Binder.getCallingUid();
+        // Posted (not run) so that the batch is always ended even if applying a batch times out.
+        mWifiThreadRunner.post(() -> mWifiConfigManager.startBatchedStoreWrites());
+        boolean success = streamParser.test(batch -> restoreNetworks(batch, callingUid));
+        mWifiThreadRunner.post(() -> mWifiConfigManager.endBatchedStoreWrites());
+        if (!success) {
+            Log.e(TAG, "Backup data parse failed after it was validated");
+        }
     }
 
     /**
@@ -3583,10 +3612,16 @@ public class WifiServiceImpl extends BaseWifiService {
             return;
         }
 
+        if (data == null || data.length == 0) {
+            Log.e(TAG, "Invalid backup data received");
+            return;
+        }
+
         Log.d(TAG, "Restoring backup data");
-        List<WifiConfiguration> wifiConfigurations =
-                mWifiBackupRestore.retrieveConfigurationsFromBackupData(data);
-        restoreNetworks(wifiConfigurations);
+        restoreNetworksInBatches(batchConsumer ->
+                mWifiBackupRestore.retrieveConfigurationsFromBackupStream(
+                        new ByteArrayInputStream(data),
+                        WifiBackupRestore.DEFAULT_RESTORE_BATCH_SIZE, batchConsumer));
         Log.d(TAG, "Restored backup data");
     }
 
@@ -3600,7 +3635,7 @@ public class WifiServiceImpl extends BaseWifiService {
         enforceNetworkSettingsPermission();
         mLog.info("retrieveSoftApBackupData uid=%").c(Binder.getCallingUid()).flush();
         SoftApConfiguration config = mWifiThreadRunner.call(mWifiApConfigStore::getApConfiguration,
-                new SoftApConfiguration.Builder().build());
+                new SoftApConfiguration.Builder().build(), "retrieveSoftApBackupData");
         byte[] backupData =
                 mSoftApBackupRestore.retrieveBackupDataFromSoftApConfiguration(config);
         Log.d(TAG, "Retrieved soft ap backup data");
@@ -3643,11 +3678,18 @@ public class WifiServiceImpl extends BaseWifiService {
             return;
         }
 
+        if (supplicantData == null || supplicantData.length == 0) {
+            Log.e(TAG, "Invalid supplicant backup data received");
+            return;
+        }
+
         Log.d(TAG, "Restoring supplicant backup data");
-        List<WifiConfiguration> wifiConfigurations =
-                mWifiBackupRestore.retrieveConfigurationsFromSupplicantBackupData(
-                        supplicantData, ipConfigData);
-        restoreNetworks(wifiConfigurations);
+        restoreNetworksInBatches(batchConsumer ->
+                mWifiBackupRestore.retrieveConfigurationsFromSupplicantBackupStream(
+                        new ByteArrayInputStream(supplicantData),
+                        (ipConfigData != null && ipConfigData.length != 0)
+                                ? new ByteArrayInputStream(ipConfigData) : null,
+                        WifiBackupRestore.DEFAULT_RESTORE_BATCH_SIZE, batchConsumer));
         Log.d(TAG, "Restored supplicant backup data");
     }
 
@@ -3730,14 +3772,8 @@ public class WifiServiceImpl extends BaseWifiService {
     }
 
     private long getSupportedFeaturesInternal() {
-        final AsyncChannel channel = mClientModeImplChannel;
-        long supportedFeatureSet = 0L;
-        if (channel != null) {
-            supportedFeatureSet = mClientModeImpl.syncGetSupportedFeatures(channel);
-        } else {
-            Log.e(TAG, "mClientModeImplChannel is not initialized");
-            return supportedFeatureSet;
-        }
+        WifiStateSnapshot snapshot = mWifiStateSnapshotPublisher.getSnapshot();
+        long supportedFeatureSet = snapshot.getSupportedFeatures();
         // Mask the feature set against system properties.
         boolean rttSupported = mContext.getPackageManager().hasSystemFeature(
                 PackageManager.FEATURE_WIFI_RTT);
@@ -3761,9 +3797,7 @@ public class WifiServiceImpl extends BaseWifiService {
             // no corresponding flags in vendor HAL, set if overlay enables it.
             supportedFeatureSet |= WifiManager.WIFI_FEATURE_AP_RAND_MAC;
         }
-        if (mWifiThreadRunner.call(
-                () -> mActiveModeWarden.isStaApConcurrencySupported(),
-                false)) {
+        if (snapshot.isStaApConcurrencySupported()) {
             supportedFeatureSet |= WifiManager.WIFI_FEATURE_AP_STA;
         }
         return supportedFeatureSet;
@@ -3852,7 +3886,7 @@ public class WifiServiceImpl extends BaseWifiService {
 
         int success = mWifiThreadRunner.call(() -> mWifiNetworkSuggestionsManager.add(
                 networkSuggestions, callingUid, callingPackageName, callingFeatureId),
-                WifiManager.STATUS_NETWORK_SUGGESTIONS_ERROR_INTERNAL);
+                WifiManager.STATUS_NETWORK_SUGGESTIONS_ERROR_INTERNAL, "addNetworkSuggestions");
         if (success != WifiManager.STATUS_NETWORK_SUGGESTIONS_SUCCESS) {
             Log.e(TAG, "Failed to add network suggestions");
         }
@@ -3880,7 +3914,7 @@ public class WifiServiceImpl extends BaseWifiService {
 
         int success = mWifiThreadRunner.call(() -> mWifiNetworkSuggestionsManager.remove(
                 networkSuggestions, callingUid, callingPackageName),
-                WifiManager.STATUS_NETWORK_SUGGESTIONS_ERROR_INTERNAL);
+                WifiManager.STATUS_NETWORK_SUGGESTIONS_ERROR_INTERNAL, "removeNetworkSuggestions");
         if (success != WifiManager.STATUS_NETWORK_SUGGESTIONS_SUCCESS) {
             Log.e(TAG, "Failed to remove network suggestions");
         }
@@ -3899,7 +3933,8 @@ public class WifiServiceImpl extends BaseWifiService {
             mLog.info("getNetworkSuggestionList uid=%").c(Binder.getCallingUid()).flush();
         }
         return mWifiThreadRunner.call(() ->
-                mWifiNetworkSuggestionsManager.get(callingPackageName), Collections.emptyList());
+                mWifiNetworkSuggestionsManager.get(callingPackageName), Collections.emptyList(),
+                "getNetworkSuggestions");
     }
 
     /**
@@ -3914,7 +3949,8 @@ public class WifiServiceImpl extends BaseWifiService {
             throw new SecurityException("App not allowed to get Wi-Fi factory MAC address "
                     + "(uid = " + uid + ")");
         }
-        String result = mWifiThreadRunner.call(mClientModeImpl::getFactoryMacAddress, null);
+        String result = mWifiThreadRunner.call(mClientModeImpl::getFactoryMacAddress, null,
+                "getFactoryMacAddresses");
         // result can be empty array if either: WifiThreadRunner.call() timed out, or
         // ClientModeImpl.getFactoryMacAddress() returned null.
         // In this particular instance, we don't differentiate the two types of nulls.
@@ -4280,7 +4316,7 @@ public class WifiServiceImpl extends BaseWifiService {
         // Post operation to handler thread
         WifiScoreReport wifiScoreReport = mClientModeImpl.getWifiScoreReport();
         return mWifiThreadRunner.call(() -> wifiScoreReport.setWifiConnectedNetworkScorer(
-                binder, scorer), false);
+                binder, scorer), false, "setWifiConnectedNetworkScorer");
     }
     /**
      * See {@link android.net.wifi.WifiManager#clearWifiConnectedNetworkScorer(
@@ -4308,7 +4344,12 @@ public class WifiServiceImpl extends BaseWifiService {
         mLog.info("setScanThrottleEnabled uid=% verbose=%")
                 .c(Binder.getCallingUid())
                 .c(enable).flush();
-        mWifiThreadRunner.post(()-> mScanRequestProxy.setScanThrottleEnabled(enable));
+        // Invalidated again once written, in case it was computed again in the meantime.
+        mScanThrottleEnabled.invalidate();
+        mWifiThreadRunner.post(() -> {
+            mScanRequestProxy.setScanThrottleEnabled(enable);
+            mScanThrottleEnabled.invalidate();
+        });
     }
 
     /**
@@ -4320,7 +4361,7 @@ public class WifiServiceImpl extends BaseWifiService {
         if (mVerboseLoggingEnabled) {
             mLog.info("isScanThrottleEnabled uid=%").c(Binder.getCallingUid()).flush();
         }
-        return mWifiThreadRunner.call(()-> mScanRequestProxy.isScanThrottleEnabled(), true);
+        return mScanThrottleEnabled.get(true);
     }
 
     /**
@@ -4332,7 +4373,12 @@ public class WifiServiceImpl extends BaseWifiService {
         mLog.info("setWalkeupEnabled uid=% verbose=%")
                 .c(Binder.getCallingUid())
                 .c(enable).flush();
-        mWifiThreadRunner.post(()-> mWifiInjector.getWakeupController().setEnabled(enable));
+        // Invalidated again once written, in case it was computed again in the meantime.
+        mAutoWakeupEnabled.invalidate();
+        mWifiThreadRunner.post(() -> {
+            mWifiInjector.getWakeupController().setEnabled(enable);
+            mAutoWakeupEnabled.invalidate();
+        });
     }
 
     /**
@@ -4344,6 +4390,6 @@ public class WifiServiceImpl extends BaseWifiService {
         if (mVerboseLoggingEnabled) {
             mLog.info("isAutoWakeupEnabled uid=%").c(Binder.getCallingUid()).flush();
         }
-        return mWifiThreadRunner.call(()-> mWifiInjector.getWakeupController().isEnabled(), false);
+        return mAutoWakeupEnabled.get(false);
     }
 }
@@ -37,12 +37,22 @@ import java.io.FileDescriptor;
 import java.io.IOException;
 import java.io.PrintWriter;
 import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.Collection;
+import java.util.Collections;
 import java.util.HashMap;
+import java.util.LinkedHashSet;
+import java.util.List;
 import java.util.Map;
+import java.util.Set;
 
 /**
  * Store data for storing wifi settings. These are key (string) / value pairs that are stored in
  * WifiConfigStore.xml file in a separate section.
+ *
+ * Reads are served lock-free from an immutable snapshot array indexed by {@link Key#ordinal},
+ * which is rebuilt and republished whenever the settings are modified, since several of these
+ * settings are read on hot paths.
  */
 public class WifiSettingsConfigStore {
     private static final String TAG = "WifiSettingsConfigStore";
@@ -89,9 +99,19 @@ public class WifiSettingsConfigStore {
     private final SettingsMigrationDataHolder mSettingsMigrationDataHolder;
     private final WifiConfigManager mWifiConfigManager;
 
+    /**
+     * Marker stored in {@link #mSnapshot} for keys which have no value stored in settings.
+     */
+    private static final Object VALUE_NOT_SET = new Object();
+
     private final Object mLock = new Object();
     @GuardedBy("mLock")
     private final Map<String, Object> mSettings = new HashMap<>();
+    /**
+     * Immutable copy of the value of each key in {@link #mSettings} indexed by
+     * {@link Key#ordinal}, or {@link #VALUE_NOT_SET}. Replaced wholesale on every modification.
+     */
+    private volatile Object[] mSnapshot = createEmptySnapshot();
     @GuardedBy("mLock")
     private final Map<String, Map<OnSettingsChangedListener, Handler>> mListeners =
             new HashMap<>();
@@ -126,50 +146,78 @@ public class WifiSettingsConfigStore {
         wifiConfigStore.registerStoreData(new StoreData());
     }
 
-    private void invokeAllListeners() {
-        synchronized (mLock) {
-            for (Key key : sKeys) {
-                invokeListeners(key);
+    private static Object[] createEmptySnapshot() {
+        Object[] snapshot = new Object[sKeys.size()];
+        Arrays.fill(snapshot, VALUE_NOT_SET);
+        return snapshot;
+    }
+
+    /**
+     * Rebuild the read snapshot from {@link #mSettings} and publish it.
+     */
+    @GuardedBy("mLock")
+    private void publishSnapshotLocked() {
+        Object[] snapshot = createEmptySnapshot();
+        for (Key key : sKeys) {
+            if (mSettings.containsKey(key.key)) {
+                snapshot[key.ordinal] = mSettings.get(key.key);
             }
         }
+        mSnapshot = snapshot;
     }
 
-    private <T> void invokeListeners(@NonNull Key<T> key) {
+    private void invokeAllListeners() {
+        invokeListeners(sKeys);
+    }
+
+    /**
+     * Invoke the listeners registered for the provided keys. All the callbacks destined to the
+     * same handler are batched into a single post.
+     */
+    private void invokeListeners(@NonNull Collection<Key> keys) {
+        Map<Handler, List<Runnable>> callbacksPerHandler = new HashMap<>();
         synchronized (mLock) {
-            if (!mSettings.containsKey(key.key)) return;
-            Object newValue = mSettings.get(key.key);
-            Map<OnSettingsChangedListener, Handler> listeners = mListeners.get(key.key);
-            if (listeners == null || listeners.isEmpty()) return;
-            for (Map.Entry<OnSettingsChangedListener, Handler> listener
-                    : listeners.entrySet()) {
-                // Trigger the callback in the appropriate handler.
-                listener.getValue().post(() ->
-                        listener.getKey().onSettingsChanged(key, newValue));
+            Object[] snapshot = mSnapshot;
+            for (Key key : keys) {
+                Object newValue = snapshot[key.ordinal];
+                if (newValue == VALUE_NOT_SET) continue;
+                Map<OnSettingsChangedListener, Handler> listeners = mListeners.get(key.key);
+                if (listeners == null || listeners.isEmpty()) continue;
+                for (Map.Entry<OnSettingsChangedListener, Handler> listener
+                        : listeners.entrySet()) {
+                    callbacksPerHandler.computeIfAbsent(listener.getValue(),
+                            ignore -> new ArrayList<>()).add(() ->
+                                    listener.getKey().onSettingsChanged(key, newValue));
+                }
             }
         }
+        for (Map.Entry<Handler, List<Runnable>> entry : callbacksPerHandler.entrySet()) {
+            // Trigger the callbacks in the appropriate handler.
+            List<Runnable> callbacks = entry.getValue();
+            entry.getKey().post(() -> {
+                for (Runnable callback : callbacks) {
+                    callback.run();
+                }
+            });
+        }
     }
 
     /**
      * Trigger config store writes and invoke listeners in the main wifi service looper's handler.
      */
     private void triggerSaveToStoreAndInvokeAllListeners() {
-        mHandler.post(() -> {
-            mHasNewDataToSerialize = true;
-            mWifiConfigManager.saveToStore(true);
-
-            invokeAllListeners();
-        });
+        triggerSaveToStoreAndInvokeListeners(sKeys);
     }
 
     /**
      * Trigger config store writes and invoke listeners in the main wifi service looper's handler.
      */
-    private <T> void triggerSaveToStoreAndInvokeListeners(@NonNull Key<T> key) {
+    private void triggerSaveToStoreAndInvokeListeners(@NonNull Collection<Key> keys) {
         mHandler.post(() -> {
             mHasNewDataToSerialize = true;
             mWifiConfigManager.saveToStore(true);
 
-            invokeListeners(key);
+            invokeListeners(keys);
         });
     }
 
@@ -186,17 +234,19 @@ public class WifiSettingsConfigStore {
             return;
         }
         Log.i(TAG, "Migrating data out of settings to shared preferences");
-
-        mSettings.put(WIFI_P2P_DEVICE_NAME.key,
-                mCachedMigrationData.getP2pDeviceName());
-        mSettings.put(WIFI_P2P_PENDING_FACTORY_RESET.key,
-                mCachedMigrationData.isP2pFactoryResetPending());
-        mSettings.put(WIFI_SCAN_ALWAYS_AVAILABLE.key,
-                mCachedMigrationData.isScanAlwaysAvailable());
-        mSettings.put(WIFI_SCAN_THROTTLE_ENABLED.key,
-                mCachedMigrationData.isScanThrottleEnabled());
-        mSettings.put(WIFI_VERBOSE_LOGGING_ENABLED.key,
-                mCachedMigrationData.isVerboseLoggingEnabled());
+        synchronized (mLock) {
+            mSettings.put(WIFI_P2P_DEVICE_NAME.key,
+                    mCachedMigrationData.getP2pDeviceName());
+            mSettings.put(WIFI_P2P_PENDING_FACTORY_RESET.key,
+                    mCachedMigrationData.isP2pFactoryResetPending());
+            mSettings.put(WIFI_SCAN_ALWAYS_AVAILABLE.key,
+                    mCachedMigrationData.isScanAlwaysAvailable());
+            mSettings.put(WIFI_SCAN_THROTTLE_ENABLED.key,
+                    mCachedMigrationData.isScanThrottleEnabled());
+            mSettings.put(WIFI_VERBOSE_LOGGING_ENABLED.key,
+                    mCachedMigrationData.isVerboseLoggingEnabled());
+            publishSnapshotLocked();
+        }
         triggerSaveToStoreAndInvokeAllListeners();
     }
 
@@ -209,20 +259,30 @@ public class WifiSettingsConfigStore {
     public <T> void put(@NonNull Key<T> key, @Nullable T value) {
         synchronized (mLock) {
             mSettings.put(key.key, value);
+            publishSnapshotLocked();
         }
-        triggerSaveToStoreAndInvokeListeners(key);
+        triggerSaveToStoreAndInvokeListeners(Collections.singletonList(key));
+    }
+
+    /**
+     * Start a transaction to store multiple values to the stored settings at once.
+     * The values are published together on {@link Transaction#commit()}, with a single config
+     * store write and a single batch of listener callbacks.
+     */
+    public Transaction beginTransaction() {
+        return new Transaction();
     }
 
     /**
      * Retrieve a value from the stored settings.
+     * Note: This does not take any lock, the value is read from the last published snapshot.
      *
      * @param key One of the settings keys.
      * @return value stored in settings, defValue if the key does not exist.
      */
     public @Nullable <T> T get(@NonNull Key<T> key) {
-        synchronized (mLock) {
-            return (T) mSettings.getOrDefault(key.key, key.defaultValue);
-        }
+        Object value = mSnapshot[key.ordinal];
+        return value == VALUE_NOT_SET ? key.defaultValue : (T) value;
     }
 
     /**
@@ -267,10 +327,12 @@ public class WifiSettingsConfigStore {
         pw.println();
         pw.println("Dump of " + TAG);
         pw.println("Settings:");
-        for (Map.Entry<String, Object> entry : mSettings.entrySet()) {
-            pw.print(entry.getKey());
-            pw.print("=");
-            pw.println(entry.getValue());
+        synchronized (mLock) {
+            for (Map.Entry<String, Object> entry : mSettings.entrySet()) {
+                pw.print(entry.getKey());
+                pw.print("=");
+                pw.println(entry.getValue());
+            }
         }
         if (mCachedMigrationData == null) return;
         pw.println("Migration data:");
@@ -292,6 +354,41 @@ public class WifiSettingsConfigStore {
         pw.println();
     }
 
+    /**
+     * Set of values to be stored together to the stored settings.
+     */
+    public class Transaction {
+        private final Map<Key, Object> mValues = new HashMap<>();
+
+        private Transaction() {}
+
+        /**
+         * Add a value to be stored when the transaction is committed.
+         *
+         * @param key One of the settings keys.
+         * @param value Value to be stored.
+         */
+        public <T> Transaction put(@NonNull Key<T> key, @Nullable T value) {
+            mValues.put(key, value);
+            return this;
+        }
+
+        /**
+         * Store all the values added to this transaction.
+         */
+        public void commit() {
+            if (mValues.isEmpty()) return;
+            Set<Key> keys = new LinkedHashSet<>(mValues.keySet());
+            synchronized (mLock) {
+                for (Map.Entry<Key, Object> entry : mValues.entrySet()) {
+                    mSettings.put(entry.getKey().key, entry.getValue());
+                }
+                publishSnapshotLocked();
+            }
+            triggerSaveToStoreAndInvokeListeners(keys);
+        }
+    }
+
     /**
      * Base class to store string key and its default value.
      * @param <T> Type of the value.
@@ -299,10 +396,15 @@ public class WifiSettingsConfigStore {
     public static class Key<T> {
         public final String key;
         public final T defaultValue;
+        /**
+         * Index of this key in the read snapshot.
+         */
+        final int ordinal;
 
         private Key(@NonNull String key, T defaultValue) {
             this.key = key;
             this.defaultValue = defaultValue;
+            this.ordinal = sKeys.size();
             sKeys.add(this);
         }
 
@@ -359,9 +461,10 @@ public class WifiSettingsConfigStore {
             if (values != null) {
                 synchronized (mLock) {
                     mSettings.putAll(values);
-                    // Invoke all the registered listeners.
-                    invokeAllListeners();
+                    publishSnapshotLocked();
                 }
+                // Invoke all the registered listeners.
+                invokeAllListeners();
             }
         }
 
@@ -369,6 +472,7 @@ public class WifiSettingsConfigStore {
         public void resetData() {
             synchronized (mLock) {
                 mSettings.clear();
+                publishSnapshotLocked();
             }
         }
 
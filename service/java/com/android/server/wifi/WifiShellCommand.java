@@ -118,6 +118,7 @@ public class WifiShellCommand extends BasicShellCommandHandler {
     private final Context mContext;
     private final ConnectivityManager mConnectivityManager;
     private final WifiCarrierInfoManager mWifiCarrierInfoManager;
+    private final ConnectionPhaseTracer mConnectionPhaseTracer;
 
     WifiShellCommand(WifiInjector wifiInjector, WifiServiceImpl wifiService, Context context) {
         mClientModeImpl = wifiInjector.getClientModeImpl();
@@ -132,6 +133,7 @@ public class WifiShellCommand extends BasicShellCommandHandler {
         mContext = context;
         mConnectivityManager = context.getSystemService(ConnectivityManager.class);
         mWifiCarrierInfoManager = wifiInjector.getWifiCarrierInfoManager();
+        mConnectionPhaseTracer = wifiInjector.getConnectionPhaseTracer();
     }
 
     @Override
@@ -270,6 +272,24 @@ public class WifiShellCommand extends BasicShellCommandHandler {
                 case "send-link-probe": {
                     return sendLinkProbe(pw);
                 }
+                case "get-connection-phase-stats": {
+                    int numConnections = ConnectionPhaseTracer.DEFAULT_NUM_CONNECTIONS;
+                    String arg = getNextArg();
+                    if (arg != null) {
+                        try {
+                            numConnections = Integer.parseInt(arg);
+                        } catch (NumberFormatException e) {
+                            numConnections = 0;
+                        }
+                        if (numConnections < 1) {
+                            pw.println("Invalid argument to 'get-connection-phase-stats' "
+                                    + "- must be a positive integer");
+                            return -1;
+                        }
+                    }
+                    mConnectionPhaseTracer.analyze(pw, numConnections);
+                    return 0;
+                }
                 case "force-softap-channel": {
                     boolean enabled = getNextArgRequiredTrueOrFalse("enabled", "disabled");
                     if (enabled) {
@@ -1083,6 +1103,11 @@ public class WifiShellCommand extends BasicShellCommandHandler {
         pw.println("    Clears the user disabled networks list.");
         pw.println("  send-link-probe");
         pw.println("    Manually triggers a link probe.");
+        pw.println("  get-connection-phase-stats [<count>]");
+        pw.println("    Prints the p50/p95 latency of each phase (selection, association,");
+        pw.println("    handshake, ip provisioning, validation) of the last <count> connections");
+        pw.println("    (default " + ConnectionPhaseTracer.DEFAULT_NUM_CONNECTIONS
+                + "), and lists the outliers.");
         pw.println("  force-softap-channel enabled <int> | disabled");
         pw.println("    Sets whether soft AP channel is forced to <int> MHz");
         pw.println("    or left for normal   operation.");
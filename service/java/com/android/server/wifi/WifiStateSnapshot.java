@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.server.wifi;
+
+import android.annotation.NonNull;
+import android.annotation.Nullable;
+import android.net.Network;
+import android.net.wifi.WifiConfiguration;
+import android.net.wifi.WifiInfo;
+import android.net.wifi.WifiManager;
+import android.os.Process;
+
+import java.util.ArrayList;
+import java.util.Collections;
+import java.util.List;
+
+/**
+ * An immutable, versioned view of the state read by the frequently polled WifiServiceImpl
+ * getters, published by {@link WifiStateSnapshotPublisher}.
+ *
+ * Each publication creates a new snapshot with the next version, so a snapshot can be read on
+ * any thread without locking or posting to the wifi thread.
+ */
+public final class WifiStateSnapshot {
+    private final long mVersion;
+    private int mWifiState = WifiManager.WIFI_STATE_DISABLED;
+    private WifiInfo mConnectionInfo = new WifiInfo();
+    private Network mCurrentNetwork;
+    private long mSupportedFeatures;
+    private boolean mStaApConcurrencySupported;
+    // Saved networks with passwords masked, as read by the wifi UID.
+    private List<WifiConfiguration> mSavedNetworks = Collections.emptyList();
+
+    /**
+     * Creates the initial snapshot, with wifi disabled and no saved networks.
+     */
+    WifiStateSnapshot() {
+        mVersion = 0;
+    }
+
+    private WifiStateSnapshot(WifiStateSnapshot from) {
+        mVersion = from.mVersion + 1;
+        mWifiState = from.mWifiState;
+        mConnectionInfo = from.mConnectionInfo;
+        mCurrentNetwork = from.mCurrentNetwork;
+        mSupportedFeatures = from.mSupportedFeatures;
+        mStaApConcurrencySupported = from.mStaApConcurrencySupported;
+        mSavedNetworks = from.mSavedNetworks;
+    }
+
+    /**
+     * Returns the next version of this snapshot, with the wifi state replaced.
+     */
+    WifiStateSnapshot withWifiState(int wifiState) {
+        WifiStateSnapshot snapshot = new WifiStateSnapshot(this);
+        snapshot.mWifiState = wifiState;
+        return snapshot;
+    }
+
+    /**
+     * Returns the next version of this snapshot, with the client mode state replaced.
+     * @param connectionInfo copy of the connection info, owned by the snapshot from now on
+     */
+    WifiStateSnapshot withClientModeState(int wifiState, @NonNull WifiInfo connectionInfo,
+            @Nullable Network currentNetwork, long supportedFeatures) {
+        WifiStateSnapshot snapshot = new WifiStateSnapshot(this);
+        snapshot.mWifiState = wifiState;
+        snapshot.mConnectionInfo = connectionInfo;
+        snapshot.mCurrentNetwork = currentNetwork;
+        snapshot.mSupportedFeatures = supportedFeatures;
+        return snapshot;
+    }
+
+    /**
+     * Returns the next version of this snapshot, with the STA + AP concurrency support replaced.
+     */
+    WifiStateSnapshot withStaApConcurrencySupported(boolean supported) {
+        WifiStateSnapshot snapshot = new WifiStateSnapshot(this);
+        snapshot.mStaApConcurrencySupported = supported;
+        return snapshot;
+    }
+
+    /**
+     * Returns the next version of this snapshot, with the saved networks replaced.
+     * @param savedNetworks saved networks with passwords masked, owned by the snapshot from now on
+     */
+    WifiStateSnapshot withSavedNetworks(@NonNull List<WifiConfiguration> savedNetworks) {
+        WifiStateSnapshot snapshot = new WifiStateSnapshot(this);
+        snapshot.mSavedNetworks = Collections.unmodifiableList(savedNetworks);
+        return snapshot;
+    }
+
+    /**
+     * Returns the version of this snapshot, which increases with every publication.
+     */
+    public long getVersion() {
+        return mVersion;
+    }
+
+    /**
+     * Returns the wifi state, one of WifiManager.WIFI_STATE_*.
+     */
+    public int getWifiState() {
+        return mWifiState;
+    }
+
+    /**
+     * Returns a copy of the connection info, which the caller may modify.
+     */
+    @NonNull
+    public WifiInfo getConnectionInfo() {
+        return new WifiInfo(mConnectionInfo);
+    }
+
+    /**
+     * Returns the network of the current connection, or null if not connected.
+     */
+    @Nullable
+    public Network getCurrentNetwork() {
+        return mCurrentNetwork;
+    }
+
+    /**
+     * Returns the feature set supported by the client interface, as a bitmask of
+     * WifiManager.WIFI_FEATURE_*.
+     */
+    public long getSupportedFeatures() {
+        return mSupportedFeatures;
+    }
+
+    /**
+     * Returns whether the chip supports a concurrent client and soft AP.
+     */
+    public boolean isStaApConcurrencySupported() {
+        return mStaApConcurrencySupported;
+    }
+
+    /**
+     * Returns copies of the saved networks, with passwords masked, so callers can't modify the
+     * published snapshot.
+     *
+     * @param targetUid Target UID for MAC address reading: -1 (Invalid UID) = mask all,
+     *                  WIFI||SYSTEM = mask none, <other> = mask all but the targetUid (carrier
+     *                  app). See {@link WifiConfigManager#getSavedNetworks(int)}.
+     */
+    @NonNull
+    public List<WifiConfiguration> getSavedNetworks(int targetUid) {
+        boolean maskNone = targetUid == Process.WIFI_UID || targetUid == Process.SYSTEM_UID;
+        List<WifiConfiguration> networks = new ArrayList<>(mSavedNetworks.size());
+        for (WifiConfiguration network : mSavedNetworks) {
+            WifiConfiguration copy = new WifiConfiguration(network);
+            if (!maskNone && network.creatorUid != targetUid) {
+                WifiConfigManager.maskRandomizedMacAddressInWifiConfiguration(copy);
+            }
+            networks.add(copy);
+        }
+        return networks;
+    }
+}
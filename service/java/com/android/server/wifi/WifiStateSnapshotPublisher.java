@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.server.wifi;
+
+import android.annotation.NonNull;
+import android.annotation.Nullable;
+import android.net.Network;
+import android.net.wifi.WifiConfiguration;
+import android.net.wifi.WifiInfo;
+import android.os.Process;
+
+import java.io.PrintWriter;
+import java.util.List;
+import java.util.concurrent.atomic.AtomicReference;
+
+/**
+ * Publishes the {@link WifiStateSnapshot} read by the WifiServiceImpl getters.
+ *
+ * ClientModeImpl, WifiConfigManager and ActiveModeWarden publish their part of the state when it
+ * changes, on the wifi thread; binder threads read the latest snapshot without locking, instead
+ * of posting to the wifi thread and waiting for the reply on every call.
+ */
+public class WifiStateSnapshotPublisher {
+    private final AtomicReference<WifiStateSnapshot> mSnapshot =
+            new AtomicReference<>(new WifiStateSnapshot());
+
+    /**
+     * Returns the latest snapshot.
+     */
+    @NonNull
+    public WifiStateSnapshot getSnapshot() {
+        return mSnapshot.get();
+    }
+
+    /**
+     * Publishes the wifi state, one of WifiManager.WIFI_STATE_*.
+     */
+    public void publishWifiState(int wifiState) {
+        mSnapshot.updateAndGet(snapshot -> snapshot.getWifiState() == wifiState
+                ? snapshot : snapshot.withWifiState(wifiState));
+    }
+
+    /**
+     * Publishes the client mode state.
+     * @param connectionInfo copy of the connection info, which must not be modified afterwards
+     * @param currentNetwork network of the current connection, or null if not connected
+     * @param supportedFeatures feature set supported by the client interface
+     */
+    public void publishClientModeState(int wifiState, @NonNull WifiInfo connectionInfo,
+            @Nullable Network currentNetwork, long supportedFeatures) {
+        mSnapshot.updateAndGet(snapshot -> snapshot.withClientModeState(wifiState,
+                connectionInfo, currentNetwork, supportedFeatures));
+    }
+
+    /**
+     * Publishes whether the chip supports a concurrent client and soft AP.
+     */
+    public void publishStaApConcurrencySupported(boolean supported) {
+        mSnapshot.updateAndGet(snapshot -> snapshot.isStaApConcurrencySupported() == supported
+                ? snapshot : snapshot.withStaApConcurrencySupported(supported));
+    }
+
+    /**
+     * Publishes the saved networks.
+     * @param savedNetworks saved networks with passwords masked, as read by the wifi UID, which
+     *                      must not be modified afterwards
+     */
+    public void publishSavedNetworks(@NonNull List<WifiConfiguration> savedNetworks) {
+        mSnapshot.updateAndGet(snapshot -> snapshot.withSavedNetworks(savedNetworks));
+    }
+
+    /**
+     * Dump the latest snapshot.
+     */
+    public void dump(PrintWriter pw) {
+        WifiStateSnapshot snapshot = getSnapshot();
+        pw.println("Dump of WifiStateSnapshotPublisher");
+        pw.println("version=" + snapshot.getVersion()
+                + " wifiState=" + snapshot.getWifiState()
+                + " supportedFeatures=0x" + Long.toHexString(snapshot.getSupportedFeatures())
+                + " staApConcurrencySupported=" + snapshot.isStaApConcurrencySupported()
+                + " savedNetworks=" + snapshot.getSavedNetworks(Process.WIFI_UID).size());
+    }
+}
@@ -21,10 +21,17 @@ import android.annotation.Nullable;
 import android.os.Handler;
 import android.os.Looper;
 import android.os.SystemClock;
+import android.util.ArrayMap;
 import android.util.Log;
 
+import com.android.internal.annotations.GuardedBy;
+import com.android.internal.annotations.VisibleForTesting;
 import com.android.server.wifi.util.GeneralUtil.Mutable;
+import com.android.server.wifi.util.IntHistogram;
 
+import java.io.PrintWriter;
+import java.util.Arrays;
+import java.util.concurrent.CompletableFuture;
 import java.util.function.Supplier;
 
 import javax.annotation.concurrent.ThreadSafe;
@@ -41,13 +48,50 @@ public class WifiThreadRunner {
 
     /** Max wait time for posting blocking runnables */
     private static final int RUN_WITH_SCISSORS_TIMEOUT_MILLIS = 4000;
+    /** Task name of the blocking calls made without one */
+    private static final String UNNAMED_TASK = "<unnamed>";
+    // Log-scale (powers of 2) bucket boundaries of the wait time histograms, in milliseconds.
+    private static final int[] WAIT_TIME_BUCKET_BOUNDARIES_MS =
+            {1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, RUN_WITH_SCISSORS_TIMEOUT_MILLIS};
+
+    /**
+     * Time spent blocked by the calls made for a task.
+     */
+    @VisibleForTesting
+    static class WaitStats {
+        public int count;
+        public int timeouts;
+        public long totalWaitMs;
+        public int maxWaitMs;
+        public final IntHistogram waitHistogram = new IntHistogram(WAIT_TIME_BUCKET_BOUNDARIES_MS);
+
+        @Override
+        public String toString() {
+            return "count=" + count + " timeouts=" + timeouts
+                    + " avg=" + totalWaitMs / Math.max(count, 1)
+                    + " p95=" + (int) waitHistogram.quantileFunction(0.95, 0, maxWaitMs)
+                    + " max=" + maxWaitMs + " histogram=" + waitHistogram;
+        }
+    }
 
     private final Handler mHandler;
+    private final Object mLock = new Object();
+    @GuardedBy("mLock")
+    private final ArrayMap<String, WaitStats> mWaitStats = new ArrayMap<>();
 
     public WifiThreadRunner(Handler handler) {
         mHandler = handler;
     }
 
+    /**
+     * Same as {@link #call(Supplier, Object, String)}, recording the time blocked under an
+     * unnamed task.
+     */
+    @Nullable
+    public <T> T call(@NonNull Supplier<T> supplier, T valueToReturnOnTimeout) {
+        return call(supplier, valueToReturnOnTimeout, UNNAMED_TASK);
+    }
+
     /**
      * Synchronously runs code on the main Wifi thread and return a value.
      * <b>Blocks</b> the calling thread until the callable completes execution on the main Wifi
@@ -67,13 +111,15 @@ public class WifiThreadRunner {
      *         type, it may still return null and throw a NullPointerException when auto-unboxing!
      *         Recommend capturing the return value in an Integer or Long instead and explicitly
      *         handling nulls.
+     * @param taskName name of the task, typically the calling API (e.g. "getConnectionInfo"),
+     *                 under which the time blocked is recorded for {@link #dump(PrintWriter)}
      */
     @Nullable
-    public <T> T call(@NonNull Supplier<T> supplier, T valueToReturnOnTimeout) {
+    public <T> T call(@NonNull Supplier<T> supplier, T valueToReturnOnTimeout,
+            @NonNull String taskName) {
         Mutable<T> result = new Mutable<>();
-        boolean runWithScissorsSuccess = runWithScissors(mHandler,
-                () -> result.value = supplier.get(),
-                RUN_WITH_SCISSORS_TIMEOUT_MILLIS);
+        boolean runWithScissorsSuccess = runWithScissorsAndRecord(
+                () -> result.value = supplier.get(), taskName);
         if (runWithScissorsSuccess) {
             return result.value;
         } else {
@@ -82,17 +128,24 @@ public class WifiThreadRunner {
         }
     }
 
+    /**
+     * Same as {@link #run(Runnable, String)}, recording the time blocked under an unnamed task.
+     */
+    public boolean run(@NonNull Runnable runnable) {
+        return run(runnable, UNNAMED_TASK);
+    }
+
     /**
      * Runs a Runnable on the main Wifi thread and <b>blocks</b> the calling thread until the
      * Runnable completes execution on the main Wifi thread.
      *
      * BEWARE OF DEADLOCKS!!!
      *
+     * @param taskName name of the task, under which the time blocked is recorded
      * @return true if the runnable executed successfully, false otherwise
      */
-    public boolean run(@NonNull Runnable runnable) {
-        boolean runWithScissorsSuccess =
-                runWithScissors(mHandler, runnable, RUN_WITH_SCISSORS_TIMEOUT_MILLIS);
+    public boolean run(@NonNull Runnable runnable, @NonNull String taskName) {
+        boolean runWithScissorsSuccess = runWithScissorsAndRecord(runnable, taskName);
         if (runWithScissorsSuccess) {
             return true;
         } else {
@@ -111,6 +164,205 @@ public class WifiThreadRunner {
         return mHandler.post(runnable);
     }
 
+    /**
+     * Asynchronously runs code on the main Wifi thread, without blocking the calling thread.
+     *
+     * @param <T> the return type
+     * @param supplier the lambda that should be run on the main Wifi thread
+     * @return a future completed with the value retrieved from the main Wifi thread, or
+     *         completed exceptionally if the supplier threw or could not be posted
+     */
+    @NonNull
+    public <T> CompletableFuture<T> callAsync(@NonNull Supplier<T> supplier) {
+        CompletableFuture<T> future = new CompletableFuture<>();
+        boolean posted = mHandler.post(() -> {
+            try {
+                future.complete(supplier.get());
+            } catch (RuntimeException e) {
+                future.completeExceptionally(e);
+            }
+        });
+        if (!posted) {
+            future.completeExceptionally(
+                    new IllegalStateException("WifiThreadRunner.callAsync() failed to post"));
+        }
+        return future;
+    }
+
+    /**
+     * Creates a {@link CachedValue} serving the value computed by |supplier| on the main Wifi
+     * thread.
+     *
+     * @param refreshAgeMs age after which the cached value is refreshed asynchronously
+     * @param maxAgeMs age after which the cached value is not served anymore, and get() blocks
+     *                 until it is computed again
+     * @param taskName name of the task under which the blocking calls are recorded
+     */
+    @NonNull
+    public <T> CachedValue<T> newCachedValue(@NonNull Supplier<T> supplier, long refreshAgeMs,
+            long maxAgeMs, @NonNull String taskName) {
+        return new CachedValue<>(supplier, refreshAgeMs, maxAgeMs, taskName);
+    }
+
+    /**
+     * A value computed on the main Wifi thread, for binder calls whose answer may be slightly
+     * out of date.
+     *
+     * The first call to {@link #get(Object)} blocks until the value is computed. After that,
+     * get() returns the latest value computed immediately, and once it is older than the refresh
+     * age, refreshes it asynchronously for later calls. A value older than the max age (e.g. if
+     * the refreshes are stuck behind the main Wifi thread) is not served, get() blocks for a new
+     * one instead. The owner must {@link #invalidate()} the value when it knows it changed, so
+     * that the next call to get() blocks for the new value.
+     */
+    @ThreadSafe
+    public class CachedValue<T> {
+        private final Supplier<T> mSupplier;
+        private final long mRefreshAgeMs;
+        private final long mMaxAgeMs;
+        private final String mTaskName;
+        private final Object mCacheLock = new Object();
+        @GuardedBy("mCacheLock")
+        private boolean mHasValue;
+        @GuardedBy("mCacheLock")
+        private T mValue;
+        @GuardedBy("mCacheLock")
+        private long mValueTimeMs;
+        // Incremented on invalidation, so that values computed before are discarded.
+        @GuardedBy("mCacheLock")
+        private int mGeneration;
+        @GuardedBy("mCacheLock")
+        private boolean mRefreshPending;
+
+        private CachedValue(Supplier<T> supplier, long refreshAgeMs, long maxAgeMs,
+                String taskName) {
+            mSupplier = supplier;
+            mRefreshAgeMs = refreshAgeMs;
+            mMaxAgeMs = maxAgeMs;
+            mTaskName = taskName;
+        }
+
+        /**
+         * Returns the latest value computed, or blocks until the value is computed if there is
+         * none or it is older than the max age.
+         *
+         * @param valueToReturnOnTimeout value to return if the value could not be computed within
+         *                               the timeout
+         */
+        @Nullable
+        public T get(T valueToReturnOnTimeout) {
+            int generation;
+            synchronized (mCacheLock) {
+                long ageMs = SystemClock.elapsedRealtime() - mValueTimeMs;
+                if (mHasValue && ageMs <= mMaxAgeMs) {
+                    if (!mRefreshPending && ageMs > mRefreshAgeMs) {
+                        mRefreshPending = true;
+                        refreshAsync(mGeneration);
+                    }
+                    return mValue;
+                }
+                generation = mGeneration;
+            }
+            Mutable<T> result = new Mutable<>();
+            boolean runWithScissorsSuccess = runWithScissorsAndRecord(() -> {
+                result.value = mSupplier.get();
+                setValue(result.value, generation);
+            }, mTaskName);
+            if (!runWithScissorsSuccess) {
+                Log.e(TAG, "WifiThreadRunner.CachedValue.get() timed out!",
+                        new Throwable("Stack trace:"));
+                return valueToReturnOnTimeout;
+            }
+            return result.value;
+        }
+
+        /**
+         * Discards the value computed, so that the next call to {@link #get(Object)} blocks
+         * until it is computed again.
+         */
+        public void invalidate() {
+            synchronized (mCacheLock) {
+                mHasValue = false;
+                mValue = null;
+                mRefreshPending = false;
+                mGeneration++;
+            }
+        }
+
+        private void refreshAsync(int generation) {
+            callAsync(mSupplier).whenComplete((value, throwable) -> {
+                if (throwable != null) {
+                    Log.e(TAG, "Failed to refresh " + mTaskName, throwable);
+                    synchronized (mCacheLock) {
+                        if (generation == mGeneration) {
+                            mRefreshPending = false;
+                        }
+                    }
+                    return;
+                }
+                setValue(value, generation);
+            });
+        }
+
+        private void setValue(T value, int generation) {
+            synchronized (mCacheLock) {
+                if (generation != mGeneration) {
+                    return;
+                }
+                mHasValue = true;
+                mValue = value;
+                mValueTimeMs = SystemClock.elapsedRealtime();
+                mRefreshPending = false;
+            }
+        }
+    }
+
+    private boolean runWithScissorsAndRecord(Runnable runnable, String taskName) {
+        long startMs = SystemClock.uptimeMillis();
+        boolean success = runWithScissors(mHandler, runnable, RUN_WITH_SCISSORS_TIMEOUT_MILLIS);
+        int waitMs = (int) (SystemClock.uptimeMillis() - startMs);
+        synchronized (mLock) {
+            WaitStats stats = mWaitStats.get(taskName);
+            if (stats == null) {
+                stats = new WaitStats();
+                mWaitStats.put(taskName, stats);
+            }
+            stats.count++;
+            if (!success) {
+                stats.timeouts++;
+            }
+            stats.totalWaitMs += waitMs;
+            stats.maxWaitMs = Math.max(stats.maxWaitMs, waitMs);
+            stats.waitHistogram.increment(waitMs);
+        }
+        return success;
+    }
+
+    @VisibleForTesting
+    WaitStats getWaitStats(String taskName) {
+        synchronized (mLock) {
+            return mWaitStats.get(taskName);
+        }
+    }
+
+    /**
+     * Dump the time blocked by the calls of each task, worst first.
+     */
+    public void dump(PrintWriter pw) {
+        pw.println("WifiThreadRunner blocking call wait times (ms):");
+        synchronized (mLock) {
+            Integer[] order = new Integer[mWaitStats.size()];
+            for (int i = 0; i < order.length; i++) {
+                order[i] = i;
+            }
+            Arrays.sort(order, (a, b) -> Long.compare(
+                    mWaitStats.valueAt(b).totalWaitMs, mWaitStats.valueAt(a).totalWaitMs));
+            for (int i : order) {
+                pw.println("  " + mWaitStats.keyAt(i) + ": " + mWaitStats.valueAt(i));
+            }
+        }
+    }
+
     // Note: @hide methods copied from android.os.Handler
     /**
      * Runs the specified task synchronously.
@@ -17,36 +17,66 @@
 package com.android.server.wifi;
 
 import android.annotation.NonNull;
+import android.content.Context;
 import android.net.wifi.ITrafficStateCallback;
 import android.net.wifi.WifiManager;
 import android.os.Handler;
 import android.os.IBinder;
-import android.os.RemoteException;
 import android.util.Log;
 
 import com.android.server.wifi.util.ExternalCallbackTracker;
+import com.android.wifi.resources.R;
 
 import java.io.FileDescriptor;
 import java.io.PrintWriter;
+import java.util.concurrent.Executor;
 
 /**
  * Polls for traffic stats and notifies the clients
+ *
+ * Each direction is considered active once its packet rate reaches
+ * {@link #ACTIVE_PACKETS_PER_SECOND_THR}, and idle again only once its rate falls below
+ * {@link #IDLE_PACKETS_PER_SECOND_THR}, so that sparse background traffic does not make the
+ * activity flap between polls. A client is handed the activity of the last poll as soon as it
+ * registers, rather than at the next poll, and is then not notified again until
+ * config_wifiTrafficStateCallbackMinIntervalMs has passed since its last callback; changes in
+ * between are coalesced, and the client gets the activity current at the first poll after the
+ * interval, if it differs from what it was last sent. Clients are invoked on the broadcast
+ * executor, off the wifi thread.
+ *
+ * The first poll after polling starts, or after {@link #resetPollState()}, only sets the baseline
+ * for the next one, so that neither the counts of a new connection nor the time spent without
+ * polling are taken as the rate of a single interval.
  */
 public class WifiTrafficPoller {
     private static final String TAG = "WifiTrafficPoller";
 
+    /** Packet rate at which an idle direction becomes active. */
+    private static final double ACTIVE_PACKETS_PER_SECOND_THR = 1.0;
+    /** Packet rate below which an active direction becomes idle. */
+    private static final double IDLE_PACKETS_PER_SECOND_THR = 0.2;
+    /** Value of mLastPollTimeMs when there is no baseline poll. */
+    private static final long NO_POLL_TIME = -1;
+
+    private final Clock mClock;
+    private final int mMinCallbackIntervalMs;
+
     private long mTxPkts = 0;
     private long mRxPkts = 0;
+    private long mLastPollTimeMs = NO_POLL_TIME;
+
+    // Accessed via Binder thread (getDataActivity), and the main Wifi thread.
+    private volatile int mDataActivity = WifiManager.TrafficStateCallback.DATA_ACTIVITY_NONE;
 
-    private int mLastActivity = -1;
+    private long mNumCallbacksSent = 0;
+    private long mNumCallbacksSuppressed = 0;
 
     private static class CallbackWrapper {
         public final ITrafficStateCallback callback;
-        /**
-         * On the first invocation, the callback is invoked no matter if the data activity changed
-         * or not.
-         */
-        public boolean isFirstInvocation = true;
+        /** Data activity last sent to the callback. */
+        public int lastActivity;
+        /** Time of the last invocation, from {@link Clock#getElapsedSinceBootMillis()}. */
+        public long lastInvocationTimeMs;
 
         CallbackWrapper(ITrafficStateCallback callback) {
             this.callback = callback;
@@ -55,17 +85,35 @@ public class WifiTrafficPoller {
 
     private final ExternalCallbackTracker<CallbackWrapper> mRegisteredCallbacks;
 
-    public WifiTrafficPoller(@NonNull Handler handler) {
-        mRegisteredCallbacks = new ExternalCallbackTracker<>(handler);
+    public WifiTrafficPoller(@NonNull Context context, @NonNull Handler handler,
+            @NonNull Executor broadcastExecutor, @NonNull Clock clock) {
+        mRegisteredCallbacks = new ExternalCallbackTracker<>(handler, broadcastExecutor);
+        mClock = clock;
+        mMinCallbackIntervalMs = context.getResources().getInteger(
+                R.integer.config_wifiTrafficStateCallbackMinIntervalMs);
     }
 
     /**
      * Add a new callback to the traffic poller.
      */
     public void addCallback(IBinder binder, ITrafficStateCallback callback, int callbackId) {
-        if (!mRegisteredCallbacks.add(binder, new CallbackWrapper(callback), callbackId)) {
+        final CallbackWrapper newWrapper = new CallbackWrapper(callback);
+        if (!mRegisteredCallbacks.add(binder, newWrapper, callbackId)) {
             Log.e(TAG, "Failed to add callback");
+            return;
         }
+        // Hand the new client the current activity, instead of waiting for the next poll.
+        final int activity = mDataActivity;
+        final long nowMs = mClock.getElapsedSinceBootMillis();
+        mRegisteredCallbacks.broadcast("onStateChanged", wrapper -> {
+            if (wrapper != newWrapper) {
+                return false;
+            }
+            wrapper.lastActivity = activity;
+            wrapper.lastInvocationTimeMs = nowMs;
+            mNumCallbacksSent++;
+            return true;
+        }, wrapper -> wrapper.callback.onStateChanged(activity));
     }
 
     /**
@@ -75,6 +123,50 @@ public class WifiTrafficPoller {
         mRegisteredCallbacks.remove(callbackId);
     }
 
+    /**
+     * Forgets the last poll, so that the next one is only used as a baseline. To be called when
+     * polling starts or stops.
+     */
+    public void resetPollState() {
+        mLastPollTimeMs = NO_POLL_TIME;
+    }
+
+    /**
+     * Returns the data activity computed at the last poll, one of
+     * WifiManager.TrafficStateCallback.DATA_ACTIVITY_*. May be called from any thread.
+     */
+    public int getDataActivity() {
+        return mDataActivity;
+    }
+
+    /**
+     * Returns the number of callbacks invoked.
+     */
+    public long getNumCallbacksSent() {
+        return mNumCallbacksSent;
+    }
+
+    /**
+     * Returns the number of callbacks held back because the client was notified less than the
+     * minimum interval before.
+     */
+    public long getNumCallbacksSuppressed() {
+        return mNumCallbacksSuppressed;
+    }
+
+    /**
+     * Returns whether a direction with |packets| sent or received since the last poll is active,
+     * given whether it was active at the last poll.
+     */
+    private static boolean isDirectionActive(long packets, long elapsedMs, boolean wasActive) {
+        if (packets <= 0) {
+            return false;
+        }
+        double packetsPerSecond = packets * 1000.0 / elapsedMs;
+        return packetsPerSecond >= (wasActive
+                ? IDLE_PACKETS_PER_SECOND_THR : ACTIVE_PACKETS_PER_SECOND_THR);
+    }
+
     /**
      * Notifies clients of data activity if the activity changed since the last update.
      */
@@ -83,33 +175,46 @@ public class WifiTrafficPoller {
             return;
         }
 
-        long sent = newTxPkts - mTxPkts;
-        long received = newRxPkts - mRxPkts;
+        long nowMs = mClock.getElapsedSinceBootMillis();
+        if (mLastPollTimeMs == NO_POLL_TIME) {
+            mTxPkts = newTxPkts;
+            mRxPkts = newRxPkts;
+            mLastPollTimeMs = nowMs;
+            return;
+        }
+        long elapsedMs = Math.max(nowMs - mLastPollTimeMs, 1);
+        int lastActivity = mDataActivity;
         int dataActivity = WifiManager.TrafficStateCallback.DATA_ACTIVITY_NONE;
-        if (sent > 0) {
+        if (isDirectionActive(newTxPkts - mTxPkts, elapsedMs,
+                (lastActivity & WifiManager.TrafficStateCallback.DATA_ACTIVITY_OUT) != 0)) {
             dataActivity |= WifiManager.TrafficStateCallback.DATA_ACTIVITY_OUT;
         }
-        if (received > 0) {
+        if (isDirectionActive(newRxPkts - mRxPkts, elapsedMs,
+                (lastActivity & WifiManager.TrafficStateCallback.DATA_ACTIVITY_IN) != 0)) {
             dataActivity |= WifiManager.TrafficStateCallback.DATA_ACTIVITY_IN;
         }
 
-        for (CallbackWrapper wrapper : mRegisteredCallbacks.getCallbacks()) {
-            // if this callback hasn't been triggered before, or the data activity changed,
-            // notify the callback
-            if (wrapper.isFirstInvocation || dataActivity != mLastActivity) {
-                wrapper.isFirstInvocation = false;
-                try {
-                    wrapper.callback.onStateChanged(dataActivity);
-                } catch (RemoteException e) {
-                    // Failed to reach, skip
-                    // Client removal is handled in WifiService
-                }
-            }
-        }
-
         mTxPkts = newTxPkts;
         mRxPkts = newRxPkts;
-        mLastActivity = dataActivity;
+        mLastPollTimeMs = nowMs;
+        mDataActivity = dataActivity;
+
+        final int activity = dataActivity;
+        mRegisteredCallbacks.broadcast("onStateChanged", wrapper -> {
+            // if the data activity changed since the callback was last triggered, notify the
+            // callback unless it was notified too recently
+            if (activity == wrapper.lastActivity) {
+                return false;
+            }
+            if (nowMs - wrapper.lastInvocationTimeMs < mMinCallbackIntervalMs) {
+                mNumCallbacksSuppressed++;
+                return false;
+            }
+            wrapper.lastActivity = activity;
+            wrapper.lastInvocationTimeMs = nowMs;
+            mNumCallbacksSent++;
+            return true;
+        }, wrapper -> wrapper.callback.onStateChanged(activity));
     }
 
     /**
@@ -118,7 +223,11 @@ public class WifiTrafficPoller {
     public void dump(FileDescriptor fd, PrintWriter pw, String[] args) {
         pw.println("mTxPkts " + mTxPkts);
         pw.println("mRxPkts " + mRxPkts);
-        pw.println("mLastActivity " + mLastActivity);
+        pw.println("mDataActivity " + mDataActivity);
         pw.println("mRegisteredCallbacks " + mRegisteredCallbacks.getNumCallbacks());
+        pw.println("mMinCallbackIntervalMs " + mMinCallbackIntervalMs);
+        pw.println("mNumCallbacksSent " + mNumCallbacksSent);
+        pw.println("mNumCallbacksSuppressed " + mNumCallbacksSuppressed);
+        mRegisteredCallbacks.dump(pw);
     }
 }
@@ -55,6 +55,7 @@ import android.net.wifi.WifiScanner;
 import android.net.wifi.WifiSsid;
 import android.os.Handler;
 import android.os.RemoteException;
+import android.os.SystemClock;
 import android.text.TextUtils;
 import android.util.Log;
 import android.util.MutableBoolean;
@@ -72,10 +73,15 @@ import com.android.server.wifi.util.NativeUtil;
 
 import com.google.errorprone.annotations.CompileTimeConstant;
 
+import java.io.PrintWriter;
 import java.util.ArrayList;
 import java.util.HashMap;
 import java.util.List;
+import java.util.Map;
 import java.util.Set;
+import java.util.concurrent.atomic.AtomicInteger;
+import java.util.function.Consumer;
+import java.util.function.Supplier;
 import java.util.stream.Collectors;
 
 /**
@@ -97,6 +103,20 @@ public class WifiVendorHal {
     @VisibleForTesting
     WifiLog mLog = new LogcatLog("WifiVendorHal");
 
+    /**
+     * Sets a log which records messages cheaply, and only writes them to logcat as verbose
+     * logging asks, such as {@link BinaryLog}. It gets the errors, and the chatty logging when
+     * verbose logging is enabled.
+     */
+    public void setRecordingLog(WifiLog log) {
+        synchronized (sLock) {
+            if (mVerboseLog == mLog) {
+                mVerboseLog = log;
+            }
+            mLog = log;
+        }
+    }
+
     /**
      * Enables or disables verbose logging
      *
@@ -143,16 +163,8 @@ public class WifiVendorHal {
      */
     private boolean boolResult(boolean result) {
         if (mVerboseLog == sNoLog) return result;
-        // Currently only seen if verbose logging is on
-
-        Thread cur = Thread.currentThread();
-        StackTraceElement[] trace = cur.getStackTrace();
-
-        mVerboseLog.err("% returns %")
-                .c(niceMethodName(trace, 3))
-                .c(result)
-                .flush();
-
+        // The log names the calling method, when it formats the message
+        mVerboseLog.trace("returns %", 1).c(result).flush();
         return result;
     }
 
@@ -163,16 +175,8 @@ public class WifiVendorHal {
      */
     private String stringResult(String result) {
         if (mVerboseLog == sNoLog) return result;
-        // Currently only seen if verbose logging is on
-
-        Thread cur = Thread.currentThread();
-        StackTraceElement[] trace = cur.getStackTrace();
-
-        mVerboseLog.err("% returns %")
-                .c(niceMethodName(trace, 3))
-                .c(result)
-                .flush();
-
+        // The log names the calling method, when it formats the message
+        mVerboseLog.trace("returns %", 1).c(result).flush();
         return result;
     }
 
@@ -183,16 +187,10 @@ public class WifiVendorHal {
      */
     private byte[] byteArrayResult(byte[] result) {
         if (mVerboseLog == sNoLog) return result;
-        // Currently only seen if verbose logging is on
-
-        Thread cur = Thread.currentThread();
-        StackTraceElement[] trace = cur.getStackTrace();
-
-        mVerboseLog.err("% returns %")
-                .c(niceMethodName(trace, 3))
+        // The log names the calling method, when it formats the message
+        mVerboseLog.trace("returns %", 1)
                 .c(result == null ? "(null)" : HexDump.dumpHexString(result))
                 .flush();
-
         return result;
     }
 
@@ -257,9 +255,22 @@ public class WifiVendorHal {
     // https://docs.oracle.com/javase/specs/jls/se7/html/jls-17.html#jls-17.5
     private final Handler mHalEventHandler;
 
-    public WifiVendorHal(HalDeviceManager halDeviceManager, Handler handler) {
+    /**
+     * Handler of the dedicated thread running non-critical calls, such as statistics and debug
+     * dumps, which may take long in the HAL. Control calls stay synchronous on the caller's
+     * thread, and do not queue behind them.
+     */
+    private final Handler mAsyncCallHandler;
+
+    /**
+     * @param handler Handler on which HAL events and async call completions are delivered.
+     * @param asyncCallHandler Handler of the thread running the non-critical async calls.
+     */
+    public WifiVendorHal(HalDeviceManager halDeviceManager, Handler handler,
+            Handler asyncCallHandler) {
         mHalDeviceManager = halDeviceManager;
         mHalEventHandler = handler;
+        mAsyncCallHandler = asyncCallHandler;
         mHalDeviceManagerStatusCallbacks = new HalDeviceManagerStatusListener();
         mIWifiStaIfaceEventCallback = new StaIfaceEventCallback();
         mIWifiChipEventCallback = new ChipEventCallback();
@@ -269,6 +280,107 @@ public class WifiVendorHal {
 
     public static final Object sLock = new Object();
 
+    /**
+     * Maximum number of async calls queued or running at a time. Calls made while the lane is
+     * full are rejected, so that a stuck HAL does not grow the queue without bound.
+     */
+    @VisibleForTesting
+    static final int MAX_PENDING_ASYNC_CALLS = 8;
+
+    private final AtomicInteger mNumPendingAsyncCalls = new AtomicInteger();
+
+    /**
+     * Latencies of the async calls of one kind.
+     */
+    private static class AsyncCallStats {
+        public int numCalls;
+        public int numRejected;
+        public long totalQueuedUs;
+        public long maxQueuedUs;
+        public long totalRunUs;
+        public long maxRunUs;
+    }
+
+    // Guarded by itself.
+    private final Map<String, AsyncCallStats> mAsyncCallStats = new HashMap<>();
+
+    private AsyncCallStats getAsyncCallStatsLocked(String name) {
+        AsyncCallStats stats = mAsyncCallStats.get(name);
+        if (stats == null) {
+            stats = new AsyncCallStats();
+            mAsyncCallStats.put(name, stats);
+        }
+        return stats;
+    }
+
+    /**
+     * Runs |call| on the async call lane, then delivers its result to |onComplete| on the HAL
+     * event handler. A call which throws a RuntimeException delivers null.
+     *
+     * @return true if the call was queued, false if the lane is full.
+     */
+    private <T> boolean submitAsyncCall(String name, Supplier<T> call,
+            @NonNull Consumer<T> onComplete) {
+        final long queuedNs = SystemClock.elapsedRealtimeNanos();
+        if (mNumPendingAsyncCalls.incrementAndGet() > MAX_PENDING_ASYNC_CALLS
+                || !mAsyncCallHandler.post(() -> runAsyncCall(name, call, onComplete, queuedNs))) {
+            mNumPendingAsyncCalls.decrementAndGet();
+            synchronized (mAsyncCallStats) {
+                getAsyncCallStatsLocked(name).numRejected++;
+            }
+            mLog.err("% rejected, % async calls pending").c(name)
+                    .c(MAX_PENDING_ASYNC_CALLS).flush();
+            return false;
+        }
+        return true;
+    }
+
+    private <T> void runAsyncCall(String name, Supplier<T> call, Consumer<T> onComplete,
+            long queuedNs) {
+        final long startNs = SystemClock.elapsedRealtimeNanos();
+        T result = null;
+        try {
+            result = call.get();
+        } catch (RuntimeException e) {
+            // Caught so that the async call thread keeps running; the caller gets no result.
+            mLog.err("% failed: %").c(name).c(e.toString()).flush();
+        } finally {
+            mNumPendingAsyncCalls.decrementAndGet();
+        }
+        final long queuedUs = (startNs - queuedNs) / 1000;
+        final long runUs = (SystemClock.elapsedRealtimeNanos() - startNs) / 1000;
+        synchronized (mAsyncCallStats) {
+            AsyncCallStats stats = getAsyncCallStatsLocked(name);
+            stats.numCalls++;
+            stats.totalQueuedUs += queuedUs;
+            stats.maxQueuedUs = Math.max(stats.maxQueuedUs, queuedUs);
+            stats.totalRunUs += runUs;
+            stats.maxRunUs = Math.max(stats.maxRunUs, runUs);
+        }
+        final T completedResult = result;
+        mHalEventHandler.post(() -> onComplete.accept(completedResult));
+    }
+
+    /**
+     * Dump the latencies of the async calls.
+     */
+    public void dump(PrintWriter pw) {
+        pw.println("WifiVendorHal async calls: pending=" + mNumPendingAsyncCalls.get());
+        synchronized (mAsyncCallStats) {
+            for (Map.Entry<String, AsyncCallStats> entry : mAsyncCallStats.entrySet()) {
+                AsyncCallStats stats = entry.getValue();
+                pw.println("  " + entry.getKey() + ": calls=" + stats.numCalls
+                        + " rejected=" + stats.numRejected
+                        + " avgQueuedUs=" + (stats.numCalls == 0
+                                ? 0 : stats.totalQueuedUs / stats.numCalls)
+                        + " maxQueuedUs=" + stats.maxQueuedUs
+                        + " avgRunUs=" + (stats.numCalls == 0
+                                ? 0 : stats.totalRunUs / stats.numCalls)
+                        + " maxRunUs=" + stats.maxRunUs);
+            }
+        }
+    }
+
     private void handleRemoteException(RemoteException e) {
         String methodName = niceMethodName(Thread.currentThread().getStackTrace(), 3);
         mVerboseLog.err("% RemoteException in HIDL call %").c(methodName).c(e.toString()).flush();
@@ -922,6 +1034,32 @@ public class WifiVendorHal {
         }
     }
 
+    /**
+     * Gets the latest scan results on the async call lane.
+     *
+     * @param ifaceName Name of the interface.
+     * @param onComplete called on the HAL event handler with the results, or null.
+     * @return true if the call was queued, false if the async call lane is full.
+     */
+    public boolean getBgScanResultsAsync(@NonNull String ifaceName,
+            @NonNull Consumer<WifiScanner.ScanData[]> onComplete) {
+        return submitAsyncCall("getBgScanResults", () -> getBgScanResults(ifaceName),
+                onComplete);
+    }
+
+    /**
+     * Gets the link layer statistics on the async call lane.
+     *
+     * @param ifaceName Name of the interface.
+     * @param onComplete called on the HAL event handler with the statistics, or null.
+     * @return true if the call was queued, false if the async call lane is full.
+     */
+    public boolean getWifiLinkLayerStatsAsync(@NonNull String ifaceName,
+            @NonNull Consumer<WifiLinkLayerStats> onComplete) {
+        return submitAsyncCall("getWifiLinkLayerStats", () -> getWifiLinkLayerStats(ifaceName),
+                onComplete);
+    }
+
     /**
      * Get the link layer statistics
      *
@@ -1738,6 +1876,18 @@ public class WifiVendorHal {
         }
     }
 
+    /**
+     * Indicates to driver that all the data has to be uploaded urgently, on the async call lane.
+     *
+     * @param onComplete called on the HAL event handler with whether the request succeeded, or
+     *                   null if it failed unexpectedly.
+     * @return true if the call was queued, false if the async call lane is full.
+     */
+    public boolean getRingBufferDataAsync(String ringName, @NonNull Consumer<Boolean> onComplete) {
+        return submitAsyncCall("getRingBufferData", () -> getRingBufferData(ringName),
+                onComplete);
+    }
+
     /**
      * request hal to flush ring buffers to files
      */
@@ -1804,6 +1954,66 @@ public class WifiVendorHal {
         return ans.value;
     }
 
+    /**
+     * Request vendor debug info from the firmware, on the async call lane.
+     *
+     * The dump is requested without holding the lock, so that control calls made meanwhile do
+     * not wait for the firmware.
+     *
+     * @param onComplete called on the HAL event handler with the dump, or null.
+     * @return true if the call was queued, false if the async call lane is full.
+     */
+    public boolean getFwMemoryDumpAsync(@NonNull Consumer<byte[]> onComplete) {
+        return submitAsyncCall("getFwMemoryDump", () -> requestDebugDumpWithoutLock(true),
+                onComplete);
+    }
+
+    /**
+     * Request vendor debug info from the driver, on the async call lane.
+     *
+     * The dump is requested without holding the lock, so that control calls made meanwhile do
+     * not wait for the driver.
+     *
+     * @param onComplete called on the HAL event handler with the dump, or null.
+     * @return true if the call was queued, false if the async call lane is full.
+     */
+    public boolean getDriverStateDumpAsync(@NonNull Consumer<byte[]> onComplete) {
+        return submitAsyncCall("getDriverStateDump", () -> requestDebugDumpWithoutLock(false),
+                onComplete);
+    }
+
+    private byte[] requestDebugDumpWithoutLock(boolean firmware) {
+        class AnswerBox {
+            public byte[] value;
+        }
+        AnswerBox ans = new AnswerBox();
+        final IWifiChip chip;
+        synchronized (sLock) {
+            chip = mIWifiChip;
+        }
+        if (chip == null) return null;
+        try {
+            if (firmware) {
+                chip.requestFirmwareDebugDump((status, blob) -> {
+                    if (!ok(status)) return;
+                    ans.value = NativeUtil.byteArrayFromArrayList(blob);
+                });
+            } else {
+                chip.requestDriverDebugDump((status, blob) -> {
+                    if (!ok(status)) return;
+                    ans.value = NativeUtil.byteArrayFromArrayList(blob);
+                });
+            }
+        } catch (RemoteException e) {
+            synchronized (sLock) {
+                // The chip may have been torn down and replaced meanwhile.
+                if (mIWifiChip == chip) handleRemoteException(e);
+            }
+            return null;
+        }
+        return ans.value;
+    }
+
     /**
      * Start packet fate monitoring
      * <p>
@@ -1105,8 +1105,8 @@ public class PasspointManager {
             if (mWifiConfigManager.shouldUseAggressiveRandomization(config)) {
                 config.setRandomizedMacAddress(MacAddress.fromString(DEFAULT_MAC_ADDRESS));
             } else {
-                MacAddress result = mMacAddressUtil.calculatePersistentMac(config.getKey(),
-                        mMacAddressUtil.obtainMacRandHashFunction(Process.WIFI_UID));
+                MacAddress result = mMacAddressUtil.getOrCalculatePersistentMac(config.getKey(),
+                        Process.WIFI_UID);
                 if (result != null) {
                     config.setRandomizedMacAddress(result);
                 }
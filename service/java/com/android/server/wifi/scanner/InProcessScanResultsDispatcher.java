@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.server.wifi.scanner;
+
+import android.annotation.NonNull;
+import android.net.wifi.ScanResult;
+import android.net.wifi.WifiScanner;
+import android.net.wifi.WifiScanner.ScanData;
+
+import com.android.internal.annotations.GuardedBy;
+
+import java.io.PrintWriter;
+import java.util.Arrays;
+import java.util.concurrent.Executor;
+
+/**
+ * Delivers the results of all single scans to listeners in the wifi service process, directly
+ * from {@link WifiScanningServiceImpl} instead of through a WifiScanner client channel.
+ *
+ * Every listener is handed the same ScanData for a scan, on its own executor. The results are
+ * shared with the other listeners and with the scanning service, so listeners must not modify
+ * them; copy the results before changing or holding on to them.
+ *
+ * Owned by WifiInjector, so that listeners may register before WifiScanningService is started.
+ * Thread-safe.
+ */
+public class InProcessScanResultsDispatcher {
+    private static class Registration {
+        public final Executor executor;
+        public final WifiScanner.ScanListener listener;
+
+        Registration(Executor executor, WifiScanner.ScanListener listener) {
+            this.executor = executor;
+            this.listener = listener;
+        }
+    }
+
+    private final Object mLock = new Object();
+    // Replaced on every change, so that results are dispatched without holding the lock.
+    @GuardedBy("mLock")
+    private volatile Registration[] mRegistrations = new Registration[0];
+    // Only written on the scanning thread.
+    private volatile long mNumScansDispatched;
+    private volatile long mNumFullResultsDispatched;
+
+    /**
+     * Register a listener for the results of all single scans, whoever requested them.
+     *
+     * Registering a listener which is already registered has no effect.
+     * @param executor the executor on which to call the listener
+     * @param listener the listener to call, which must not modify the results it is handed
+     */
+    public void registerScanListener(@NonNull Executor executor,
+            @NonNull WifiScanner.ScanListener listener) {
+        synchronized (mLock) {
+            Registration[] registrations = mRegistrations;
+            for (Registration registration : registrations) {
+                if (registration.listener == listener) {
+                    return;
+                }
+            }
+            Registration[] updated = Arrays.copyOf(registrations, registrations.length + 1);
+            updated[registrations.length] = new Registration(executor, listener);
+            mRegistrations = updated;
+        }
+    }
+
+    /**
+     * Unregister a listener registered with {@link #registerScanListener}. Results already
+     * handed to its executor may still be delivered.
+     */
+    public void unregisterScanListener(@NonNull WifiScanner.ScanListener listener) {
+        synchronized (mLock) {
+            Registration[] registrations = mRegistrations;
+            for (int i = 0; i < registrations.length; i++) {
+                if (registrations[i].listener == listener) {
+                    Registration[] updated = new Registration[registrations.length - 1];
+                    System.arraycopy(registrations, 0, updated, 0, i);
+                    System.arraycopy(registrations, i + 1, updated, i, updated.length - i);
+                    mRegistrations = updated;
+                    return;
+                }
+            }
+        }
+    }
+
+    /**
+     * Returns the number of registered listeners.
+     */
+    public int getNumListeners() {
+        return mRegistrations.length;
+    }
+
+    /**
+     * Hand the results of a single scan to all listeners.
+     * @param allResults the results, wrapped as delivered to WifiScanner listeners
+     */
+    void dispatchResults(@NonNull ScanData[] allResults) {
+        Registration[] registrations = mRegistrations;
+        for (Registration registration : registrations) {
+            WifiScanner.ScanListener listener = registration.listener;
+            registration.executor.execute(() -> listener.onResults(allResults));
+        }
+        mNumScansDispatched++;
+    }
+
+    /**
+     * Hand a full scan result to all listeners.
+     */
+    void dispatchFullResult(@NonNull ScanResult result) {
+        Registration[] registrations = mRegistrations;
+        for (Registration registration : registrations) {
+            WifiScanner.ScanListener listener = registration.listener;
+            registration.executor.execute(() -> listener.onFullResult(result));
+        }
+        mNumFullResultsDispatched++;
+    }
+
+    /**
+     * Dump the number of listeners and of results dispatched.
+     */
+    public void dump(PrintWriter pw) {
+        pw.println("InProcessScanResultsDispatcher: listeners=" + getNumListeners()
+                + " scansDispatched=" + mNumScansDispatched
+                + " fullResultsDispatched=" + mNumFullResultsDispatched);
+    }
+}
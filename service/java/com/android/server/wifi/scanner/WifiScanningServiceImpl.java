@@ -399,6 +399,7 @@ public class WifiScanningServiceImpl extends IWifiScanner.Stub {
     private final FrameworkFacade mFrameworkFacade;
     private final WifiPermissionsUtil mWifiPermissionsUtil;
     private final WifiNative mWifiNative;
+    private final InProcessScanResultsDispatcher mInProcessScanResultsDispatcher;
 
     WifiScanningServiceImpl(Context context, Looper looper,
             WifiScannerImpl.WifiScannerImplFactory scannerImplFactory,
@@ -417,6 +418,7 @@ public class WifiScanningServiceImpl extends IWifiScanner.Stub {
         mFrameworkFacade = wifiInjector.getFrameworkFacade();
         mWifiPermissionsUtil = wifiInjector.getWifiPermissionsUtil();
         mWifiNative = wifiInjector.getWifiNative();
+        mInProcessScanResultsDispatcher = wifiInjector.getInProcessScanResultsDispatcher();
         mPreviousSchedule = null;
     }
 
@@ -1249,6 +1251,7 @@ public class WifiScanningServiceImpl extends IWifiScanner.Stub {
             for (RequestInfo<Void> entry : mSingleScanListeners) {
                 entry.reportEvent(WifiScanner.CMD_FULL_SCAN_RESULT, 0, result);
             }
+            mInProcessScanResultsDispatcher.dispatchFullResult(result);
         }
 
         void reportScanResults(@NonNull ScanData results) {
@@ -1279,6 +1282,13 @@ public class WifiScanningServiceImpl extends IWifiScanner.Stub {
                         describeForLog(allResults));
                 entry.reportEvent(WifiScanner.CMD_SCAN_RESULT, 0, parcelableAllResults);
             }
+            // In-process listeners share the results, so they are logged once for all of them.
+            int numInProcessListeners = mInProcessScanResultsDispatcher.getNumListeners();
+            if (numInProcessListeners > 0) {
+                localLog("inProcessScanResults: listeners=" + numInProcessListeners + ","
+                        + describeForLog(allResults));
+            }
+            mInProcessScanResultsDispatcher.dispatchResults(allResults);
 
             // Cache full band (with DFS or not) scan results.
             if (WifiScanner.isFullBandScan(results.getBandScanned(), true)) {
@@ -2519,6 +2529,7 @@ public class WifiScanningServiceImpl extends IWifiScanner.Stub {
         for (ClientInfo client : mClients.values()) {
             pw.println("  " + client);
         }
+        mInProcessScanResultsDispatcher.dump(pw);
         pw.println("listeners:");
         for (ClientInfo client : mClients.values()) {
             Collection<ScanSettings> settingsList =
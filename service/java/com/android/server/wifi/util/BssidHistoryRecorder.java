@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.server.wifi.util;
+
+import android.net.wifi.WifiInfo;
+
+import java.io.PrintWriter;
+import java.util.Calendar;
+import java.util.function.IntFunction;
+
+/**
+ * A history of events about BSSIDs, such as connection failures or blocklist changes, kept as
+ * fixed-size binary records in a preallocated ring.
+ *
+ * Recording an event stores its time, SSID, packed BSSID, event and reason codes, RSSI and
+ * failure streak, without allocating; the SSID is kept by reference. The records are only
+ * formatted, using names supplied by the owner for the event and reason codes, when dumped.
+ *
+ * Not thread-safe.
+ */
+public class BssidHistoryRecorder {
+    /**
+     * Packed value of BSSIDs which are not MAC addresses, such as "any".
+     */
+    public static final long INVALID_BSSID = -1;
+
+    private final IntFunction<String> mEventToString;
+    private final IntFunction<String> mReasonToString;
+    private final long[] mTimeMs;
+    private final String[] mSsids;
+    private final long[] mBssids;
+    private final int[] mEvents;
+    private final int[] mReasons;
+    private final int[] mRssis;
+    private final int[] mStreaks;
+    // Index of the oldest record, and number of records held.
+    private int mStart;
+    private int mSize;
+
+    /**
+     * @param capacity number of records to keep
+     * @param eventToString names the event codes when dumping
+     * @param reasonToString names the reason codes when dumping
+     */
+    public BssidHistoryRecorder(int capacity, IntFunction<String> eventToString,
+            IntFunction<String> reasonToString) {
+        if (capacity < 1) {
+            throw new IllegalArgumentException("capacity must be positive: " + capacity);
+        }
+        mEventToString = eventToString;
+        mReasonToString = reasonToString;
+        mTimeMs = new long[capacity];
+        mSsids = new String[capacity];
+        mBssids = new long[capacity];
+        mEvents = new int[capacity];
+        mReasons = new int[capacity];
+        mRssis = new int[capacity];
+        mStreaks = new int[capacity];
+    }
+
+    /**
+     * Records an event, overwriting the oldest record if the ring is full.
+     * @param timeMs wall clock time of the event
+     * @param ssid SSID of the network the event is about, or null if unknown
+     * @param bssid BSSID the event is about, packed by {@link #packBssid(String)}
+     * @param event event code, named by the owner
+     * @param reason reason code, named by the owner
+     * @param rssi RSSI of the BSSID, or {@link WifiInfo#INVALID_RSSI} if unknown
+     * @param streak failure streak of the BSSID
+     */
+    public void record(long timeMs, String ssid, long bssid, int event, int reason, int rssi,
+            int streak) {
+        int index;
+        if (mSize < mTimeMs.length) {
+            index = (mStart + mSize) % mTimeMs.length;
+            mSize++;
+        } else {
+            index = mStart;
+            mStart = (mStart + 1) % mTimeMs.length;
+        }
+        mTimeMs[index] = timeMs;
+        mSsids[index] = ssid;
+        mBssids[index] = bssid;
+        mEvents[index] = event;
+        mReasons[index] = reason;
+        mRssis[index] = rssi;
+        mStreaks[index] = streak;
+    }
+
+    /**
+     * Returns the number of records held.
+     */
+    public int size() {
+        return mSize;
+    }
+
+    /**
+     * Packs a BSSID of the form "xx:xx:xx:xx:xx:xx" into the low 48 bits of a long, without
+     * allocating.
+     * @return the packed BSSID, or {@link #INVALID_BSSID} if |bssid| is not a MAC address
+     */
+    public static long packBssid(String bssid) {
+        if (bssid == null || bssid.length() != 17) {
+            return INVALID_BSSID;
+        }
+        long packed = 0;
+        for (int i = 0; i < 17; i += 3) {
+            int high = Character.digit(bssid.charAt(i), 16);
+            int low = Character.digit(bssid.charAt(i + 1), 16);
+            if (high < 0 || low < 0 || (i < 15 && bssid.charAt(i + 2) != ':')) {
+                return INVALID_BSSID;
+            }
+            packed = (packed << 8) | (high << 4) | low;
+        }
+        return packed;
+    }
+
+    /**
+     * Formats a BSSID packed by {@link #packBssid(String)}.
+     */
+    public static String formatBssid(long bssid) {
+        if (bssid == INVALID_BSSID) {
+            return "any";
+        }
+        StringBuilder sb = new StringBuilder(17);
+        for (int shift = 40; shift >= 0; shift -= 8) {
+            if (shift < 40) {
+                sb.append(':');
+            }
+            int octet = (int) (bssid >> shift) & 0xff;
+            sb.append(Character.forDigit(octet >> 4, 16));
+            sb.append(Character.forDigit(octet & 0xf, 16));
+        }
+        return sb.toString();
+    }
+
+    /**
+     * Dump the records, oldest first.
+     */
+    public void dump(PrintWriter pw) {
+        Calendar calendar = Calendar.getInstance();
+        for (int i = 0; i < mSize; i++) {
+            int index = (mStart + i) % mTimeMs.length;
+            calendar.setTimeInMillis(mTimeMs[index]);
+            StringBuilder sb = new StringBuilder();
+            sb.append(String.format("%tm-%td %tH:%tM:%tS.%tL", calendar, calendar, calendar,
+                    calendar, calendar, calendar));
+            if (mSsids[index] != null) {
+                sb.append(" SSID=").append(mSsids[index]).append(',');
+            }
+            sb.append(" BSSID=").append(formatBssid(mBssids[index]));
+            sb.append(", event=").append(mEventToString.apply(mEvents[index]));
+            sb.append(", reason=").append(mReasonToString.apply(mReasons[index]));
+            if (mRssis[index] != WifiInfo.INVALID_RSSI) {
+                sb.append(", rssi=").append(mRssis[index]);
+            }
+            sb.append(", streak=").append(mStreaks[index]);
+            pw.println(sb.toString());
+        }
+    }
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.server.wifi.util;
+
+import java.util.ArrayDeque;
+import java.util.Arrays;
+import java.util.zip.Deflater;
+
+/**
+ * A ring buffer of bytes, held compressed.
+ *
+ * Appended data is gathered into segments of |segmentBytes|. Each full segment is compressed
+ * into an independent zlib stream, and the oldest segments are dropped once the compressed
+ * segments exceed |maxCompressedBytes|. Compressed segments are never modified, so
+ * {@link #freeze()} can return a snapshot of the ring which shares them rather than copying
+ * them. Only the segment being filled is compressed when freezing.
+ *
+ * Not thread-safe.
+ */
+public class CompressedRingBuffer {
+    private final ArrayDeque<byte[]> mSegments = new ArrayDeque<>();
+    private final Deflater mDeflater = new Deflater(Deflater.BEST_SPEED);
+    private final byte[] mPending;
+    private final byte[] mCompressBuffer;
+    private int mPendingBytes;
+    private int mMaxCompressedBytes;
+    private int mCompressedBytes;
+
+    /**
+     * Creates a ring buffer holding at most |maxCompressedBytes| of compressed data, plus the
+     * segment being filled.
+     * @param maxCompressedBytes upper bound on the compressed data to hold
+     * @param segmentBytes number of uncompressed bytes compressed together
+     */
+    public CompressedRingBuffer(int maxCompressedBytes, int segmentBytes) {
+        if (maxCompressedBytes < 1 || segmentBytes < 1) {
+            throw new IllegalArgumentException();
+        }
+        mMaxCompressedBytes = maxCompressedBytes;
+        mPending = new byte[segmentBytes];
+        // Deflate may expand incompressible data by a few bytes per 16KB block
+        mCompressBuffer = new byte[segmentBytes + segmentBytes / 1000 + 64];
+    }
+
+    /**
+     * Appends |data| to the ring, compressing each segment filled and dropping the oldest
+     * segments to make room for it.
+     */
+    public void append(byte[] data) {
+        int offset = 0;
+        while (offset < data.length) {
+            int length = Math.min(data.length - offset, mPending.length - mPendingBytes);
+            System.arraycopy(data, offset, mPending, mPendingBytes, length);
+            mPendingBytes += length;
+            offset += length;
+            if (mPendingBytes == mPending.length) {
+                compressPending();
+            }
+        }
+    }
+
+    /**
+     * Returns the data in the ring, oldest first, as a series of independent zlib streams.
+     * The returned segments are shared with the ring, and must not be modified.
+     */
+    public byte[][] freeze() {
+        compressPending();
+        return mSegments.toArray(new byte[mSegments.size()][]);
+    }
+
+    /**
+     * Returns the number of compressed bytes held.
+     */
+    public int getCompressedBytes() {
+        return mCompressedBytes;
+    }
+
+    /**
+     * Resize the buffer, dropping the oldest segments if necessary.
+     * @param maxCompressedBytes upper bound on the compressed data to hold
+     */
+    public void resize(int maxCompressedBytes) {
+        mMaxCompressedBytes = maxCompressedBytes;
+        prune();
+    }
+
+    private void compressPending() {
+        if (mPendingBytes == 0) {
+            return;
+        }
+        mDeflater.reset();
+        mDeflater.setInput(mPending, 0, mPendingBytes);
+        mDeflater.finish();
+        int length = 0;
+        while (!mDeflater.finished() && length < mCompressBuffer.length) {
+            length += mDeflater.deflate(mCompressBuffer, length, mCompressBuffer.length - length);
+        }
+        if (mDeflater.finished()) {
+            mSegments.addLast(Arrays.copyOf(mCompressBuffer, length));
+            mCompressedBytes += length;
+        }
+        mPendingBytes = 0;
+        prune();
+    }
+
+    private void prune() {
+        while (mCompressedBytes > mMaxCompressedBytes && !mSegments.isEmpty()) {
+            mCompressedBytes -= mSegments.removeFirst().length;
+        }
+    }
+}
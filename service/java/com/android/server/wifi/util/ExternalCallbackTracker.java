@@ -18,21 +18,32 @@ package com.android.server.wifi.util;
 
 import android.annotation.NonNull;
 import android.annotation.Nullable;
+import android.os.DeadObjectException;
 import android.os.Handler;
 import android.os.IBinder;
 import android.os.RemoteException;
 import android.util.Log;
 
+import com.android.internal.annotations.VisibleForTesting;
 import com.android.internal.util.Preconditions;
+import com.android.server.wifi.Clock;
 
+import java.io.PrintWriter;
 import java.util.ArrayList;
 import java.util.HashMap;
 import java.util.List;
 import java.util.Map;
+import java.util.concurrent.Executor;
+import java.util.function.Predicate;
 
 /**
  * Holds a list of external app-provided binder callback objects and tracks the death
  * of the callback object.
+ *
+ * Callbacks are added, removed and broadcast to on the thread of the handler passed in. A
+ * {@link #broadcast(String, CallbackInvoker)} snapshots the callbacks and invokes them on the
+ * broadcast executor, so that a slow client does not hold up that thread; clients which keep
+ * failing or keep being slow to invoke are evicted.
  * @param <T> Callback object type.
  */
 public class ExternalCallbackTracker<T> {
@@ -42,6 +53,29 @@ public class ExternalCallbackTracker<T> {
     private static final int NUM_CALLBACKS_WARN_LIMIT = 10;
     private static final int NUM_CALLBACKS_WTF_LIMIT = 20;
 
+    /* Mask of the callbacks invoked by an unfiltered broadcast */
+    private static final long ALL_CALLBACKS = -1L;
+
+    /* Clients failing this many invocations in a row are evicted */
+    @VisibleForTesting
+    static final int MAX_CONSECUTIVE_FAILURES = 3;
+    /* Clients taking longer than this to invoke this many times in a row are evicted */
+    @VisibleForTesting
+    static final long SLOW_INVOCATION_THRESHOLD_NS = 100_000_000L;
+    @VisibleForTesting
+    static final int MAX_CONSECUTIVE_SLOW_INVOCATIONS = 5;
+
+    /**
+     * Invokes a method of a callback object, on the broadcast executor.
+     * @param <T> Callback object type.
+     */
+    public interface CallbackInvoker<T> {
+        /**
+         * Invoke the callback.
+         */
+        void invoke(@NonNull T callback) throws RemoteException;
+    }
+
     /**
      * Container for storing info about each external callback and tracks it's death.
      */
@@ -49,6 +83,17 @@ public class ExternalCallbackTracker<T> {
         private final IBinder mBinder;
         private final T mCallbackObject;
         private final DeathCallback mDeathCallback;
+        private int mCallbackIdentifier;
+
+        // Invocation stats, updated on the broadcast executor.
+        private final Object mStatsLock = new Object();
+        private long mNumInvocations;
+        private long mNumFailures;
+        private int mConsecutiveFailures;
+        private int mConsecutiveSlowInvocations;
+        private long mTotalLatencyNs;
+        private long mMaxLatencyNs;
+        private boolean mEvictionPending;
 
         /**
          * Callback to be invoked on death of the app hosting the binder.
@@ -101,6 +146,47 @@ public class ExternalCallbackTracker<T> {
             return mCallbackObject;
         }
 
+        /**
+         * Records an invocation of the callback.
+         * @return true if the client should be evicted, the first time it should be.
+         */
+        public boolean recordInvocation(long latencyNs, boolean failed, boolean dead) {
+            synchronized (mStatsLock) {
+                mNumInvocations++;
+                mTotalLatencyNs += latencyNs;
+                mMaxLatencyNs = Math.max(mMaxLatencyNs, latencyNs);
+                if (failed) {
+                    mNumFailures++;
+                    mConsecutiveFailures++;
+                } else {
+                    mConsecutiveFailures = 0;
+                }
+                if (latencyNs > SLOW_INVOCATION_THRESHOLD_NS) {
+                    mConsecutiveSlowInvocations++;
+                } else {
+                    mConsecutiveSlowInvocations = 0;
+                }
+                if (mEvictionPending) return false;
+                mEvictionPending = dead || mConsecutiveFailures >= MAX_CONSECUTIVE_FAILURES
+                        || mConsecutiveSlowInvocations >= MAX_CONSECUTIVE_SLOW_INVOCATIONS;
+                return mEvictionPending;
+            }
+        }
+
+        /**
+         * Dump the invocation stats of the callback.
+         */
+        public void dump(PrintWriter pw) {
+            synchronized (mStatsLock) {
+                pw.println("callback=" + mCallbackIdentifier
+                        + " invocations=" + mNumInvocations
+                        + " failures=" + mNumFailures
+                        + " avgLatencyUs=" + (mNumInvocations == 0
+                                ? 0 : mTotalLatencyNs / mNumInvocations / 1000)
+                        + " maxLatencyUs=" + mMaxLatencyNs / 1000);
+            }
+        }
+
         /**
          * App hosting the binder has died.
          */
@@ -113,10 +199,36 @@ public class ExternalCallbackTracker<T> {
 
     private final Map<Integer, ExternalCallbackHolder<T>> mCallbacks;
     private final Handler mHandler;
+    private final Executor mBroadcastExecutor;
+    private final Clock mClock;
+    // Holders of the callbacks, rebuilt when a callback is added or removed. An array is never
+    // modified once built, so broadcasts still running and dumps keep a consistent view.
+    private volatile ExternalCallbackHolder<T>[] mHolderSnapshot;
+    // Only written on the thread of |mHandler|, read by dumps.
+    private volatile long mNumBroadcasts;
+    private volatile long mNumEvictions;
 
+    /**
+     * Creates a tracker which invokes the callbacks of a broadcast on the calling thread.
+     */
     public ExternalCallbackTracker(Handler handler) {
+        this(handler, Runnable::run);
+    }
+
+    /**
+     * Creates a tracker which invokes the callbacks of a broadcast on |broadcastExecutor|.
+     */
+    public ExternalCallbackTracker(Handler handler, Executor broadcastExecutor) {
+        this(handler, broadcastExecutor, new Clock());
+    }
+
+    @VisibleForTesting
+    ExternalCallbackTracker(Handler handler, Executor broadcastExecutor, Clock clock) {
         mHandler = handler;
+        mBroadcastExecutor = broadcastExecutor;
+        mClock = clock;
         mCallbacks = new HashMap<>();
+        updateHolderSnapshot();
     }
 
     /**
@@ -136,7 +248,9 @@ public class ExternalCallbackTracker<T> {
             Log.d(TAG, "Replacing callback " + callbackIdentifier);
             remove(callbackIdentifier);
         }
+        externalCallback.mCallbackIdentifier = callbackIdentifier;
         mCallbacks.put(callbackIdentifier, externalCallback);
+        updateHolderSnapshot();
         if (mCallbacks.size() > NUM_CALLBACKS_WTF_LIMIT) {
             Log.wtf(TAG, "Too many callbacks: " + mCallbacks.size());
         } else if (mCallbacks.size() > NUM_CALLBACKS_WARN_LIMIT) {
@@ -155,6 +269,7 @@ public class ExternalCallbackTracker<T> {
             Log.w(TAG, "Unknown external callback " + callbackIdentifier);
             return null;
         }
+        updateHolderSnapshot();
         externalCallback.reset();
         return externalCallback.getCallback();
     }
@@ -170,6 +285,102 @@ public class ExternalCallbackTracker<T> {
         return callbacks;
     }
 
+    @SuppressWarnings("unchecked")
+    private void updateHolderSnapshot() {
+        mHolderSnapshot = mCallbacks.values().toArray(
+                new ExternalCallbackHolder[mCallbacks.size()]);
+    }
+
+    /**
+     * Invoke all the callback objects in the tracker, on the broadcast executor.
+     * @param name name of the invoked method, for logging.
+     * @param invoker invokes the method on each callback object.
+     */
+    public void broadcast(@NonNull String name, @NonNull CallbackInvoker<T> invoker) {
+        ExternalCallbackHolder<T>[] holders = mHolderSnapshot;
+        if (holders.length == 0) return;
+        mNumBroadcasts++;
+        mBroadcastExecutor.execute(() -> invokeAll(holders, ALL_CALLBACKS, name, invoker));
+    }
+
+    /**
+     * Invoke the callback objects in the tracker accepted by |filter|, on the broadcast executor.
+     * @param name name of the invoked method, for logging.
+     * @param filter called for each callback object on the calling thread, in turn, before
+     *               broadcasting.
+     * @param invoker invokes the method on each accepted callback object.
+     */
+    @SuppressWarnings("unchecked")
+    public void broadcast(@NonNull String name, @NonNull Predicate<T> filter,
+            @NonNull CallbackInvoker<T> invoker) {
+        ExternalCallbackHolder<T>[] holders = mHolderSnapshot;
+        if (holders.length > Long.SIZE) {
+            // Too many callbacks for a mask, which only happens well past the WTF limit.
+            List<ExternalCallbackHolder<T>> accepted = new ArrayList<>(holders.length);
+            for (ExternalCallbackHolder<T> holder : holders) {
+                if (filter.test(holder.getCallback())) {
+                    accepted.add(holder);
+                }
+            }
+            if (accepted.isEmpty()) return;
+            mNumBroadcasts++;
+            mBroadcastExecutor.execute(() -> invokeAll(accepted.toArray(
+                    new ExternalCallbackHolder[accepted.size()]), ALL_CALLBACKS, name, invoker));
+            return;
+        }
+        // Mark the accepted callbacks in a mask over the snapshot, so that frequent broadcasts
+        // which most callbacks filter out (e.g. traffic polls) don't allocate.
+        long acceptedMask = 0;
+        for (int i = 0; i < holders.length; i++) {
+            if (filter.test(holders[i].getCallback())) {
+                acceptedMask |= 1L << i;
+            }
+        }
+        if (acceptedMask == 0) return;
+        mNumBroadcasts++;
+        final long mask = acceptedMask;
+        mBroadcastExecutor.execute(() -> invokeAll(holders, mask, name, invoker));
+    }
+
+    /**
+     * Invoke the callbacks of |holders| whose bit is set in |acceptedMask|. Callbacks past the
+     * bits of the mask are invoked only if all of them are accepted.
+     */
+    private void invokeAll(ExternalCallbackHolder<T>[] holders, long acceptedMask, String name,
+            CallbackInvoker<T> invoker) {
+        for (int i = 0; i < holders.length; i++) {
+            boolean accepted = i < Long.SIZE
+                    ? (acceptedMask & (1L << i)) != 0 : acceptedMask == ALL_CALLBACKS;
+            if (!accepted) continue;
+            ExternalCallbackHolder<T> holder = holders[i];
+            boolean failed = false;
+            boolean dead = false;
+            long startNs = mClock.getElapsedSinceBootNanos();
+            try {
+                invoker.invoke(holder.getCallback());
+            } catch (DeadObjectException e) {
+                failed = true;
+                dead = true;
+            } catch (RemoteException e) {
+                Log.e(TAG, name + ": remote exception on callback "
+                        + holder.mCallbackIdentifier + " -- " + e);
+                failed = true;
+            }
+            long latencyNs = mClock.getElapsedSinceBootNanos() - startNs;
+            if (holder.recordInvocation(latencyNs, failed, dead)) {
+                mHandler.post(() -> evict(holder));
+            }
+        }
+    }
+
+    private void evict(ExternalCallbackHolder<T> holder) {
+        // The callback may have been removed, or replaced, since the broadcast.
+        if (mCallbacks.get(holder.mCallbackIdentifier) != holder) return;
+        Log.w(TAG, "Evicting dead or unresponsive callback " + holder.mCallbackIdentifier);
+        remove(holder.mCallbackIdentifier);
+        mNumEvictions++;
+    }
+
     /**
      * Retrieve the number of callback objects in the tracker.
      */
@@ -185,5 +396,17 @@ public class ExternalCallbackTracker<T> {
             externalCallback.reset();
         }
         mCallbacks.clear();
+        updateHolderSnapshot();
+    }
+
+    /**
+     * Dump the broadcast and per callback invocation stats.
+     */
+    public void dump(PrintWriter pw) {
+        pw.println("mNumBroadcasts=" + mNumBroadcasts + " mNumEvictions=" + mNumEvictions);
+        // Called on binder threads: read the immutable snapshot rather than |mCallbacks|.
+        for (ExternalCallbackHolder<T> holder : mHolderSnapshot) {
+            holder.dump(pw);
+        }
     }
 }
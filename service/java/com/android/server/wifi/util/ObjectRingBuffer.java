@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.server.wifi.util;
+
+import java.util.Iterator;
+import java.util.NoSuchElementException;
+
+/**
+ * A fixed capacity ring of objects, oldest first. The backing array is allocated up front, and
+ * appending to a full ring evicts the oldest element in O(1).
+ *
+ * To avoid allocating a new element for every append once the ring is full, callers may take the
+ * oldest element back with {@link #recycleOldestIfFull()}, refill it and append it again.
+ *
+ * This class is not thread safe.
+ */
+public class ObjectRingBuffer<T> implements Iterable<T> {
+    private final Object[] mElements;
+    // Index of the oldest element.
+    private int mHead;
+    private int mSize;
+
+    /**
+     * Creates a ring that holds at most |capacity| elements.
+     */
+    public ObjectRingBuffer(int capacity) {
+        if (capacity < 1) {
+            throw new IllegalArgumentException();
+        }
+        mElements = new Object[capacity];
+    }
+
+    /**
+     * Returns the maximum number of elements the ring holds.
+     */
+    public int capacity() {
+        return mElements.length;
+    }
+
+    /**
+     * Returns the number of elements present in the ring.
+     */
+    public int size() {
+        return mSize;
+    }
+
+    /**
+     * Returns true if the ring holds no elements.
+     */
+    public boolean isEmpty() {
+        return mSize == 0;
+    }
+
+    /**
+     * Appends |element| as the newest element of the ring, evicting the oldest one if the ring is
+     * full.
+     * @return the evicted element, or null if none was evicted
+     */
+    public T add(T element) {
+        T evicted = null;
+        if (mSize == mElements.length) {
+            evicted = elementAt(mHead);
+            mElements[mHead] = element;
+            mHead = (mHead + 1) % mElements.length;
+        } else {
+            mElements[(mHead + mSize) % mElements.length] = element;
+            mSize++;
+        }
+        return evicted;
+    }
+
+    /**
+     * If the ring is full, removes and returns its oldest element so that it can be refilled and
+     * passed back to {@link #add(Object)}. Returns null if the ring is not full.
+     */
+    public T recycleOldestIfFull() {
+        if (mSize < mElements.length) {
+            return null;
+        }
+        return removeOldest();
+    }
+
+    /**
+     * Removes and returns the oldest element of the ring.
+     * @throws NoSuchElementException if the ring is empty
+     */
+    public T removeOldest() {
+        if (mSize == 0) {
+            throw new NoSuchElementException();
+        }
+        T oldest = elementAt(mHead);
+        mElements[mHead] = null;
+        mHead = (mHead + 1) % mElements.length;
+        mSize--;
+        return oldest;
+    }
+
+    /**
+     * Returns the |i|-th oldest element of the ring.
+     * @throws IndexOutOfBoundsException if |i| is not in [0, size())
+     */
+    public T get(int i) {
+        if (i < 0 || i >= mSize) {
+            throw new IndexOutOfBoundsException("Index " + i + " out of bounds for size " + mSize);
+        }
+        return elementAt((mHead + i) % mElements.length);
+    }
+
+    /**
+     * Returns the newest element of the ring.
+     * @throws NoSuchElementException if the ring is empty
+     */
+    public T getLast() {
+        if (mSize == 0) {
+            throw new NoSuchElementException();
+        }
+        return get(mSize - 1);
+    }
+
+    /**
+     * Removes all elements from the ring. The capacity is retained.
+     */
+    public void clear() {
+        for (int i = 0; i < mSize; i++) {
+            mElements[(mHead + i) % mElements.length] = null;
+        }
+        mHead = 0;
+        mSize = 0;
+    }
+
+    /**
+     * Returns an iterator over the elements of the ring, oldest first.
+     */
+    @Override
+    public Iterator<T> iterator() {
+        return new Iterator<T>() {
+            private int mNext = 0;
+
+            @Override
+            public boolean hasNext() {
+                return mNext < mSize;
+            }
+
+            @Override
+            public T next() {
+                if (!hasNext()) {
+                    throw new NoSuchElementException();
+                }
+                return get(mNext++);
+            }
+        };
+    }
+
+    @SuppressWarnings("unchecked")
+    private T elementAt(int index) {
+        return (T) mElements[index];
+    }
+}
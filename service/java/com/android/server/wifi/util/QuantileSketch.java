@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.server.wifi.util;
+
+import com.android.server.wifi.proto.nano.WifiMetricsProto;
+import com.android.server.wifi.proto.nano.WifiMetricsProto.Int32Count;
+
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
+
+/**
+ * A mergeable sketch of the distribution of non-negative int values, such as latencies, from
+ * which quantiles can be estimated with a bounded relative error (DDSketch style).
+ *
+ * Unlike {@link IntHistogram}, which counts values in fixed buckets chosen upfront, values are
+ * counted in logarithmically sized buckets: bucket |key| holds the values in
+ * (gamma^(key - 1), gamma^key], where gamma = (1 + relativeAccuracy) / (1 - relativeAccuracy).
+ * Any quantile returned by {@link #quantile(double)} is then within relativeAccuracy of the true
+ * value. Values less than or equal to zero are counted separately and estimated as zero.
+ *
+ * Adding a value is O(1). Two sketches with the same accuracy can be merged bucket by bucket.
+ */
+public class QuantileSketch {
+    private static final int INITIAL_NUM_BUCKETS = 64;
+
+    private final int mRelativeAccuracyPpm;
+    private final double mGamma;
+    private final double mLogGamma;
+    // mBucketCounts[key] is the count of bucket |key|. Grown as larger keys are added.
+    private int[] mBucketCounts = new int[0];
+    private int mZeroCount;
+    private long mCount;
+
+    /**
+     * Constructs an empty sketch.
+     * @param relativeAccuracyPpm the relative accuracy of the quantiles, in parts per million,
+     *                            in (0, 1000000). e.g. 10000 for 1%.
+     */
+    public QuantileSketch(int relativeAccuracyPpm) {
+        if (relativeAccuracyPpm <= 0 || relativeAccuracyPpm >= 1000000) {
+            throw new IllegalArgumentException(
+                    "relativeAccuracyPpm must be in (0, 1000000): " + relativeAccuracyPpm);
+        }
+        double relativeAccuracy = relativeAccuracyPpm / 1e6;
+        mRelativeAccuracyPpm = relativeAccuracyPpm;
+        mGamma = (1 + relativeAccuracy) / (1 - relativeAccuracy);
+        mLogGamma = Math.log(mGamma);
+    }
+
+    /**
+     * Returns the relative accuracy of this sketch, in parts per million.
+     */
+    public int getRelativeAccuracyPpm() {
+        return mRelativeAccuracyPpm;
+    }
+
+    /**
+     * Returns the number of values added to this sketch.
+     */
+    public long getCount() {
+        return mCount;
+    }
+
+    /**
+     * Resets this sketch to the initial state.
+     */
+    public void clear() {
+        Arrays.fill(mBucketCounts, 0);
+        mZeroCount = 0;
+        mCount = 0;
+    }
+
+    /**
+     * Adds one occurrence of |value| to this sketch.
+     */
+    public void increment(int value) {
+        add(value, 1);
+    }
+
+    /**
+     * Adds |count| occurrences of |value| to this sketch.
+     */
+    public void add(int value, int count) {
+        if (count <= 0) {
+            return;
+        }
+        if (value <= 0) {
+            mZeroCount += count;
+        } else {
+            int key = getBucketKey(value);
+            ensureCapacity(key + 1);
+            mBucketCounts[key] += count;
+        }
+        mCount += count;
+    }
+
+    /**
+     * Adds all the values of |other| to this sketch.
+     * @throws IllegalArgumentException if |other| has a different relative accuracy.
+     */
+    public void merge(QuantileSketch other) {
+        if (other.mRelativeAccuracyPpm != mRelativeAccuracyPpm) {
+            throw new IllegalArgumentException("Cannot merge sketches of different accuracies: "
+                    + mRelativeAccuracyPpm + " and " + other.mRelativeAccuracyPpm);
+        }
+        ensureCapacity(other.mBucketCounts.length);
+        for (int key = 0; key < other.mBucketCounts.length; key++) {
+            mBucketCounts[key] += other.mBucketCounts[key];
+        }
+        mZeroCount += other.mZeroCount;
+        mCount += other.mCount;
+    }
+
+    /**
+     * Estimates the value v such that the given fraction of the values added are less than or
+     * equal to v. The estimate is within the relative accuracy of this sketch of an added value.
+     * @param probability the fraction, in [0, 1]
+     * @return the estimate, or Double.NaN if this sketch is empty
+     */
+    public double quantile(double probability) {
+        if (probability < 0.0 || probability > 1.0) {
+            throw new IllegalArgumentException("probability must be in [0, 1]: " + probability);
+        }
+        if (mCount == 0) {
+            return Double.NaN;
+        }
+        // Rank, 0 based, of the value to return
+        long rank = (long) (probability * (mCount - 1));
+        long cumulativeCount = mZeroCount;
+        if (rank < cumulativeCount) {
+            return 0;
+        }
+        for (int key = 0; key < mBucketCounts.length; key++) {
+            cumulativeCount += mBucketCounts[key];
+            if (rank < cumulativeCount) {
+                return getBucketValue(key);
+            }
+        }
+        // Not reached, since the bucket counts add up to mCount
+        return getBucketValue(mBucketCounts.length - 1);
+    }
+
+    /**
+     * Converts this sketch to its Protobuf representation.
+     */
+    public WifiMetricsProto.QuantileSketch toProto() {
+        WifiMetricsProto.QuantileSketch proto = new WifiMetricsProto.QuantileSketch();
+        proto.relativeAccuracyPpm = mRelativeAccuracyPpm;
+        proto.zeroCount = mZeroCount;
+        List<Int32Count> buckets = new ArrayList<>();
+        for (int key = 0; key < mBucketCounts.length; key++) {
+            if (mBucketCounts[key] == 0) {
+                continue;
+            }
+            Int32Count bucket = new Int32Count();
+            bucket.key = key;
+            bucket.count = mBucketCounts[key];
+            buckets.add(bucket);
+        }
+        proto.bucketCounts = buckets.toArray(new Int32Count[0]);
+        return proto;
+    }
+
+    /**
+     * Constructs a sketch from its Protobuf representation, e.g. to merge sketches received from
+     * several devices.
+     */
+    public static QuantileSketch fromProto(WifiMetricsProto.QuantileSketch proto) {
+        QuantileSketch sketch = new QuantileSketch(proto.relativeAccuracyPpm);
+        sketch.mZeroCount = proto.zeroCount;
+        sketch.mCount = proto.zeroCount;
+        for (Int32Count bucket : proto.bucketCounts) {
+            if (bucket.key < 0 || bucket.count <= 0) {
+                continue;
+            }
+            sketch.ensureCapacity(bucket.key + 1);
+            sketch.mBucketCounts[bucket.key] += bucket.count;
+            sketch.mCount += bucket.count;
+        }
+        return sketch;
+    }
+
+    /**
+     * Returns a human-readable string representation of this sketch, suitable for dump().
+     */
+    @Override
+    public String toString() {
+        if (mCount == 0) {
+            return "{count=0}";
+        }
+        return String.format("{count=%d, p50=%.1f, p90=%.1f, p99=%.1f, max=%.1f}", mCount,
+                quantile(0.5), quantile(0.9), quantile(0.99), quantile(1.0));
+    }
+
+    /**
+     * Returns the key of the bucket holding |value|, which must be positive.
+     */
+    private int getBucketKey(int value) {
+        return (int) Math.ceil(Math.log(value) / mLogGamma);
+    }
+
+    /**
+     * Returns the estimate of the values in bucket |key|, which is within the relative accuracy
+     * of both bounds of the bucket.
+     */
+    private double getBucketValue(int key) {
+        return 2 * Math.pow(mGamma, key) / (mGamma + 1);
+    }
+
+    private void ensureCapacity(int numBuckets) {
+        if (numBuckets <= mBucketCounts.length) {
+            return;
+        }
+        int newLength = Math.max(numBuckets,
+                Math.max(INITIAL_NUM_BUCKETS, mBucketCounts.length * 2));
+        mBucketCounts = Arrays.copyOf(mBucketCounts, newLength);
+    }
+}
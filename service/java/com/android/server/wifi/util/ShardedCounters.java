@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.server.wifi.util;
+
+import com.android.internal.annotations.VisibleForTesting;
+
+import java.util.concurrent.atomic.AtomicLongArray;
+
+/**
+ * A fixed size set of long counters, addressed by precomputed ids in [0, size), which can be
+ * updated concurrently from multiple threads without taking a lock.
+ *
+ * Each counter is striped across several cells, in the style of
+ * {@link java.util.concurrent.atomic.LongAdder}: a thread only updates the cell of its own stripe,
+ * so concurrent updates from different threads rarely contend on the same cache line. The cells
+ * of a counter are only merged when it is read via {@link #get(int)} or {@link #drain(int)}.
+ */
+public class ShardedCounters {
+    // Number of longs in a 64 byte cache line. The cells of different stripes are padded to start
+    // on different cache lines.
+    private static final int LONGS_PER_CACHE_LINE = 8;
+    private static final int MAX_STRIPES = 16;
+
+    private final int mSize;
+    private final int mStripeLength;
+    private final int mStripeMask;
+    private final AtomicLongArray mCells;
+
+    /**
+     * Creates a set of |size| counters striped according to the number of available processors.
+     */
+    public ShardedCounters(int size) {
+        this(size, Math.min(MAX_STRIPES, Runtime.getRuntime().availableProcessors()));
+    }
+
+    /**
+     * Creates a set of |size| counters striped across at least |numStripes| stripes.
+     */
+    @VisibleForTesting
+    public ShardedCounters(int size, int numStripes) {
+        if (size <= 0 || numStripes <= 0) {
+            throw new IllegalArgumentException("size and numStripes must be positive");
+        }
+        int stripes = Integer.highestOneBit(numStripes);
+        if (stripes < numStripes) {
+            stripes <<= 1;
+        }
+        mSize = size;
+        mStripeMask = stripes - 1;
+        mStripeLength = ((size + LONGS_PER_CACHE_LINE - 1) / LONGS_PER_CACHE_LINE)
+                * LONGS_PER_CACHE_LINE;
+        mCells = new AtomicLongArray(stripes * mStripeLength);
+    }
+
+    /**
+     * Returns the number of counters.
+     */
+    public int size() {
+        return mSize;
+    }
+
+    /**
+     * Increments the counter |id| by one.
+     */
+    public void increment(int id) {
+        add(id, 1);
+    }
+
+    /**
+     * Adds |delta| to the counter |id|.
+     */
+    public void add(int id, long delta) {
+        checkId(id);
+        mCells.getAndAdd(cellIndex(id), delta);
+    }
+
+    /**
+     * Returns the current value of the counter |id|. Updates made concurrently with this call may
+     * or may not be included.
+     */
+    public long get(int id) {
+        checkId(id);
+        long sum = 0;
+        for (int i = id; i < mCells.length(); i += mStripeLength) {
+            sum += mCells.get(i);
+        }
+        return sum;
+    }
+
+    /**
+     * Returns the current value of the counter |id| and resets it to zero. Every update is
+     * returned by exactly one call to this method, even if made concurrently with it.
+     */
+    public long drain(int id) {
+        checkId(id);
+        long sum = 0;
+        for (int i = id; i < mCells.length(); i += mStripeLength) {
+            sum += mCells.getAndSet(i, 0);
+        }
+        return sum;
+    }
+
+    /**
+     * Resets all counters to zero.
+     */
+    public void clear() {
+        for (int i = 0; i < mCells.length(); i++) {
+            mCells.set(i, 0);
+        }
+    }
+
+    private int cellIndex(int id) {
+        int stripe = (int) Thread.currentThread().getId() & mStripeMask;
+        return stripe * mStripeLength + id;
+    }
+
+    private void checkId(int id) {
+        if (id < 0 || id >= mSize) {
+            throw new IndexOutOfBoundsException("Invalid counter id " + id);
+        }
+    }
+}
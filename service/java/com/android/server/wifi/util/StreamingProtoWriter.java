@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.server.wifi.util;
+
+import android.util.SparseArray;
+
+import com.google.protobuf.nano.CodedInputByteBufferNano;
+import com.google.protobuf.nano.CodedOutputByteBufferNano;
+import com.google.protobuf.nano.MessageNano;
+
+import java.io.IOException;
+import java.io.OutputStream;
+
+/**
+ * Serializes a nano proto message to an {@link OutputStream} without materializing the whole
+ * encoding in memory.
+ *
+ * The large repeated message fields of the message are passed separately and encoded one element
+ * at a time into a reusable buffer, spliced between the other fields of the message so that the
+ * output is byte-identical to {@link MessageNano#toByteArray(MessageNano)} of the full message:
+ * nano protos serialize fields in field number order, and elements that are null are skipped.
+ *
+ * This class is not thread safe.
+ */
+public class StreamingProtoWriter {
+    private static final int TAG_TYPE_BITS = 3;
+    private static final int WIRETYPE_LENGTH_DELIMITED = 2;
+    private static final int INITIAL_BUFFER_SIZE = 1024;
+
+    private final OutputStream mOut;
+    private byte[] mBuffer = new byte[INITIAL_BUFFER_SIZE];
+
+    /**
+     * Creates a writer that writes to |out|.
+     */
+    public StreamingProtoWriter(OutputStream out) {
+        mOut = out;
+    }
+
+    /**
+     * Writes |message| followed, in field number order, by |streamedFields|.
+     *
+     * @param message the message, with the fields in |streamedFields| left empty
+     * @param streamedFields the elements of repeated message fields of |message|, keyed by field
+     *        number
+     */
+    public void write(MessageNano message, SparseArray<MessageNano[]> streamedFields)
+            throws IOException {
+        byte[] encoded = MessageNano.toByteArray(message);
+        CodedInputByteBufferNano input = CodedInputByteBufferNano.newInstance(encoded);
+        int nextStreamedField = 0;
+        while (true) {
+            int start = input.getPosition();
+            int tag = input.readTag();
+            if (tag == 0) {
+                break;
+            }
+            int fieldNumber = tag >>> TAG_TYPE_BITS;
+            while (nextStreamedField < streamedFields.size()
+                    && streamedFields.keyAt(nextStreamedField) < fieldNumber) {
+                writeRepeatedField(streamedFields.keyAt(nextStreamedField),
+                        streamedFields.valueAt(nextStreamedField));
+                nextStreamedField++;
+            }
+            input.skipField(tag);
+            mOut.write(encoded, start, input.getPosition() - start);
+        }
+        for (; nextStreamedField < streamedFields.size(); nextStreamedField++) {
+            writeRepeatedField(streamedFields.keyAt(nextStreamedField),
+                    streamedFields.valueAt(nextStreamedField));
+        }
+    }
+
+    private void writeRepeatedField(int fieldNumber, MessageNano[] elements) throws IOException {
+        if (elements == null) {
+            return;
+        }
+        int tag = (fieldNumber << TAG_TYPE_BITS) | WIRETYPE_LENGTH_DELIMITED;
+        for (MessageNano element : elements) {
+            if (element == null) {
+                continue;
+            }
+            int size = element.getSerializedSize();
+            int headerSize = CodedOutputByteBufferNano.computeRawVarint32Size(tag)
+                    + CodedOutputByteBufferNano.computeRawVarint32Size(size);
+            if (mBuffer.length < headerSize + size) {
+                mBuffer = new byte[Math.max(headerSize + size, mBuffer.length * 2)];
+            }
+            CodedOutputByteBufferNano output =
+                    CodedOutputByteBufferNano.newInstance(mBuffer, 0, headerSize + size);
+            output.writeRawVarint32(tag);
+            output.writeRawVarint32(size);
+            element.writeTo(output);
+            mOut.write(mBuffer, 0, headerSize + size);
+        }
+    }
+}
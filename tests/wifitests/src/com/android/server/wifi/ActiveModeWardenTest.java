@@ -123,6 +123,7 @@ public class ActiveModeWardenTest extends WifiBaseTest {
     @Mock WifiManager.SoftApCallback mLohsStateMachineCallback;
     WifiNative.StatusListener mWifiNativeStatusListener;
     ActiveModeWarden mActiveModeWarden;
+    WifiStateSnapshotPublisher mWifiStateSnapshotPublisher = new WifiStateSnapshotPublisher();
     private SoftApInfo mTestSoftApInfo;
 
     final ArgumentCaptor<WifiNative.StatusListener> mStatusListenerCaptor =
@@ -143,6 +144,8 @@ public class ActiveModeWardenTest extends WifiBaseTest {
         mLooper = new TestLooper();
 
         when(mWifiInjector.getScanRequestProxy()).thenReturn(mScanRequestProxy);
+        when(mWifiInjector.getWifiStateSnapshotPublisher())
+                .thenReturn(mWifiStateSnapshotPublisher);
         when(mClientModeManager.getRole()).thenReturn(ROLE_CLIENT_PRIMARY);
         when(mContext.getResources()).thenReturn(mResources);
         when(mSoftApManager.getRole()).thenReturn(ROLE_SOFTAP_TETHERED);
@@ -457,6 +460,20 @@ public class ActiveModeWardenTest extends WifiBaseTest {
         assertInDisabledState();
     }
 
+    /**
+     * Test that the STA + AP concurrency support is published once a client mode manager has
+     * started.
+     */
+    @Test
+    public void testStaApConcurrencyIsPublishedWhenClientModeStarts() throws Exception {
+        when(mWifiNative.isStaApConcurrencySupported()).thenReturn(true);
+        assertFalse(mWifiStateSnapshotPublisher.getSnapshot().isStaApConcurrencySupported());
+
+        enterClientModeActiveState();
+
+        assertTrue(mWifiStateSnapshotPublisher.getSnapshot().isStaApConcurrencySupported());
+    }
+
     /**
      * Test that ActiveModeWarden properly enters the EnabledState (in ScanOnlyMode) from the
      * DisabledState state.
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.server.wifi;
+
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertNotSame;
+import static org.junit.Assert.assertSame;
+import static org.junit.Assert.assertTrue;
+
+import androidx.test.filters.SmallTest;
+
+import org.junit.Before;
+import org.junit.Test;
+
+import java.io.PrintWriter;
+import java.io.StringWriter;
+
+/**
+ * Unit tests for {@link BinaryLog}.
+ */
+@SmallTest
+public class BinaryLogTest extends WifiBaseTest {
+    private static final String TAG = "BinaryLogTest";
+    private static final int CAPACITY = 4;
+    private BinaryLog.Buffer mBuffer;
+    private BinaryLog mLogger;
+
+    /** Initializes test fixture. */
+    @Before
+    public void setUp() {
+        mBuffer = new BinaryLog.Buffer(CAPACITY);
+        mLogger = new BinaryLog(TAG, mBuffer);
+    }
+
+    /**
+     * Verifies that messages are formatted as LogcatLog formats them, including placeholders
+     * without values and values without placeholders.
+     */
+    @Test
+    public void messagesAreFormattedLikeLogcatLog() {
+        LogcatLog logcatLog = new LogcatLog(TAG);
+        WifiLog.LogMessage expected = logcatLog.info("a=% b=% c=% d=% e=%");
+        expected.c("str").c(-42L).c('%').c(true).flush();
+        mLogger.info("a=% b=% c=% d=% e=%").c("str").c(-42L).c('%').c(true).flush();
+        assertEquals(expected.toString(), mBuffer.getMessage(0));
+
+        expected = logcatLog.err("no placeholders");
+        expected.c(1).flush();
+        mLogger.err("no placeholders").c(1).flush();
+        assertEquals(expected.toString(), mBuffer.getMessage(1));
+    }
+
+    /**
+     * Verifies that messages logged with a preformatted string are recorded verbatim.
+     */
+    @Test
+    public void preformattedMessagesAreRecordedVerbatim() {
+        mLogger.eC("100% done");
+        mLogger.d("debug");
+        assertEquals(2, mBuffer.size());
+        assertEquals("100% done", mBuffer.getMessage(0));
+        assertEquals("debug", mBuffer.getMessage(1));
+    }
+
+    /**
+     * Verifies that the ring keeps the newest messages once full.
+     */
+    @Test
+    public void ringKeepsNewestMessages() {
+        for (int i = 0; i < CAPACITY + 2; i++) {
+            mLogger.info("message %").c(i).flush();
+        }
+        assertEquals(CAPACITY, mBuffer.size());
+        assertEquals("message 2", mBuffer.getMessage(0));
+        assertEquals("message " + (CAPACITY + 1), mBuffer.getMessage(CAPACITY - 1));
+
+        StringWriter sw = new StringWriter();
+        mBuffer.dump(new PrintWriter(sw));
+        String dump = sw.toString();
+        assertTrue(dump.contains("2 dropped"));
+        assertTrue(dump.contains(" I " + TAG + ": message " + (CAPACITY + 1)));
+    }
+
+    /**
+     * Verifies that arguments past the maximum are dropped, leaving their placeholder.
+     */
+    @Test
+    public void argumentsPastMaximumAreDropped() {
+        StringBuilder format = new StringBuilder();
+        StringBuilder expected = new StringBuilder();
+        for (int i = 0; i <= BinaryLog.MAX_ARGS; i++) {
+            format.append('%');
+            expected.append(i < BinaryLog.MAX_ARGS ? "1" : "%");
+        }
+        WifiLog.LogMessage logMessage = mLogger.info(format.toString());
+        for (int i = 0; i <= BinaryLog.MAX_ARGS; i++) {
+            logMessage.c(1);
+        }
+        logMessage.flush();
+        assertEquals(expected.toString(), mBuffer.getMessage(0));
+    }
+
+    /**
+     * Verifies that the LogMessage of a thread is reused across messages, except when a message
+     * is logged while building another one.
+     */
+    @Test
+    public void logMessageIsReused() {
+        WifiLog.LogMessage first = mLogger.info("first %");
+        WifiLog.LogMessage nested = mLogger.info("nested");
+        assertNotSame(first, nested);
+        nested.flush();
+        first.c(1).flush();
+
+        WifiLog.LogMessage second = mLogger.warn("second");
+        assertSame(first, second);
+        second.flush();
+
+        assertEquals("nested", mBuffer.getMessage(0));
+        assertEquals("first 1", mBuffer.getMessage(1));
+        assertEquals("second", mBuffer.getMessage(2));
+    }
+
+    /**
+     * Verifies that trace messages are prefixed with the name of the calling method, as
+     * LogcatLog does, skipping the frames to ignore.
+     */
+    @Test
+    public void traceNamesCallingMethod() {
+        LogcatLog logcatLog = new LogcatLog(TAG);
+        LogcatLog.enableVerboseLogging(1);
+        BinaryLog.enableVerboseLogging(1);
+        try {
+            WifiLog.LogMessage expected = logcatLog.trace("traced %");
+            expected.c(1).flush();
+            mLogger.trace("traced %").c(1).flush();
+            assertEquals(expected.toString(), mBuffer.getMessage(0));
+            assertEquals("traceNamesCallingMethod traced 1", mBuffer.getMessage(0));
+
+            traceFromHelper();
+            assertEquals("traceNamesCallingMethod helper", mBuffer.getMessage(1));
+        } finally {
+            LogcatLog.enableVerboseLogging(0);
+            BinaryLog.enableVerboseLogging(0);
+        }
+    }
+
+    /**
+     * Verifies that trace messages do not capture their caller with verbose logging disabled.
+     */
+    @Test
+    public void traceDoesNotNameCallingMethodWhenNotVerbose() {
+        mLogger.trace("traced %").c(1).flush();
+        traceFromHelper();
+
+        assertEquals("traced 1", mBuffer.getMessage(0));
+        assertEquals("helper", mBuffer.getMessage(1));
+    }
+
+    private void traceFromHelper() {
+        mLogger.trace("helper", 1).flush();
+    }
+}
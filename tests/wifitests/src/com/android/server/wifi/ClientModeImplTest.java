@@ -40,6 +40,7 @@ import static org.mockito.Mockito.anyObject;
 import static org.mockito.Mockito.anyString;
 import static org.mockito.Mockito.argThat;
 import static org.mockito.Mockito.atLeastOnce;
+import static org.mockito.Mockito.clearInvocations;
 import static org.mockito.Mockito.doAnswer;
 import static org.mockito.Mockito.doReturn;
 import static org.mockito.Mockito.eq;
@@ -359,6 +360,7 @@ public class ClientModeImplTest extends WifiBaseTest {
     AsyncChannel  mNetworkAgentAsyncChannel;
     TestAlarmManager mAlarmManager;
     MockWifiMonitor mWifiMonitor;
+    WifiStateSnapshotPublisher mWifiStateSnapshotPublisher;
     TestLooper mLooper;
     Context mContext;
     MockResources mResources;
@@ -377,6 +379,7 @@ public class ClientModeImplTest extends WifiBaseTest {
     @Mock WifiInjector mWifiInjector;
     @Mock WifiLastResortWatchdog mWifiLastResortWatchdog;
     @Mock BssidBlocklistMonitor mBssidBlocklistMonitor;
+    @Mock ConnectionPhaseTracer mConnectionPhaseTracer;
     @Mock PropertyService mPropertyService;
     @Mock BuildProperties mBuildProperties;
     @Mock IBinder mPackageManagerBinder;
@@ -444,6 +447,9 @@ public class ClientModeImplTest extends WifiBaseTest {
         when(mWifiInjector.getWifiMetrics()).thenReturn(mWifiMetrics);
         when(mWifiInjector.getClock()).thenReturn(new Clock());
         when(mWifiInjector.getWifiLastResortWatchdog()).thenReturn(mWifiLastResortWatchdog);
+        mWifiStateSnapshotPublisher = new WifiStateSnapshotPublisher();
+        when(mWifiInjector.getWifiStateSnapshotPublisher())
+                .thenReturn(mWifiStateSnapshotPublisher);
         when(mWifiInjector.getPropertyService()).thenReturn(mPropertyService);
         when(mWifiInjector.getBuildProperties()).thenReturn(mBuildProperties);
         when(mWifiInjector.getWifiBackupRestore()).thenReturn(mock(WifiBackupRestore.class));
@@ -481,6 +487,7 @@ public class ClientModeImplTest extends WifiBaseTest {
         when(mWifiInjector.makeConnectionFailureNotifier(any()))
                 .thenReturn(mConnectionFailureNotifier);
         when(mWifiInjector.getBssidBlocklistMonitor()).thenReturn(mBssidBlocklistMonitor);
+        when(mWifiInjector.getConnectionPhaseTracer()).thenReturn(mConnectionPhaseTracer);
         when(mWifiInjector.getThroughputPredictor()).thenReturn(mThroughputPredictor);
         when(mWifiInjector.getScanRequestProxy()).thenReturn(mScanRequestProxy);
         when(mWifiInjector.getDeviceConfigFacade()).thenReturn(mDeviceConfigFacade);
@@ -1056,6 +1063,24 @@ public class ClientModeImplTest extends WifiBaseTest {
         assertEquals(90, wifiInfo.getMaxSupportedTxLinkSpeedMbps());
     }
 
+    /**
+     * Verify that the phases of a successful connection are traced in order.
+     */
+    @Test
+    public void testConnectionPhasesAreTraced() throws Exception {
+        connect();
+
+        InOrder inOrder = inOrder(mConnectionPhaseTracer);
+        inOrder.verify(mConnectionPhaseTracer).trace(
+                eq(ConnectionPhaseTracer.PHASE_CONNECT_START), eq(FRAMEWORK_NETWORK_ID), any());
+        inOrder.verify(mConnectionPhaseTracer).trace(
+                ConnectionPhaseTracer.PHASE_L2_CONNECTED, FRAMEWORK_NETWORK_ID, sBSSID);
+        inOrder.verify(mConnectionPhaseTracer).trace(
+                ConnectionPhaseTracer.PHASE_L3_CONNECTED, FRAMEWORK_NETWORK_ID, sBSSID);
+        verify(mConnectionPhaseTracer, never()).trace(
+                eq(ConnectionPhaseTracer.PHASE_FAILED), anyInt(), any());
+    }
+
     private void setupEapSimConnection() throws Exception {
         mConnectedNetwork = spy(WifiConfigurationTestUtil.createEapNetwork(
                 WifiEnterpriseConfig.Eap.SIM, WifiEnterpriseConfig.Phase2.NONE));
@@ -3820,6 +3845,32 @@ public class ClientModeImplTest extends WifiBaseTest {
         verify(mWifiMetrics).incrementWifiLinkLayerUsageStats(newLLStats);
     }
 
+    /**
+     * Verify that the rssi poll fetches the link layer stats on the async call lane of the HAL,
+     * and completes once they are delivered.
+     */
+    @Test
+    public void verifyRssiPollFetchesLinkLayerStatsAsync() throws Exception {
+        when(mWifiNative.getWifiLinkLayerStats(any())).thenReturn(new WifiLinkLayerStats());
+        mCmi.enableRssiPolling(true);
+        connect();
+
+        WifiLinkLayerStats stats = new WifiLinkLayerStats();
+        when(mWifiNative.getWifiLinkLayerStatsAsync(any(), any())).thenAnswer(invocation -> {
+            Consumer<WifiLinkLayerStats> onComplete = invocation.getArgument(1);
+            onComplete.accept(stats);
+            return true;
+        });
+        clearInvocations(mWifiNative, mWifiMetrics);
+        mCmi.sendMessage(ClientModeImpl.CMD_RSSI_POLL, 1);
+        mLooper.dispatchAll();
+
+        verify(mWifiNative, never()).getWifiLinkLayerStats(any());
+        verify(mWifiNative).getWifiLinkLayerStatsAsync(eq(WIFI_IFACE_NAME), any());
+        verify(mWifiMetrics).updateWifiUsabilityStatsEntries(any(), eq(stats));
+        verify(mWifiMetrics).incrementWifiLinkLayerUsageStats(stats);
+    }
+
     /**
      * Verify that we update wifi usability stats entries during rssi poll and that when we get
      * a data stall we label and save the current list of usability stats entries.
@@ -3889,14 +3940,17 @@ public class ClientModeImplTest extends WifiBaseTest {
     }
 
     /**
-     * Verify that we call into WifiTrafficPoller during rssi poll
+     * Verify that we call into WifiTrafficPoller during rssi poll, after resetting its poll
+     * state for the new connection.
      */
     @Test
     public void verifyRssiPollCallsWifiTrafficPoller() throws Exception {
         mCmi.enableRssiPolling(true);
         connect();
 
-        verify(mWifiTrafficPoller).notifyOnDataActivity(anyLong(), anyLong());
+        InOrder inOrder = inOrder(mWifiTrafficPoller);
+        inOrder.verify(mWifiTrafficPoller, atLeastOnce()).resetPollState();
+        inOrder.verify(mWifiTrafficPoller).notifyOnDataActivity(anyLong(), anyLong());
     }
 
     /**
@@ -5338,6 +5392,33 @@ public class ClientModeImplTest extends WifiBaseTest {
         mLooper.stopAutoDispatch();
     }
 
+    /**
+     * Verifies that the state read by the WifiServiceImpl getters is published once the messages
+     * changing it are handled.
+     */
+    @Test
+    public void testStateSnapshotIsPublishedOnConnection() throws Exception {
+        long version = mWifiStateSnapshotPublisher.getSnapshot().getVersion();
+
+        connect();
+
+        WifiStateSnapshot snapshot = mWifiStateSnapshotPublisher.getSnapshot();
+        assertTrue(snapshot.getVersion() > version);
+        assertEquals(mNetwork, snapshot.getCurrentNetwork());
+        assertEquals(sBSSID, snapshot.getConnectionInfo().getBSSID());
+        assertEquals(mCmi.syncRequestConnectionInfo().getNetworkId(),
+                snapshot.getConnectionInfo().getNetworkId());
+        // The snapshot hands out copies of the connection info.
+        snapshot.getConnectionInfo().setBSSID(null);
+        assertEquals(sBSSID, snapshot.getConnectionInfo().getBSSID());
+
+        // Messages which leave the state as it is don't publish a new snapshot.
+        mCmi.sendMessage(ClientModeImpl.CMD_DIAGS_CONNECT_TIMEOUT);
+        mLooper.dispatchAll();
+        assertEquals(snapshot.getVersion(),
+                mWifiStateSnapshotPublisher.getSnapshot().getVersion());
+    }
+
     @Test
     public void clearRequestingPackageNameInWifiInfoOnConnectionFailure() throws Exception {
         mConnectedNetwork.fromWifiNetworkSpecifier = true;
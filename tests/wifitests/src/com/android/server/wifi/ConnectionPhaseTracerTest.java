@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.server.wifi;
+
+import static com.android.server.wifi.ConnectionPhaseTracer.PHASE_ASSOCIATED;
+import static com.android.server.wifi.ConnectionPhaseTracer.PHASE_CONNECT_START;
+import static com.android.server.wifi.ConnectionPhaseTracer.PHASE_FAILED;
+import static com.android.server.wifi.ConnectionPhaseTracer.PHASE_L2_CONNECTED;
+import static com.android.server.wifi.ConnectionPhaseTracer.PHASE_L3_CONNECTED;
+import static com.android.server.wifi.ConnectionPhaseTracer.PHASE_NETWORK_SELECTED;
+import static com.android.server.wifi.ConnectionPhaseTracer.PHASE_VALIDATED;
+
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertFalse;
+import static org.junit.Assert.assertTrue;
+import static org.mockito.Mockito.when;
+
+import androidx.test.filters.SmallTest;
+
+import org.junit.Before;
+import org.junit.Test;
+import org.mockito.Mock;
+import org.mockito.MockitoAnnotations;
+
+import java.io.PrintWriter;
+import java.io.StringWriter;
+import java.util.ArrayList;
+import java.util.List;
+
+/**
+ * Unit tests for {@link ConnectionPhaseTracer}.
+ */
+@SmallTest
+public class ConnectionPhaseTracerTest extends WifiBaseTest {
+    private static final int NETWORK_ID = 3;
+    private static final String BSSID = "02:00:00:00:00:01";
+    private static final int CAPACITY = 64;
+
+    @Mock private Clock mClock;
+    private ConnectionPhaseTracer mTracer;
+    private long mNowMs;
+
+    /** Initializes test fixture. */
+    @Before
+    public void setUp() {
+        MockitoAnnotations.initMocks(this);
+        mTracer = new ConnectionPhaseTracer(mClock, CAPACITY);
+    }
+
+    private void traceAfter(long delayMs, int phase) {
+        mNowMs += delayMs;
+        when(mClock.getElapsedSinceBootMillis()).thenReturn(mNowMs);
+        mTracer.trace(phase, NETWORK_ID, BSSID);
+    }
+
+    /**
+     * Traces a connection whose steps, from selection to validation, take the given durations.
+     */
+    private void traceConnection(long connectMs, long associationMs, long handshakeMs,
+            long dhcpMs, long validationMs) {
+        traceAfter(1000, PHASE_NETWORK_SELECTED);
+        traceAfter(connectMs, PHASE_CONNECT_START);
+        traceAfter(associationMs, PHASE_ASSOCIATED);
+        traceAfter(handshakeMs, PHASE_L2_CONNECTED);
+        traceAfter(dhcpMs, PHASE_L3_CONNECTED);
+        traceAfter(validationMs, PHASE_VALIDATED);
+    }
+
+    private String analyze(int numConnections) {
+        StringWriter sw = new StringWriter();
+        mTracer.analyze(new PrintWriter(sw), numConnections);
+        return sw.toString();
+    }
+
+    /**
+     * Verifies that a traced connection is broken down into its steps.
+     */
+    @Test
+    public void connectionIsBrokenDownIntoSteps() {
+        traceConnection(5, 100, 50, 300, 1000);
+
+        List<ConnectionPhaseTracer.Attempt> attempts = new ArrayList<>();
+        assertEquals(0, mTracer.getAttempts(attempts));
+        assertEquals(1, attempts.size());
+        ConnectionPhaseTracer.Attempt attempt = attempts.get(0);
+        assertEquals(NETWORK_ID, attempt.networkId);
+        assertEquals(BSSID, attempt.bssid);
+        assertEquals(5, attempt.getStepDurationMs(PHASE_CONNECT_START));
+        assertEquals(100, attempt.getStepDurationMs(PHASE_ASSOCIATED));
+        assertEquals(50, attempt.getStepDurationMs(PHASE_L2_CONNECTED));
+        assertEquals(300, attempt.getStepDurationMs(PHASE_L3_CONNECTED));
+        assertEquals(1000, attempt.getStepDurationMs(PHASE_VALIDATED));
+        assertEquals(1455, attempt.getTotalDurationMs());
+    }
+
+    /**
+     * Verifies that failed attempts are counted but not analyzed, and that trace points outside
+     * of an attempt, such as associations while roaming, are ignored.
+     */
+    @Test
+    public void failedAttemptsAndTracePointsOutsideAttemptsAreNotAnalyzed() {
+        traceAfter(0, PHASE_ASSOCIATED);
+        traceAfter(10, PHASE_CONNECT_START);
+        traceAfter(10, PHASE_ASSOCIATED);
+        traceAfter(10, PHASE_FAILED);
+        traceAfter(10, PHASE_NETWORK_SELECTED);
+        traceAfter(10, PHASE_ASSOCIATED);
+        // Abandoned for another network selection
+        traceConnection(5, 100, 50, 300, 1000);
+        traceAfter(10, PHASE_ASSOCIATED);
+
+        List<ConnectionPhaseTracer.Attempt> attempts = new ArrayList<>();
+        assertEquals(2, mTracer.getAttempts(attempts));
+        assertEquals(1, attempts.size());
+        assertEquals(100, attempts.get(0).getStepDurationMs(PHASE_ASSOCIATED));
+    }
+
+    /**
+     * Verifies that a connection not validated yet is analyzed up to ip provisioning.
+     */
+    @Test
+    public void connectionWaitingForValidationIsAnalyzed() {
+        traceAfter(0, PHASE_CONNECT_START);
+        traceAfter(100, PHASE_ASSOCIATED);
+        traceAfter(50, PHASE_L2_CONNECTED);
+        traceAfter(300, PHASE_L3_CONNECTED);
+
+        List<ConnectionPhaseTracer.Attempt> attempts = new ArrayList<>();
+        assertEquals(0, mTracer.getAttempts(attempts));
+        assertEquals(1, attempts.size());
+        assertEquals(-1, attempts.get(0).getStepDurationMs(PHASE_CONNECT_START));
+        assertEquals(-1, attempts.get(0).getStepDurationMs(PHASE_VALIDATED));
+        assertEquals(450, attempts.get(0).getTotalDurationMs());
+    }
+
+    /**
+     * Verifies the percentiles reported over the last connections, and that the outlier
+     * connection is listed with its slowest step.
+     */
+    @Test
+    public void analysisReportsPercentilesAndOutliers() {
+        // Dropped, since only the last 20 connections are analyzed.
+        traceConnection(5, 100, 50, 9000, 1000);
+        for (int i = 0; i < 19; i++) {
+            traceConnection(5, 100 + i, 50, 300, 1000);
+        }
+        traceConnection(5, 100, 50, 3000, 1000);
+
+        String output = analyze(20);
+        assertTrue(output, output.contains("last 20 connections"));
+        assertTrue(output, output.matches(
+                "(?s).*association\\s+20\\s+108\\s+117\\s+118\\n.*"));
+        assertTrue(output, output.matches(
+                "(?s).*ip provisioning\\s+20\\s+300\\s+300\\s+3000\\n.*"));
+        assertTrue(output, output.contains("total=4155ms"));
+        assertTrue(output, output.contains("slowest=ip provisioning"));
+        assertFalse(output, output.contains("=9000"));
+    }
+
+    /**
+     * Verifies that the ring keeps the newest trace points once full.
+     */
+    @Test
+    public void ringKeepsNewestTracePoints() {
+        for (int i = 0; i < CAPACITY; i++) {
+            traceConnection(5, 100, 50, 300, 1000);
+        }
+
+        List<ConnectionPhaseTracer.Attempt> attempts = new ArrayList<>();
+        mTracer.getAttempts(attempts);
+        // 64 trace points hold 10 whole connections, plus the end of one more.
+        assertEquals(CAPACITY / 6, attempts.size());
+
+        mTracer.clear();
+        attempts.clear();
+        assertEquals(0, mTracer.getAttempts(attempts));
+        assertEquals(0, attempts.size());
+    }
+}
@@ -350,6 +350,7 @@ public class HalDeviceManagerTest extends WifiBaseTest {
 
         // fiddle with the "chip" by removing the STA
         chipMock.interfaceNames.get(IfaceType.STA).remove("wlan0");
+        chipMock.chipEventCallback.onIfaceRemoved(IfaceType.STA, "wlan0");
 
         // now try to request another NAN
         IWifiIface nanIface2 = mDut.createNanIface(nanDestroyedListener, mHandler);
@@ -2005,6 +2006,53 @@ public class HalDeviceManagerTest extends WifiBaseTest {
         runP2pAndNanExclusiveInteractionsTestChip(new TestChipV3(), TestChipV3.CHIP_MODE_ID);
     }
 
+    /**
+     * Validate that the chip info is read from the chip once, and read again only after the chip
+     * is reconfigured - by the manager or as reported by the chip callbacks.
+     */
+    @Test
+    public void testChipInfoIsCachedUntilChipChanges() throws Exception {
+        TestChipV1 chipMock = new TestChipV1();
+        chipMock.initialize();
+        mInOrder = inOrder(mServiceManagerMock, mWifiMock, chipMock.chip,
+                mManagerStatusListenerMock);
+        executeAndValidateInitializationSequence();
+        executeAndValidateStartupSequence();
+
+        mDut.getSupportedIfaceTypes();
+        mDut.getSupportedIfaceTypes();
+        verify(chipMock.chip).getStaIfaceNames(any(IWifiChip.getStaIfaceNamesCallback.class));
+
+        // Creating an interface reuses the cached info, then reads it again once the chip has
+        // been configured.
+        validateInterfaceSequence(chipMock,
+                false, // chipModeValid
+                -1000, // chipModeId (only used if chipModeValid is true)
+                IfaceType.STA, // ifaceTypeToCreate
+                "wlan0", // ifaceName
+                TestChipV1.STA_CHIP_MODE_ID, // finalChipMode
+                null, // tearDownList
+                null, // destroyedListener
+                null // availableListener
+        );
+        verify(chipMock.chip, times(2)).getStaIfaceNames(
+                any(IWifiChip.getStaIfaceNamesCallback.class));
+        mDut.getSupportedIfaceTypes();
+        verify(chipMock.chip, times(2)).getStaIfaceNames(
+                any(IWifiChip.getStaIfaceNamesCallback.class));
+
+        chipMock.chipEventCallback.onChipReconfigured(TestChipV1.STA_CHIP_MODE_ID);
+        mDut.getSupportedIfaceTypes();
+        verify(chipMock.chip, times(3)).getStaIfaceNames(
+                any(IWifiChip.getStaIfaceNamesCallback.class));
+
+        StringWriter sw = new StringWriter();
+        mDut.dump(null, new PrintWriter(sw), null);
+        assertTrue(sw.toString().contains("mNumChipInfoCacheMisses: 3"));
+        assertTrue(sw.toString().contains("createIface latency: type=" + IfaceType.STA
+                + ", calls=1"));
+    }
+
     /**
      * Validate that the getSupportedIfaceTypes API works when requesting for all chips.
      */
@@ -2551,9 +2599,14 @@ public class HalDeviceManagerTest extends WifiBaseTest {
             HalDeviceManager.InterfaceAvailableForRequestListener availableListener,
             InterfaceDestroyedListenerWithIfaceName...destroyedInterfacesDestroyedListeners)
             throws Exception {
-        // configure chip mode response
+        // configure chip mode response, notifying the change as the chip would
+        boolean chipModeChanged = chipMock.chipModeValid != chipModeValid
+                || (chipModeValid && chipMock.chipModeId != chipModeId);
         chipMock.chipModeValid = chipModeValid;
         chipMock.chipModeId = chipModeId;
+        if (chipModeChanged && chipMock.chipEventCallback != null) {
+            chipMock.chipEventCallback.onChipReconfigured(chipModeId);
+        }
 
         IWifiIface iface = null;
 
@@ -2976,6 +3029,7 @@ public class HalDeviceManagerTest extends WifiBaseTest {
         public int chipModeIdValidForRtt = -1; // single chip mode ID where RTT can be created
         public Map<Integer, ArrayList<String>> interfaceNames = new HashMap<>();
         public Map<Integer, Map<String, IWifiIface>> interfacesByName = new HashMap<>();
+        public IWifiChipEventCallback chipEventCallback;
 
         public ArrayList<IWifiChip.ChipMode> availableModes;
 
@@ -2992,8 +3046,11 @@ public class HalDeviceManagerTest extends WifiBaseTest {
             interfacesByName.put(IfaceType.P2P, new HashMap<>());
             interfacesByName.put(IfaceType.NAN, new HashMap<>());
 
-            when(chip.registerEventCallback(any(IWifiChipEventCallback.class))).thenReturn(
-                    mStatusOk);
+            when(chip.registerEventCallback(any(IWifiChipEventCallback.class))).thenAnswer(
+                    invocation -> {
+                        chipEventCallback = invocation.getArgument(0);
+                        return mStatusOk;
+                    });
             when(chip.configureChip(anyInt())).thenAnswer(new ConfigureChipAnswer(this));
             doAnswer(new GetIdAnswer(this)).when(chip).getId(any(IWifiChip.getIdCallback.class));
             doAnswer(new GetModeAnswer(this)).when(chip).getMode(
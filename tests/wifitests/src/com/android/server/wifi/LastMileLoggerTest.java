@@ -17,6 +17,7 @@
 package com.android.server.wifi;
 
 import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertFalse;
 import static org.junit.Assert.assertTrue;
 import static org.mockito.Matchers.anyString;
 import static org.mockito.Matchers.contains;
@@ -24,6 +25,8 @@ import static org.mockito.Mockito.verify;
 import static org.mockito.Mockito.verifyZeroInteractions;
 import static org.mockito.Mockito.when;
 
+import android.os.test.TestLooper;
+
 import androidx.test.filters.SmallTest;
 
 import com.android.server.wifi.util.FileUtils;
@@ -39,6 +42,8 @@ import org.mockito.Spy;
 import java.io.File;
 import java.io.PrintWriter;
 import java.io.StringWriter;
+import java.nio.file.Files;
+import java.util.Arrays;
 
 /**
  * Unit tests for {@link LastMileLogger}.
@@ -47,6 +52,7 @@ import java.io.StringWriter;
 public class LastMileLoggerTest extends WifiBaseTest {
     @Mock WifiInjector mWifiInjector;
     @Spy FakeWifiLog mLog;
+    private final TestLooper mLooper = new TestLooper();
 
     @Before
     public void setUp() throws Exception {
@@ -59,27 +65,32 @@ public class LastMileLoggerTest extends WifiBaseTest {
         mTraceEnableFile.deleteOnExit();
         mTraceReleaseFile.deleteOnExit();
         FileUtils.stringToFile(mTraceEnableFile.getPath(), "0");
+        mCaptureDir = Files.createTempDirectory(CAPTURE_DIR_PREFIX).toFile();
+        mCaptureDir.deleteOnExit();
         mLastMileLogger = new LastMileLogger(mWifiInjector, mTraceDataFile.getPath(),
-                mTraceEnableFile.getPath(),  mTraceReleaseFile.getPath());
+                mTraceEnableFile.getPath(),  mTraceReleaseFile.getPath(), mCaptureDir,
+                mLooper.getLooper());
+        mLooper.dispatchAll();
     }
 
     @Test
     public void ctorDoesNotCrash() throws Exception {
         new LastMileLogger(mWifiInjector, mTraceDataFile.getPath(), mTraceEnableFile.getPath(),
-                mTraceReleaseFile.getPath());
+                mTraceReleaseFile.getPath(), mCaptureDir, mLooper.getLooper());
+        mLooper.dispatchAll();
         verifyZeroInteractions(mLog);
     }
 
     @Test
     public void connectionEventStartedEnablesTracing() throws Exception {
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
         assertEquals("1", IoUtils.readFileAsString(mTraceEnableFile.getPath()));
     }
 
     @Test
     public void connectionEventStartedDoesNotCrashIfReleaseFileIsMissing() throws Exception {
         mTraceReleaseFile.delete();
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
         verify(mLog).warn(contains("Failed to open free_buffer"));
     }
 
@@ -87,13 +98,13 @@ public class LastMileLoggerTest extends WifiBaseTest {
     public void connectionEventStartedDoesNotEnableTracingIfReleaseFileIsMissing()
             throws Exception {
         mTraceReleaseFile.delete();
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
         assertEquals("0", IoUtils.readFileAsString(mTraceEnableFile.getPath()));
     }
 
     @Test
     public void connectionEventStartedDoesNotAttemptToReopenReleaseFile() throws Exception {
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
 
         // This is a rather round-about way of verifying that we don't attempt to re-open
         // the file. Namely: if we delete the |release| file, and CONNECTION_EVENT_STARTED
@@ -104,78 +115,78 @@ public class LastMileLoggerTest extends WifiBaseTest {
         // A more direct test would require the use of a factory for the creation of the
         // FileInputStream.
         mTraceReleaseFile.delete();
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
         verifyZeroInteractions(mLog);
     }
 
     @Test
     public void connectionEventStartedDoesNotCrashIfEnableFileIsMissing() throws Exception {
         mTraceEnableFile.delete();
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
     }
 
     @Test
     public void connectionEventStartedDoesNotCrashOnRepeatedCalls() throws Exception {
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
     }
 
     @Test
     public void connectionEventSucceededDisablesTracing() throws Exception {
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_SUCCEEDED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_SUCCEEDED);
         assertEquals("0", IoUtils.readFileAsString(mTraceEnableFile.getPath()));
     }
 
     @Test
     public void connectionEventSucceededDoesNotCrashIfEnableFileIsMissing() throws Exception {
         mTraceEnableFile.delete();
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_SUCCEEDED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_SUCCEEDED);
     }
 
     @Test
     public void connectionEventSucceededDoesNotCrashOnRepeatedCalls() throws Exception {
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_SUCCEEDED);
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_SUCCEEDED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_SUCCEEDED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_SUCCEEDED);
     }
 
     @Test
     public void connectionEventFailedDisablesTracingWhenPendingFails() throws Exception {
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_FAILED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_FAILED);
         assertEquals("0", IoUtils.readFileAsString(mTraceEnableFile.getPath()));
     }
 
     @Test
     public void connectionEventTimeoutDisablesTracing()
             throws Exception {
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_TIMEOUT);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_TIMEOUT);
         assertEquals("0", IoUtils.readFileAsString(mTraceEnableFile.getPath()));
     }
 
     @Test
     public void connectionEventFailedDoesNotCrashIfEnableFileIsMissing() throws Exception {
         mTraceEnableFile.delete();
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_FAILED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_FAILED);
     }
 
     @Test
     public void connectionEventFailedDoesNotCrashIfDataFileIsMissing() throws Exception {
         mTraceDataFile.delete();
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_FAILED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_FAILED);
     }
 
     @Test
     public void connectionEventFailedDoesNotCrashOnRepeatedCalls() throws Exception {
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_FAILED);
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_FAILED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_FAILED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_FAILED);
     }
 
     @Test
     public void dumpShowsFailureTrace() throws Exception {
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
         FileUtils.stringToFile(mTraceDataFile.getPath(), "rdev_connect");
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_FAILED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_FAILED);
         assertTrue(getDumpString().contains("--- Last failed"));
         assertTrue(getDumpString().contains("rdev_connect"));
     }
@@ -183,7 +194,7 @@ public class LastMileLoggerTest extends WifiBaseTest {
 
     @Test
     public void dumpShowsPendingConnectionTrace() throws Exception {
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
         FileUtils.stringToFile(mTraceDataFile.getPath(), "rdev_connect");
         assertTrue(getDumpString().contains("No last mile log for \"Last failed"));
         assertTrue(getDumpString().contains("--- Latest"));
@@ -192,10 +203,10 @@ public class LastMileLoggerTest extends WifiBaseTest {
 
     @Test
     public void dumpShowsLastFailureTraceAndPendingConnectionTrace() throws Exception {
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
         FileUtils.stringToFile(mTraceDataFile.getPath(), "rdev_connect try #1");
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_FAILED);
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_FAILED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
         FileUtils.stringToFile(mTraceDataFile.getPath(), "rdev_connect try #2");
 
         String dumpString = getDumpString();
@@ -205,12 +216,12 @@ public class LastMileLoggerTest extends WifiBaseTest {
 
     @Test
     public void dumpShowsLastFailureTraceAndCurrentConnectionTrace() throws Exception {
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
         FileUtils.stringToFile(mTraceDataFile.getPath(), "rdev_connect try #1");
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_FAILED);
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_FAILED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
         FileUtils.stringToFile(mTraceDataFile.getPath(), "rdev_connect try #2");
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_SUCCEEDED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_SUCCEEDED);
 
         String dumpString = getDumpString();
         assertTrue(dumpString.contains("rdev_connect try #1"));
@@ -219,9 +230,9 @@ public class LastMileLoggerTest extends WifiBaseTest {
 
     @Test
     public void dumpDoesNotClearLastFailureData() throws Exception {
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
         FileUtils.stringToFile(mTraceDataFile.getPath(), "rdev_connect");
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_FAILED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_FAILED);
 
         getDumpString();
         String dumpString = getDumpString();
@@ -230,7 +241,7 @@ public class LastMileLoggerTest extends WifiBaseTest {
 
     @Test
     public void dumpDoesNotClearPendingConnectionTrace() throws Exception {
-        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
         FileUtils.stringToFile(mTraceDataFile.getPath(), "rdev_connect");
 
         getDumpString();
@@ -238,6 +249,109 @@ public class LastMileLoggerTest extends WifiBaseTest {
         assertTrue(dumpString.contains("rdev_connect"));
     }
 
+    @Test
+    public void dumpShowsBoundedNumberOfFailureTraces() throws Exception {
+        for (int i = 1; i <= LastMileLogger.MAX_FROZEN_WINDOWS + 1; i++) {
+            reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
+            FileUtils.stringToFile(mTraceDataFile.getPath(), "rdev_connect try #" + i);
+            reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_FAILED);
+        }
+        FileUtils.stringToFile(mTraceDataFile.getPath(), "");
+
+        String dumpString = getDumpString();
+        assertFalse(dumpString.contains("rdev_connect try #1"));
+        for (int i = 2; i <= LastMileLogger.MAX_FROZEN_WINDOWS + 1; i++) {
+            assertTrue(dumpString.contains("rdev_connect try #" + i));
+        }
+        // Most recent failure first
+        String lastTrace = "rdev_connect try #" + (LastMileLogger.MAX_FROZEN_WINDOWS + 1);
+        assertTrue(dumpString.indexOf(lastTrace) < dumpString.indexOf("rdev_connect try #2"));
+        assertEquals(LastMileLogger.MAX_FROZEN_WINDOWS, mCaptureDir.list().length);
+    }
+
+    @Test
+    public void failureTraceIsTruncatedToMaxWindowSize() throws Exception {
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
+        char[] trace = new char[LastMileLogger.MAX_WINDOW_BYTES + 100];
+        Arrays.fill(trace, 'x');
+        FileUtils.stringToFile(mTraceDataFile.getPath(), new String(trace));
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_FAILED);
+
+        File[] windows = mCaptureDir.listFiles();
+        assertEquals(1, windows.length);
+        assertEquals(LastMileLogger.MAX_WINDOW_BYTES, windows[0].length());
+    }
+
+    @Test
+    public void ctorDeletesWindowsFrozenBeforeRestart() throws Exception {
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
+        FileUtils.stringToFile(mTraceDataFile.getPath(), "rdev_connect");
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_FAILED);
+        assertEquals(1, mCaptureDir.list().length);
+
+        new LastMileLogger(mWifiInjector, mTraceDataFile.getPath(), mTraceEnableFile.getPath(),
+                mTraceReleaseFile.getPath(), mCaptureDir, mLooper.getLooper());
+        assertEquals(1, mCaptureDir.list().length);
+        mLooper.dispatchAll();
+        assertEquals(0, mCaptureDir.list().length);
+    }
+
+    /**
+     * Verifies that the trace is frozen on the background looper, not when the failure is
+     * reported.
+     */
+    @Test
+    public void connectionEventFailedFreezesTraceOnBackgroundLooper() throws Exception {
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
+        FileUtils.stringToFile(mTraceDataFile.getPath(), "rdev_connect");
+        mLastMileLogger.reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_FAILED);
+        assertEquals(0, mCaptureDir.list().length);
+
+        mLooper.dispatchAll();
+        assertEquals(1, mCaptureDir.list().length);
+        assertTrue(getDumpString().contains("rdev_connect"));
+    }
+
+    /**
+     * Verifies that a failure whose trace cannot be read does not evict any frozen window.
+     */
+    @Test
+    public void unreadableTraceDoesNotEvictFrozenWindows() throws Exception {
+        for (int i = 1; i <= LastMileLogger.MAX_FROZEN_WINDOWS; i++) {
+            reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
+            FileUtils.stringToFile(mTraceDataFile.getPath(), "rdev_connect try #" + i);
+            reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_FAILED);
+        }
+        mTraceDataFile.delete();
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_FAILED);
+
+        String dumpString = getDumpString();
+        for (int i = 1; i <= LastMileLogger.MAX_FROZEN_WINDOWS; i++) {
+            assertTrue(dumpString.contains("rdev_connect try #" + i));
+        }
+        assertEquals(LastMileLogger.MAX_FROZEN_WINDOWS, mCaptureDir.list().length);
+    }
+
+    /**
+     * Verifies that a failure with an empty trace does not evict any frozen window.
+     */
+    @Test
+    public void emptyTraceDoesNotEvictFrozenWindows() throws Exception {
+        for (int i = 1; i <= LastMileLogger.MAX_FROZEN_WINDOWS; i++) {
+            reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_STARTED);
+            FileUtils.stringToFile(mTraceDataFile.getPath(), "rdev_connect try #" + i);
+            reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_FAILED);
+        }
+        FileUtils.stringToFile(mTraceDataFile.getPath(), "");
+        reportConnectionEvent(BaseWifiDiagnostics.CONNECTION_EVENT_FAILED);
+
+        String dumpString = getDumpString();
+        for (int i = 1; i <= LastMileLogger.MAX_FROZEN_WINDOWS; i++) {
+            assertTrue(dumpString.contains("rdev_connect try #" + i));
+        }
+        assertEquals(LastMileLogger.MAX_FROZEN_WINDOWS, mCaptureDir.list().length);
+    }
+
     @Test
     public void dumpDoesNotCrashIfDataFileIsEmpty() throws Exception {
         getDumpString();
@@ -252,10 +366,17 @@ public class LastMileLoggerTest extends WifiBaseTest {
     private static final String TRACE_DATA_PREFIX = "last-mile-logger-trace-data";
     private static final String TRACE_ENABLE_PREFIX = "last-mile-logger-trace-enable";
     private static final String TRACE_RELEASE_PREFIX = "last-mile-logger-trace-release";
+    private static final String CAPTURE_DIR_PREFIX = "last-mile-logger-capture";
     private LastMileLogger mLastMileLogger;
     private File mTraceDataFile;
     private File mTraceEnableFile;
     private File mTraceReleaseFile;
+    private File mCaptureDir;
+
+    private void reportConnectionEvent(byte event) {
+        mLastMileLogger.reportConnectionEvent(event);
+        mLooper.dispatchAll();
+    }
 
     private String getDumpString() {
         StringWriter sw = new StringWriter();
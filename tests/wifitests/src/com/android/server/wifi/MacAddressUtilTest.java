@@ -30,6 +30,8 @@ import org.mockito.Mock;
 import org.mockito.MockitoAnnotations;
 
 import java.security.ProviderException;
+import java.util.Arrays;
+import java.util.Map;
 import java.util.Random;
 
 import javax.crypto.Mac;
@@ -39,6 +41,8 @@ import javax.crypto.Mac;
  */
 @SmallTest
 public class MacAddressUtilTest extends WifiBaseTest {
+    private static final String TEST_KEY = "\"TEST_SSID\"WPA_PSK";
+    private static final int TEST_UID = 1010;
     private MacAddressUtil mMacAddressUtil;
 
     @Mock private Mac mMac;
@@ -82,4 +86,76 @@ public class MacAddressUtilTest extends WifiBaseTest {
             fail("Exception not caught.");
         }
     }
+
+    /**
+     * Verifies that the persistent MAC is derived once per key and then served from the cache.
+     */
+    @Test
+    public void testGetOrCalculatePersistentMacUsesCache() {
+        MacAddressUtil macAddressUtil = spy(mMacAddressUtil);
+        doReturn(mMac).when(macAddressUtil).obtainMacRandHashFunction(anyInt());
+        when(mMac.doFinal(any())).thenReturn(new byte[32]);
+
+        MacAddress macAddress = macAddressUtil.getOrCalculatePersistentMac(TEST_KEY, TEST_UID);
+        assertTrue(WifiConfiguration.isValidMacAddressForRandomization(macAddress));
+        assertEquals(macAddress, macAddressUtil.getOrCalculatePersistentMac(TEST_KEY, TEST_UID));
+        verify(macAddressUtil).obtainMacRandHashFunction(TEST_UID);
+
+        // Removing the key from the cache causes the MAC to be derived again.
+        macAddressUtil.removePersistentMacFromCache(TEST_KEY);
+        assertEquals(macAddress, macAddressUtil.getOrCalculatePersistentMac(TEST_KEY, TEST_UID));
+        verify(macAddressUtil, times(2)).obtainMacRandHashFunction(TEST_UID);
+    }
+
+    /**
+     * Verifies that the batch API retrieves the secret from KeyStore at most once.
+     */
+    @Test
+    public void testGetOrCalculatePersistentMacsRetrievesSecretOnce() {
+        MacAddressUtil macAddressUtil = spy(mMacAddressUtil);
+        doReturn(mMac).when(macAddressUtil).obtainMacRandHashFunction(anyInt());
+        when(mMac.doFinal(any())).thenReturn(new byte[32]);
+
+        Map<String, MacAddress> macAddresses = macAddressUtil.getOrCalculatePersistentMacs(
+                Arrays.asList(TEST_KEY, TEST_KEY + "1", TEST_KEY + "2"), TEST_UID);
+        assertEquals(3, macAddresses.size());
+        verify(macAddressUtil).obtainMacRandHashFunction(TEST_UID);
+
+        // All keys are cached now.
+        macAddressUtil.getOrCalculatePersistentMacs(
+                Arrays.asList(TEST_KEY, TEST_KEY + "1", TEST_KEY + "2"), TEST_UID);
+        verify(macAddressUtil).obtainMacRandHashFunction(TEST_UID);
+    }
+
+    /**
+     * Verifies that a persisted cache is restored only if it was derived with the current secret.
+     */
+    @Test
+    public void testLoadPersistentMacCacheChecksSecretFingerprint() {
+        MacAddressUtil macAddressUtil = spy(mMacAddressUtil);
+        doReturn(mMac).when(macAddressUtil).obtainMacRandHashFunction(anyInt());
+        when(mMac.doFinal(any())).thenReturn(new byte[32]);
+        MacAddress macAddress = macAddressUtil.getOrCalculatePersistentMac(TEST_KEY, TEST_UID);
+        Map<String, String> cache = macAddressUtil.getPersistentMacCacheForStore();
+        String fingerprint = macAddressUtil.getSecretFingerprintForStore();
+        assertEquals(macAddress.toString(), cache.get(TEST_KEY));
+        assertNotNull(fingerprint);
+
+        // Same secret: the cache is restored and no derivation is needed for TEST_KEY.
+        MacAddressUtil reloadedUtil = spy(new MacAddressUtil());
+        doReturn(mMac).when(reloadedUtil).obtainMacRandHashFunction(anyInt());
+        reloadedUtil.loadPersistentMacCache(cache, fingerprint, TEST_UID);
+        assertEquals(cache, reloadedUtil.getPersistentMacCacheForStore());
+
+        // Rotated secret: the cache is dropped.
+        Mac rotatedMac = mock(Mac.class);
+        byte[] rotatedBytes = new byte[32];
+        Arrays.fill(rotatedBytes, (byte) 1);
+        when(rotatedMac.doFinal(any())).thenReturn(rotatedBytes);
+        MacAddressUtil rotatedUtil = spy(new MacAddressUtil());
+        doReturn(rotatedMac).when(rotatedUtil).obtainMacRandHashFunction(anyInt());
+        rotatedUtil.loadPersistentMacCache(cache, fingerprint, TEST_UID);
+        assertTrue(rotatedUtil.getPersistentMacCacheForStore().isEmpty());
+        assertNotEquals(macAddress, rotatedUtil.getOrCalculatePersistentMac(TEST_KEY, TEST_UID));
+    }
 }
@@ -21,6 +21,8 @@ import static org.mockito.Mockito.*;
 
 import android.content.Context;
 import android.net.IpMemoryStore;
+import android.os.Handler;
+import android.os.test.TestLooper;
 
 import androidx.test.filters.SmallTest;
 
@@ -45,13 +47,20 @@ public class MemoryStoreImplTest extends WifiBaseTest {
     @Mock WifiInjector mWifiInjector;
     @Mock IpMemoryStore mIpMemoryStore;
     private MemoryStoreImpl mMemoryStoreImpl;
+    private TestLooper mLooper;
     private static final String DATA_NAME = "test";
 
     @Before
     public void setUp() throws Exception {
         MockitoAnnotations.initMocks(this);
+        mLooper = new TestLooper();
         mMemoryStoreImpl = new MemoryStoreImpl(mContext, mWifiInjector, mWifiScoreCard,
-                mWifiHealthMonitor);
+                mWifiHealthMonitor, new Handler(mLooper.getLooper()));
+    }
+
+    private void flushWrites() {
+        mLooper.moveTimeForward(MemoryStoreImpl.WRITE_FLUSH_INTERVAL_MS);
+        mLooper.dispatchAll();
     }
 
     /**
@@ -146,6 +155,9 @@ public class MemoryStoreImplTest extends WifiBaseTest {
         when(mWifiInjector.getIpMemoryStore()).thenReturn(mIpMemoryStore);
         mMemoryStoreImpl.start();
         mMemoryStoreImpl.write(myL2Key, DATA_NAME, myBlob);
+        // Writes are buffered until the flush interval elapses.
+        verify(mIpMemoryStore, never()).storeBlob(any(), any(), any(), any(), any());
+        flushWrites();
         verify(mIpMemoryStore).storeBlob(
                 eq(myL2Key),
                 eq(MemoryStoreImpl.WIFI_FRAMEWORK_IP_MEMORY_STORE_CLIENT_ID),
@@ -171,9 +183,133 @@ public class MemoryStoreImplTest extends WifiBaseTest {
                 .when(mIpMemoryStore).storeBlob(any(), any(), any(), any(), any());
         mMemoryStoreImpl.start();
         mMemoryStoreImpl.write(myL2Key, DATA_NAME, myBlob);
+        flushWrites();
         // After the failed write, the read should do nothing.
         mMemoryStoreImpl.read(myL2Key, DATA_NAME, mBlobListener);
         verify(mIpMemoryStore, never())
                 .retrieveBlob(any(), any(), any(), any());
     }
+
+    /**
+     * Repeated writes of the same blob within the flush interval should collapse into one.
+     */
+    @Test
+    public void duplicateWritesWithinFlushIntervalCollapse() throws Exception {
+        final String myL2Key = "L2Key:collapse";
+        final byte[] firstBlob = new byte[]{0x1};
+        final byte[] lastBlob = new byte[]{0x2};
+        when(mWifiInjector.getIpMemoryStore()).thenReturn(mIpMemoryStore);
+        mMemoryStoreImpl.start();
+        mMemoryStoreImpl.setCluster(myL2Key, "cluster");
+        mMemoryStoreImpl.write(myL2Key, DATA_NAME, firstBlob);
+        mMemoryStoreImpl.setCluster(myL2Key, "cluster");
+        mMemoryStoreImpl.write(myL2Key, DATA_NAME, lastBlob);
+        flushWrites();
+
+        verify(mIpMemoryStore).storeNetworkAttributes(eq(myL2Key), any(), any());
+        verify(mIpMemoryStore).storeBlob(
+                eq(myL2Key),
+                eq(MemoryStoreImpl.WIFI_FRAMEWORK_IP_MEMORY_STORE_CLIENT_ID),
+                eq(DATA_NAME),
+                mIpMemoryStoreBlobCaptor.capture(),
+                eq(null));
+        assertArrayEquals(lastBlob, mIpMemoryStoreBlobCaptor.getValue().data);
+        verifyNoMoreInteractions(mIpMemoryStore);
+        assertEquals(2, mMemoryStoreImpl.getIpcCallsSaved());
+    }
+
+    /**
+     * A read of a blob with a buffered write should be served from the buffer.
+     */
+    @Test
+    public void readOfBufferedWriteIsServedFromBuffer() throws Exception {
+        final String myL2Key = "L2Key:buffered";
+        final byte[] myBlob = new byte[]{0x4, 0x2};
+        when(mWifiInjector.getIpMemoryStore()).thenReturn(mIpMemoryStore);
+        mMemoryStoreImpl.start();
+        mMemoryStoreImpl.write(myL2Key, DATA_NAME, myBlob);
+        mMemoryStoreImpl.read(myL2Key, DATA_NAME, mBlobListener);
+        mLooper.dispatchAll();
+
+        verify(mBlobListener).onBlobRetrieved(mBytesCaptor.capture());
+        assertArrayEquals(myBlob, mBytesCaptor.getValue());
+        verify(mIpMemoryStore, never()).retrieveBlob(any(), any(), any(), any());
+    }
+
+    /**
+     * Concurrent reads of the same blob share a request, and the number of outstanding reads is
+     * bounded.
+     */
+    @Test
+    public void readsAreCoalescedAndBounded() throws Exception {
+        final android.net.ipmemorystore.Status statusSuccess =
+                new android.net.ipmemorystore.Status(android.net.ipmemorystore.Status.SUCCESS);
+        final WifiScoreCard.BlobListener otherListener = mock(WifiScoreCard.BlobListener.class);
+        when(mWifiInjector.getIpMemoryStore()).thenReturn(mIpMemoryStore);
+        mMemoryStoreImpl.start();
+
+        mMemoryStoreImpl.read("L2Key:0", DATA_NAME, mBlobListener);
+        mMemoryStoreImpl.read("L2Key:0", DATA_NAME, otherListener);
+        for (int i = 1; i <= MemoryStoreImpl.MAX_READS_IN_FLIGHT; i++) {
+            mMemoryStoreImpl.read("L2Key:" + i, DATA_NAME, mBlobListener);
+        }
+        verify(mIpMemoryStore, times(MemoryStoreImpl.MAX_READS_IN_FLIGHT)).retrieveBlob(
+                any(), any(), any(), mOnBlobRetrievedListenerCaptor.capture());
+
+        // Completing the first read notifies both listeners and issues the queued read.
+        final android.net.ipmemorystore.Blob wrappedBlob = new android.net.ipmemorystore.Blob();
+        wrappedBlob.data = new byte[]{0x7};
+        mOnBlobRetrievedListenerCaptor.getAllValues().get(0)
+                .onBlobRetrieved(statusSuccess, "L2Key:0", DATA_NAME, wrappedBlob);
+        verify(mBlobListener).onBlobRetrieved(wrappedBlob.data);
+        verify(otherListener).onBlobRetrieved(wrappedBlob.data);
+        verify(mIpMemoryStore).retrieveBlob(
+                eq("L2Key:" + MemoryStoreImpl.MAX_READS_IN_FLIGHT), any(), any(), any());
+        assertEquals(1, mMemoryStoreImpl.getIpcCallsSaved());
+    }
+
+    /**
+     * A read whose reply is lost should time out and give its slot to the next queued read, and
+     * a late reply should not be delivered.
+     */
+    @Test
+    public void lostReadReplyTimesOutAndReleasesItsSlot() throws Exception {
+        final android.net.ipmemorystore.Status statusSuccess =
+                new android.net.ipmemorystore.Status(android.net.ipmemorystore.Status.SUCCESS);
+        when(mWifiInjector.getIpMemoryStore()).thenReturn(mIpMemoryStore);
+        mMemoryStoreImpl.start();
+
+        for (int i = 0; i <= MemoryStoreImpl.MAX_READS_IN_FLIGHT; i++) {
+            mMemoryStoreImpl.read("L2Key:" + i, DATA_NAME, mBlobListener);
+        }
+        verify(mIpMemoryStore, times(MemoryStoreImpl.MAX_READS_IN_FLIGHT)).retrieveBlob(
+                any(), any(), any(), mOnBlobRetrievedListenerCaptor.capture());
+
+        mLooper.moveTimeForward(MemoryStoreImpl.READ_TIMEOUT_MS);
+        mLooper.dispatchAll();
+        verify(mIpMemoryStore).retrieveBlob(
+                eq("L2Key:" + MemoryStoreImpl.MAX_READS_IN_FLIGHT), any(), any(), any());
+
+        final android.net.ipmemorystore.Blob wrappedBlob = new android.net.ipmemorystore.Blob();
+        wrappedBlob.data = new byte[]{0x7};
+        mOnBlobRetrievedListenerCaptor.getAllValues().get(0)
+                .onBlobRetrieved(statusSuccess, "L2Key:0", DATA_NAME, wrappedBlob);
+        verify(mBlobListener, never()).onBlobRetrieved(any());
+    }
+
+    /**
+     * Reads made while there is no IpMemoryStore should not hold their slots.
+     */
+    @Test
+    public void readsWithoutIpMemoryStoreDoNotHoldSlots() throws Exception {
+        for (int i = 0; i <= MemoryStoreImpl.MAX_READS_IN_FLIGHT; i++) {
+            mMemoryStoreImpl.read("L2Key:" + i, DATA_NAME, mBlobListener);
+        }
+        when(mWifiInjector.getIpMemoryStore()).thenReturn(mIpMemoryStore);
+        mMemoryStoreImpl.start();
+
+        mMemoryStoreImpl.read("L2Key:new", DATA_NAME, mBlobListener);
+        verify(mIpMemoryStore).retrieveBlob(eq("L2Key:new"), any(), any(), any());
+        verifyNoMoreInteractions(mIpMemoryStore);
+    }
 }
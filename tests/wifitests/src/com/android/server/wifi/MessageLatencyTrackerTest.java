@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.server.wifi;
+
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertFalse;
+import static org.junit.Assert.assertNull;
+import static org.junit.Assert.assertTrue;
+import static org.mockito.Mockito.when;
+
+import android.os.Handler;
+import android.os.Message;
+import android.os.test.TestLooper;
+
+import androidx.test.filters.SmallTest;
+
+import com.android.internal.util.IState;
+
+import org.junit.Before;
+import org.junit.Test;
+import org.mockito.Mock;
+import org.mockito.MockitoAnnotations;
+
+import java.io.PrintWriter;
+import java.io.StringWriter;
+
+/**
+ * Unit tests for {@link MessageLatencyTracker}.
+ */
+@SmallTest
+public class MessageLatencyTrackerTest extends WifiBaseTest {
+    private static final int CMD_FAST = 1;
+    private static final int CMD_SLOW = 2;
+    private static final int CMD_UNNAMED = 3;
+    // Uptime at which messages are due
+    private static final long DUE_TIME_MS = 1000;
+
+    @Mock private Clock mClock;
+    @Mock private IState mConnectedState;
+    @Mock private IState mDisconnectedState;
+    private TestLooper mLooper;
+    private MessageLatencyTracker mTracker;
+
+    /** Initializes test fixture. */
+    @Before
+    public void setUp() {
+        MockitoAnnotations.initMocks(this);
+        when(mConnectedState.getName()).thenReturn("ConnectedState");
+        when(mDisconnectedState.getName()).thenReturn("DisconnectedState");
+        mLooper = new TestLooper();
+        mTracker = new MessageLatencyTracker(mClock,
+                what -> what == CMD_FAST ? "CMD_FAST" : what == CMD_SLOW ? "CMD_SLOW" : null);
+    }
+
+    /**
+     * Handles a message with |what|, which was due at DUE_TIME_MS, after waiting |queueDelayMs|
+     * for |handlingMs|.
+     */
+    private void handleMessage(int what, IState state, long queueDelayMs, long handlingMs) {
+        Handler handler = new Handler(mLooper.getLooper()) {
+            @Override
+            public void handleMessage(Message msg) {
+                when(mClock.getUptimeSinceBootMillis()).thenReturn(DUE_TIME_MS + queueDelayMs);
+                mTracker.onPreHandleMessage(msg, state);
+                when(mClock.getUptimeSinceBootMillis())
+                        .thenReturn(DUE_TIME_MS + queueDelayMs + handlingMs);
+                mTracker.onPostHandleMessage(msg);
+            }
+        };
+        handler.sendMessageAtTime(handler.obtainMessage(what), DUE_TIME_MS);
+        mLooper.dispatchAll();
+    }
+
+    private String dump() {
+        StringWriter sw = new StringWriter();
+        mTracker.dump(null, new PrintWriter(sw), null);
+        return sw.toString();
+    }
+
+    /**
+     * Verifies that queue delays and handling durations are aggregated per what code and per
+     * state.
+     */
+    @Test
+    public void latenciesAreAggregatedPerWhatAndState() {
+        handleMessage(CMD_FAST, mConnectedState, 2, 1);
+        handleMessage(CMD_FAST, mDisconnectedState, 4, 3);
+        handleMessage(CMD_SLOW, mConnectedState, 0, 50);
+
+        MessageLatencyTracker.Stats fast = mTracker.getStatsForWhat(CMD_FAST);
+        assertEquals(2, fast.count);
+        assertEquals(6, fast.totalQueueDelayMs);
+        assertEquals(4, fast.totalHandlingMs);
+        assertEquals(4, fast.maxQueueDelayMs);
+        assertEquals(3, fast.maxHandlingMs);
+
+        MessageLatencyTracker.Stats connected = mTracker.getStatsForState(mConnectedState);
+        assertEquals(2, connected.count);
+        assertEquals(51, connected.totalHandlingMs);
+        assertEquals(50, connected.maxHandlingMs);
+        assertEquals(1, mTracker.getStatsForState(mDisconnectedState).count);
+        assertNull(mTracker.getStatsForWhat(CMD_UNNAMED));
+    }
+
+    /**
+     * Verifies that only messages queued or handled for at least the threshold are reported as
+     * slow, and that unnamed what codes are dumped by value.
+     */
+    @Test
+    public void slowMessagesAreReported() {
+        int threshold = MessageLatencyTracker.SLOW_MESSAGE_THRESHOLD_MS;
+        handleMessage(CMD_FAST, mConnectedState, threshold - 1, threshold - 1);
+        handleMessage(CMD_SLOW, mConnectedState, 0, threshold);
+        handleMessage(CMD_UNNAMED, mDisconnectedState, threshold * 3, 0);
+
+        String dump = dump();
+        assertTrue(dump, dump.contains("CMD_SLOW in ConnectedState queued=0ms handled="
+                + threshold + "ms"));
+        assertTrue(dump, dump.contains("what=" + CMD_UNNAMED + " in DisconnectedState queued="
+                + threshold * 3 + "ms handled=0ms"));
+        assertFalse(dump, dump.contains("CMD_FAST in"));
+        assertTrue(dump, dump.contains("  CMD_FAST: count=1"));
+        assertTrue(dump, dump.contains("  in DisconnectedState: count=1"));
+    }
+}
@@ -132,4 +132,21 @@ public class RandomizedMacStoreDataTest extends WifiBaseTest {
         Map<String, String> deserializedMap = deserializeData(data);
         assertEquals(macMap, deserializedMap);
     }
+
+    /**
+     * Verify that the persistent MAC address cache and the secret fingerprint are serialized and
+     * deserialized correctly.
+     * @throws Exception
+     */
+    @Test
+    public void testSerializeDeserializePersistentMacCache() throws Exception {
+        Map<String, String> macCache = new HashMap<>();
+        macCache.put(TEST_CONFIG_KEY_1, TEST_MAC_ADDRESS_1);
+        mRandomizedMacStoreData.setPersistentMacCache(macCache, "0123abcd");
+        byte[] data = serializeData();
+        mRandomizedMacStoreData.resetData();
+        assertTrue(deserializeData(data).isEmpty());
+        assertEquals(macCache, mRandomizedMacStoreData.getPersistentMacCache());
+        assertEquals("0123abcd", mRandomizedMacStoreData.getSecretFingerprint());
+    }
 }
@@ -44,6 +44,7 @@ import android.os.test.TestLooper;
 
 import androidx.test.filters.SmallTest;
 
+import com.android.server.wifi.scanner.InProcessScanResultsDispatcher;
 import com.android.server.wifi.util.WifiPermissionsUtil;
 
 import org.junit.After;
@@ -84,6 +85,7 @@ public class ScanRequestProxyTest extends WifiBaseTest {
     @Mock private WifiInjector mWifiInjector;
     @Mock private WifiConfigManager mWifiConfigManager;
     @Mock private WifiScanner mWifiScanner;
+    @Mock private InProcessScanResultsDispatcher mInProcessScanResultsDispatcher;
     @Mock private WifiPermissionsUtil mWifiPermissionsUtil;
     @Mock private WifiMetrics mWifiMetrics;
     @Mock private Clock mClock;
@@ -114,12 +116,14 @@ public class ScanRequestProxyTest extends WifiBaseTest {
         MockitoAnnotations.initMocks(this);
 
         when(mWifiInjector.getWifiScanner()).thenReturn(mWifiScanner);
+        when(mWifiInjector.getInProcessScanResultsDispatcher())
+                .thenReturn(mInProcessScanResultsDispatcher);
         when(mWifiInjector.getWifiNetworkSuggestionsManager())
                 .thenReturn(mWifiNetworkSuggestionsManager);
         when(mWifiConfigManager.retrieveHiddenNetworkList()).thenReturn(TEST_HIDDEN_NETWORKS_LIST);
         when(mWifiNetworkSuggestionsManager.retrieveHiddenNetworkList())
                 .thenReturn(TEST_HIDDEN_NETWORKS_LIST_NS);
-        doNothing().when(mWifiScanner).registerScanListener(
+        doNothing().when(mInProcessScanResultsDispatcher).registerScanListener(
                 any(),
                 mGlobalScanListenerArgumentCaptor.capture());
         doNothing().when(mWifiScanner).startScan(
@@ -128,7 +132,7 @@ public class ScanRequestProxyTest extends WifiBaseTest {
                 mScanRequestListenerArgumentCaptor.capture(),
                 mWorkSourceArgumentCaptor.capture());
 
-        mInOrder = inOrder(mWifiScanner, mWifiConfigManager,
+        mInOrder = inOrder(mWifiScanner, mInProcessScanResultsDispatcher, mWifiConfigManager,
                 mContext, mWifiNetworkSuggestionsManager);
         mTestScanDatas1 =
                 ScanTestUtil.createScanDatas(new int[][]{{ 2417, 2427, 5180, 5170 }},
@@ -152,14 +156,15 @@ public class ScanRequestProxyTest extends WifiBaseTest {
 
     @After
     public void cleanUp() throws Exception {
-        verifyNoMoreInteractions(mWifiScanner, mWifiConfigManager, mContext, mWifiMetrics);
+        verifyNoMoreInteractions(mWifiScanner, mInProcessScanResultsDispatcher, mWifiConfigManager,
+                mContext, mWifiMetrics);
         validateMockitoUsage();
     }
 
     private void enableScanning() {
         // Enable scanning
         mScanRequestProxy.enableScanning(true, false);
-        mInOrder.verify(mWifiScanner).registerScanListener(any(), any());
+        mInOrder.verify(mInProcessScanResultsDispatcher).registerScanListener(any(), any());
         mInOrder.verify(mWifiScanner).setScanningEnabled(true);
         validateScanAvailableBroadcastSent(true);
 
@@ -172,7 +177,7 @@ public class ScanRequestProxyTest extends WifiBaseTest {
     @Test
     public void testEnableScanning() {
         mScanRequestProxy.enableScanning(true, false);
-        mInOrder.verify(mWifiScanner).registerScanListener(any(), any());
+        mInOrder.verify(mInProcessScanResultsDispatcher).registerScanListener(any(), any());
         mInOrder.verify(mWifiScanner).setScanningEnabled(true);
         validateScanAvailableBroadcastSent(true);
     }
@@ -183,7 +188,7 @@ public class ScanRequestProxyTest extends WifiBaseTest {
     @Test
     public void testDisableScanning() {
         mScanRequestProxy.enableScanning(false, false);
-        mInOrder.verify(mWifiScanner).registerScanListener(any(), any());
+        mInOrder.verify(mInProcessScanResultsDispatcher).registerScanListener(any(), any());
         mInOrder.verify(mWifiScanner).setScanningEnabled(false);
         validateScanAvailableBroadcastSent(false);
     }
@@ -250,7 +255,7 @@ public class ScanRequestProxyTest extends WifiBaseTest {
     @Test
     public void testStartScanWithHiddenNetworkScanningDisabled() {
         mScanRequestProxy.enableScanning(true, false);
-        mInOrder.verify(mWifiScanner).registerScanListener(any(), any());
+        mInOrder.verify(mInProcessScanResultsDispatcher).registerScanListener(any(), any());
         mInOrder.verify(mWifiScanner).setScanningEnabled(true);
         validateScanAvailableBroadcastSent(true);
 
@@ -272,7 +277,7 @@ public class ScanRequestProxyTest extends WifiBaseTest {
     @Test
     public void testStartScanWithHiddenNetworkScanningEnabled() {
         mScanRequestProxy.enableScanning(true, true);
-        mInOrder.verify(mWifiScanner).registerScanListener(any(), any());
+        mInOrder.verify(mInProcessScanResultsDispatcher).registerScanListener(any(), any());
         mInOrder.verify(mWifiScanner).setScanningEnabled(true);
         validateScanAvailableBroadcastSent(true);
 
@@ -496,7 +501,7 @@ public class ScanRequestProxyTest extends WifiBaseTest {
     public void testToggleScanStateClearsScanResults() {
         // Enable scanning
         mScanRequestProxy.enableScanning(true, false);
-        mInOrder.verify(mWifiScanner).registerScanListener(any(), any());
+        mInOrder.verify(mInProcessScanResultsDispatcher).registerScanListener(any(), any());
         mInOrder.verify(mWifiScanner).setScanningEnabled(true);
         validateScanAvailableBroadcastSent(true);
 
@@ -517,6 +517,80 @@ public class SupplicantStaIfaceHalTest extends WifiBaseTest {
                 .addNetwork(any(ISupplicantStaIface.addNetworkCallback.class));
     }
 
+    @Test
+    public void connectToNetworkWithUpdatedCredentialsUpdatesNetworkInPlace()
+            throws Exception {
+        executeAndValidateInitializationSequence();
+        WifiConfiguration config = executeAndValidateConnectSequence(SUPPLICANT_NETWORK_ID, false);
+        when(mSupplicantStaNetworkMock.updateWifiConfiguration(any(WifiConfiguration.class)))
+                .thenReturn(true);
+        when(mSupplicantStaNetworkMock.getNumHidlCallsInLastSave()).thenReturn(1);
+        when(mSupplicantStaNetworkMock.getNumHidlCallsSkippedInLastSave()).thenReturn(6);
+
+        // Reset mocks for mISupplicantStaIfaceMock because we finished the first connection.
+        reset(mISupplicantStaIfaceMock);
+        setupMocksForConnectSequence(true /*haveExistingNetwork*/);
+        when(mISupplicantStaIfaceMock.disconnect()).thenReturn(mStatusSuccess);
+        // Change the credentials and connect to the same network.
+        config.preSharedKey = "\"updatedPassphrase\"";
+        assertTrue(mDut.connectToNetwork(WLAN0_IFACE_NAME, config));
+        verify(mSupplicantStaNetworkMock).updateWifiConfiguration(eq(config));
+        verify(mISupplicantStaIfaceMock, never()).removeNetwork(anyInt());
+        verify(mISupplicantStaIfaceMock, never())
+                .addNetwork(any(ISupplicantStaIface.addNetworkCallback.class));
+        verify(mWifiMetrics).logSupplicantNetworkHidlCallsForConnect(1, 6);
+    }
+
+    /**
+     * Verifies that changing the credentials and security type of the current network
+     * disconnects before selecting it again, so that the new credentials are used.
+     */
+    @Test
+    public void connectToNetworkWithUpdatedCredentialsDisconnectsBeforeSelect()
+            throws Exception {
+        executeAndValidateInitializationSequence();
+        WifiConfiguration config = executeAndValidateConnectSequence(SUPPLICANT_NETWORK_ID, false);
+        when(mSupplicantStaNetworkMock.updateWifiConfiguration(any(WifiConfiguration.class)))
+                .thenReturn(true);
+
+        reset(mISupplicantStaIfaceMock);
+        setupMocksForConnectSequence(true /*haveExistingNetwork*/);
+        when(mISupplicantStaIfaceMock.disconnect()).thenReturn(mStatusSuccess);
+        config.allowedKeyManagement.clear();
+        config.allowedKeyManagement.set(WifiConfiguration.KeyMgmt.SAE);
+        config.preSharedKey = "\"updatedPassphrase\"";
+        InOrder inOrder = inOrder(mSupplicantStaNetworkMock, mISupplicantStaIfaceMock);
+        assertTrue(mDut.connectToNetwork(WLAN0_IFACE_NAME, config));
+        inOrder.verify(mSupplicantStaNetworkMock).updateWifiConfiguration(eq(config));
+        inOrder.verify(mISupplicantStaIfaceMock).disconnect();
+        inOrder.verify(mSupplicantStaNetworkMock).select();
+
+        // Connecting again with the same credentials does not disconnect.
+        assertTrue(mDut.connectToNetwork(WLAN0_IFACE_NAME, config));
+        verify(mISupplicantStaIfaceMock).disconnect();
+    }
+
+    /**
+     * Verifies that the connection fails if the interface cannot be disconnected after updating
+     * the current network in place.
+     */
+    @Test
+    public void connectToNetworkWithUpdatedCredentialsFailsIfDisconnectFails()
+            throws Exception {
+        executeAndValidateInitializationSequence();
+        WifiConfiguration config = executeAndValidateConnectSequence(SUPPLICANT_NETWORK_ID, false);
+        when(mSupplicantStaNetworkMock.updateWifiConfiguration(any(WifiConfiguration.class)))
+                .thenReturn(true);
+
+        reset(mISupplicantStaIfaceMock);
+        setupMocksForConnectSequence(true /*haveExistingNetwork*/);
+        when(mISupplicantStaIfaceMock.disconnect()).thenReturn(mStatusFailure);
+        config.preSharedKey = "\"updatedPassphrase\"";
+        assertFalse(mDut.connectToNetwork(WLAN0_IFACE_NAME, config));
+        // Only selected by the first connection.
+        verify(mSupplicantStaNetworkMock).select();
+    }
+
     /**
      * Tests connection to a specified network failure due to network add.
      */
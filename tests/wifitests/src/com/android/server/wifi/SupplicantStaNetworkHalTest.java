@@ -27,6 +27,7 @@ import static org.mockito.Mockito.any;
 import static org.mockito.Mockito.anyString;
 import static org.mockito.Mockito.doAnswer;
 import static org.mockito.Mockito.never;
+import static org.mockito.Mockito.times;
 import static org.mockito.Mockito.verify;
 import static org.mockito.Mockito.when;
 
@@ -245,6 +246,76 @@ public class SupplicantStaNetworkHalTest extends WifiBaseTest {
                 NativeUtil.removeEnclosingQuotes(config.preSharedKey));
     }
 
+    /**
+     * Tests that saving an unchanged WifiConfiguration again does not issue any HIDL calls to
+     * set the network variables.
+     */
+    @Test
+    public void testSaveUnchangedConfigurationSkipsHidlCalls() throws Exception {
+        WifiConfiguration config = WifiConfigurationTestUtil.createPskNetwork();
+        assertTrue(mSupplicantNetwork.saveWifiConfiguration(config));
+        int numHidlCalls = mSupplicantNetwork.getNumHidlCallsInLastSave();
+        assertTrue(numHidlCalls > 0);
+        assertEquals(0, mSupplicantNetwork.getNumHidlCallsSkippedInLastSave());
+
+        assertTrue(mSupplicantNetwork.saveWifiConfiguration(config));
+        assertEquals(0, mSupplicantNetwork.getNumHidlCallsInLastSave());
+        assertEquals(numHidlCalls, mSupplicantNetwork.getNumHidlCallsSkippedInLastSave());
+        verify(mISupplicantStaNetworkMock).setSsid(any(ArrayList.class));
+        verify(mISupplicantStaNetworkMock).setPskPassphrase(anyString());
+        verify(mISupplicantStaNetworkMock)
+                .registerCallback(any(ISupplicantStaNetworkCallback.class));
+    }
+
+    /**
+     * Tests that updating the credentials of a saved network only pushes the changed field.
+     */
+    @Test
+    public void testUpdateConfigurationPushesOnlyChangedFields() throws Exception {
+        WifiConfiguration config = WifiConfigurationTestUtil.createPskNetwork();
+        assertTrue(mSupplicantNetwork.saveWifiConfiguration(config));
+
+        config.preSharedKey = "\"updatedPassphrase\"";
+        assertTrue(mSupplicantNetwork.updateWifiConfiguration(config));
+        assertEquals(1, mSupplicantNetwork.getNumHidlCallsInLastSave());
+        assertEquals("updatedPassphrase", mSupplicantVariables.pskPassphrase);
+        verify(mISupplicantStaNetworkMock, times(2)).setPskPassphrase(anyString());
+        verify(mISupplicantStaNetworkMock).setSsid(any(ArrayList.class));
+        verify(mISupplicantStaNetworkMock).setScanSsid(anyBoolean());
+    }
+
+    /**
+     * Tests that an in-place update fails if a previously saved field is no longer set, since
+     * wpa_supplicant would otherwise keep the stale value.
+     */
+    @Test
+    public void testUpdateConfigurationFailsWhenFieldIsUnset() throws Exception {
+        WifiConfiguration config = WifiConfigurationTestUtil.createPskNetwork();
+        config.getNetworkSelectionStatus().setNetworkSelectionBSSID("34:45:19:09:45:66");
+        assertTrue(mSupplicantNetwork.saveWifiConfiguration(config));
+
+        config.getNetworkSelectionStatus().setNetworkSelectionBSSID(null);
+        assertFalse(mSupplicantNetwork.updateWifiConfiguration(config));
+    }
+
+    /**
+     * Tests that a failed HIDL call is retried on the next save.
+     */
+    @Test
+    public void testFailedFieldIsPushedAgainOnNextSave() throws Exception {
+        when(mISupplicantStaNetworkMock.registerCallback(any(ISupplicantStaNetworkCallback.class)))
+                .thenReturn(mStatusFailure);
+        WifiConfiguration config = WifiConfigurationTestUtil.createPskNetwork();
+        assertFalse(mSupplicantNetwork.saveWifiConfiguration(config));
+
+        when(mISupplicantStaNetworkMock.registerCallback(any(ISupplicantStaNetworkCallback.class)))
+                .thenReturn(mStatusSuccess);
+        assertTrue(mSupplicantNetwork.saveWifiConfiguration(config));
+        assertEquals(1, mSupplicantNetwork.getNumHidlCallsInLastSave());
+        verify(mISupplicantStaNetworkMock, times(2))
+                .registerCallback(any(ISupplicantStaNetworkCallback.class));
+    }
+
     /**
      * Tests the saving/loading of WifiConfiguration to wpa_supplicant.
      */
@@ -39,6 +39,7 @@ import android.provider.Settings;
 
 import androidx.test.filters.SmallTest;
 
+import com.android.server.wifi.scanner.InProcessScanResultsDispatcher;
 import com.android.server.wifi.util.ScanResultUtil;
 import com.android.server.wifi.util.WifiConfigStoreEncryptionUtil;
 
@@ -75,6 +76,7 @@ public class WakeupControllerTest extends WifiBaseTest {
     @Mock private WifiConfigStore mWifiConfigStore;
     @Mock private WifiInjector mWifiInjector;
     @Mock private WifiScanner mWifiScanner;
+    @Mock private InProcessScanResultsDispatcher mInProcessScanResultsDispatcher;
     @Mock private WifiConfigManager mWifiConfigManager;
     @Mock private WifiNetworkSuggestionsManager mWifiNetworkSuggestionsManager;
     @Mock private FrameworkFacade mFrameworkFacade;
@@ -96,6 +98,8 @@ public class WakeupControllerTest extends WifiBaseTest {
         MockitoAnnotations.initMocks(this);
 
         when(mWifiInjector.getWifiScanner()).thenReturn(mWifiScanner);
+        when(mWifiInjector.getInProcessScanResultsDispatcher())
+                .thenReturn(mInProcessScanResultsDispatcher);
         when(mWifiInjector.getWifiSettingsStore()).thenReturn(mWifiSettingsStore);
         when(mWifiInjector.getActiveModeWarden()).thenReturn(mActiveModeWarden);
         when(mWifiInjector.getWifiNative()).thenReturn(mWifiNative);
@@ -299,7 +303,7 @@ public class WakeupControllerTest extends WifiBaseTest {
     public void startRegistersScanListener() {
         initializeWakeupController(true /* enabled */);
         mWakeupController.start();
-        verify(mWifiScanner).registerScanListener(any(), any());
+        verify(mInProcessScanResultsDispatcher).registerScanListener(any(), any());
     }
 
     /**
@@ -310,7 +314,7 @@ public class WakeupControllerTest extends WifiBaseTest {
         initializeWakeupController(true /* enabled */);
         mWakeupController.start();
         mWakeupController.stop();
-        verify(mWifiScanner).unregisterScanListener(any());
+        verify(mInProcessScanResultsDispatcher).unregisterScanListener(any());
     }
 
     /**
@@ -510,7 +514,8 @@ public class WakeupControllerTest extends WifiBaseTest {
         ArgumentCaptor<WifiScanner.ScanListener> scanListenerArgumentCaptor =
                 ArgumentCaptor.forClass(WifiScanner.ScanListener.class);
 
-        verify(mWifiScanner).registerScanListener(any(), scanListenerArgumentCaptor.capture());
+        verify(mInProcessScanResultsDispatcher).registerScanListener(
+                any(), scanListenerArgumentCaptor.capture());
         WifiScanner.ScanListener scanListener = scanListenerArgumentCaptor.getValue();
 
         // incoming scan results
@@ -539,7 +544,8 @@ public class WakeupControllerTest extends WifiBaseTest {
         ArgumentCaptor<WifiScanner.ScanListener> scanListenerArgumentCaptor =
                 ArgumentCaptor.forClass(WifiScanner.ScanListener.class);
 
-        verify(mWifiScanner).registerScanListener(any(), scanListenerArgumentCaptor.capture());
+        verify(mInProcessScanResultsDispatcher).registerScanListener(
+                any(), scanListenerArgumentCaptor.capture());
         WifiScanner.ScanListener scanListener = scanListenerArgumentCaptor.getValue();
 
         // incoming scan results
@@ -562,7 +568,8 @@ public class WakeupControllerTest extends WifiBaseTest {
         ArgumentCaptor<WifiScanner.ScanListener> scanListenerArgumentCaptor =
                 ArgumentCaptor.forClass(WifiScanner.ScanListener.class);
 
-        verify(mWifiScanner).registerScanListener(any(), scanListenerArgumentCaptor.capture());
+        verify(mInProcessScanResultsDispatcher).registerScanListener(
+                any(), scanListenerArgumentCaptor.capture());
         WifiScanner.ScanListener scanListener = scanListenerArgumentCaptor.getValue();
 
         // incoming scan results
@@ -582,7 +589,8 @@ public class WakeupControllerTest extends WifiBaseTest {
         ArgumentCaptor<WifiScanner.ScanListener> scanListenerArgumentCaptor =
                 ArgumentCaptor.forClass(WifiScanner.ScanListener.class);
 
-        verify(mWifiScanner).registerScanListener(any(), scanListenerArgumentCaptor.capture());
+        verify(mInProcessScanResultsDispatcher).registerScanListener(
+                any(), scanListenerArgumentCaptor.capture());
         WifiScanner.ScanListener scanListener = scanListenerArgumentCaptor.getValue();
 
         // incoming scan results
@@ -609,7 +617,8 @@ public class WakeupControllerTest extends WifiBaseTest {
         ArgumentCaptor<WifiScanner.ScanListener> scanListenerArgumentCaptor =
                 ArgumentCaptor.forClass(WifiScanner.ScanListener.class);
 
-        verify(mWifiScanner).registerScanListener(any(), scanListenerArgumentCaptor.capture());
+        verify(mInProcessScanResultsDispatcher).registerScanListener(
+                any(), scanListenerArgumentCaptor.capture());
         WifiScanner.ScanListener scanListener = scanListenerArgumentCaptor.getValue();
 
         // incoming scan results
@@ -632,7 +641,8 @@ public class WakeupControllerTest extends WifiBaseTest {
         ArgumentCaptor<WifiScanner.ScanListener> scanListenerArgumentCaptor =
                 ArgumentCaptor.forClass(WifiScanner.ScanListener.class);
 
-        verify(mWifiScanner).registerScanListener(any(), scanListenerArgumentCaptor.capture());
+        verify(mInProcessScanResultsDispatcher).registerScanListener(
+                any(), scanListenerArgumentCaptor.capture());
         WifiScanner.ScanListener scanListener = scanListenerArgumentCaptor.getValue();
 
         // incoming scan results
@@ -659,7 +669,8 @@ public class WakeupControllerTest extends WifiBaseTest {
         ArgumentCaptor<WifiScanner.ScanListener> scanListenerArgumentCaptor =
                 ArgumentCaptor.forClass(WifiScanner.ScanListener.class);
 
-        verify(mWifiScanner).registerScanListener(any(), scanListenerArgumentCaptor.capture());
+        verify(mInProcessScanResultsDispatcher).registerScanListener(
+                any(), scanListenerArgumentCaptor.capture());
         WifiScanner.ScanListener scanListener = scanListenerArgumentCaptor.getValue();
 
         // incoming scan results
@@ -681,7 +692,8 @@ public class WakeupControllerTest extends WifiBaseTest {
         ArgumentCaptor<WifiScanner.ScanListener> scanListenerArgumentCaptor =
                 ArgumentCaptor.forClass(WifiScanner.ScanListener.class);
 
-        verify(mWifiScanner).registerScanListener(any(), scanListenerArgumentCaptor.capture());
+        verify(mInProcessScanResultsDispatcher).registerScanListener(
+                any(), scanListenerArgumentCaptor.capture());
         WifiScanner.ScanListener scanListener = scanListenerArgumentCaptor.getValue();
 
         // incoming scan results
@@ -712,6 +724,20 @@ public class WakeupControllerTest extends WifiBaseTest {
         verify(mWakeupOnboarding).setOnboarded();
     }
 
+    @Test
+    public void enabledChangedListenerIsCalledOnSettingChange() {
+        initializeWakeupController(true /* enabled */);
+        Runnable listener = mock(Runnable.class);
+        mWakeupController.setEnabledChangedListener(listener);
+        ArgumentCaptor<ContentObserver> argumentCaptor =
+                ArgumentCaptor.forClass(ContentObserver.class);
+        verify(mFrameworkFacade).registerContentObserver(any(), any(), eq(true),
+                argumentCaptor.capture());
+
+        argumentCaptor.getValue().onChange(false /* selfChange */);
+        verify(listener).run();
+    }
+
     /**
      * When Wifi disconnects from a network, and within LAST_DISCONNECT_TIMEOUT_MILLIS Wifi is
      * disabled, then the last connected Wifi network should be added to the wakeup lock.
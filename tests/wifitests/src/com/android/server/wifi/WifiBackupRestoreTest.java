@@ -33,6 +33,7 @@ import org.junit.Test;
 import org.mockito.Mock;
 import org.mockito.MockitoAnnotations;
 
+import java.io.ByteArrayInputStream;
 import java.io.ByteArrayOutputStream;
 import java.io.DataOutputStream;
 import java.io.FileDescriptor;
@@ -242,10 +243,7 @@ public class WifiBackupRestoreTest extends WifiBaseTest {
     @After
     public void cleanUp() throws Exception {
         if (mCheckDump) {
-            StringWriter stringWriter = new StringWriter();
-            mWifiBackupRestore.dump(
-                    new FileDescriptor(), new PrintWriter(stringWriter), new String[0]);
-            String dumpString = stringWriter.toString();
+            String dumpString = dump();
             // Ensure that the SSID was dumped out.
             assertTrue("Dump: " + dumpString,
                     dumpString.contains(WifiConfigurationTestUtil.TEST_SSID));
@@ -263,6 +261,12 @@ public class WifiBackupRestoreTest extends WifiBaseTest {
         }
     }
 
+    private String dump() {
+        StringWriter stringWriter = new StringWriter();
+        mWifiBackupRestore.dump(new FileDescriptor(), new PrintWriter(stringWriter), new String[0]);
+        return stringWriter.toString();
+    }
+
     /**
      * Verify that a null network list is serialized correctly.
      */
@@ -582,6 +586,66 @@ public class WifiBackupRestoreTest extends WifiBaseTest {
                 configurations, retrievedConfigurations);
     }
 
+    /**
+     * Verify that multiple networks are serialized to and deserialized from a stream correctly
+     * and that the networks are restored in batches of the requested size.
+     */
+    @Test
+    public void testMultipleNetworksStreamingBackupRestore() {
+        List<WifiConfiguration> configurations = new ArrayList<>();
+        configurations.add(WifiConfigurationTestUtil.createWepNetwork());
+        configurations.add(WifiConfigurationTestUtil.createPskNetwork());
+        configurations.add(WifiConfigurationTestUtil.createOpenNetwork());
+        configurations.add(WifiConfigurationTestUtil.createOweNetwork());
+        configurations.add(WifiConfigurationTestUtil.createSaeNetwork());
+
+        ByteArrayOutputStream outputStream = new ByteArrayOutputStream();
+        assertTrue(mWifiBackupRestore.writeBackupDataToStream(configurations, outputStream));
+        // Streamed data should be identical to the non-streamed data.
+        byte[] backupData = outputStream.toByteArray();
+        assertArrayEquals(
+                mWifiBackupRestore.retrieveBackupDataFromConfigurations(configurations),
+                backupData);
+
+        List<List<WifiConfiguration>> batches = new ArrayList<>();
+        assertTrue(mWifiBackupRestore.retrieveConfigurationsFromBackupStream(
+                new ByteArrayInputStream(backupData), 2, batches::add));
+        assertEquals(3, batches.size());
+        assertEquals(2, batches.get(0).size());
+        assertEquals(2, batches.get(1).size());
+        assertEquals(1, batches.get(2).size());
+        List<WifiConfiguration> retrievedConfigurations = new ArrayList<>();
+        for (List<WifiConfiguration> batch : batches) {
+            retrievedConfigurations.addAll(batch);
+        }
+        WifiConfigurationTestUtil.assertConfigurationsEqualForBackup(
+                configurations, retrievedConfigurations);
+        // The restored data is dumped as the non-streamed restore dumps it.
+        mWifiBackupRestore.retrieveConfigurationsFromBackupData(backupData);
+        String expectedDump = dump();
+        assertTrue(mWifiBackupRestore.retrieveConfigurationsFromBackupStream(
+                new ByteArrayInputStream(backupData), 2, batches::add));
+        assertEquals(expectedDump, dump());
+    }
+
+    /**
+     * Verify that corrupted backup data streams are rejected.
+     */
+    @Test
+    public void testCorruptStreamingBackupRestore() {
+        Random random = new Random();
+        byte[] backupData = new byte[100];
+        random.nextBytes(backupData);
+
+        List<WifiConfiguration> retrievedConfigurations = new ArrayList<>();
+        assertFalse(mWifiBackupRestore.retrieveConfigurationsFromBackupStream(
+                new ByteArrayInputStream(backupData),
+                WifiBackupRestore.DEFAULT_RESTORE_BATCH_SIZE, retrievedConfigurations::addAll));
+        assertTrue(retrievedConfigurations.isEmpty());
+        // No valid data to check in dump.
+        mCheckDump = false;
+    }
+
     /**
      * Verify that multiple networks of different types except enterprise ones are serialized and
      * deserialized correctly
@@ -856,6 +920,47 @@ public class WifiBackupRestoreTest extends WifiBaseTest {
                 configurations, retrievedConfigurations);
     }
 
+    /**
+     * Verify that multiple networks with different IpConfiguration types are deserialized
+     * correctly in batches from old backup data streams.
+     */
+    @Test
+    public void testMultipleNetworksWithDifferentIpConfigurationsStreamingSupplicantRestore() {
+        List<WifiConfiguration> configurations = new ArrayList<>();
+
+        WifiConfiguration wepNetwork = WifiConfigurationTestUtil.createWepNetwork();
+        wepNetwork.allowedAuthAlgorithms.set(WifiConfiguration.AuthAlgorithm.SHARED);
+        wepNetwork.setIpConfiguration(
+                WifiConfigurationTestUtil.createDHCPIpConfigurationWithPacProxy());
+        configurations.add(wepNetwork);
+
+        WifiConfiguration pskNetwork = WifiConfigurationTestUtil.createPskNetwork();
+        pskNetwork.allowedAuthAlgorithms.set(WifiConfiguration.AuthAlgorithm.OPEN);
+        pskNetwork.setIpConfiguration(
+                WifiConfigurationTestUtil.createStaticIpConfigurationWithPacProxy());
+        configurations.add(pskNetwork);
+
+        WifiConfiguration openNetwork = WifiConfigurationTestUtil.createOpenNetwork();
+        openNetwork.setIpConfiguration(
+                WifiConfigurationTestUtil.createStaticIpConfigurationWithStaticProxy());
+        configurations.add(openNetwork);
+
+        byte[] supplicantData = createWpaSupplicantConfBackupData(configurations);
+        byte[] ipConfigData = createIpConfBackupData(configurations);
+        List<List<WifiConfiguration>> batches = new ArrayList<>();
+        assertTrue(mWifiBackupRestore.retrieveConfigurationsFromSupplicantBackupStream(
+                new ByteArrayInputStream(supplicantData), new ByteArrayInputStream(ipConfigData),
+                2, batches::add));
+        assertEquals(2, batches.size());
+        List<WifiConfiguration> retrievedConfigurations = new ArrayList<>();
+        for (List<WifiConfiguration> batch : batches) {
+            retrievedConfigurations.addAll(batch);
+        }
+        WifiConfigurationTestUtil.assertConfigurationsEqualForBackup(
+                configurations, retrievedConfigurations);
+        assertTrue(dump().contains("Last old supplicant backup data restored: "));
+    }
+
     /**
      * Verify that a single open network configuration is serialized & deserialized correctly from
      * old backups with no ipconfig data.
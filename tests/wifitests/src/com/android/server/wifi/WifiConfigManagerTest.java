@@ -72,6 +72,7 @@ import java.io.PrintWriter;
 import java.io.StringWriter;
 import java.util.ArrayList;
 import java.util.Arrays;
+import java.util.Collection;
 import java.util.Collections;
 import java.util.HashMap;
 import java.util.HashSet;
@@ -131,6 +132,8 @@ public class WifiConfigManagerTest extends WifiBaseTest {
     @Mock private WifiPermissionsUtil mWifiPermissionsUtil;
     @Mock private WifiPermissionsWrapper mWifiPermissionsWrapper;
     @Mock private WifiInjector mWifiInjector;
+    private WifiStateSnapshotPublisher mWifiStateSnapshotPublisher =
+            new WifiStateSnapshotPublisher();
     @Mock private WifiLastResortWatchdog mWifiLastResortWatchdog;
     @Mock private NetworkListSharedStoreData mNetworkListSharedStoreData;
     @Mock private NetworkListUserStoreData mNetworkListUserStoreData;
@@ -217,12 +220,15 @@ public class WifiConfigManagerTest extends WifiBaseTest {
         when(mWifiInjector.getWifiNetworkSuggestionsManager())
                 .thenReturn(mWifiNetworkSuggestionsManager);
         when(mWifiInjector.getBssidBlocklistMonitor()).thenReturn(mBssidBlocklistMonitor);
+        when(mWifiInjector.getWifiStateSnapshotPublisher())
+                .thenReturn(mWifiStateSnapshotPublisher);
         when(mWifiInjector.getWifiLastResortWatchdog()).thenReturn(mWifiLastResortWatchdog);
         when(mWifiInjector.getWifiLastResortWatchdog().shouldIgnoreSsidUpdate())
                 .thenReturn(false);
         when(mWifiInjector.getMacAddressUtil()).thenReturn(mMacAddressUtil);
         when(mWifiInjector.getWifiMetrics()).thenReturn(mWifiMetrics);
-        when(mMacAddressUtil.calculatePersistentMac(any(), any())).thenReturn(TEST_RANDOMIZED_MAC);
+        when(mMacAddressUtil.getOrCalculatePersistentMac(any(), anyInt()))
+                .thenReturn(TEST_RANDOMIZED_MAC);
         when(mWifiScoreCard.lookupNetwork(any())).thenReturn(mPerNetwork);
 
         mWifiCarrierInfoManager = new WifiCarrierInfoManager(mTelephonyManager,
@@ -292,12 +298,45 @@ public class WifiConfigManagerTest extends WifiBaseTest {
         mContextConfigStoreMockOrder.verify(mWifiConfigStore).write(anyBoolean());
     }
 
+    /**
+     * Verifies that all the store writes requested between
+     * {@link WifiConfigManager#startBatchedStoreWrites()} and
+     * {@link WifiConfigManager#endBatchedStoreWrites()} are coalesced into a single write.
+     */
+    @Test
+    public void testBatchedStoreWritesAreCoalesced() throws Exception {
+        WifiConfiguration openNetwork = WifiConfigurationTestUtil.createOpenNetwork();
+        WifiConfiguration pskNetwork = WifiConfigurationTestUtil.createPskNetwork();
+        triggerStoreReadIfNeeded();
+        clearInvocations(mWifiConfigStore);
+
+        mWifiConfigManager.startBatchedStoreWrites();
+        // Nested batches should not trigger the write either.
+        mWifiConfigManager.startBatchedStoreWrites();
+        NetworkUpdateResult result =
+                mWifiConfigManager.addOrUpdateNetwork(openNetwork, TEST_CREATOR_UID);
+        assertTrue(mWifiConfigManager.enableNetwork(
+                result.getNetworkId(), false, TEST_CREATOR_UID, TEST_CREATOR_NAME));
+        mWifiConfigManager.addOrUpdateNetwork(pskNetwork, TEST_CREATOR_UID);
+        assertTrue(mWifiConfigManager.endBatchedStoreWrites());
+        verify(mWifiConfigStore, never()).write(anyBoolean());
+
+        assertTrue(mWifiConfigManager.endBatchedStoreWrites());
+        verify(mWifiConfigStore).write(eq(true));
+        assertEquals(2, mWifiConfigManager.getConfiguredNetworks().size());
+
+        // Unmatched end of batch is rejected and writes are no longer deferred.
+        assertFalse(mWifiConfigManager.endBatchedStoreWrites());
+        assertTrue(mWifiConfigManager.saveToStore(false));
+        verify(mWifiConfigStore).write(eq(false));
+    }
+
     /**
      * Verify that a randomized MAC address is generated even if the KeyStore operation fails.
      */
     @Test
     public void testRandomizedMacIsGeneratedEvenIfKeyStoreFails() {
-        when(mMacAddressUtil.calculatePersistentMac(any(), any())).thenReturn(null);
+        when(mMacAddressUtil.getOrCalculatePersistentMac(any(), anyInt())).thenReturn(null);
 
         // Try adding a network.
         WifiConfiguration openNetwork = WifiConfigurationTestUtil.createOpenNetwork();
@@ -308,7 +347,7 @@ public class WifiConfigManagerTest extends WifiBaseTest {
                 mWifiConfigManager.getConfiguredNetworksWithPasswords();
 
         // Verify that we have attempted to generate the MAC address twice (1 retry)
-        verify(mMacAddressUtil, times(2)).calculatePersistentMac(any(), any());
+        verify(mMacAddressUtil, times(2)).getOrCalculatePersistentMac(any(), anyInt());
         assertEquals(1, retrievedNetworks.size());
 
         // Verify that despite KeyStore returning null, we are still getting a valid MAC address.
@@ -2277,6 +2316,75 @@ public class WifiConfigManagerTest extends WifiBaseTest {
         assertEquals(macAddress, configs.get(0).getRandomizedMacAddress().toString());
     }
 
+    /**
+     * Verifies that the saved networks are published along with the configured networks changed
+     * broadcast, masked for the target UID as {@link WifiConfigManager#getSavedNetworks(int)}
+     * does, and that removing a network publishes its removal.
+     */
+    @Test
+    public void testSavedNetworksArePublishedToStateSnapshot() {
+        WifiConfiguration config = WifiConfigurationTestUtil.createPskNetwork();
+        verifyAddNetworkToWifiConfigManager(config);
+
+        WifiStateSnapshot snapshot = mWifiStateSnapshotPublisher.getSnapshot();
+        List<WifiConfiguration> configs = snapshot.getSavedNetworks(Process.WIFI_UID);
+        assertEquals(1, configs.size());
+        assertEquals(config.getKey(), configs.get(0).getKey());
+        assertPasswordsMaskedInWifiConfiguration(configs.get(0));
+        String macAddress = configs.get(0).getRandomizedMacAddress().toString();
+        assertNotEquals(WifiInfo.DEFAULT_MAC_ADDRESS, macAddress);
+
+        configs = snapshot.getSavedNetworks(Process.INVALID_UID);
+        assertEquals(1, configs.size());
+        assertRandomizedMacAddressMaskedInWifiConfiguration(configs.get(0));
+        configs = snapshot.getSavedNetworks(TEST_CREATOR_UID + 100);
+        assertRandomizedMacAddressMaskedInWifiConfiguration(configs.get(0));
+        configs = snapshot.getSavedNetworks(TEST_CREATOR_UID);
+        assertEquals(macAddress, configs.get(0).getRandomizedMacAddress().toString());
+
+        verifyRemoveNetworkFromWifiConfigManager(config);
+        assertTrue(mWifiStateSnapshotPublisher.getSnapshot().getSavedNetworks(Process.WIFI_UID)
+                .isEmpty());
+        assertTrue(mWifiStateSnapshotPublisher.getSnapshot().getVersion()
+                > snapshot.getVersion());
+    }
+
+    /**
+     * Verifies that changes made without a configured networks changed broadcast, including
+     * changes to fields which are not persisted, are published as well, and that changes made
+     * while store writes are batched are published once the batch ends.
+     */
+    @Test
+    public void testSavedNetworkChangesWithoutBroadcastArePublishedToStateSnapshot() {
+        WifiConfiguration config = WifiConfigurationTestUtil.createPskNetwork();
+        NetworkUpdateResult result = verifyAddNetworkToWifiConfigManager(config);
+
+        assertTrue(mWifiConfigManager.setNetworkDefaultGwMacAddress(
+                result.getNetworkId(), TEST_DEFAULT_GW_MAC_ADDRESS));
+        assertEquals(TEST_DEFAULT_GW_MAC_ADDRESS, mWifiStateSnapshotPublisher.getSnapshot()
+                .getSavedNetworks(Process.WIFI_UID).get(0).defaultGwMacAddress);
+
+        int assocRejectReason = NetworkSelectionStatus.DISABLED_ASSOCIATION_REJECTION;
+        for (int i = 0;
+                i < WifiConfigManager.getNetworkSelectionDisableThreshold(assocRejectReason); i++) {
+            assertTrue(mWifiConfigManager.updateNetworkSelectionStatus(
+                    result.getNetworkId(), assocRejectReason));
+        }
+        assertEquals(NetworkSelectionStatus.DISABLED_ASSOCIATION_REJECTION,
+                mWifiStateSnapshotPublisher.getSnapshot().getSavedNetworks(Process.WIFI_UID)
+                        .get(0).getNetworkSelectionStatus().getNetworkSelectionDisableReason());
+
+        long version = mWifiStateSnapshotPublisher.getSnapshot().getVersion();
+        mWifiConfigManager.startBatchedStoreWrites();
+        mWifiConfigManager.setNetworkDefaultGwMacAddress(result.getNetworkId(), null);
+        mWifiConfigManager.updateNetworkAfterDisconnect(result.getNetworkId());
+        assertEquals(version, mWifiStateSnapshotPublisher.getSnapshot().getVersion());
+        mWifiConfigManager.endBatchedStoreWrites();
+        assertEquals(version + 1, mWifiStateSnapshotPublisher.getSnapshot().getVersion());
+        assertNull(mWifiStateSnapshotPublisher.getSnapshot().getSavedNetworks(Process.WIFI_UID)
+                .get(0).defaultGwMacAddress);
+    }
+
     /**
      * Verify that the aggressive randomization whitelist works for passpoints. (by checking FQDN)
      */
@@ -2486,7 +2594,7 @@ public class WifiConfigManagerTest extends WifiBaseTest {
         // Verify the MAC address is valid, and is NOT calculated from the (SSID + security type)
         assertTrue(WifiConfiguration.isValidMacAddressForRandomization(
                 getFirstInternalWifiConfiguration().getRandomizedMacAddress()));
-        verify(mMacAddressUtil, never()).calculatePersistentMac(any(), any());
+        verify(mMacAddressUtil, never()).getOrCalculatePersistentMac(any(), anyInt());
     }
 
     /**
@@ -4508,6 +4616,39 @@ public class WifiConfigManagerTest extends WifiBaseTest {
         mockSession.finishMocking();
     }
 
+    /**
+     * Verifies that the persistent MAC derivation cache is loaded from the store before the
+     * randomized MAC addresses of the loaded networks are derived in a single batch, and that it
+     * is written back on {@link WifiConfigManager#saveToStore(boolean)}.
+     */
+    @Test
+    public void testLoadFromStoreDerivesPersistentMacsInBatchFromCache() {
+        WifiConfiguration openNetwork = WifiConfigurationTestUtil.createOpenNetwork();
+        WifiConfiguration pskNetwork = WifiConfigurationTestUtil.createPskNetwork();
+        setupStoreDataForRead(Arrays.asList(openNetwork, pskNetwork), new ArrayList<>());
+        Map<String, String> persistentMacCache = new HashMap<>();
+        persistentMacCache.put(openNetwork.getKey(), TEST_RANDOMIZED_MAC.toString());
+        when(mRandomizedMacStoreData.getPersistentMacCache()).thenReturn(persistentMacCache);
+        when(mRandomizedMacStoreData.getSecretFingerprint()).thenReturn("fingerprint");
+
+        assertTrue(mWifiConfigManager.loadFromStore());
+
+        InOrder inOrder = inOrder(mMacAddressUtil);
+        inOrder.verify(mMacAddressUtil).loadPersistentMacCache(
+                persistentMacCache, "fingerprint", Process.WIFI_UID);
+        ArgumentCaptor<Collection<String>> keysCaptor = ArgumentCaptor.forClass(Collection.class);
+        inOrder.verify(mMacAddressUtil).getOrCalculatePersistentMacs(keysCaptor.capture(),
+                eq(Process.WIFI_UID));
+        assertEquals(new HashSet<>(Arrays.asList(openNetwork.getKey(), pskNetwork.getKey())),
+                new HashSet<>(keysCaptor.getValue()));
+
+        Map<String, String> updatedCache = new HashMap<>();
+        when(mMacAddressUtil.getPersistentMacCacheForStore()).thenReturn(updatedCache);
+        when(mMacAddressUtil.getSecretFingerprintForStore()).thenReturn("fingerprint");
+        assertTrue(mWifiConfigManager.saveToStore(true));
+        verify(mRandomizedMacStoreData).setPersistentMacCache(updatedCache, "fingerprint");
+    }
+
     /**
      * Verifies that SIM configs are reset on {@link WifiConfigManager#loadFromStore()}.
      */
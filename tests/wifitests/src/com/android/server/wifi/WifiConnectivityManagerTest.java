@@ -54,6 +54,7 @@ import android.util.LocalLog;
 import androidx.test.filters.SmallTest;
 
 import com.android.server.wifi.hotspot2.PasspointManager;
+import com.android.server.wifi.scanner.InProcessScanResultsDispatcher;
 import com.android.server.wifi.util.LruConnectionTracker;
 import com.android.server.wifi.util.ScanResultUtil;
 import com.android.wifi.resources.R;
@@ -107,12 +108,15 @@ public class WifiConnectivityManagerTest extends WifiBaseTest {
         mWifiConnectivityHelper = mockWifiConnectivityHelper();
         mWifiNS = mockWifiNetworkSelector();
         when(mWifiInjector.getWifiScanner()).thenReturn(mWifiScanner);
+        when(mWifiInjector.getInProcessScanResultsDispatcher())
+                .thenReturn(mInProcessScanResultsDispatcher);
         when(mWifiNetworkSuggestionsManager.retrieveHiddenNetworkList())
                 .thenReturn(new ArrayList<>());
         when(mWifiNetworkSuggestionsManager.getAllApprovedNetworkSuggestions())
                 .thenReturn(new HashSet<>());
         when(mWifiInjector.getBssidBlocklistMonitor()).thenReturn(mBssidBlocklistMonitor);
         when(mWifiInjector.getWifiChannelUtilizationScan()).thenReturn(mWifiChannelUtilization);
+        when(mWifiInjector.getConnectionPhaseTracer()).thenReturn(mConnectionPhaseTracer);
         when(mWifiInjector.getWifiScoreCard()).thenReturn(mWifiScoreCard);
         when(mWifiInjector.getWifiNetworkSuggestionsManager())
                 .thenReturn(mWifiNetworkSuggestionsManager);
@@ -190,6 +194,7 @@ public class WifiConnectivityManagerTest extends WifiBaseTest {
     private LocalLog mLocalLog;
     private LruConnectionTracker mLruConnectionTracker;
     @Mock private WifiInjector mWifiInjector;
+    @Mock private InProcessScanResultsDispatcher mInProcessScanResultsDispatcher;
     @Mock private NetworkScoreManager mNetworkScoreManager;
     @Mock private Clock mClock;
     @Mock private WifiLastResortWatchdog mWifiLastResortWatchdog;
@@ -199,6 +204,7 @@ public class WifiConnectivityManagerTest extends WifiBaseTest {
     @Mock private WifiNetworkSuggestionsManager mWifiNetworkSuggestionsManager;
     @Mock private BssidBlocklistMonitor mBssidBlocklistMonitor;
     @Mock private WifiChannelUtilization mWifiChannelUtilization;
+    @Mock private ConnectionPhaseTracer mConnectionPhaseTracer;
     @Mock private ScoringParams mScoringParams;
     @Mock private WifiScoreCard mWifiScoreCard;
     @Mock private PasspointManager mPasspointManager;
@@ -275,7 +281,7 @@ public class WifiConnectivityManagerTest extends WifiBaseTest {
         ArgumentCaptor<ScanListener> allSingleScanListenerCaptor =
                 ArgumentCaptor.forClass(ScanListener.class);
 
-        doNothing().when(scanner).registerScanListener(
+        doNothing().when(mInProcessScanResultsDispatcher).registerScanListener(
                 any(), allSingleScanListenerCaptor.capture());
 
         ScanData[] scanDatas = new ScanData[1];
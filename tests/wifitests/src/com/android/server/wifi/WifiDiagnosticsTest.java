@@ -19,6 +19,8 @@ package com.android.server.wifi;
 import static org.junit.Assert.assertArrayEquals;
 import static org.junit.Assert.assertEquals;
 import static org.junit.Assert.assertFalse;
+import static org.junit.Assert.assertNotNull;
+import static org.junit.Assert.assertNull;
 import static org.junit.Assert.assertTrue;
 import static org.mockito.AdditionalMatchers.gt;
 import static org.mockito.ArgumentMatchers.any;
@@ -38,6 +40,7 @@ import static org.mockito.Mockito.when;
 import android.app.test.MockAnswerUtil.AnswerWithArguments;
 import android.content.Context;
 import android.os.BugreportManager;
+import android.os.test.TestLooper;
 
 import androidx.test.filters.SmallTest;
 
@@ -51,10 +54,15 @@ import org.mockito.MockitoAnnotations;
 import org.mockito.Spy;
 
 import java.io.ByteArrayInputStream;
+import java.io.ByteArrayOutputStream;
 import java.io.FileDescriptor;
 import java.io.PrintWriter;
 import java.io.StringWriter;
+import java.util.Arrays;
+import java.util.Random;
+import java.util.function.Consumer;
 import java.util.regex.Pattern;
+import java.util.zip.Inflater;
 
 /**
  * Unit tests for {@link WifiDiagnostics}.
@@ -77,6 +85,7 @@ public class WifiDiagnosticsTest extends WifiBaseTest {
     private long mBootTimeMs = 0L;
     MockResources mResources;
     WifiDiagnostics mWifiDiagnostics;
+    TestLooper mLooper;
 
     private static final String FAKE_RING_BUFFER_NAME = "fake-ring-buffer";
     private static final String STA_IF_NAME = "wlan0";
@@ -146,8 +155,9 @@ public class WifiDiagnosticsTest extends WifiBaseTest {
                 return mBootTimeMs;
             }
         }).when(mClock).getElapsedSinceBootMillis();
-        mWifiDiagnostics = new WifiDiagnostics(
-                mContext, mWifiInjector, mWifiNative, mBuildProperties, mLastMileLogger, mClock);
+        mLooper = new TestLooper();
+        mWifiDiagnostics = new WifiDiagnostics(mContext, mWifiInjector, mWifiNative,
+                mBuildProperties, mLastMileLogger, mClock, mLooper.getLooper());
         mWifiNative.enableVerboseLogging(0);
     }
 
@@ -912,8 +922,8 @@ public class WifiDiagnosticsTest extends WifiBaseTest {
     public void takeBugReportDoesNothingWhenConfigOverlayDisabled() {
         when(mBuildProperties.isUserBuild()).thenReturn(false);
         mResources.setBoolean(R.bool.config_wifi_diagnostics_bugreport_enabled, false);
-        mWifiDiagnostics = new WifiDiagnostics(
-                mContext, mWifiInjector, mWifiNative, mBuildProperties, mLastMileLogger, mClock);
+        mWifiDiagnostics = new WifiDiagnostics(mContext, mWifiInjector, mWifiNative,
+                mBuildProperties, mLastMileLogger, mClock, mLooper.getLooper());
 
         mWifiDiagnostics.takeBugReport("", "");
         verify(mBugreportManager, never()).requestBugreport(any(), any(), any());
@@ -1073,4 +1083,174 @@ public class WifiDiagnosticsTest extends WifiBaseTest {
 
         verify(mWifiNative).resetLogHandler();
     }
+
+    private static byte[] inflate(byte[][] segments) throws Exception {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        byte[] buf = new byte[1024];
+        for (byte[] segment : segments) {
+            Inflater inflater = new Inflater();
+            inflater.setInput(segment);
+            while (!inflater.finished()) {
+                bos.write(buf, 0, inflater.inflate(buf));
+            }
+            inflater.end();
+        }
+        return bos.toByteArray();
+    }
+
+    /**
+     * Verifies that in incremental snapshot mode, capturing bug report data fetches the latest
+     * ring buffer data once on the async call lane and then freezes the compressed ring buffer
+     * snapshot, and that logs are collected in the background.
+     */
+    @Test
+    public void incrementalSnapshotModeFreezesSnapshotAndCollectsLogsInBackground()
+            throws Exception {
+        mResources.setBoolean(R.bool.config_wifiDiagnosticsIncrementalSnapshotEnabled, true);
+        mWifiDiagnostics = new WifiDiagnostics(mContext, mWifiInjector, mWifiNative,
+                mBuildProperties, mLastMileLogger, mClock, mLooper.getLooper());
+        mWifiDiagnostics.enableVerboseLogging(false);
+        mWifiDiagnostics.startLogging(STA_IF_NAME);
+
+        final byte[] data = new byte[SMALL_RING_BUFFER_SIZE_KB * BYTES_PER_KBYTE];
+        for (int i = 0; i < data.length; i++) {
+            data[i] = (byte) (i % 7);
+        }
+        final byte[] latestData = new byte[] {1, 2, 3};
+        final Consumer<Boolean>[] onRingBufferDataFetched = new Consumer[1];
+        when(mWifiNative.getRingBufferDataAsync(eq(FAKE_RING_BUFFER_NAME), any()))
+                .thenAnswer(invocation -> {
+                    onRingBufferDataFetched[0] = invocation.getArgument(1);
+                    return true;
+                });
+        mWifiDiagnostics.onRingBufferData(mFakeRbs, data);
+        mWifiDiagnostics.captureBugReportData(WifiDiagnostics.REPORT_REASON_NONE);
+
+        verify(mWifiNative).getRingBufferDataAsync(eq(FAKE_RING_BUFFER_NAME), any());
+        verify(mWifiNative, never()).getRingBufferData(anyString());
+        verify(mJavaRuntime, never()).exec(anyString());
+        WifiDiagnostics.BugReport report = mWifiDiagnostics.getBugReports().get(0);
+        assertTrue(report.ringBuffers.isEmpty());
+        assertTrue(report.compressedRingBuffers.isEmpty());
+
+        // The HAL pushes the latest data, then completes the call.
+        mWifiDiagnostics.onRingBufferData(mFakeRbs, latestData);
+        onRingBufferDataFetched[0].accept(true);
+        byte[] expected = Arrays.copyOf(data, data.length + latestData.length);
+        System.arraycopy(latestData, 0, expected, data.length, latestData.length);
+        assertArrayEquals(expected,
+                inflate(report.compressedRingBuffers.get(FAKE_RING_BUFFER_NAME)));
+        assertNull(report.logcatLines);
+
+        mLooper.dispatchAll();
+        verify(mJavaRuntime, times(2)).exec(anyString());
+        assertNotNull(report.logcatLines);
+        assertNotNull(report.kernelLogLines);
+
+        StringWriter sw = new StringWriter();
+        mWifiDiagnostics.dump(new FileDescriptor(), new PrintWriter(sw), new String[]{});
+        assertTrue(sw.toString().contains("ring-buffer = " + FAKE_RING_BUFFER_NAME + " ("));
+        assertTrue(sw.toString().contains(
+                "Bug report capture latency (incremental snapshot enabled): count=1"));
+    }
+
+    /**
+     * Verifies that in incremental snapshot mode, a dump captures the compressed ring buffer
+     * snapshot and collects the logs right away.
+     */
+    @Test
+    public void incrementalSnapshotModeCapturesUserActionReport() throws Exception {
+        mResources.setBoolean(R.bool.config_wifiDiagnosticsIncrementalSnapshotEnabled, true);
+        mWifiDiagnostics = new WifiDiagnostics(mContext, mWifiInjector, mWifiNative,
+                mBuildProperties, mLastMileLogger, mClock, mLooper.getLooper());
+        mWifiDiagnostics.enableVerboseLogging(false);
+        mWifiDiagnostics.startLogging(STA_IF_NAME);
+
+        final byte[] data = new byte[] {4, 5, 6};
+        mWifiDiagnostics.onRingBufferData(mFakeRbs, data);
+        mWifiDiagnostics.captureBugReportData(WifiDiagnostics.REPORT_REASON_USER_ACTION);
+
+        verify(mWifiNative).getRingBufferData(FAKE_RING_BUFFER_NAME);
+        verify(mJavaRuntime, times(2)).exec(anyString());
+        WifiDiagnostics.BugReport report = mWifiDiagnostics.getBugReports().get(0);
+        assertTrue(report.ringBuffers.isEmpty());
+        assertArrayEquals(data, inflate(report.compressedRingBuffers.get(FAKE_RING_BUFFER_NAME)));
+        assertNotNull(report.logcatLines);
+        assertNotNull(report.kernelLogLines);
+
+        StringWriter sw = new StringWriter();
+        mWifiDiagnostics.dump(new FileDescriptor(), new PrintWriter(sw), new String[]{});
+        assertTrue(sw.toString().contains("ring-buffer = " + FAKE_RING_BUFFER_NAME + " ("));
+    }
+
+    /**
+     * Verifies that in incremental snapshot mode, the firmware and driver dumps are requested on
+     * the async call lane, and that the snapshot is frozen right away if the lane is full.
+     */
+    @Test
+    public void incrementalSnapshotModeRequestsDumpsOnAsyncCallLane() throws Exception {
+        mResources.setBoolean(R.bool.config_wifiDiagnosticsIncrementalSnapshotEnabled, true);
+        mWifiDiagnostics = new WifiDiagnostics(mContext, mWifiInjector, mWifiNative,
+                mBuildProperties, mLastMileLogger, mClock, mLooper.getLooper());
+        mWifiDiagnostics.enableVerboseLogging(true /* verbose enabled */);
+        mWifiDiagnostics.startLogging(STA_IF_NAME);
+        final byte[] fwMemoryDump = new byte[] {0, 1, 2};
+        final byte[] driverStateDump = new byte[] {3, 4, 5};
+        final Consumer<byte[]>[] onDumpsFetched = new Consumer[2];
+        when(mWifiNative.getRingBufferDataAsync(anyString(), any())).thenReturn(false);
+        when(mWifiNative.getFwMemoryDumpAsync(any())).thenAnswer(invocation -> {
+            onDumpsFetched[0] = invocation.getArgument(0);
+            return true;
+        });
+        when(mWifiNative.getDriverStateDumpAsync(any())).thenAnswer(invocation -> {
+            onDumpsFetched[1] = invocation.getArgument(0);
+            return true;
+        });
+
+        final byte[] data = new byte[] {4, 5, 6};
+        mWifiDiagnostics.onRingBufferData(mFakeRbs, data);
+        mWifiDiagnostics.captureBugReportData(WifiDiagnostics.REPORT_REASON_NONE);
+
+        verify(mWifiNative, never()).getFwMemoryDump();
+        verify(mWifiNative, never()).getDriverStateDump();
+        WifiDiagnostics.BugReport report = mWifiDiagnostics.getBugReports().get(0);
+        assertArrayEquals(data, inflate(report.compressedRingBuffers.get(FAKE_RING_BUFFER_NAME)));
+        assertNull(report.fwMemoryDump);
+        assertNull(report.mDriverStateDump);
+
+        onDumpsFetched[0].accept(fwMemoryDump);
+        onDumpsFetched[1].accept(driverStateDump);
+        assertArrayEquals(fwMemoryDump, report.fwMemoryDump);
+        assertArrayEquals(driverStateDump, report.mDriverStateDump);
+    }
+
+    /**
+     * Verifies that in incremental snapshot mode, the compressed ring buffer snapshot is bounded
+     * by the ring buffer size limit.
+     */
+    @Test
+    public void incrementalSnapshotIsBoundedByRingBufferSize() throws Exception {
+        mResources.setBoolean(R.bool.config_wifiDiagnosticsIncrementalSnapshotEnabled, true);
+        mWifiDiagnostics = new WifiDiagnostics(mContext, mWifiInjector, mWifiNative,
+                mBuildProperties, mLastMileLogger, mClock, mLooper.getLooper());
+        mWifiDiagnostics.enableVerboseLogging(false);
+        mWifiDiagnostics.startLogging(STA_IF_NAME);
+
+        // Incompressible data, twice the ring buffer size (which is always the large size)
+        Random random = new Random(1);
+        for (int i = 0; i < 2 * LARGE_RING_BUFFER_SIZE_KB; i++) {
+            byte[] data = new byte[BYTES_PER_KBYTE];
+            random.nextBytes(data);
+            mWifiDiagnostics.onRingBufferData(mFakeRbs, data);
+        }
+        mWifiDiagnostics.captureBugReportData(WifiDiagnostics.REPORT_REASON_NONE);
+
+        int compressedBytes = 0;
+        for (byte[] segment : mWifiDiagnostics.getBugReports().get(0)
+                .compressedRingBuffers.get(FAKE_RING_BUFFER_NAME)) {
+            compressedBytes += segment.length;
+        }
+        assertTrue(compressedBytes > 0);
+        assertTrue(compressedBytes <= LARGE_RING_BUFFER_SIZE_KB * BYTES_PER_KBYTE);
+    }
 }
@@ -54,6 +54,7 @@ import com.android.server.wifi.WifiScoreCard.PerNetwork;
 import com.android.server.wifi.proto.WifiScoreCardProto.SystemInfoStats;
 import com.android.server.wifi.proto.WifiStatsLog;
 import com.android.server.wifi.proto.nano.WifiMetricsProto.HealthMonitorMetrics;
+import com.android.server.wifi.scanner.InProcessScanResultsDispatcher;
 
 
 import org.junit.Before;
@@ -67,6 +68,7 @@ import java.nio.charset.StandardCharsets;
 import java.util.ArrayList;
 import java.util.Calendar;
 import java.util.List;
+import java.util.concurrent.Executor;
 
 /**
  * Unit tests for {@link com.android.server.wifi.WifiHealthMonitor}.
@@ -101,6 +103,8 @@ public class WifiHealthMonitorTest extends WifiBaseTest {
     PackageInfo mPackageInfo;
     @Mock
     ModuleInfo mModuleInfo;
+    @Mock
+    InProcessScanResultsDispatcher mInProcessScanResultsDispatcher;
 
     private final ArrayList<String> mKeys = new ArrayList<>();
     private final ArrayList<WifiScoreCard.BlobListener> mBlobListeners = new ArrayList<>();
@@ -172,6 +176,8 @@ public class WifiHealthMonitorTest extends WifiBaseTest {
         mScanData = mockScanData();
         mWifiScanner = mockWifiScanner(WifiScanner.WIFI_BAND_ALL);
         when(mWifiInjector.getWifiScanner()).thenReturn(mWifiScanner);
+        when(mWifiInjector.getInProcessScanResultsDispatcher())
+                .thenReturn(mInProcessScanResultsDispatcher);
         when(mWifiNative.getDriverVersion()).thenReturn(mDriverVersion);
         when(mWifiNative.getFirmwareVersion()).thenReturn(mFirmwareVersion);
         when(mDeviceConfigFacade.getConnectionFailureHighThrPercent()).thenReturn(
@@ -278,10 +284,10 @@ public class WifiHealthMonitorTest extends WifiBaseTest {
         WifiScanner scanner = mock(WifiScanner.class);
 
         doAnswer(new AnswerWithArguments() {
-            public void answer(ScanListener listener) throws Exception {
+            public void answer(Executor executor, ScanListener listener) throws Exception {
                 mScanListener = listener;
             }
-        }).when(scanner).registerScanListener(anyObject());
+        }).when(mInProcessScanResultsDispatcher).registerScanListener(anyObject(), anyObject());
 
         ScanData[] scanDatas = new ScanData[1];
         scanDatas[0] = mock(ScanData.class);
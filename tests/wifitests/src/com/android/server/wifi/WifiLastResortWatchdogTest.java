@@ -37,6 +37,8 @@ import org.junit.Before;
 import org.junit.Test;
 import org.mockito.Mock;
 
+import java.io.PrintWriter;
+import java.io.StringWriter;
 import java.util.ArrayList;
 import java.util.Arrays;
 import java.util.List;
@@ -2353,4 +2355,41 @@ public class WifiLastResortWatchdogTest extends WifiBaseTest {
         mLooper.dispatchAll();
         verify(mClientModeImpl, times(1)).takeBugReport(anyString(), anyString());
     }
+
+    /**
+     * Verifies that the connection failures noted, and the trigger they cause, are dumped in the
+     * failure history.
+     */
+    @Test
+    public void testFailureHistoryIsDumped() {
+        String[] ssids = {"\"test1\""};
+        String[] bssids = {"04:03:02:01:00:0f"};
+        int[] frequencies = {2437};
+        String[] caps = {"[WPA2-EAP-CCMP][ESS]"};
+        int[] levels = {-60};
+        boolean[] isEphemeral = {false};
+        boolean[] hasEverConnected = {true};
+        List<Pair<ScanDetail, WifiConfiguration>> candidates = createFilteredQnsCandidates(ssids,
+                bssids, frequencies, caps, levels, isEphemeral, hasEverConnected);
+        mLastResortWatchdog.updateAvailableNetworks(candidates);
+
+        mLastResortWatchdog.noteConnectionFailureAndTriggerIfNeeded(
+                ssids[0], WifiLastResortWatchdog.BSSID_ANY,
+                WifiLastResortWatchdog.FAILURE_CODE_DHCP);
+        for (int i = 1; i < WifiLastResortWatchdog.FAILURE_THRESHOLD; i++) {
+            mLastResortWatchdog.noteConnectionFailureAndTriggerIfNeeded(
+                    ssids[0], bssids[0], WifiLastResortWatchdog.FAILURE_CODE_ASSOCIATION);
+        }
+
+        StringWriter sw = new StringWriter();
+        mLastResortWatchdog.dump(null, new PrintWriter(sw), null);
+        String dump = sw.toString();
+        assertTrue(dump, dump.contains(" SSID=\"test1\", BSSID=any, event=connection failure, "
+                + "reason=FAILURE_CODE_DHCP, streak=1"));
+        assertTrue(dump, dump.contains(" SSID=\"test1\", BSSID=04:03:02:01:00:0f, "
+                + "event=connection failure, reason=FAILURE_CODE_ASSOCIATION, streak=2"));
+        assertTrue(dump, dump.contains(" SSID=\"test1\", BSSID=04:03:02:01:00:0f, event=trigger, "
+                + "reason=FAILURE_CODE_ASSOCIATION, streak="
+                + WifiLastResortWatchdog.FAILURE_THRESHOLD));
+    }
 }
@@ -46,7 +46,6 @@ import java.util.NoSuchElementException;
 /** Unit tests for {@link WifiLockManager}. */
 @SmallTest
 public class WifiLockManagerTest extends WifiBaseTest {
-
     private static final int DEFAULT_TEST_UID_1 = 52;
     private static final int DEFAULT_TEST_UID_2 = 53;
     private static final int DEFAULT_TEST_UID_3 = 54;
@@ -292,6 +291,36 @@ public class WifiLockManagerTest extends WifiBaseTest {
         assertEquals(1, merged.getWorkChains().size());
     }
 
+    /**
+     * Checks that the merged WorkSource keeps the attributions still held by another lock, and
+     * drops those of released locks.
+     */
+    @Test
+    public void mergedWorkSourceTracksReleasedLocks() throws Exception {
+        acquireWifiLockSuccessful(WifiManager.WIFI_MODE_FULL_HIGH_PERF, "", mBinder, mWorkSource);
+        WorkSource ws = new WorkSource(DEFAULT_TEST_UID_1);
+        ws.add(new WorkSource(DEFAULT_TEST_UID_2));
+        ws.add(mChainedWorkSource);
+        acquireWifiLockSuccessful(WifiManager.WIFI_MODE_FULL_HIGH_PERF, "", mBinder2, ws);
+        WorkSource merged = mWifiLockManager.createMergedWorkSource();
+        assertEquals(2, merged.size());
+        assertEquals(1, merged.getWorkChains().size());
+
+        releaseWifiLockSuccessful(mBinder2);
+        merged = mWifiLockManager.createMergedWorkSource();
+        assertEquals(1, merged.size());
+        assertEquals(DEFAULT_TEST_UID_1, merged.getUid(0));
+        assertTrue(merged.getWorkChains() == null || merged.getWorkChains().isEmpty());
+
+        mWifiLockManager.updateWifiLockWorkSource(mBinder, new WorkSource(DEFAULT_TEST_UID_3));
+        merged = mWifiLockManager.createMergedWorkSource();
+        assertEquals(1, merged.size());
+        assertEquals(DEFAULT_TEST_UID_3, merged.getUid(0));
+
+        releaseWifiLockSuccessful(mBinder);
+        assertEquals(0, mWifiLockManager.createMergedWorkSource().size());
+    }
+
     /**
      * A smoke test for acquiring, updating and releasing WifiLocks with chained WorkSources.
      */
@@ -1391,4 +1420,42 @@ public class WifiLockManagerTest extends WifiBaseTest {
         assertEquals(WifiManager.WIFI_MODE_NO_LOCKS_HELD,
                 mWifiLockManager.getStrongestLockMode());
     }
+
+    /**
+     * Acquires and releases low-latency locks from a foreground app while other apps hold locks,
+     * and verifies the strongest mode and merged WorkSource after each change.
+     */
+    @Test
+    public void lockChurnKeepsStrongestModeAndMergedWorkSource() throws Exception {
+        final int numHeldLocks = 100;
+        final int numPairs = 10;
+        when(mFrameworkFacade.isAppForeground(any(), anyInt())).thenReturn(true);
+        when(mWifiNative.getSupportedFeatureSet(INTERFACE_NAME))
+                .thenReturn((long) WifiManager.WIFI_FEATURE_LOW_LATENCY);
+        when(mClientModeImpl.setLowLatencyMode(anyBoolean())).thenReturn(true);
+        when(mClientModeImpl.setPowerSave(anyBoolean())).thenReturn(true);
+        mWifiLockManager.updateWifiClientConnected(true);
+        mWifiLockManager.handleScreenStateChanged(true);
+        for (int i = 0; i < numHeldLocks; i++) {
+            assertTrue(mWifiLockManager.acquireWifiLock(WifiManager.WIFI_MODE_FULL_HIGH_PERF,
+                    TEST_WIFI_LOCK_TAG, new Binder(), new WorkSource(1000 + i)));
+        }
+        assertEquals(WifiManager.WIFI_MODE_FULL_HIGH_PERF,
+                mWifiLockManager.getStrongestLockMode());
+
+        WorkSource churnWorkSource = new WorkSource(DEFAULT_TEST_UID_4);
+        for (int i = 0; i < numPairs; i++) {
+            IBinder binder = new Binder();
+            mWifiLockManager.acquireWifiLock(WifiManager.WIFI_MODE_FULL_LOW_LATENCY,
+                    TEST_WIFI_LOCK_TAG, binder, churnWorkSource);
+            assertEquals(WifiManager.WIFI_MODE_FULL_LOW_LATENCY,
+                    mWifiLockManager.getStrongestLockMode());
+            assertEquals(numHeldLocks + 1, mWifiLockManager.createMergedWorkSource().size());
+            mWifiLockManager.releaseWifiLock(binder);
+            assertEquals(WifiManager.WIFI_MODE_FULL_HIGH_PERF,
+                    mWifiLockManager.getStrongestLockMode());
+        }
+
+        assertEquals(numHeldLocks, mWifiLockManager.createMergedWorkSource().size());
+    }
 }
@@ -113,6 +113,7 @@ import com.android.server.wifi.proto.nano.WifiMetricsProto.WifiUsabilityStatsEnt
 import com.android.server.wifi.rtt.RttMetrics;
 import com.android.server.wifi.util.ExternalCallbackTracker;
 import com.android.server.wifi.util.InformationElementUtil;
+import com.android.server.wifi.util.QuantileSketch;
 import com.android.wifi.resources.R;
 
 import org.junit.Before;
@@ -1894,6 +1895,110 @@ public class WifiMetricsTest extends WifiBaseTest {
         assertEquals(2, mDecodedProto.bssidBlocklistStats.numHighMovementConnectionSkipped);
     }
 
+    /**
+     * Test the histogram of supplicant network HIDL calls issued per connection attempt.
+     */
+    @Test
+    public void testSupplicantNetworkHidlCallsForConnect() throws Exception {
+        mWifiMetrics.logSupplicantNetworkHidlCallsForConnect(12, 0);
+        mWifiMetrics.logSupplicantNetworkHidlCallsForConnect(1, 11);
+        mWifiMetrics.logSupplicantNetworkHidlCallsForConnect(1, 11);
+        dumpProtoAndDeserialize();
+
+        Int32Count[] expectedHistogram = {
+                buildInt32Count(1, 2),
+                buildInt32Count(12, 1),
+        };
+        assertKeyCountsEqual(expectedHistogram,
+                mDecodedProto.supplicantNetworkHidlCallsPerConnect);
+        assertEquals(22, mDecodedProto.numSupplicantNetworkHidlCallsSkipped);
+    }
+
+    /**
+     * Verify that the durations of successful connection attempts, and only those, are recorded
+     * in the connection duration sketch.
+     */
+    @Test
+    public void testSuccessfulConnectionDurationSketch() throws Exception {
+        when(mClock.getElapsedSinceBootMillis()).thenReturn(1000L);
+        mWifiMetrics.startConnectionEvent(null, "RED",
+                WifiMetricsProto.ConnectionEvent.ROAM_NONE);
+        when(mClock.getElapsedSinceBootMillis()).thenReturn(3500L);
+        mWifiMetrics.endConnectionEvent(
+                WifiMetrics.ConnectionEvent.FAILURE_NONE,
+                WifiMetricsProto.ConnectionEvent.HLF_NONE,
+                WifiMetricsProto.ConnectionEvent.FAILURE_REASON_UNKNOWN);
+        mWifiMetrics.startConnectionEvent(null, "BLUE",
+                WifiMetricsProto.ConnectionEvent.ROAM_NONE);
+        when(mClock.getElapsedSinceBootMillis()).thenReturn(9000L);
+        mWifiMetrics.endConnectionEvent(
+                WifiMetrics.ConnectionEvent.FAILURE_ASSOCIATION_TIMED_OUT,
+                WifiMetricsProto.ConnectionEvent.HLF_NONE,
+                WifiMetricsProto.ConnectionEvent.FAILURE_REASON_UNKNOWN);
+        dumpProtoAndDeserialize();
+
+        QuantileSketch sketch = QuantileSketch.fromProto(
+                mDecodedProto.successfulConnectionDurationMillisSketch);
+        assertEquals(1, sketch.getCount());
+        assertEquals(2500, sketch.quantile(0.5), 2500 * 0.01);
+    }
+
+    /**
+     * Verify that scan and RSSI poll counters updated concurrently from several threads, while
+     * the metrics are being dumped, are all reported exactly once.
+     */
+    @Test
+    public void testConcurrentScanAndRssiPollCountsAreNotLost() throws Exception {
+        final int numThreads = 4;
+        final int numUpdatesPerThread = 1000;
+        List<Thread> threads = new ArrayList<>();
+        for (int t = 0; t < numThreads; t++) {
+            Thread thread = new Thread(() -> {
+                for (int i = 0; i < numUpdatesPerThread; i++) {
+                    mWifiMetrics.incrementOneshotScanCount();
+                    mWifiMetrics.incrementScanReturnEntry(WifiMetricsProto.WifiLog.SCAN_SUCCESS, 1);
+                    mWifiMetrics.incrementRssiPollRssiCount(RSSI_POLL_FREQUENCY, MIN_RSSI_LEVEL);
+                }
+            });
+            threads.add(thread);
+            thread.start();
+        }
+        // Read some of the counters while they are being updated.
+        mWifiMetrics.getOneshotScanCount();
+        for (Thread thread : threads) {
+            thread.join();
+        }
+
+        assertEquals(numThreads * numUpdatesPerThread, mWifiMetrics.getOneshotScanCount());
+        assertEquals(numThreads * numUpdatesPerThread,
+                mWifiMetrics.getScanReturnEntry(WifiMetricsProto.WifiLog.SCAN_SUCCESS));
+        dumpProtoAndDeserialize();
+        assertEquals(numThreads * numUpdatesPerThread, mDecodedProto.numOneshotScans);
+        assertEquals(1, mDecodedProto.rssiPollRssiCount.length);
+        assertEquals(MIN_RSSI_LEVEL, mDecodedProto.rssiPollRssiCount[0].rssi);
+        assertEquals(numThreads * numUpdatesPerThread, mDecodedProto.rssiPollRssiCount[0].count);
+    }
+
+    /**
+     * Verify that RSSI polls on more frequencies than lock-free counters are kept for are still
+     * all reported, once per frequency.
+     */
+    @Test
+    public void testRssiPollCountsBeyondHotFrequencyBoundAreNotLost() throws Exception {
+        int numFrequencies = WifiMetrics.MAX_RSSI_POLL_HOT_FREQUENCIES + 4;
+        for (int i = 0; i < numFrequencies; i++) {
+            mWifiMetrics.incrementRssiPollRssiCount(5180 + 20 * i, MIN_RSSI_LEVEL);
+            mWifiMetrics.incrementRssiPollRssiCount(5180 + 20 * i, MIN_RSSI_LEVEL);
+        }
+
+        dumpProtoAndDeserialize();
+        assertEquals(numFrequencies, mDecodedProto.rssiPollRssiCount.length);
+        for (WifiMetricsProto.RssiPollCount rssiPollCount : mDecodedProto.rssiPollRssiCount) {
+            assertEquals(MIN_RSSI_LEVEL, rssiPollCount.rssi);
+            assertEquals(2, rssiPollCount.count);
+        }
+    }
+
     /**
      * Test that WifiMetrics is being cleared after dumping via proto
      */
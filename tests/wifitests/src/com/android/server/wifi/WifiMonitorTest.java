@@ -19,7 +19,10 @@ package com.android.server.wifi;
 import static org.junit.Assert.assertArrayEquals;
 import static org.junit.Assert.assertEquals;
 import static org.junit.Assert.assertNull;
+import static org.junit.Assert.assertTrue;
+import static org.mockito.Mockito.any;
 import static org.mockito.Mockito.mock;
+import static org.mockito.Mockito.never;
 import static org.mockito.Mockito.spy;
 import static org.mockito.Mockito.times;
 import static org.mockito.Mockito.verify;
@@ -36,6 +39,7 @@ import android.os.test.TestLooper;
 
 import androidx.test.filters.SmallTest;
 
+import com.android.internal.util.Protocol;
 import com.android.server.wifi.MboOceController.BtmFrameData;
 import com.android.server.wifi.hotspot2.AnqpEvent;
 import com.android.server.wifi.hotspot2.IconEvent;
@@ -44,6 +48,12 @@ import org.junit.Before;
 import org.junit.Test;
 import org.mockito.ArgumentCaptor;
 
+import java.io.PrintWriter;
+import java.io.StringWriter;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
+
 /**
  * Unit tests for {@link com.android.server.wifi.WifiMonitor}.
  */
@@ -60,6 +70,9 @@ public class WifiMonitorTest extends WifiBaseTest {
     private TestLooper mLooper;
     private Handler mHandlerSpy;
     private Handler mSecondHandlerSpy;
+    // Events handled by mRecordingHandler, as "<what - BASE>:<state or BSSID>".
+    private final List<String> mHandledEvents = new ArrayList<>();
+    private Handler mRecordingHandler;
 
     @Before
     public void setUp() throws Exception {
@@ -68,6 +81,55 @@ public class WifiMonitorTest extends WifiBaseTest {
         mHandlerSpy = spy(new Handler(mLooper.getLooper()));
         mSecondHandlerSpy = spy(new Handler(mLooper.getLooper()));
         mWifiMonitor.setMonitoring(WLAN_IFACE_NAME, true);
+        mRecordingHandler = new Handler(mLooper.getLooper()) {
+            @Override
+            public void handleMessage(Message msg) {
+                Object payload = msg.obj instanceof StateChangeResult
+                        ? ((StateChangeResult) msg.obj).state : msg.obj;
+                mHandledEvents.add((msg.what - Protocol.BASE_WIFI_MONITOR) + ":" + payload);
+            }
+        };
+    }
+
+    private void registerRecordingHandler(int... whats) {
+        for (int what : whats) {
+            mWifiMonitor.registerHandler(WLAN_IFACE_NAME, what, mRecordingHandler);
+        }
+        mWifiMonitor.setEventCollapsingEnabled(mRecordingHandler, true);
+    }
+
+    private String dumpMonitor() {
+        StringWriter sw = new StringWriter();
+        mWifiMonitor.dump(new PrintWriter(sw));
+        return sw.toString();
+    }
+
+    /**
+     * Returns the number of steps back between handshake states in |states|, which is what
+     * SupplicantStateTracker detects supplicant loops with.
+     */
+    private static int countHandshakeStepsBack(List<SupplicantState> states) {
+        int stepsBack = 0;
+        for (int i = 1; i < states.size(); i++) {
+            if (SupplicantState.isHandshakeState(states.get(i - 1))
+                    && SupplicantState.isHandshakeState(states.get(i))
+                    && states.get(i - 1).ordinal() > states.get(i).ordinal()) {
+                stepsBack++;
+            }
+        }
+        return stepsBack;
+    }
+
+    private void broadcastStates(int networkId, SupplicantState... states) {
+        for (SupplicantState state : states) {
+            mWifiMonitor.broadcastSupplicantStateChangeEvent(WLAN_IFACE_NAME, networkId,
+                    WifiSsid.createFromAsciiEncoded(SSID), BSSID, state);
+        }
+    }
+
+    private static String stateEvent(SupplicantState state) {
+        return (WifiMonitor.SUPPLICANT_STATE_CHANGE_EVENT - Protocol.BASE_WIFI_MONITOR) + ":"
+                + state;
     }
 
     /**
@@ -621,4 +683,245 @@ public class WifiMonitorTest extends WifiBaseTest {
         assertEquals(1, messageCaptor.getValue().arg2);
         assertEquals(bssid, (String) messageCaptor.getValue().obj);
     }
+
+    /**
+     * Broadcast message when iface is null, and one of the monitored ifaces has no handler for
+     * the event.
+     */
+    @Test
+    public void testBroadcastEventWhenIfaceIsNullSkipsIfacesWithoutHandler() {
+        mWifiMonitor.setMonitoring(SECOND_WLAN_IFACE_NAME, true);
+        mWifiMonitor.registerHandler(
+                WLAN_IFACE_NAME, WifiMonitor.SUP_DISCONNECTION_EVENT, mHandlerSpy);
+        mWifiMonitor.registerHandler(
+                SECOND_WLAN_IFACE_NAME, WifiMonitor.SUP_CONNECTION_EVENT, mSecondHandlerSpy);
+        mWifiMonitor.broadcastSupplicantDisconnectionEvent(null);
+        mLooper.dispatchAll();
+
+        ArgumentCaptor<Message> messageCaptor = ArgumentCaptor.forClass(Message.class);
+        verify(mHandlerSpy).handleMessage(messageCaptor.capture());
+        assertEquals(WifiMonitor.SUP_DISCONNECTION_EVENT, messageCaptor.getValue().what);
+        verify(mSecondHandlerSpy, never()).handleMessage(any());
+    }
+
+    /**
+     * Verify that every event is delivered, with handlers registered for 40 events on each of
+     * 4 ifaces.
+     */
+    @Test
+    public void testEventDeliveryWithManyHandlers() {
+        final int numIfaces = 4;
+        final int numEventTypes = 40;
+        final int numRounds = 10;
+        final int[] delivered = new int[1];
+        // Counts messages rather than queueing them.
+        Handler countingHandler = new Handler(mLooper.getLooper()) {
+            @Override
+            public boolean sendMessageAtTime(Message msg, long uptimeMillis) {
+                delivered[0]++;
+                msg.recycle();
+                return true;
+            }
+        };
+        String[] ifaces = new String[numIfaces];
+        for (int i = 0; i < numIfaces; i++) {
+            ifaces[i] = "wlan" + i;
+            mWifiMonitor.setMonitoring(ifaces[i], true);
+            for (int j = 0; j < numEventTypes; j++) {
+                mWifiMonitor.registerHandler(
+                        ifaces[i], WifiMonitor.SUP_CONNECTION_EVENT + j, countingHandler);
+            }
+        }
+
+        for (int round = 0; round < numRounds; round++) {
+            for (String iface : ifaces) {
+                mWifiMonitor.broadcastScanResultEvent(iface);
+                mWifiMonitor.broadcastPnoScanResultEvent(iface);
+                mWifiMonitor.broadcastWpsSuccessEvent(iface);
+                mWifiMonitor.broadcastWpsTimeoutEvent(iface);
+            }
+        }
+
+        int numEvents = numRounds * numIfaces * 4;
+        assertEquals(numEvents, delivered[0]);
+    }
+
+    /**
+     * Verify that transient supplicant state changes are superseded by later intermediate ones
+     * while still queued, and that ASSOCIATED and terminal states are delivered.
+     */
+    @Test
+    public void testTransientStateChangesAreSupersededWhileQueued() {
+        registerRecordingHandler(WifiMonitor.SUPPLICANT_STATE_CHANGE_EVENT);
+        broadcastStates(NETWORK_ID, SupplicantState.SCANNING, SupplicantState.AUTHENTICATING,
+                SupplicantState.ASSOCIATING, SupplicantState.ASSOCIATED,
+                SupplicantState.FOUR_WAY_HANDSHAKE, SupplicantState.GROUP_HANDSHAKE,
+                SupplicantState.COMPLETED, SupplicantState.DISCONNECTED,
+                SupplicantState.SCANNING);
+        mLooper.dispatchAll();
+
+        assertEquals(Arrays.asList(stateEvent(SupplicantState.ASSOCIATED),
+                stateEvent(SupplicantState.GROUP_HANDSHAKE),
+                stateEvent(SupplicantState.COMPLETED),
+                stateEvent(SupplicantState.DISCONNECTED),
+                stateEvent(SupplicantState.SCANNING)), mHandledEvents);
+    }
+
+    /**
+     * Verify that state changes are not superseded once handled, or by state changes for
+     * another network.
+     */
+    @Test
+    public void testStateChangesAreNotSupersededOnceHandled() {
+        registerRecordingHandler(WifiMonitor.SUPPLICANT_STATE_CHANGE_EVENT);
+        broadcastStates(NETWORK_ID, SupplicantState.AUTHENTICATING);
+        mLooper.dispatchAll();
+        broadcastStates(NETWORK_ID, SupplicantState.ASSOCIATING);
+        broadcastStates(NETWORK_ID + 1, SupplicantState.ASSOCIATING);
+        mLooper.dispatchAll();
+
+        assertEquals(Arrays.asList(stateEvent(SupplicantState.AUTHENTICATING),
+                stateEvent(SupplicantState.ASSOCIATING),
+                stateEvent(SupplicantState.ASSOCIATING)), mHandledEvents);
+    }
+
+    /**
+     * Verify that events are not superseded across another event queued in between, so the
+     * events keep their order.
+     */
+    @Test
+    public void testEventsAreNotSupersededAcrossOtherEvents() {
+        registerRecordingHandler(WifiMonitor.SUPPLICANT_STATE_CHANGE_EVENT,
+                WifiMonitor.TARGET_BSSID_EVENT);
+        broadcastStates(NETWORK_ID, SupplicantState.AUTHENTICATING);
+        mWifiMonitor.broadcastTargetBssidEvent(WLAN_IFACE_NAME, BSSID);
+        broadcastStates(NETWORK_ID, SupplicantState.ASSOCIATING);
+        mLooper.dispatchAll();
+
+        assertEquals(Arrays.asList(stateEvent(SupplicantState.AUTHENTICATING),
+                (WifiMonitor.TARGET_BSSID_EVENT - Protocol.BASE_WIFI_MONITOR) + ":" + BSSID,
+                stateEvent(SupplicantState.ASSOCIATING)), mHandledEvents);
+    }
+
+    /**
+     * Verify that queued target BSSID events are superseded by the latest one, and associated
+     * BSSID events only by one for the same BSSID.
+     */
+    @Test
+    public void testBssidEventsAreSupersededWhileQueued() {
+        String otherBssid = "fe:45:23:12:12:0b";
+        registerRecordingHandler(WifiMonitor.TARGET_BSSID_EVENT,
+                WifiMonitor.ASSOCIATED_BSSID_EVENT);
+        mWifiMonitor.broadcastTargetBssidEvent(WLAN_IFACE_NAME, BSSID);
+        mWifiMonitor.broadcastTargetBssidEvent(WLAN_IFACE_NAME, otherBssid);
+        mWifiMonitor.broadcastAssociatedBssidEvent(WLAN_IFACE_NAME, otherBssid);
+        mWifiMonitor.broadcastAssociatedBssidEvent(WLAN_IFACE_NAME, new String(otherBssid));
+        mWifiMonitor.broadcastAssociatedBssidEvent(WLAN_IFACE_NAME, BSSID);
+        mLooper.dispatchAll();
+
+        int target = WifiMonitor.TARGET_BSSID_EVENT - Protocol.BASE_WIFI_MONITOR;
+        int associated = WifiMonitor.ASSOCIATED_BSSID_EVENT - Protocol.BASE_WIFI_MONITOR;
+        assertEquals(Arrays.asList(target + ":" + otherBssid, associated + ":" + otherBssid,
+                associated + ":" + BSSID), mHandledEvents);
+    }
+
+    /**
+     * Verify a roaming storm while the handler is behind: every roam goes through the transient
+     * states to COMPLETED, with its BSSID events. Verifies that the terminal events are all
+     * delivered, that fewer events were queued, and that the dump shows it.
+     */
+    @Test
+    public void testRoamingStormQueuesFewerEvents() {
+        final int numRoams = 10;
+        registerRecordingHandler(WifiMonitor.SUPPLICANT_STATE_CHANGE_EVENT,
+                WifiMonitor.TARGET_BSSID_EVENT, WifiMonitor.ASSOCIATED_BSSID_EVENT);
+        for (int i = 0; i < numRoams; i++) {
+            mWifiMonitor.broadcastTargetBssidEvent(WLAN_IFACE_NAME, BSSID);
+            mWifiMonitor.broadcastTargetBssidEvent(WLAN_IFACE_NAME, BSSID);
+            broadcastStates(NETWORK_ID, SupplicantState.AUTHENTICATING,
+                    SupplicantState.ASSOCIATING, SupplicantState.ASSOCIATED);
+            mWifiMonitor.broadcastAssociatedBssidEvent(WLAN_IFACE_NAME, BSSID);
+            mWifiMonitor.broadcastAssociatedBssidEvent(WLAN_IFACE_NAME, BSSID);
+            broadcastStates(NETWORK_ID, SupplicantState.FOUR_WAY_HANDSHAKE,
+                    SupplicantState.GROUP_HANDSHAKE, SupplicantState.COMPLETED);
+        }
+        mLooper.dispatchAll();
+
+        int numCompleted = 0;
+        for (String event : mHandledEvents) {
+            if (event.equals(stateEvent(SupplicantState.COMPLETED))) numCompleted++;
+        }
+        assertEquals(numRoams, numCompleted);
+        // Target BSSID, ASSOCIATED, associated BSSID, GROUP_HANDSHAKE and COMPLETED per roam.
+        assertEquals(numRoams * 5, mHandledEvents.size());
+
+        String dump = dumpMonitor();
+        assertTrue(dump, dump.contains("SUPPLICANT_STATE_CHANGE_EVENT queued=" + numRoams * 6
+                + " superseded=" + numRoams * 3));
+        assertTrue(dump, dump.contains("TARGET_BSSID_EVENT queued=" + numRoams * 2
+                + " superseded=" + numRoams));
+    }
+
+    /**
+     * Verify that a wrong password loop, where supplicant keeps going from FOUR_WAY_HANDSHAKE
+     * back to ASSOCIATING, delivers every step back, so that SupplicantStateTracker still
+     * detects the loop.
+     */
+    @Test
+    public void testWrongPasswordLoopKeepsEveryStepBack() {
+        final int numLoops = 5;
+        registerRecordingHandler(WifiMonitor.SUPPLICANT_STATE_CHANGE_EVENT);
+        List<SupplicantState> broadcast = new ArrayList<>();
+        for (int i = 0; i < numLoops; i++) {
+            broadcast.add(SupplicantState.ASSOCIATING);
+            broadcast.add(SupplicantState.ASSOCIATED);
+            broadcast.add(SupplicantState.FOUR_WAY_HANDSHAKE);
+        }
+        broadcastStates(NETWORK_ID, broadcast.toArray(new SupplicantState[0]));
+        mLooper.dispatchAll();
+
+        List<SupplicantState> delivered = new ArrayList<>();
+        for (String event : mHandledEvents) {
+            delivered.add(SupplicantState.valueOf(event.substring(event.indexOf(':') + 1)));
+        }
+        assertEquals(numLoops - 1, countHandshakeStepsBack(broadcast));
+        assertEquals(countHandshakeStepsBack(broadcast), countHandshakeStepsBack(delivered));
+        assertTrue(delivered.size() < broadcast.size());
+    }
+
+    /**
+     * Verify that handlers which did not enable collapsing get every event, even while another
+     * handler for the same events has its events collapsed.
+     */
+    @Test
+    public void testEventsAreNotCollapsedUnlessEnabled() {
+        registerRecordingHandler(WifiMonitor.SUPPLICANT_STATE_CHANGE_EVENT);
+        mWifiMonitor.registerHandler(
+                WLAN_IFACE_NAME, WifiMonitor.SUPPLICANT_STATE_CHANGE_EVENT, mHandlerSpy);
+        broadcastStates(NETWORK_ID, SupplicantState.AUTHENTICATING,
+                SupplicantState.ASSOCIATING, SupplicantState.ASSOCIATED);
+        mLooper.dispatchAll();
+
+        verify(mHandlerSpy, times(3)).handleMessage(any(Message.class));
+        assertEquals(Arrays.asList(stateEvent(SupplicantState.ASSOCIATED)), mHandledEvents);
+    }
+
+    /**
+     * Verify that the last event queued to a handler is forgotten once the handler is
+     * deregistered from every event.
+     */
+    @Test
+    public void testDeregisteredHandlersArePruned() {
+        registerRecordingHandler(WifiMonitor.SUPPLICANT_STATE_CHANGE_EVENT,
+                WifiMonitor.TARGET_BSSID_EVENT);
+        broadcastStates(NETWORK_ID, SupplicantState.AUTHENTICATING);
+        assertTrue(dumpMonitor(), dumpMonitor().contains("SupplicantEventBatcher: handlers=1"));
+
+        mWifiMonitor.deregisterHandler(
+                WLAN_IFACE_NAME, WifiMonitor.SUPPLICANT_STATE_CHANGE_EVENT, mRecordingHandler);
+        assertTrue(dumpMonitor(), dumpMonitor().contains("SupplicantEventBatcher: handlers=1"));
+        mWifiMonitor.deregisterHandler(
+                WLAN_IFACE_NAME, WifiMonitor.TARGET_BSSID_EVENT, mRecordingHandler);
+        assertTrue(dumpMonitor(), dumpMonitor().contains("SupplicantEventBatcher: handlers=0"));
+    }
 }
@@ -34,6 +34,7 @@ import static android.net.wifi.WifiManager.WIFI_AP_STATE_DISABLING;
 import static android.net.wifi.WifiManager.WIFI_AP_STATE_ENABLED;
 import static android.net.wifi.WifiManager.WIFI_AP_STATE_FAILED;
 import static android.net.wifi.WifiManager.WIFI_STATE_DISABLED;
+import static android.net.wifi.WifiManager.WIFI_STATE_ENABLED;
 
 import static com.android.dx.mockito.inline.extended.ExtendedMockito.mockitoSession;
 import static com.android.server.wifi.LocalOnlyHotspotRequestInfo.HOTSPOT_NO_ERROR;
@@ -45,6 +46,7 @@ import static org.junit.Assert.assertArrayEquals;
 import static org.junit.Assert.assertEquals;
 import static org.junit.Assert.assertFalse;
 import static org.junit.Assert.assertNotNull;
+import static org.junit.Assert.assertNotSame;
 import static org.junit.Assert.assertNull;
 import static org.junit.Assert.assertTrue;
 import static org.junit.Assert.fail;
@@ -93,6 +95,7 @@ import android.content.pm.PackageManager;
 import android.content.pm.ParceledListSlice;
 import android.content.res.Resources;
 import android.net.MacAddress;
+import android.net.Network;
 import android.net.NetworkStack;
 import android.net.Uri;
 import android.net.wifi.IActionListener;
@@ -179,6 +182,7 @@ import java.util.Collections;
 import java.util.HashMap;
 import java.util.List;
 import java.util.Map;
+import java.util.function.Consumer;
 
 /**
  * Unit tests for {@link WifiServiceImpl}.
@@ -238,6 +242,7 @@ public class WifiServiceImplTest extends WifiBaseTest {
     private AsyncChannel mAsyncChannel;
     private WifiServiceImpl mWifiServiceImpl;
     private TestLooper mLooper;
+    private WifiStateSnapshotPublisher mWifiStateSnapshotPublisher;
     private PowerManager mPowerManager;
     private PhoneStateListener mPhoneStateListener;
     private int mPid;
@@ -308,6 +313,7 @@ public class WifiServiceImplTest extends WifiBaseTest {
     @Mock PasspointManager mPasspointManager;
     @Mock IDppCallback mDppCallback;
     @Mock SarManager mSarManager;
+    @Mock ConnectionPhaseTracer mConnectionPhaseTracer;
     @Mock ILocalOnlyHotspotCallback mLohsCallback;
     @Mock IScanResultsCallback mScanResultsCallback;
     @Mock ISuggestionConnectionStatusListener mSuggestionConnectionStatusListener;
@@ -339,6 +345,7 @@ public class WifiServiceImplTest extends WifiBaseTest {
         when(mWifiInjector.getActiveModeWarden()).thenReturn(mActiveModeWarden);
         when(mWifiInjector.getAsyncChannelHandlerThread()).thenReturn(mHandlerThread);
         when(mWifiInjector.getWifiHandlerThread()).thenReturn(mHandlerThread);
+        when(mWifiInjector.getCallbackBroadcastExecutor()).thenReturn(Runnable::run);
         when(mHandlerThread.getThreadHandler()).thenReturn(new Handler(mLooper.getLooper()));
         when(mHandlerThread.getLooper()).thenReturn(mLooper.getLooper());
         when(mContext.getResources()).thenReturn(mResources);
@@ -385,10 +392,14 @@ public class WifiServiceImplTest extends WifiBaseTest {
         when(mWifiInjector.getWifiScoreCard()).thenReturn(mWifiScoreCard);
         when(mWifiInjector.getWifiHealthMonitor()).thenReturn(mWifiHealthMonitor);
         when(mWifiInjector.getSarManager()).thenReturn(mSarManager);
+        when(mWifiInjector.getConnectionPhaseTracer()).thenReturn(mConnectionPhaseTracer);
         when(mWifiInjector.getWifiNetworkScoreCache())
                 .thenReturn(mock(WifiNetworkScoreCache.class));
         when(mWifiInjector.getWifiThreadRunner())
                 .thenReturn(new WifiThreadRunner(new Handler(mLooper.getLooper())));
+        mWifiStateSnapshotPublisher = new WifiStateSnapshotPublisher();
+        when(mWifiInjector.getWifiStateSnapshotPublisher())
+                .thenReturn(mWifiStateSnapshotPublisher);
         when(mWifiInjector.getSettingsConfigStore()).thenReturn(mWifiSettingsConfigStore);
         when(mWifiInjector.getWifiScanAlwaysAvailableSettingsCompatibility())
                 .thenReturn(mScanAlwaysAvailableSettingsCompatibility);
@@ -474,9 +485,9 @@ public class WifiServiceImplTest extends WifiBaseTest {
 
     private WifiServiceImpl makeWifiServiceImplWithMockRunnerWhichTimesOut() {
         WifiThreadRunner mockRunner = mock(WifiThreadRunner.class);
-        when(mockRunner.call(any(), any())).then(returnsSecondArg());
-        when(mockRunner.call(any(), any(int.class))).then(returnsSecondArg());
-        when(mockRunner.call(any(), any(boolean.class))).then(returnsSecondArg());
+        when(mockRunner.call(any(), any(), anyString())).then(returnsSecondArg());
+        when(mockRunner.call(any(), any(int.class), anyString())).then(returnsSecondArg());
+        when(mockRunner.call(any(), any(boolean.class), anyString())).then(returnsSecondArg());
         when(mockRunner.post(any())).thenReturn(false);
 
         when(mWifiInjector.getWifiThreadRunner()).thenReturn(mockRunner);
@@ -1614,7 +1625,12 @@ public class WifiServiceImplTest extends WifiBaseTest {
         wifiInfo.setNetworkId(TEST_NETWORK_ID);
         wifiInfo.setFQDN(TEST_FQDN);
         wifiInfo.setProviderFriendlyName(TEST_FRIENDLY_NAME);
-        when(mClientModeImpl.syncRequestConnectionInfo()).thenReturn(wifiInfo);
+        mWifiStateSnapshotPublisher.publishClientModeState(WIFI_STATE_ENABLED, wifiInfo, null, 0);
+    }
+
+    private void publishSupportedFeatures(long supportedFeatures) {
+        mWifiStateSnapshotPublisher.publishClientModeState(WIFI_STATE_ENABLED, new WifiInfo(),
+                null, supportedFeatures);
     }
 
     /**
@@ -1674,14 +1690,32 @@ public class WifiServiceImplTest extends WifiBaseTest {
         assertEquals(TEST_FRIENDLY_NAME, connectionInfo.getPasspointProviderFriendlyName());
     }
 
+    /**
+     * Verify that the wifi state and the current network are read from the latest published
+     * snapshot, without posting to the wifi thread.
+     */
+    @Test
+    public void testWifiStateAndCurrentNetworkAreReadFromSnapshot() {
+        when(mContext.checkPermission(eq(android.Manifest.permission.NETWORK_SETTINGS),
+                anyInt(), anyInt())).thenReturn(PackageManager.PERMISSION_GRANTED);
+        Network network = mock(Network.class);
+        assertEquals(WIFI_STATE_DISABLED, mWifiServiceImpl.getWifiEnabledState());
+        assertNull(mWifiServiceImpl.getCurrentNetwork());
+
+        mWifiStateSnapshotPublisher.publishClientModeState(WIFI_STATE_ENABLED, new WifiInfo(),
+                network, 0);
+
+        assertEquals(WIFI_STATE_ENABLED, mWifiServiceImpl.getWifiEnabledState());
+        assertEquals(network, mWifiServiceImpl.getCurrentNetwork());
+    }
+
     /**
      * Test that configured network list are exposed empty list to an app that does not have the
      * appropriate permissions.
      */
     @Test
     public void testConfiguredNetworkListAreEmptyFromAppWithoutPermission() throws Exception {
-        when(mWifiConfigManager.getSavedNetworks(anyInt()))
-                .thenReturn(TEST_WIFI_CONFIGURATION_LIST);
+        mWifiStateSnapshotPublisher.publishSavedNetworks(TEST_WIFI_CONFIGURATION_LIST);
 
         // no permission = target SDK=Q && not a carrier app
         when(mTelephonyManager.checkCarrierPrivilegesForPackageAnyPhone(anyString())).thenReturn(
@@ -1699,8 +1733,7 @@ public class WifiServiceImplTest extends WifiBaseTest {
      */
     @Test
     public void testConfiguredNetworkListAreEmptyOnSecurityException() throws Exception {
-        when(mWifiConfigManager.getSavedNetworks(anyInt()))
-                .thenReturn(TEST_WIFI_CONFIGURATION_LIST);
+        mWifiStateSnapshotPublisher.publishSavedNetworks(TEST_WIFI_CONFIGURATION_LIST);
 
         doThrow(new SecurityException()).when(mWifiPermissionsUtil).enforceCanAccessScanResults(
                 anyString(), nullable(String.class), anyInt(), nullable(String.class));
@@ -1718,8 +1751,13 @@ public class WifiServiceImplTest extends WifiBaseTest {
      */
     @Test
     public void testConfiguredNetworkListAreVisibleFromPermittedApp() throws Exception {
-        when(mWifiConfigManager.getSavedNetworks(anyInt()))
-                .thenReturn(TEST_WIFI_CONFIGURATION_LIST);
+        List<WifiConfiguration> savedNetworks = new ArrayList<>();
+        for (WifiConfiguration config : TEST_WIFI_CONFIGURATION_LIST) {
+            WifiConfiguration savedNetwork = new WifiConfiguration(config);
+            savedNetwork.setRandomizedMacAddress(TEST_FACTORY_MAC_ADDR);
+            savedNetworks.add(savedNetwork);
+        }
+        mWifiStateSnapshotPublisher.publishSavedNetworks(savedNetworks);
 
         when(mContext.checkPermission(eq(android.Manifest.permission.NETWORK_SETTINGS),
                 anyInt(), anyInt())).thenReturn(PackageManager.PERMISSION_GRANTED);
@@ -1731,9 +1769,15 @@ public class WifiServiceImplTest extends WifiBaseTest {
                 mWifiServiceImpl.getConfiguredNetworks(TEST_PACKAGE, TEST_FEATURE_ID);
         mLooper.stopAutoDispatchAndIgnoreExceptions();
 
-        verify(mWifiConfigManager).getSavedNetworks(eq(Process.WIFI_UID));
         WifiConfigurationTestUtil.assertConfigurationsEqualForBackup(
                 TEST_WIFI_CONFIGURATION_LIST, configs.getList());
+        // Privileged apps read the networks as the wifi UID does, with no MAC address masked,
+        // and get copies rather than the networks held by the snapshot.
+        for (int i = 0; i < savedNetworks.size(); i++) {
+            WifiConfiguration config = configs.getList().get(i);
+            assertEquals(TEST_FACTORY_MAC_ADDR, config.getRandomizedMacAddress());
+            assertNotSame(savedNetworks.get(i), config);
+        }
     }
 
 
@@ -3460,27 +3504,107 @@ public class WifiServiceImplTest extends WifiBaseTest {
      * Verify that a call to {@link WifiServiceImpl#restoreBackupData(byte[])} is only allowed from
      * callers with the signature only NETWORK_SETTINGS permission.
      */
-    @Test(expected = SecurityException.class)
+    @Test
     public void testRestoreBackupDataNotApprovedCaller() {
         doThrow(new SecurityException()).when(mContext)
                 .enforceCallingOrSelfPermission(eq(android.Manifest.permission.NETWORK_SETTINGS),
                         eq("WifiService"));
-        mWifiServiceImpl.restoreBackupData(null);
-        verify(mWifiBackupRestore, never()).retrieveConfigurationsFromBackupData(any(byte[].class));
+        mWifiServiceImpl.mClientModeImplChannel = mAsyncChannel;
+        try {
+            mWifiServiceImpl.restoreBackupData(new byte[]{1});
+            fail("Expected SecurityException");
+        } catch (SecurityException e) {
+            // expected
+        }
+        verify(mWifiBackupRestore, never()).retrieveConfigurationsFromBackupStream(
+                any(), anyInt(), any());
+        verify(mWifiConfigManager, never()).startBatchedStoreWrites();
     }
 
     /**
      * Verify that a call to {@link WifiServiceImpl#restoreSupplicantBackupData(byte[], byte[])} is
      * only allowed from callers with the signature only NETWORK_SETTINGS permission.
      */
-    @Test(expected = SecurityException.class)
+    @Test
     public void testRestoreSupplicantBackupDataNotApprovedCaller() {
         doThrow(new SecurityException()).when(mContext)
                 .enforceCallingOrSelfPermission(eq(android.Manifest.permission.NETWORK_SETTINGS),
                         eq("WifiService"));
-        mWifiServiceImpl.restoreSupplicantBackupData(null, null);
-        verify(mWifiBackupRestore, never()).retrieveConfigurationsFromSupplicantBackupData(
-                any(byte[].class), any(byte[].class));
+        mWifiServiceImpl.mClientModeImplChannel = mAsyncChannel;
+        try {
+            mWifiServiceImpl.restoreSupplicantBackupData(new byte[]{1}, null);
+            fail("Expected SecurityException");
+        } catch (SecurityException e) {
+            // expected
+        }
+        verify(mWifiBackupRestore, never()).retrieveConfigurationsFromSupplicantBackupStream(
+                any(), any(), anyInt(), any());
+        verify(mWifiConfigManager, never()).startBatchedStoreWrites();
+    }
+
+    /**
+     * Verify that {@link WifiServiceImpl#restoreBackupData(byte[])} validates the whole backup
+     * data, then adds the restored networks batch by batch with the store writes batched.
+     */
+    @Test
+    public void testRestoreBackupDataAddsNetworksInBatches() {
+        List<WifiConfiguration> batch1 = Arrays.asList(
+                WifiConfigurationTestUtil.createOpenNetwork(),
+                WifiConfigurationTestUtil.createPskNetwork());
+        List<WifiConfiguration> batch2 = Arrays.asList(
+                WifiConfigurationTestUtil.createOpenNetwork());
+        doAnswer(invocation -> {
+            Consumer<List<WifiConfiguration>> batchConsumer = invocation.getArgument(2);
+            batchConsumer.accept(batch1);
+            batchConsumer.accept(batch2);
+            return true;
+        }).when(mWifiBackupRestore).retrieveConfigurationsFromBackupStream(
+                any(), anyInt(), any());
+        when(mWifiConfigManager.addOrUpdateNetwork(any(), anyInt())).thenReturn(
+                new NetworkUpdateResult(0));
+        mWifiServiceImpl.mClientModeImplChannel = mAsyncChannel;
+
+        mLooper.startAutoDispatch();
+        mWifiServiceImpl.restoreBackupData(new byte[]{1});
+        mLooper.stopAutoDispatchAndIgnoreExceptions();
+        mLooper.dispatchAll();
+
+        // Parsed once to validate the data, then once to apply it.
+        verify(mWifiBackupRestore, times(2)).retrieveConfigurationsFromBackupStream(
+                any(), eq(WifiBackupRestore.DEFAULT_RESTORE_BATCH_SIZE), any());
+        InOrder inOrder = inOrder(mWifiConfigManager);
+        inOrder.verify(mWifiConfigManager).startBatchedStoreWrites();
+        for (WifiConfiguration config : batch1) {
+            inOrder.verify(mWifiConfigManager).addOrUpdateNetwork(eq(config), anyInt());
+        }
+        for (WifiConfiguration config : batch2) {
+            inOrder.verify(mWifiConfigManager).addOrUpdateNetwork(eq(config), anyInt());
+        }
+        inOrder.verify(mWifiConfigManager).endBatchedStoreWrites();
+    }
+
+    /**
+     * Verify that {@link WifiServiceImpl#restoreBackupData(byte[])} restores no network from
+     * backup data which is corrupt past its first batch.
+     */
+    @Test
+    public void testRestoreCorruptBackupDataAddsNoNetwork() {
+        doAnswer(invocation -> {
+            Consumer<List<WifiConfiguration>> batchConsumer = invocation.getArgument(2);
+            batchConsumer.accept(Arrays.asList(WifiConfigurationTestUtil.createOpenNetwork()));
+            return false;
+        }).when(mWifiBackupRestore).retrieveConfigurationsFromBackupStream(
+                any(), anyInt(), any());
+        mWifiServiceImpl.mClientModeImplChannel = mAsyncChannel;
+
+        mLooper.startAutoDispatch();
+        mWifiServiceImpl.restoreBackupData(new byte[]{1});
+        mLooper.stopAutoDispatchAndIgnoreExceptions();
+        mLooper.dispatchAll();
+
+        verify(mWifiBackupRestore).retrieveConfigurationsFromBackupStream(any(), anyInt(), any());
+        verify(mWifiConfigManager, never()).startBatchedStoreWrites();
+        verify(mWifiConfigManager, never()).addOrUpdateNetwork(any(), anyInt());
     }
 
     /**
@@ -5462,7 +5586,7 @@ public class WifiServiceImplTest extends WifiBaseTest {
      */
     @Test
     public void getWifiActivityEnergyInfoAsyncFeatureUnsupported() throws Exception {
-        when(mClientModeImpl.syncGetSupportedFeatures(any())).thenReturn(0L);
+        publishSupportedFeatures(0L);
         mWifiServiceImpl.getWifiActivityEnergyInfoAsync(mOnWifiActivityEnergyInfoListener);
         verify(mOnWifiActivityEnergyInfoListener).onWifiActivityEnergyInfo(null);
     }
@@ -5473,7 +5597,7 @@ public class WifiServiceImplTest extends WifiBaseTest {
      */
     @Test
     public void getWifiActivityEnergyInfoAsyncSuccess() throws Exception {
-        when(mClientModeImpl.syncGetSupportedFeatures(any())).thenReturn(Long.MAX_VALUE);
+        publishSupportedFeatures(Long.MAX_VALUE);
         setupReportActivityInfo();
         mWifiServiceImpl.getWifiActivityEnergyInfoAsync(mOnWifiActivityEnergyInfoListener);
         ArgumentCaptor<WifiActivityEnergyInfo> infoCaptor =
@@ -5652,8 +5776,7 @@ public class WifiServiceImplTest extends WifiBaseTest {
             long supportedFeaturesFromClientModeImpl, boolean rttDisabled) {
         when(mPackageManager.hasSystemFeature(PackageManager.FEATURE_WIFI_RTT)).thenReturn(
                 !rttDisabled);
-        when(mClientModeImpl.syncGetSupportedFeatures(any()))
-                .thenReturn(supportedFeaturesFromClientModeImpl);
+        publishSupportedFeatures(supportedFeaturesFromClientModeImpl);
         mLooper.startAutoDispatch();
         long supportedFeatures = mWifiServiceImpl.getSupportedFeatures();
         mLooper.stopAutoDispatchAndIgnoreExceptions();
@@ -5710,8 +5833,7 @@ public class WifiServiceImplTest extends WifiBaseTest {
         when(mResources.getBoolean(
                 R.bool.config_wifi_p2p_mac_randomization_supported))
                 .thenReturn(p2pMacRandomizationEnabled);
-        when(mClientModeImpl.syncGetSupportedFeatures(
-                any())).thenReturn(supportedFeaturesFromClientModeImpl);
+        publishSupportedFeatures(supportedFeaturesFromClientModeImpl);
         mLooper.startAutoDispatch();
         long supportedFeatures = mWifiServiceImpl.getSupportedFeatures();
         mLooper.stopAutoDispatchAndIgnoreExceptions();
@@ -5747,18 +5869,15 @@ public class WifiServiceImplTest extends WifiBaseTest {
     @Test
     public void syncGetSupportedFeaturesForStaApConcurrency() {
         long supportedFeaturesFromClientModeImpl = WifiManager.WIFI_FEATURE_OWE;
-        when(mClientModeImpl.syncGetSupportedFeatures(
-                any())).thenReturn(supportedFeaturesFromClientModeImpl);
+        publishSupportedFeatures(supportedFeaturesFromClientModeImpl);
 
-        when(mActiveModeWarden.isStaApConcurrencySupported())
-                .thenReturn(false);
+        mWifiStateSnapshotPublisher.publishStaApConcurrencySupported(false);
         mLooper.startAutoDispatch();
         assertEquals(supportedFeaturesFromClientModeImpl,
                         mWifiServiceImpl.getSupportedFeatures());
         mLooper.stopAutoDispatchAndIgnoreExceptions();
 
-        when(mActiveModeWarden.isStaApConcurrencySupported())
-                .thenReturn(true);
+        mWifiStateSnapshotPublisher.publishStaApConcurrencySupported(true);
         mLooper.startAutoDispatch();
         assertEquals(supportedFeaturesFromClientModeImpl | WifiManager.WIFI_FEATURE_AP_STA,
                 mWifiServiceImpl.getSupportedFeatures());
@@ -5799,6 +5918,29 @@ public class WifiServiceImplTest extends WifiBaseTest {
         verify(mScanRequestProxy).isScanThrottleEnabled();
     }
 
+    /**
+     * Verify that isScanThrottleEnabled() returns the new value once changed through
+     * setScanThrottleEnabled(), rather than the value cached earlier.
+     */
+    @Test
+    public void testIsScanThrottleEnabledAfterSetScanThrottleEnabled() {
+        doNothing().when(mContext)
+                .enforceCallingOrSelfPermission(eq(android.Manifest.permission.NETWORK_SETTINGS),
+                        eq("WifiService"));
+        when(mScanRequestProxy.isScanThrottleEnabled()).thenReturn(true);
+        mLooper.startAutoDispatch();
+        assertTrue(mWifiServiceImpl.isScanThrottleEnabled());
+        mLooper.stopAutoDispatchAndIgnoreExceptions();
+
+        mWifiServiceImpl.setScanThrottleEnabled(false);
+        when(mScanRequestProxy.isScanThrottleEnabled()).thenReturn(false);
+        mLooper.startAutoDispatch();
+        assertFalse(mWifiServiceImpl.isScanThrottleEnabled());
+        mLooper.stopAutoDispatchAndIgnoreExceptions();
+        verify(mScanRequestProxy).setScanThrottleEnabled(false);
+        verify(mScanRequestProxy, times(2)).isScanThrottleEnabled();
+    }
+
     @Test
     public void testSetAutoWakeupEnabledWithNetworkSettingsPermission() {
         doNothing().when(mContext)
@@ -5833,6 +5975,27 @@ public class WifiServiceImplTest extends WifiBaseTest {
         verify(mWakeupController).isEnabled();
     }
 
+    /**
+     * Verify that isAutoWakeupEnabled() returns the new value once the setting is changed
+     * outside of setAutoWakeupEnabled(), rather than the value cached earlier.
+     */
+    @Test
+    public void testIsAutoWakeupEnabledAfterSettingChange() {
+        ArgumentCaptor<Runnable> listenerCaptor = ArgumentCaptor.forClass(Runnable.class);
+        verify(mWakeupController).setEnabledChangedListener(listenerCaptor.capture());
+        when(mWakeupController.isEnabled()).thenReturn(true);
+        mLooper.startAutoDispatch();
+        assertTrue(mWifiServiceImpl.isAutoWakeupEnabled());
+        mLooper.stopAutoDispatchAndIgnoreExceptions();
+
+        when(mWakeupController.isEnabled()).thenReturn(false);
+        listenerCaptor.getValue().run();
+        mLooper.startAutoDispatch();
+        assertFalse(mWifiServiceImpl.isAutoWakeupEnabled());
+        mLooper.stopAutoDispatchAndIgnoreExceptions();
+        verify(mWakeupController, times(2)).isEnabled();
+    }
+
     @Test
     public void testSetScanAlwaysAvailableWithNetworkSettingsPermission() {
         doNothing().when(mContext)
@@ -16,12 +16,16 @@
 
 package com.android.server.wifi;
 
+import static com.android.server.wifi.WifiSettingsConfigStore.WIFI_SCAN_ALWAYS_AVAILABLE;
+import static com.android.server.wifi.WifiSettingsConfigStore.WIFI_SCAN_THROTTLE_ENABLED;
 import static com.android.server.wifi.WifiSettingsConfigStore.WIFI_VERBOSE_LOGGING_ENABLED;
 
+import static org.junit.Assert.assertEquals;
 import static org.junit.Assert.assertFalse;
 import static org.junit.Assert.assertNotNull;
 import static org.junit.Assert.assertTrue;
 import static org.mockito.Mockito.mock;
+import static org.mockito.Mockito.times;
 import static org.mockito.Mockito.validateMockitoUsage;
 import static org.mockito.Mockito.verify;
 import static org.mockito.Mockito.verifyNoMoreInteractions;
@@ -116,6 +120,46 @@ public class WifiSettingsConfigStoreTest extends WifiBaseTest {
         verifyNoMoreInteractions(listener);
     }
 
+    @Test
+    public void testTransactionPublishesAllValuesWithSingleStoreWrite() {
+        WifiSettingsConfigStore.OnSettingsChangedListener verboseListener = mock(
+                WifiSettingsConfigStore.OnSettingsChangedListener.class);
+        WifiSettingsConfigStore.OnSettingsChangedListener scanListener = mock(
+                WifiSettingsConfigStore.OnSettingsChangedListener.class);
+        Handler handler = new Handler(mLooper.getLooper());
+        mWifiSettingsConfigStore.registerChangeListener(WIFI_VERBOSE_LOGGING_ENABLED,
+                verboseListener, handler);
+        mWifiSettingsConfigStore.registerChangeListener(WIFI_SCAN_ALWAYS_AVAILABLE,
+                scanListener, handler);
+
+        mWifiSettingsConfigStore.beginTransaction()
+                .put(WIFI_VERBOSE_LOGGING_ENABLED, true)
+                .put(WIFI_SCAN_ALWAYS_AVAILABLE, true)
+                .commit();
+        // Values are visible to readers right away.
+        assertTrue(mWifiSettingsConfigStore.get(WIFI_VERBOSE_LOGGING_ENABLED));
+        assertTrue(mWifiSettingsConfigStore.get(WIFI_SCAN_ALWAYS_AVAILABLE));
+
+        mLooper.dispatchAll();
+        verify(mWifiConfigManager, times(1)).saveToStore(true);
+        verify(verboseListener).onSettingsChanged(WIFI_VERBOSE_LOGGING_ENABLED, true);
+        verify(scanListener).onSettingsChanged(WIFI_SCAN_ALWAYS_AVAILABLE, true);
+    }
+
+    @Test
+    public void testResetDataRestoresDefaultValues() throws Exception {
+        ArgumentCaptor<WifiConfigStore.StoreData> storeDataCaptor = ArgumentCaptor.forClass(
+                WifiConfigStore.StoreData.class);
+        verify(mWifiConfigStore).registerStoreData(storeDataCaptor.capture());
+
+        mWifiSettingsConfigStore.put(WIFI_SCAN_THROTTLE_ENABLED, false);
+        assertFalse(mWifiSettingsConfigStore.get(WIFI_SCAN_THROTTLE_ENABLED));
+
+        storeDataCaptor.getValue().resetData();
+        assertEquals(WIFI_SCAN_THROTTLE_ENABLED.defaultValue,
+                mWifiSettingsConfigStore.get(WIFI_SCAN_THROTTLE_ENABLED));
+    }
+
     @Test
     public void testSaveAndLoadFromStore() throws Exception {
         ArgumentCaptor<WifiConfigStore.StoreData> storeDataCaptor = ArgumentCaptor.forClass(
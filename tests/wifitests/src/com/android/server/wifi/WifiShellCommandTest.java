@@ -65,6 +65,7 @@ public class WifiShellCommandTest extends WifiBaseTest {
     @Mock Context mContext;
     @Mock ConnectivityManager mConnectivityManager;
     @Mock WifiCarrierInfoManager mWifiCarrierInfoManager;
+    @Mock ConnectionPhaseTracer mConnectionPhaseTracer;
 
     WifiShellCommand mWifiShellCommand;
 
@@ -82,6 +83,7 @@ public class WifiShellCommandTest extends WifiBaseTest {
         when(mWifiInjector.getWifiCountryCode()).thenReturn(mWifiCountryCode);
         when(mWifiInjector.getWifiLastResortWatchdog()).thenReturn(mWifiLastResortWatchdog);
         when(mWifiInjector.getWifiCarrierInfoManager()).thenReturn(mWifiCarrierInfoManager);
+        when(mWifiInjector.getConnectionPhaseTracer()).thenReturn(mConnectionPhaseTracer);
 
         mWifiShellCommand = new WifiShellCommand(mWifiInjector, mWifiService, mContext);
 
@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.server.wifi;
+
+import static android.net.wifi.WifiManager.WIFI_STATE_DISABLED;
+import static android.net.wifi.WifiManager.WIFI_STATE_ENABLED;
+
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertFalse;
+import static org.junit.Assert.assertNotSame;
+import static org.junit.Assert.assertSame;
+import static org.junit.Assert.assertTrue;
+
+import android.net.MacAddress;
+import android.net.wifi.WifiConfiguration;
+import android.net.wifi.WifiInfo;
+import android.os.Process;
+
+import androidx.test.filters.SmallTest;
+
+import org.junit.Test;
+
+import java.util.Arrays;
+import java.util.List;
+import java.util.concurrent.CountDownLatch;
+
+/**
+ * Unit tests for {@link WifiStateSnapshotPublisher} and {@link WifiStateSnapshot}.
+ */
+@SmallTest
+public class WifiStateSnapshotPublisherTest extends WifiBaseTest {
+    private static final String TEST_BSSID = "02:00:00:00:00:01";
+    private static final int TEST_CREATOR_UID = 1234;
+    private static final int NUM_POLLING_APPS = 4;
+    private static final int NUM_PUBLICATIONS = 100;
+
+    private final WifiStateSnapshotPublisher mPublisher = new WifiStateSnapshotPublisher();
+
+    private static WifiConfiguration createNetwork(int networkId, int creatorUid, String mac) {
+        WifiConfiguration config = WifiConfigurationTestUtil.createOpenNetwork();
+        config.networkId = networkId;
+        config.creatorUid = creatorUid;
+        config.setRandomizedMacAddress(MacAddress.fromString(mac));
+        return config;
+    }
+
+    /**
+     * Verifies that every change publishes a new version, and that publishing unchanged wifi
+     * state or concurrency support does not.
+     */
+    @Test
+    public void changesArePublishedAsNewVersions() {
+        WifiStateSnapshot initial = mPublisher.getSnapshot();
+        assertEquals(WIFI_STATE_DISABLED, initial.getWifiState());
+
+        mPublisher.publishWifiState(WIFI_STATE_DISABLED);
+        mPublisher.publishStaApConcurrencySupported(false);
+        assertSame(initial, mPublisher.getSnapshot());
+
+        mPublisher.publishWifiState(WIFI_STATE_ENABLED);
+        mPublisher.publishStaApConcurrencySupported(true);
+        WifiStateSnapshot snapshot = mPublisher.getSnapshot();
+        assertEquals(initial.getVersion() + 2, snapshot.getVersion());
+        assertEquals(WIFI_STATE_ENABLED, snapshot.getWifiState());
+        assertTrue(snapshot.isStaApConcurrencySupported());
+        // Earlier snapshots are unchanged.
+        assertEquals(WIFI_STATE_DISABLED, initial.getWifiState());
+    }
+
+    /**
+     * Verifies that the connection info is handed out as copies, so callers masking fields do
+     * not change the snapshot.
+     */
+    @Test
+    public void connectionInfoIsCopied() {
+        WifiInfo wifiInfo = new WifiInfo();
+        wifiInfo.setBSSID(TEST_BSSID);
+        mPublisher.publishClientModeState(WIFI_STATE_ENABLED, wifiInfo, null, 0);
+
+        WifiStateSnapshot snapshot = mPublisher.getSnapshot();
+        WifiInfo copy = snapshot.getConnectionInfo();
+        assertNotSame(wifiInfo, copy);
+        copy.setBSSID(WifiInfo.DEFAULT_MAC_ADDRESS);
+        assertEquals(TEST_BSSID, snapshot.getConnectionInfo().getBSSID());
+    }
+
+    /**
+     * Verifies that randomized MAC addresses of saved networks are only exposed to the wifi stack
+     * and to the creator of the network.
+     */
+    @Test
+    public void savedNetworksAreMaskedForTargetUid() {
+        String mac = "02:00:00:00:00:02";
+        mPublisher.publishSavedNetworks(
+                Arrays.asList(createNetwork(0, TEST_CREATOR_UID, mac),
+                        createNetwork(1, TEST_CREATOR_UID + 1, mac)));
+        WifiStateSnapshot snapshot = mPublisher.getSnapshot();
+
+        for (WifiConfiguration config : snapshot.getSavedNetworks(Process.WIFI_UID)) {
+            assertEquals(mac, config.getRandomizedMacAddress().toString());
+        }
+        for (WifiConfiguration config : snapshot.getSavedNetworks(Process.INVALID_UID)) {
+            assertEquals(WifiInfo.DEFAULT_MAC_ADDRESS,
+                    config.getRandomizedMacAddress().toString());
+        }
+        List<WifiConfiguration> configs = snapshot.getSavedNetworks(TEST_CREATOR_UID);
+        assertEquals(mac, configs.get(0).getRandomizedMacAddress().toString());
+        assertEquals(WifiInfo.DEFAULT_MAC_ADDRESS,
+                configs.get(1).getRandomizedMacAddress().toString());
+        // Masking copies the network, leaving the published one as it was.
+        assertEquals(mac, snapshot.getSavedNetworks(Process.WIFI_UID).get(1)
+                .getRandomizedMacAddress().toString());
+    }
+
+    /**
+     * Verifies that saved networks are handed out as copies for every target UID, so in-process
+     * callers modifying them do not change the published snapshot.
+     */
+    @Test
+    public void savedNetworksAreCopied() {
+        String mac = "02:00:00:00:00:02";
+        WifiConfiguration network = createNetwork(0, TEST_CREATOR_UID, mac);
+        mPublisher.publishSavedNetworks(Arrays.asList(network));
+        WifiStateSnapshot snapshot = mPublisher.getSnapshot();
+
+        for (int targetUid : new int[] {Process.WIFI_UID, Process.SYSTEM_UID, TEST_CREATOR_UID}) {
+            WifiConfiguration copy = snapshot.getSavedNetworks(targetUid).get(0);
+            assertNotSame(network, copy);
+            copy.setRandomizedMacAddress(MacAddress.fromString(WifiInfo.DEFAULT_MAC_ADDRESS));
+        }
+        assertEquals(mac, network.getRandomizedMacAddress().toString());
+    }
+
+    /**
+     * Verifies that apps polling the snapshot from other threads, while the wifi thread keeps
+     * publishing, never see the version go backwards.
+     */
+    @Test
+    public void pollingAppsNeverSeeOlderSnapshots() throws Exception {
+        long finalVersion = mPublisher.getSnapshot().getVersion() + NUM_PUBLICATIONS;
+        boolean[] versionWentBackwards = new boolean[NUM_POLLING_APPS];
+        Thread[] apps = new Thread[NUM_POLLING_APPS];
+        CountDownLatch started = new CountDownLatch(NUM_POLLING_APPS);
+        for (int app = 0; app < NUM_POLLING_APPS; app++) {
+            int index = app;
+            apps[app] = new Thread(() -> {
+                started.countDown();
+                long lastVersion = -1;
+                while (lastVersion < finalVersion) {
+                    WifiStateSnapshot snapshot = mPublisher.getSnapshot();
+                    snapshot.getConnectionInfo();
+                    if (snapshot.getVersion() < lastVersion) {
+                        versionWentBackwards[index] = true;
+                    }
+                    lastVersion = snapshot.getVersion();
+                }
+            });
+            apps[app].start();
+        }
+        started.await();
+
+        WifiInfo wifiInfo = new WifiInfo();
+        wifiInfo.setBSSID(TEST_BSSID);
+        for (int i = 0; i < NUM_PUBLICATIONS; i++) {
+            wifiInfo.setRssi(-50 - i % 20);
+            mPublisher.publishClientModeState(WIFI_STATE_ENABLED, new WifiInfo(wifiInfo), null, 0);
+        }
+        for (Thread app : apps) {
+            app.join();
+        }
+
+        assertEquals(finalVersion, mPublisher.getSnapshot().getVersion());
+        for (boolean wentBackwards : versionWentBackwards) {
+            assertFalse(wentBackwards);
+        }
+    }
+}
@@ -37,6 +37,9 @@ import org.mockito.Mock;
 import org.mockito.MockitoAnnotations;
 import org.mockito.Spy;
 
+import java.util.concurrent.CompletableFuture;
+import java.util.concurrent.TimeUnit;
+import java.util.concurrent.atomic.AtomicInteger;
 import java.util.function.Supplier;
 
 @SmallTest
@@ -140,4 +143,81 @@ public class WifiThreadRunnerTest {
         verify(mHandler).post(mRunnable);
         verify(mRunnable, never()).run();
     }
+
+    @Test
+    public void callRecordsWaitStatsPerTask() {
+        mWifiThreadRunner.call(mSupplier, VALUE_ON_TIMEOUT, "getResult");
+        mWifiThreadRunner.call(mSupplier, VALUE_ON_TIMEOUT, "getResult");
+        doReturn(false).when(mHandler).post(any());
+        mWifiThreadRunner.run(mRunnable, "runTask");
+
+        WifiThreadRunner.WaitStats stats = mWifiThreadRunner.getWaitStats("getResult");
+        assertThat(stats.count).isEqualTo(2);
+        assertThat(stats.timeouts).isEqualTo(0);
+        assertThat(mWifiThreadRunner.getWaitStats("runTask").timeouts).isEqualTo(1);
+    }
+
+    @Test
+    public void callAsyncSuccess_completesWithExpectedValue() throws Exception {
+        CompletableFuture<Integer> future = mWifiThreadRunner.callAsync(mSupplier);
+
+        assertThat(future.get(1, TimeUnit.SECONDS)).isEqualTo(RESULT);
+        verify(mSupplier).get();
+    }
+
+    @Test
+    public void callAsyncFailure_completesExceptionally() {
+        doReturn(false).when(mHandler).post(any());
+
+        CompletableFuture<Integer> future = mWifiThreadRunner.callAsync(mSupplier);
+
+        assertThat(future.isCompletedExceptionally()).isTrue();
+        verify(mSupplier, never()).get();
+    }
+
+    @Test
+    public void cachedValue_servedUntilInvalidated() {
+        AtomicInteger value = new AtomicInteger(RESULT);
+        WifiThreadRunner.CachedValue<Integer> cachedValue =
+                mWifiThreadRunner.newCachedValue(value::get, 60_000, 60_000, "getValue");
+
+        assertThat(cachedValue.get(VALUE_ON_TIMEOUT)).isEqualTo(RESULT);
+        value.set(RESULT + 1);
+        assertThat(cachedValue.get(VALUE_ON_TIMEOUT)).isEqualTo(RESULT);
+
+        cachedValue.invalidate();
+        assertThat(cachedValue.get(VALUE_ON_TIMEOUT)).isEqualTo(RESULT + 1);
+        assertThat(mWifiThreadRunner.getWaitStats("getValue").count).isEqualTo(2);
+    }
+
+    @Test
+    public void cachedValue_staleValueServedAndRefreshedAsynchronously() throws Exception {
+        AtomicInteger value = new AtomicInteger(RESULT);
+        WifiThreadRunner.CachedValue<Integer> cachedValue =
+                mWifiThreadRunner.newCachedValue(value::get, 0, 60_000, "getValue");
+        assertThat(cachedValue.get(VALUE_ON_TIMEOUT)).isEqualTo(RESULT);
+        value.set(RESULT + 1);
+        Thread.sleep(10);
+
+        // The stale value is returned without blocking, and a refresh is posted.
+        assertThat(cachedValue.get(VALUE_ON_TIMEOUT)).isEqualTo(RESULT);
+        // Wait for the refresh to complete.
+        mWifiThreadRunner.run(() -> { }, "flush");
+        assertThat(cachedValue.get(VALUE_ON_TIMEOUT)).isEqualTo(RESULT + 1);
+        assertThat(mWifiThreadRunner.getWaitStats("getValue").count).isEqualTo(1);
+    }
+
+    @Test
+    public void cachedValue_valueOlderThanMaxAgeIsComputedAgain() throws Exception {
+        AtomicInteger value = new AtomicInteger(RESULT);
+        WifiThreadRunner.CachedValue<Integer> cachedValue =
+                mWifiThreadRunner.newCachedValue(value::get, 0, 0, "getValue");
+        assertThat(cachedValue.get(VALUE_ON_TIMEOUT)).isEqualTo(RESULT);
+        value.set(RESULT + 1);
+        Thread.sleep(10);
+
+        // The value is too old to be served, so get() blocks for the new one.
+        assertThat(cachedValue.get(VALUE_ON_TIMEOUT)).isEqualTo(RESULT + 1);
+        assertThat(mWifiThreadRunner.getWaitStats("getValue").count).isEqualTo(2);
+    }
 }
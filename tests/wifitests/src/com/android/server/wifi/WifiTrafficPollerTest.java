@@ -15,13 +15,16 @@
  */
 package com.android.server.wifi;
 
+import static org.junit.Assert.assertEquals;
 import static org.mockito.ArgumentMatchers.any;
 import static org.mockito.ArgumentMatchers.anyInt;
 import static org.mockito.Mockito.doThrow;
 import static org.mockito.Mockito.never;
 import static org.mockito.Mockito.times;
 import static org.mockito.Mockito.verify;
+import static org.mockito.Mockito.when;
 
+import android.content.Context;
 import android.net.wifi.ITrafficStateCallback;
 import android.net.wifi.WifiManager;
 import android.os.Handler;
@@ -31,6 +34,8 @@ import android.os.test.TestLooper;
 
 import androidx.test.filters.SmallTest;
 
+import com.android.wifi.resources.R;
+
 import org.junit.Before;
 import org.junit.Test;
 import org.mockito.Mock;
@@ -50,12 +55,19 @@ public class WifiTrafficPollerTest extends WifiBaseTest {
     private final static long RX_PACKET_COUNT = 50;
     private static final int TEST_TRAFFIC_STATE_CALLBACK_IDENTIFIER = 14;
     private static final int TEST_TRAFFIC_STATE_CALLBACK_IDENTIFIER2 = 42;
+    private static final int TEST_MIN_CALLBACK_INTERVAL_MS = 1000;
+
+    // Time advanced by the clock on each poll
+    private long mPollIntervalMs = 3000;
+    private long mTimeMs = 0;
 
     @Mock IBinder mAppBinder;
     @Mock ITrafficStateCallback mTrafficStateCallback;
 
     @Mock IBinder mAppBinder2;
     @Mock ITrafficStateCallback mTrafficStateCallback2;
+    @Mock Context mContext;
+    @Mock Clock mClock;
 
     /**
      * Called before each test
@@ -66,7 +78,17 @@ public class WifiTrafficPollerTest extends WifiBaseTest {
         mLooper = new TestLooper();
         MockitoAnnotations.initMocks(this);
 
-        mWifiTrafficPoller = new WifiTrafficPoller(new Handler(mLooper.getLooper()));
+        MockResources resources = new MockResources();
+        resources.setInteger(R.integer.config_wifiTrafficStateCallbackMinIntervalMs,
+                TEST_MIN_CALLBACK_INTERVAL_MS);
+        when(mContext.getResources()).thenReturn(resources);
+        when(mClock.getElapsedSinceBootMillis()).thenAnswer(invocation -> {
+            mTimeMs += mPollIntervalMs;
+            return mTimeMs;
+        });
+
+        mWifiTrafficPoller = new WifiTrafficPoller(mContext, new Handler(mLooper.getLooper()),
+                Runnable::run, mClock);
 
         // Set the current mTxPkts and mRxPkts to DEFAULT_PACKET_COUNT
         mWifiTrafficPoller.notifyOnDataActivity(DEFAULT_PACKET_COUNT, DEFAULT_PACKET_COUNT);
@@ -87,6 +109,43 @@ public class WifiTrafficPollerTest extends WifiBaseTest {
                 WifiManager.TrafficStateCallback.DATA_ACTIVITY_INOUT);
     }
 
+    /**
+     * Verify that the first poll after polling restarts is only used as a baseline, so that the
+     * packets counted while not polling are not reported as activity.
+     */
+    @Test
+    public void firstPollAfterResetIsOnlyBaseline() throws RemoteException {
+        mWifiTrafficPoller.addCallback(
+                mAppBinder, mTrafficStateCallback, TEST_TRAFFIC_STATE_CALLBACK_IDENTIFIER);
+        mWifiTrafficPoller.resetPollState();
+        mWifiTrafficPoller.notifyOnDataActivity(TX_PACKET_COUNT, RX_PACKET_COUNT);
+        // Only called on registration
+        verify(mTrafficStateCallback).onStateChanged(anyInt());
+        assertEquals(WifiManager.TrafficStateCallback.DATA_ACTIVITY_NONE,
+                mWifiTrafficPoller.getDataActivity());
+
+        mWifiTrafficPoller.notifyOnDataActivity(TX_PACKET_COUNT + 10, RX_PACKET_COUNT);
+        verify(mTrafficStateCallback).onStateChanged(
+                WifiManager.TrafficStateCallback.DATA_ACTIVITY_OUT);
+    }
+
+    /**
+     * Verify that a new client is handed the activity of the last poll on registration, and is
+     * not notified again at the next poll if the activity did not change.
+     */
+    @Test
+    public void newClientGetsCurrentActivityOnRegistration() throws RemoteException {
+        mWifiTrafficPoller.notifyOnDataActivity(TX_PACKET_COUNT, RX_PACKET_COUNT);
+        mWifiTrafficPoller.addCallback(
+                mAppBinder, mTrafficStateCallback, TEST_TRAFFIC_STATE_CALLBACK_IDENTIFIER);
+        verify(mTrafficStateCallback).onStateChanged(
+                WifiManager.TrafficStateCallback.DATA_ACTIVITY_INOUT);
+
+        mWifiTrafficPoller.notifyOnDataActivity(TX_PACKET_COUNT + 10, RX_PACKET_COUNT + 10);
+        verify(mTrafficStateCallback).onStateChanged(anyInt());
+        assertEquals(1, mWifiTrafficPoller.getNumCallbacksSent());
+    }
+
     /**
      * Verify that remove client should be handled
      */
@@ -101,7 +160,8 @@ public class WifiTrafficPollerTest extends WifiBaseTest {
         mWifiTrafficPoller.notifyOnDataActivity(TX_PACKET_COUNT, RX_PACKET_COUNT);
 
         // Client should not get any message after the client is removed.
-        verify(mTrafficStateCallback, never()).onStateChanged(anyInt());
+        verify(mTrafficStateCallback, never()).onStateChanged(
+                WifiManager.TrafficStateCallback.DATA_ACTIVITY_INOUT);
     }
 
     /**
@@ -165,8 +225,8 @@ public class WifiTrafficPollerTest extends WifiBaseTest {
         // activity as before, the callback should not be triggered again.
         mWifiTrafficPoller.notifyOnDataActivity(TX_PACKET_COUNT + 1, RX_PACKET_COUNT + 1);
 
-        // still only called once
-        verify(mTrafficStateCallback).onStateChanged(anyInt());
+        // still only called on registration and once with INOUT
+        verify(mTrafficStateCallback, times(2)).onStateChanged(anyInt());
     }
 
     /**
@@ -187,9 +247,9 @@ public class WifiTrafficPollerTest extends WifiBaseTest {
                 mAppBinder2, mTrafficStateCallback2, TEST_TRAFFIC_STATE_CALLBACK_IDENTIFIER2);
         mWifiTrafficPoller.notifyOnDataActivity(TX_PACKET_COUNT + 1, RX_PACKET_COUNT + 1);
 
-        // still only called once
-        verify(mTrafficStateCallback).onStateChanged(anyInt());
-        // called for the first time with INOUT
+        // still only called on registration and once with INOUT
+        verify(mTrafficStateCallback, times(2)).onStateChanged(anyInt());
+        // called on registration with INOUT
         verify(mTrafficStateCallback2)
                 .onStateChanged(WifiManager.TrafficStateCallback.DATA_ACTIVITY_INOUT);
         // not called with anything else
@@ -201,8 +261,8 @@ public class WifiTrafficPollerTest extends WifiBaseTest {
         // called once with OUT
         verify(mTrafficStateCallback)
                 .onStateChanged(WifiManager.TrafficStateCallback.DATA_ACTIVITY_OUT);
-        // called twice total
-        verify(mTrafficStateCallback, times(2)).onStateChanged(anyInt());
+        // called three times total
+        verify(mTrafficStateCallback, times(3)).onStateChanged(anyInt());
 
         // called once with OUT
         verify(mTrafficStateCallback2)
@@ -210,4 +270,63 @@ public class WifiTrafficPollerTest extends WifiBaseTest {
         // called twice total
         verify(mTrafficStateCallback2, times(2)).onStateChanged(anyInt());
     }
+
+    /**
+     * Verify that activity changes within the minimum interval are coalesced, and that the
+     * client gets the latest activity at the first poll after the interval.
+     */
+    @Test
+    public void callbacksWithinMinIntervalAreCoalesced() throws Exception {
+        mWifiTrafficPoller.addCallback(
+                mAppBinder, mTrafficStateCallback, TEST_TRAFFIC_STATE_CALLBACK_IDENTIFIER);
+        mWifiTrafficPoller.notifyOnDataActivity(TX_PACKET_COUNT, RX_PACKET_COUNT);
+        verify(mTrafficStateCallback).onStateChanged(
+                WifiManager.TrafficStateCallback.DATA_ACTIVITY_INOUT);
+        mPollIntervalMs = 200;
+
+        // OUT, then back to INOUT within the interval: nothing to send.
+        mWifiTrafficPoller.notifyOnDataActivity(TX_PACKET_COUNT + 1, RX_PACKET_COUNT);
+        mWifiTrafficPoller.notifyOnDataActivity(TX_PACKET_COUNT + 2, RX_PACKET_COUNT + 1);
+        // OUT until the interval has passed.
+        for (int i = 3; i <= 4; i++) {
+            mWifiTrafficPoller.notifyOnDataActivity(TX_PACKET_COUNT + i, RX_PACKET_COUNT + 1);
+        }
+        verify(mTrafficStateCallback, times(2)).onStateChanged(anyInt());
+        assertEquals(WifiManager.TrafficStateCallback.DATA_ACTIVITY_OUT,
+                mWifiTrafficPoller.getDataActivity());
+
+        mWifiTrafficPoller.notifyOnDataActivity(TX_PACKET_COUNT + 5, RX_PACKET_COUNT + 1);
+        verify(mTrafficStateCallback).onStateChanged(
+                WifiManager.TrafficStateCallback.DATA_ACTIVITY_OUT);
+        verify(mTrafficStateCallback, times(3)).onStateChanged(anyInt());
+        assertEquals(3, mWifiTrafficPoller.getNumCallbacksSent());
+        assertEquals(3, mWifiTrafficPoller.getNumCallbacksSuppressed());
+    }
+
+    /**
+     * Verify that a direction needs a higher packet rate to become active than to stay active,
+     * so that sparse traffic does not make the activity flap.
+     */
+    @Test
+    public void dataActivityHasRateHysteresis() throws Exception {
+        mWifiTrafficPoller.notifyOnDataActivity(DEFAULT_PACKET_COUNT, RX_PACKET_COUNT);
+        assertEquals(WifiManager.TrafficStateCallback.DATA_ACTIVITY_IN,
+                mWifiTrafficPoller.getDataActivity());
+
+        // 1 packet in 3 seconds is below the active threshold for the idle TX direction,
+        mWifiTrafficPoller.notifyOnDataActivity(DEFAULT_PACKET_COUNT + 1, RX_PACKET_COUNT + 10);
+        assertEquals(WifiManager.TrafficStateCallback.DATA_ACTIVITY_IN,
+                mWifiTrafficPoller.getDataActivity());
+        mWifiTrafficPoller.notifyOnDataActivity(TX_PACKET_COUNT, RX_PACKET_COUNT + 20);
+        assertEquals(WifiManager.TrafficStateCallback.DATA_ACTIVITY_INOUT,
+                mWifiTrafficPoller.getDataActivity());
+
+        // but enough to keep the active TX direction active.
+        mWifiTrafficPoller.notifyOnDataActivity(TX_PACKET_COUNT + 1, RX_PACKET_COUNT + 20);
+        assertEquals(WifiManager.TrafficStateCallback.DATA_ACTIVITY_OUT,
+                mWifiTrafficPoller.getDataActivity());
+        mWifiTrafficPoller.notifyOnDataActivity(TX_PACKET_COUNT + 1, RX_PACKET_COUNT + 20);
+        assertEquals(WifiManager.TrafficStateCallback.DATA_ACTIVITY_NONE,
+                mWifiTrafficPoller.getDataActivity());
+    }
 }
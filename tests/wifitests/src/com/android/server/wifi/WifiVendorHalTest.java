@@ -106,6 +106,8 @@ import org.mockito.Mock;
 import org.mockito.MockitoAnnotations;
 import org.mockito.stubbing.Answer;
 
+import java.io.PrintWriter;
+import java.io.StringWriter;
 import java.net.InetAddress;
 import java.util.ArrayList;
 import java.util.Arrays;
@@ -133,6 +135,8 @@ public class WifiVendorHalTest extends WifiBaseTest {
     private WifiLog mWifiLog;
     private TestLooper mLooper;
     private Handler mHandler;
+    private TestLooper mAsyncCallLooper;
+    private Handler mAsyncCallHandler;
     @Mock
     private HalDeviceManager mHalDeviceManager;
     @Mock
@@ -171,8 +175,9 @@ public class WifiVendorHalTest extends WifiBaseTest {
      * device.
      */
     private class WifiVendorHalSpyV1_1 extends WifiVendorHal {
-        WifiVendorHalSpyV1_1(HalDeviceManager halDeviceManager, Handler handler) {
-            super(halDeviceManager, handler);
+        WifiVendorHalSpyV1_1(HalDeviceManager halDeviceManager, Handler handler,
+                Handler asyncCallHandler) {
+            super(halDeviceManager, handler, asyncCallHandler);
         }
 
         @Override
@@ -213,8 +218,9 @@ public class WifiVendorHalTest extends WifiBaseTest {
      * the 1.2 HAL running on the device.
      */
     private class WifiVendorHalSpyV1_2 extends WifiVendorHal {
-        WifiVendorHalSpyV1_2(HalDeviceManager halDeviceManager, Handler handler) {
-            super(halDeviceManager, handler);
+        WifiVendorHalSpyV1_2(HalDeviceManager halDeviceManager, Handler handler,
+                Handler asyncCallHandler) {
+            super(halDeviceManager, handler, asyncCallHandler);
         }
 
         @Override
@@ -255,8 +261,9 @@ public class WifiVendorHalTest extends WifiBaseTest {
      * the 1.3 HAL running on the device.
      */
     private class WifiVendorHalSpyV1_3 extends WifiVendorHal {
-        WifiVendorHalSpyV1_3(HalDeviceManager halDeviceManager, Handler handler) {
-            super(halDeviceManager, handler);
+        WifiVendorHalSpyV1_3(HalDeviceManager halDeviceManager, Handler handler,
+                Handler asyncCallHandler) {
+            super(halDeviceManager, handler, asyncCallHandler);
         }
 
         @Override
@@ -297,8 +304,9 @@ public class WifiVendorHalTest extends WifiBaseTest {
      * the 1.4 HAL running on the device.
      */
     private class WifiVendorHalSpyV1_4 extends WifiVendorHal {
-        WifiVendorHalSpyV1_4(HalDeviceManager halDeviceManager, Handler handler) {
-            super(halDeviceManager, handler);
+        WifiVendorHalSpyV1_4(HalDeviceManager halDeviceManager, Handler handler,
+                Handler asyncCallHandler) {
+            super(halDeviceManager, handler, asyncCallHandler);
         }
 
         @Override
@@ -350,6 +358,8 @@ public class WifiVendorHalTest extends WifiBaseTest {
         mWifiLog = new FakeWifiLog();
         mLooper = new TestLooper();
         mHandler = new Handler(mLooper.getLooper());
+        mAsyncCallLooper = new TestLooper();
+        mAsyncCallHandler = new Handler(mAsyncCallLooper.getLooper());
         mWifiStatusSuccess = new WifiStatus();
         mWifiStatusSuccess.code = WifiStatusCode.SUCCESS;
         mWifiStatusFailure = new WifiStatus();
@@ -434,7 +444,7 @@ public class WifiVendorHalTest extends WifiBaseTest {
         }).when(mIWifiApIface).getName(any(IWifiIface.getNameCallback.class));
 
         // Create the vendor HAL object under test.
-        mWifiVendorHal = new WifiVendorHal(mHalDeviceManager, mHandler);
+        mWifiVendorHal = new WifiVendorHal(mHalDeviceManager, mHandler, mAsyncCallHandler);
 
         // Initialize the vendor HAL to capture the registered callback.
         mWifiVendorHal.initialize(mVendorHalDeathHandler);
@@ -747,7 +757,30 @@ public class WifiVendorHalTest extends WifiBaseTest {
         mWifiVendorHal.mVerboseLog = mWifiLog;
         assertFalse(mWifiVendorHal.getBgScanCapabilities(
                 TEST_IFACE_NAME, new WifiNative.ScanCapabilities()));
-        verify(mWifiLog).err("% returns %");
+        verify(mWifiLog).trace("returns %", 1);
+    }
+
+    /**
+     * Test that a recording log only gets the chatty logging with verbose logging enabled, named
+     * after the HAL method called.
+     */
+    @Test
+    public void testRecordingLogRecordsChattyLoggingOnlyWhenVerbose() {
+        BinaryLog.Buffer buffer = new BinaryLog.Buffer(16);
+        mWifiVendorHal.setRecordingLog(new BinaryLog("WifiVendorHal", buffer));
+        mWifiVendorHal.installPacketFilter(TEST_IFACE_NAME, new byte[0]);
+        assertEquals(0, buffer.size());
+
+        BinaryLog.enableVerboseLogging(1);
+        try {
+            mWifiVendorHal.enableVerboseLogging(true);
+            mWifiVendorHal.installPacketFilter(TEST_IFACE_NAME, new byte[0]);
+        } finally {
+            BinaryLog.enableVerboseLogging(0);
+        }
+        assertEquals("installPacketFilter filter length 0",
+                buffer.getMessage(buffer.size() - 2));
+        assertEquals("installPacketFilter returns false", buffer.getMessage(buffer.size() - 1));
     }
 
     /**
@@ -902,7 +935,7 @@ public class WifiVendorHalTest extends WifiBaseTest {
             }
         }).when(mIWifiStaIfaceV13).getFactoryMacAddress(any(
                 android.hardware.wifi.V1_3.IWifiStaIface.getFactoryMacAddressCallback.class));
-        mWifiVendorHal = new WifiVendorHalSpyV1_3(mHalDeviceManager, mHandler);
+        mWifiVendorHal = new WifiVendorHalSpyV1_3(mHalDeviceManager, mHandler, mAsyncCallHandler);
         assertEquals(MacAddress.BROADCAST_ADDRESS.toString(),
                 mWifiVendorHal.getFactoryMacAddress(TEST_IFACE_NAME).toString());
         verify(mIWifiStaIfaceV13).getFactoryMacAddress(any());
@@ -938,7 +971,7 @@ public class WifiVendorHalTest extends WifiBaseTest {
      */
     @Test
     public void testLinkLayerStatsCorrectVersionWithHalV1_3() throws Exception {
-        mWifiVendorHal = new WifiVendorHalSpyV1_3(mHalDeviceManager, mHandler);
+        mWifiVendorHal = new WifiVendorHalSpyV1_3(mHalDeviceManager, mHandler, mAsyncCallHandler);
         mWifiVendorHal.getWifiLinkLayerStats(TEST_IFACE_NAME);
         verify(mIWifiStaIfaceV13).getLinkLayerStats_1_3(any());
     }
@@ -1354,7 +1387,7 @@ public class WifiVendorHalTest extends WifiBaseTest {
     @Test
     public void testReadApf() throws Exception {
         // Expose the 1.2 IWifiStaIface.
-        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler);
+        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler, mAsyncCallHandler);
 
         byte[] program = new byte[] {65, 66, 67};
         ArrayList<Byte> expected = new ArrayList<>(3);
@@ -1512,6 +1545,101 @@ public class WifiVendorHalTest extends WifiBaseTest {
         verify(mIWifiChip).forceDumpToDebugRingBuffer("Glop");
     }
 
+    /**
+     * Test that the async calls run on the async call lane, and complete on the HAL event
+     * handler.
+     */
+    @Test
+    public void testAsyncCallsRunOnAsyncCallLane() throws Exception {
+        when(mIWifiChip.forceDumpToDebugRingBuffer(eq("Gunk"))).thenReturn(mWifiStatusSuccess);
+        doNothing().when(mIWifiStaIface).getLinkLayerStats(any());
+        assertTrue(mWifiVendorHal.startVendorHalSta());
+        List<Object> results = new ArrayList<>();
+
+        assertTrue(mWifiVendorHal.getRingBufferDataAsync("Gunk", results::add));
+        assertTrue(mWifiVendorHal.getWifiLinkLayerStatsAsync(TEST_IFACE_NAME, results::add));
+        verify(mIWifiChip, never()).forceDumpToDebugRingBuffer(any());
+
+        mAsyncCallLooper.dispatchAll();
+        verify(mIWifiChip).forceDumpToDebugRingBuffer("Gunk");
+        verify(mIWifiStaIface).getLinkLayerStats(any());
+        assertTrue(results.isEmpty());
+
+        mLooper.dispatchAll();
+        assertEquals(Arrays.asList(true, null), results);
+        StringWriter sw = new StringWriter();
+        mWifiVendorHal.dump(new PrintWriter(sw));
+        assertTrue(sw.toString(), sw.toString().contains("getRingBufferData: calls=1"));
+        assertTrue(sw.toString(), sw.toString().contains("getWifiLinkLayerStats: calls=1"));
+    }
+
+    /**
+     * Test that async calls are rejected while the async call lane is full.
+     */
+    @Test
+    public void testAsyncCallsRejectedWhenLaneIsFull() throws Exception {
+        when(mIWifiChip.forceDumpToDebugRingBuffer(eq("Gunk"))).thenReturn(mWifiStatusSuccess);
+        assertTrue(mWifiVendorHal.startVendorHalSta());
+        for (int i = 0; i < WifiVendorHal.MAX_PENDING_ASYNC_CALLS; i++) {
+            assertTrue(mWifiVendorHal.getRingBufferDataAsync("Gunk", result -> { }));
+        }
+        assertFalse(mWifiVendorHal.getRingBufferDataAsync("Gunk", result -> { }));
+
+        mAsyncCallLooper.dispatchAll();
+        assertTrue(mWifiVendorHal.getRingBufferDataAsync("Gunk", result -> { }));
+        StringWriter sw = new StringWriter();
+        mWifiVendorHal.dump(new PrintWriter(sw));
+        assertTrue(sw.toString(), sw.toString().contains("getRingBufferData: calls="
+                + WifiVendorHal.MAX_PENDING_ASYNC_CALLS + " rejected=1"));
+    }
+
+    /**
+     * Test that an async call which throws a RuntimeException completes with null, and frees its
+     * slot on the async call lane.
+     */
+    @Test
+    public void testAsyncCallThrowingCompletesWithNull() throws Exception {
+        when(mIWifiChip.forceDumpToDebugRingBuffer(eq("Gunk")))
+                .thenThrow(new IllegalStateException());
+        assertTrue(mWifiVendorHal.startVendorHalSta());
+        List<Boolean> results = new ArrayList<>();
+
+        assertTrue(mWifiVendorHal.getRingBufferDataAsync("Gunk", results::add));
+        mAsyncCallLooper.dispatchAll();
+        mLooper.dispatchAll();
+
+        assertEquals(Arrays.asList((Boolean) null), results);
+        StringWriter sw = new StringWriter();
+        mWifiVendorHal.dump(new PrintWriter(sw));
+        assertTrue(sw.toString(), sw.toString().contains("async calls: pending=0"));
+        assertTrue(sw.toString(), sw.toString().contains("getRingBufferData: calls=1"));
+    }
+
+    /**
+     * Test that the async firmware dump is requested without holding the lock, so that control
+     * calls do not wait for it.
+     */
+    @Test
+    public void testAsyncFwMemoryDumpDoesNotHoldLock() throws Exception {
+        assertTrue(mWifiVendorHal.startVendorHalSta());
+        byte[] sample = new byte[] {0x01, 0x02};
+        doAnswer(new AnswerWithArguments() {
+            public void answer(IWifiChip.requestFirmwareDebugDumpCallback cb) {
+                assertFalse(Thread.holdsLock(WifiVendorHal.sLock));
+                cb.onValues(mWifiStatusSuccess, NativeUtil.byteArrayToArrayList(sample));
+            }
+        }).when(mIWifiChip).requestFirmwareDebugDump(
+                any(IWifiChip.requestFirmwareDebugDumpCallback.class));
+        List<byte[]> results = new ArrayList<>();
+
+        assertTrue(mWifiVendorHal.getFwMemoryDumpAsync(results::add));
+        mAsyncCallLooper.dispatchAll();
+        mLooper.dispatchAll();
+
+        assertEquals(1, results.size());
+        assertArrayEquals(sample, results.get(0));
+    }
+
     /**
      * Test flush ring buffer to files.
      *
@@ -1519,7 +1647,7 @@ public class WifiVendorHalTest extends WifiBaseTest {
      */
     @Test
     public void testFlushRingBufferToFile() throws Exception {
-        mWifiVendorHal = new WifiVendorHalSpyV1_3(mHalDeviceManager, mHandler);
+        mWifiVendorHal = new WifiVendorHalSpyV1_3(mHalDeviceManager, mHandler, mAsyncCallHandler);
         when(mIWifiChipV13.flushRingBufferToFile()).thenReturn(mWifiStatusSuccess);
 
         assertFalse(mWifiVendorHal.flushRingBufferData());
@@ -2421,7 +2549,7 @@ public class WifiVendorHalTest extends WifiBaseTest {
         sarInfo.isVoiceCall = true;
 
         // Now expose the 1.1 IWifiChip.
-        mWifiVendorHal = new WifiVendorHalSpyV1_1(mHalDeviceManager, mHandler);
+        mWifiVendorHal = new WifiVendorHalSpyV1_1(mHalDeviceManager, mHandler, mAsyncCallHandler);
         when(mIWifiChipV11.selectTxPowerScenario(anyInt())).thenReturn(mWifiStatusSuccess);
 
         assertTrue(mWifiVendorHal.startVendorHalSta());
@@ -2446,7 +2574,7 @@ public class WifiVendorHalTest extends WifiBaseTest {
         sarInfo.isVoiceCall = true;
 
         // Now expose the 1.2 IWifiChip
-        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler);
+        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler, mAsyncCallHandler);
         when(mIWifiChipV12.selectTxPowerScenario_1_2(anyInt())).thenReturn(mWifiStatusSuccess);
 
         assertTrue(mWifiVendorHal.startVendorHalSta());
@@ -2485,7 +2613,7 @@ public class WifiVendorHalTest extends WifiBaseTest {
         sarInfo.sarSapSupported = false;
 
         // Now expose the 1.1 IWifiChip.
-        mWifiVendorHal = new WifiVendorHalSpyV1_1(mHalDeviceManager, mHandler);
+        mWifiVendorHal = new WifiVendorHalSpyV1_1(mHalDeviceManager, mHandler, mAsyncCallHandler);
         when(mIWifiChipV11.resetTxPowerScenario()).thenReturn(mWifiStatusSuccess);
 
         assertTrue(mWifiVendorHal.startVendorHalSta());
@@ -2510,7 +2638,7 @@ public class WifiVendorHalTest extends WifiBaseTest {
         sarInfo.sarSapSupported = false;
 
         // Now expose the 1.1 IWifiChip.
-        mWifiVendorHal = new WifiVendorHalSpyV1_1(mHalDeviceManager, mHandler);
+        mWifiVendorHal = new WifiVendorHalSpyV1_1(mHalDeviceManager, mHandler, mAsyncCallHandler);
         when(mIWifiChipV11.resetTxPowerScenario()).thenReturn(mWifiStatusSuccess);
 
         assertTrue(mWifiVendorHal.startVendorHalSta());
@@ -2541,7 +2669,7 @@ public class WifiVendorHalTest extends WifiBaseTest {
         sarInfo.sarSapSupported = false;
 
         // Now expose the 1.2 IWifiChip.
-        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler);
+        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler, mAsyncCallHandler);
         when(mIWifiChipV12.resetTxPowerScenario()).thenReturn(mWifiStatusSuccess);
 
         assertTrue(mWifiVendorHal.startVendorHalSta());
@@ -2566,7 +2694,7 @@ public class WifiVendorHalTest extends WifiBaseTest {
         sarInfo.sarSapSupported = false;
 
         // Now expose the 1.2 IWifiChip.
-        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler);
+        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler, mAsyncCallHandler);
         when(mIWifiChipV12.resetTxPowerScenario()).thenReturn(mWifiStatusSuccess);
 
         assertTrue(mWifiVendorHal.startVendorHalSta());
@@ -2599,7 +2727,7 @@ public class WifiVendorHalTest extends WifiBaseTest {
         sarInfo.isWifiSapEnabled = true;
 
         // Expose the 1.2 IWifiChip.
-        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler);
+        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler, mAsyncCallHandler);
         when(mIWifiChipV12.selectTxPowerScenario_1_2(anyInt())).thenReturn(mWifiStatusSuccess);
 
         // ON_BODY_CELL_ON
@@ -2626,7 +2754,7 @@ public class WifiVendorHalTest extends WifiBaseTest {
         sarInfo.isVoiceCall = true;
 
         // Expose the 1.2 IWifiChip.
-        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler);
+        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler, mAsyncCallHandler);
         when(mIWifiChipV12.selectTxPowerScenario_1_2(anyInt())).thenReturn(mWifiStatusSuccess);
 
         // ON_HEAD_CELL_ON
@@ -2653,7 +2781,7 @@ public class WifiVendorHalTest extends WifiBaseTest {
         sarInfo.isEarPieceActive = true;
 
         // Expose the 1.2 IWifiChip.
-        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler);
+        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler, mAsyncCallHandler);
         when(mIWifiChipV12.selectTxPowerScenario_1_2(anyInt())).thenReturn(mWifiStatusSuccess);
 
         // ON_HEAD_CELL_ON
@@ -2680,7 +2808,7 @@ public class WifiVendorHalTest extends WifiBaseTest {
         sarInfo.sarSapSupported = true;
 
         // Now expose the 1.2 IWifiChip.
-        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler);
+        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler, mAsyncCallHandler);
         when(mIWifiChipV12.resetTxPowerScenario()).thenReturn(mWifiStatusSuccess);
 
         assertTrue(mWifiVendorHal.startVendorHalSta());
@@ -2715,7 +2843,7 @@ public class WifiVendorHalTest extends WifiBaseTest {
         sarInfo.isVoiceCall = false;
 
         // Expose the 1.2 IWifiChip.
-        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler);
+        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler, mAsyncCallHandler);
         when(mIWifiChipV12.selectTxPowerScenario_1_2(anyInt())).thenReturn(mWifiStatusSuccess);
 
         assertTrue(mWifiVendorHal.startVendorHalSta());
@@ -2743,7 +2871,7 @@ public class WifiVendorHalTest extends WifiBaseTest {
         sarInfo.isVoiceCall = true;
 
         // Expose the 1.2 IWifiChip.
-        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler);
+        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler, mAsyncCallHandler);
         when(mIWifiChipV12.selectTxPowerScenario_1_2(anyInt())).thenReturn(mWifiStatusSuccess);
 
         assertTrue(mWifiVendorHal.startVendorHalSta());
@@ -2761,7 +2889,7 @@ public class WifiVendorHalTest extends WifiBaseTest {
     @Test
     public void testSetLowLatencyMode_1_2() throws RemoteException {
         // Expose the 1.2 IWifiChip.
-        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler);
+        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler, mAsyncCallHandler);
         assertFalse(mWifiVendorHal.setLowLatencyMode(true));
         assertFalse(mWifiVendorHal.setLowLatencyMode(false));
     }
@@ -2774,7 +2902,7 @@ public class WifiVendorHalTest extends WifiBaseTest {
         int mode = android.hardware.wifi.V1_3.IWifiChip.LatencyMode.LOW;
 
         // Expose the 1.3 IWifiChip.
-        mWifiVendorHal = new WifiVendorHalSpyV1_3(mHalDeviceManager, mHandler);
+        mWifiVendorHal = new WifiVendorHalSpyV1_3(mHalDeviceManager, mHandler, mAsyncCallHandler);
         when(mIWifiChipV13.setLatencyMode(anyInt())).thenReturn(mWifiStatusSuccess);
         assertTrue(mWifiVendorHal.setLowLatencyMode(true));
         verify(mIWifiChipV13).setLatencyMode(eq(mode));
@@ -2788,7 +2916,7 @@ public class WifiVendorHalTest extends WifiBaseTest {
         int mode = android.hardware.wifi.V1_3.IWifiChip.LatencyMode.NORMAL;
 
         // Expose the 1.3 IWifiChip.
-        mWifiVendorHal = new WifiVendorHalSpyV1_3(mHalDeviceManager, mHandler);
+        mWifiVendorHal = new WifiVendorHalSpyV1_3(mHalDeviceManager, mHandler, mAsyncCallHandler);
         when(mIWifiChipV13.setLatencyMode(anyInt())).thenReturn(mWifiStatusSuccess);
         assertTrue(mWifiVendorHal.setLowLatencyMode(false));
         verify(mIWifiChipV13).setLatencyMode(eq(mode));
@@ -2860,7 +2988,7 @@ public class WifiVendorHalTest extends WifiBaseTest {
     @Test
     public void testAlertCallbackUsing_1_2_EventCallback() throws Exception {
         // Expose the 1.2 IWifiChip.
-        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler);
+        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler, mAsyncCallHandler);
 
         assertTrue(mWifiVendorHal.startVendorHalSta());
         assertNotNull(mIWifiChipEventCallbackV12);
@@ -2874,7 +3002,7 @@ public class WifiVendorHalTest extends WifiBaseTest {
     @Test
     public void testSetStaMacAddressSuccess() throws Exception {
         // Expose the 1.2 IWifiStaIface.
-        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler);
+        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler, mAsyncCallHandler);
         byte[] macByteArray = TEST_MAC_ADDRESS.toByteArray();
         when(mIWifiStaIfaceV12.setMacAddress(macByteArray)).thenReturn(mWifiStatusSuccess);
 
@@ -2888,7 +3016,7 @@ public class WifiVendorHalTest extends WifiBaseTest {
     @Test
     public void testSetStaMacAddressFailDueToStatusFailure() throws Exception {
         // Expose the 1.2 IWifiStaIface.
-        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler);
+        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler, mAsyncCallHandler);
         byte[] macByteArray = TEST_MAC_ADDRESS.toByteArray();
         when(mIWifiStaIfaceV12.setMacAddress(macByteArray)).thenReturn(mWifiStatusFailure);
 
@@ -2902,7 +3030,7 @@ public class WifiVendorHalTest extends WifiBaseTest {
     @Test
     public void testSetStaMacAddressFailDueToRemoteException() throws Exception {
         // Expose the 1.2 IWifiStaIface.
-        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler);
+        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler, mAsyncCallHandler);
         byte[] macByteArray = TEST_MAC_ADDRESS.toByteArray();
         doThrow(new RemoteException()).when(mIWifiStaIfaceV12).setMacAddress(macByteArray);
 
@@ -2982,7 +3110,7 @@ public class WifiVendorHalTest extends WifiBaseTest {
     @Test
     public void testIsSetMacAddressSupportedWhenV1_2Support() throws Exception {
         // Expose the 1.2 IWifiStaIface.
-        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler);
+        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler, mAsyncCallHandler);
         assertTrue(mWifiVendorHal.isSetMacAddressSupported(TEST_IFACE_NAME));
     }
 
@@ -3221,7 +3349,7 @@ public class WifiVendorHalTest extends WifiBaseTest {
 
     private void startHalInStaModeAndRegisterRadioModeChangeCallback() {
         // Expose the 1.2 IWifiChip.
-        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler);
+        mWifiVendorHal = new WifiVendorHalSpyV1_2(mHalDeviceManager, mHandler, mAsyncCallHandler);
         mWifiVendorHal.registerRadioModeChangeHandler(mVendorHalRadioModeChangeHandler);
         assertTrue(mWifiVendorHal.startVendorHalSta());
         assertNotNull(mIWifiChipEventCallbackV12);
@@ -3229,7 +3357,7 @@ public class WifiVendorHalTest extends WifiBaseTest {
 
     private void startHalInStaModeAndRegisterRadioModeChangeCallback14() {
         // Expose the 1.4 IWifiChip.
-        mWifiVendorHal = new WifiVendorHalSpyV1_4(mHalDeviceManager, mHandler);
+        mWifiVendorHal = new WifiVendorHalSpyV1_4(mHalDeviceManager, mHandler, mAsyncCallHandler);
         mWifiVendorHal.registerRadioModeChangeHandler(mVendorHalRadioModeChangeHandler);
         assertTrue(mWifiVendorHal.startVendorHalSta());
         assertNotNull(mIWifiChipEventCallbackV14);
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.server.wifi.scanner;
+
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertSame;
+import static org.junit.Assert.assertTrue;
+import static org.mockito.Mockito.mock;
+import static org.mockito.Mockito.never;
+import static org.mockito.Mockito.times;
+import static org.mockito.Mockito.verify;
+
+import android.net.wifi.ScanResult;
+import android.net.wifi.WifiScanner;
+import android.net.wifi.WifiScanner.ScanData;
+import android.os.Handler;
+import android.os.HandlerExecutor;
+import android.os.test.TestLooper;
+
+import androidx.test.filters.SmallTest;
+
+import com.android.server.wifi.ScanTestUtil;
+import com.android.server.wifi.WifiBaseTest;
+
+import org.junit.Test;
+import org.mockito.ArgumentCaptor;
+
+import java.io.PrintWriter;
+import java.io.StringWriter;
+
+/**
+ * Unit tests for {@link InProcessScanResultsDispatcher}.
+ */
+@SmallTest
+public class InProcessScanResultsDispatcherTest extends WifiBaseTest {
+    private static final int NUM_LISTENERS = 5;
+
+    private final InProcessScanResultsDispatcher mDispatcher =
+            new InProcessScanResultsDispatcher();
+    private final TestLooper mLooper = new TestLooper();
+
+    private String dump() {
+        StringWriter sw = new StringWriter();
+        mDispatcher.dump(new PrintWriter(sw));
+        return sw.toString();
+    }
+
+    /**
+     * Verifies that listeners are called on their executors, with the results dispatched.
+     */
+    @Test
+    public void listenersAreCalledOnTheirExecutors() {
+        WifiScanner.ScanListener listener = mock(WifiScanner.ScanListener.class);
+        mDispatcher.registerScanListener(new HandlerExecutor(new Handler(mLooper.getLooper())),
+                listener);
+        ScanData[] scanDatas = ScanTestUtil.createScanDatas(new int[][]{{2412, 5180}});
+        ScanResult fullResult = scanDatas[0].getResults()[0];
+
+        mDispatcher.dispatchFullResult(fullResult);
+        mDispatcher.dispatchResults(scanDatas);
+        verify(listener, never()).onFullResult(fullResult);
+        verify(listener, never()).onResults(scanDatas);
+
+        mLooper.dispatchAll();
+        verify(listener).onFullResult(fullResult);
+        verify(listener).onResults(scanDatas);
+        assertTrue(dump(), dump().contains(
+                "listeners=1 scansDispatched=1 fullResultsDispatched=1"));
+    }
+
+    /**
+     * Verifies that registering a listener twice delivers the results once, and that
+     * unregistered listeners are not called anymore.
+     */
+    @Test
+    public void registerTwiceAndUnregister() {
+        WifiScanner.ScanListener listener1 = mock(WifiScanner.ScanListener.class);
+        WifiScanner.ScanListener listener2 = mock(WifiScanner.ScanListener.class);
+        mDispatcher.registerScanListener(Runnable::run, listener1);
+        mDispatcher.registerScanListener(Runnable::run, listener2);
+        mDispatcher.registerScanListener(Runnable::run, listener1);
+        assertEquals(2, mDispatcher.getNumListeners());
+        ScanData[] scanDatas = ScanTestUtil.createScanDatas(new int[][]{{2412}});
+
+        mDispatcher.dispatchResults(scanDatas);
+        mDispatcher.unregisterScanListener(listener1);
+        mDispatcher.dispatchResults(scanDatas);
+
+        assertEquals(1, mDispatcher.getNumListeners());
+        verify(listener1).onResults(scanDatas);
+        verify(listener2, times(2)).onResults(scanDatas);
+    }
+
+    /**
+     * Verifies that all listeners are handed the very same results, each on its own executor,
+     * without copying them per listener.
+     */
+    @Test
+    public void sameResultsAreHandedToAllListeners() {
+        WifiScanner.ScanListener[] listeners = new WifiScanner.ScanListener[NUM_LISTENERS];
+        for (int i = 0; i < NUM_LISTENERS; i++) {
+            listeners[i] = mock(WifiScanner.ScanListener.class);
+            mDispatcher.registerScanListener(new HandlerExecutor(new Handler(mLooper.getLooper())),
+                    listeners[i]);
+        }
+        ScanData[] scanDatas = ScanTestUtil.createScanDatas(new int[][]{{2412, 5180, 5240}});
+        ScanResult fullResult = scanDatas[0].getResults()[0];
+
+        mDispatcher.dispatchFullResult(fullResult);
+        mDispatcher.dispatchResults(scanDatas);
+        mLooper.dispatchAll();
+
+        for (WifiScanner.ScanListener listener : listeners) {
+            ArgumentCaptor<ScanData[]> resultsCaptor = ArgumentCaptor.forClass(ScanData[].class);
+            ArgumentCaptor<ScanResult> fullResultCaptor =
+                    ArgumentCaptor.forClass(ScanResult.class);
+            verify(listener).onResults(resultsCaptor.capture());
+            verify(listener).onFullResult(fullResultCaptor.capture());
+            assertSame(scanDatas, resultsCaptor.getValue());
+            assertSame(fullResult, fullResultCaptor.getValue());
+        }
+    }
+}
@@ -33,6 +33,7 @@ import static com.android.server.wifi.scanner.WifiScanningServiceImpl.WifiSingle
 
 import static org.junit.Assert.assertEquals;
 import static org.junit.Assert.assertNotNull;
+import static org.junit.Assert.assertSame;
 import static org.junit.Assert.assertTrue;
 import static org.junit.Assert.fail;
 import static org.mockito.Mockito.any;
@@ -146,6 +147,7 @@ public class WifiScanningServiceTest extends WifiBaseTest {
     WifiMetrics mWifiMetrics;
     TestLooper mLooper;
     WifiScanningServiceImpl mWifiScanningServiceImpl;
+    InProcessScanResultsDispatcher mInProcessScanResultsDispatcher;
     @Mock WifiP2pMetrics mWifiP2pMetrics;
 
     @Before
@@ -192,6 +194,9 @@ public class WifiScanningServiceTest extends WifiBaseTest {
         when(mWifiNative.getClientInterfaceNames())
                 .thenReturn(new ArraySet<>(Arrays.asList(TEST_IFACE_NAME_0)));
         when(mWifiInjector.getWifiNative()).thenReturn(mWifiNative);
+        mInProcessScanResultsDispatcher = new InProcessScanResultsDispatcher();
+        when(mWifiInjector.getInProcessScanResultsDispatcher())
+                .thenReturn(mInProcessScanResultsDispatcher);
         when(mContext.checkPermission(eq(Manifest.permission.NETWORK_STACK),
                 anyInt(), eq(Binder.getCallingUid())))
                 .thenReturn(PERMISSION_GRANTED);
@@ -2013,6 +2018,62 @@ public class WifiScanningServiceTest extends WifiBaseTest {
                 "results=" + results.getScanData().getResults().length);
     }
 
+    /**
+     * Register in-process scan listeners and do a single scan. Verifies that every listener is
+     * handed the same results, and that they are logged once for all of them.
+     */
+    @Test
+    public void inProcessScanListenersShareResults() throws Exception {
+        WifiScanner.ScanSettings requestSettings = createRequest(WifiScanner.WIFI_BAND_BOTH, 0,
+                0, 20, WifiScanner.REPORT_EVENT_AFTER_EACH_SCAN);
+        WifiNative.ScanSettings nativeSettings = computeSingleScanNativeSettings(requestSettings);
+        ScanResults results = ScanResults.create(0, 2412, 5160, 5175);
+        int requestId = 12;
+        WifiScanner.ScanListener listener1 = mock(WifiScanner.ScanListener.class);
+        WifiScanner.ScanListener listener2 = mock(WifiScanner.ScanListener.class);
+        mInProcessScanResultsDispatcher.registerScanListener(Runnable::run, listener1);
+        mInProcessScanResultsDispatcher.registerScanListener(Runnable::run, listener2);
+        mInProcessScanResultsDispatcher.registerScanListener(Runnable::run, listener2);
+
+        startServiceAndLoadDriver();
+        mWifiScanningServiceImpl.setWifiHandlerLogForTest(mLog);
+
+        Handler handler = mock(Handler.class);
+        BidirectionalAsyncChannel controlChannel = connectChannel(handler);
+        InOrder order = inOrder(handler, mWifiScannerImpl0);
+
+        when(mWifiScannerImpl0.startSingleScan(any(WifiNative.ScanSettings.class),
+                        any(WifiNative.ScanEventHandler.class))).thenReturn(true);
+
+        sendSingleScanRequest(controlChannel, requestId, requestSettings, null);
+
+        mLooper.dispatchAll();
+        WifiNative.ScanEventHandler eventHandler = verifyStartSingleScan(order, nativeSettings);
+        verifySuccessfulResponse(order, handler, requestId);
+
+        when(mWifiScannerImpl0.getLatestSingleScanResults())
+                .thenReturn(results.getRawScanData());
+        eventHandler.onScanStatus(WifiNative.WIFI_SCAN_RESULTS_AVAILABLE);
+
+        mLooper.dispatchAll();
+        verifyScanResultsReceived(order, handler, requestId, results.getScanData());
+        ArgumentCaptor<WifiScanner.ScanData[]> results1 =
+                ArgumentCaptor.forClass(WifiScanner.ScanData[].class);
+        ArgumentCaptor<WifiScanner.ScanData[]> results2 =
+                ArgumentCaptor.forClass(WifiScanner.ScanData[].class);
+        verify(listener1).onResults(results1.capture());
+        verify(listener2).onResults(results2.capture());
+        assertSame(results1.getValue(), results2.getValue());
+        assertScanDatasEquals(new WifiScanner.ScanData[] {results.getScanData()},
+                results1.getValue());
+
+        String serviceDump = dumpService();
+        assertTrue(serviceDump, serviceDump.contains("inProcessScanResults: listeners=2,results="
+                + results.getScanData().getResults().length));
+        assertTrue(serviceDump, serviceDump.contains(
+                "InProcessScanResultsDispatcher: listeners=2 scansDispatched=1"));
+    }
+
     /**
      * Register a single scan listener and do a single scan
      */
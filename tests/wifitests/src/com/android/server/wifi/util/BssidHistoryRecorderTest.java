@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.server.wifi.util;
+
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertFalse;
+import static org.junit.Assert.assertTrue;
+
+import android.net.wifi.WifiInfo;
+import android.os.Debug;
+
+import androidx.test.filters.SmallTest;
+
+import com.android.server.wifi.WifiBaseTest;
+
+import org.junit.Test;
+
+import java.io.PrintWriter;
+import java.io.StringWriter;
+
+/**
+ * Unit tests for {@link BssidHistoryRecorder}.
+ */
+@SmallTest
+public class BssidHistoryRecorderTest extends WifiBaseTest {
+    private static final int CAPACITY = 4;
+
+    private final BssidHistoryRecorder mRecorder = new BssidHistoryRecorder(CAPACITY,
+            event -> "event" + event, reason -> "reason" + reason);
+
+    private String dump() {
+        StringWriter sw = new StringWriter();
+        mRecorder.dump(new PrintWriter(sw));
+        return sw.toString();
+    }
+
+    /**
+     * Verifies that BSSIDs are packed and formatted back, and that other strings are packed as
+     * an invalid BSSID.
+     */
+    @Test
+    public void bssidsArePackedAndFormatted() {
+        long packed = BssidHistoryRecorder.packBssid("0A:1b:2C:3d:4E:ff");
+        assertEquals(0x0a1b2c3d4effL, packed);
+        assertEquals("0a:1b:2c:3d:4e:ff", BssidHistoryRecorder.formatBssid(packed));
+        assertEquals(BssidHistoryRecorder.INVALID_BSSID, BssidHistoryRecorder.packBssid("any"));
+        assertEquals(BssidHistoryRecorder.INVALID_BSSID,
+                BssidHistoryRecorder.packBssid("0a:1b:2c:3d:4e-ff"));
+        assertEquals(BssidHistoryRecorder.INVALID_BSSID, BssidHistoryRecorder.packBssid(null));
+        assertEquals("any", BssidHistoryRecorder.formatBssid(BssidHistoryRecorder.INVALID_BSSID));
+    }
+
+    /**
+     * Verifies that the ring keeps the newest records, and that they are dumped oldest first
+     * with the names supplied for their codes.
+     */
+    @Test
+    public void ringKeepsNewestRecords() {
+        for (int i = 0; i < CAPACITY + 2; i++) {
+            mRecorder.record(1000L * i, null, 0x020000000000L + i, i, 10 + i, -50 - i, i % 3);
+        }
+        mRecorder.record(0, "\"ssid\"", BssidHistoryRecorder.INVALID_BSSID, 7, 8,
+                WifiInfo.INVALID_RSSI, 9);
+
+        assertEquals(CAPACITY, mRecorder.size());
+        String[] lines = dump().split("\n");
+        assertEquals(CAPACITY, lines.length);
+        assertTrue(lines[0], lines[0].endsWith(
+                " BSSID=02:00:00:00:00:03, event=event3, reason=reason13, rssi=-53, streak=0"));
+        assertTrue(lines[2], lines[2].contains("BSSID=02:00:00:00:00:05"));
+        assertTrue(lines[3], lines[3].endsWith(
+                " SSID=\"ssid\", BSSID=any, event=event7, reason=reason8, streak=9"));
+        assertFalse(dump().contains("02:00:00:00:00:02"));
+    }
+
+    /**
+     * Records a roaming storm, a burst of failures across many BSSIDs that wraps the ring, and
+     * verifies that recording does not allocate once the BSSIDs are packed.
+     */
+    @Test
+    @SuppressWarnings("deprecation")
+    public void roamingStormIsRecordedWithoutAllocating() {
+        final int numBssids = 64;
+        final int numEvents = 2000;
+        BssidHistoryRecorder recorder = new BssidHistoryRecorder(1000, Integer::toString,
+                Integer::toString);
+        final String ssid = "\"storm\"";
+        long[] bssids = new long[numBssids];
+        for (int i = 0; i < numBssids; i++) {
+            bssids[i] = BssidHistoryRecorder.packBssid(String.format("02:00:00:00:%02x:%02x",
+                    i / 16, i % 16));
+        }
+
+        Debug.resetThreadAllocCount();
+        Debug.startAllocCounting();
+        for (int i = 0; i < numEvents; i++) {
+            recorder.record(i, ssid, bssids[i % numBssids], i & 1, i % 12, -40 - i % 50, i % 8);
+        }
+        Debug.stopAllocCounting();
+        int allocations = Debug.getThreadAllocCount();
+
+        assertEquals(1000, recorder.size());
+        // Allow for the odd allocation by the runtime, but not one per record.
+        assertTrue("allocations=" + allocations, allocations < 10);
+    }
+}
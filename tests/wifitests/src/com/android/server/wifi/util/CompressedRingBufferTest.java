@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.server.wifi.util;
+
+import static org.junit.Assert.assertArrayEquals;
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertSame;
+import static org.junit.Assert.assertTrue;
+
+import androidx.test.filters.SmallTest;
+
+import com.android.server.wifi.WifiBaseTest;
+
+import org.junit.Test;
+
+import java.io.ByteArrayOutputStream;
+import java.util.Arrays;
+import java.util.Random;
+import java.util.zip.Inflater;
+
+/**
+ * Unit tests for {@link CompressedRingBuffer}.
+ */
+@SmallTest
+public class CompressedRingBufferTest extends WifiBaseTest {
+    private static final int SEGMENT_BYTES = 1024;
+
+    private static byte[] inflate(byte[][] segments) throws Exception {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        byte[] buf = new byte[256];
+        for (byte[] segment : segments) {
+            Inflater inflater = new Inflater();
+            inflater.setInput(segment);
+            while (!inflater.finished()) {
+                bos.write(buf, 0, inflater.inflate(buf));
+            }
+            inflater.end();
+        }
+        return bos.toByteArray();
+    }
+
+    private static byte[] randomBytes(Random random, int length) {
+        byte[] data = new byte[length];
+        random.nextBytes(data);
+        return data;
+    }
+
+    /**
+     * Verifies that the frozen segments decompress to the appended data, whatever the size of
+     * the appended records.
+     */
+    @Test
+    public void frozenSegmentsDecompressToAppendedData() throws Exception {
+        CompressedRingBuffer ring = new CompressedRingBuffer(100 * SEGMENT_BYTES, SEGMENT_BYTES);
+        ByteArrayOutputStream expected = new ByteArrayOutputStream();
+        Random random = new Random(7);
+        for (int length : new int[] {10, SEGMENT_BYTES - 10, 3 * SEGMENT_BYTES + 5, 1}) {
+            byte[] data = randomBytes(random, length);
+            ring.append(data);
+            expected.write(data);
+        }
+
+        byte[][] segments = ring.freeze();
+        assertEquals(5, segments.length);
+        assertArrayEquals(expected.toByteArray(), inflate(segments));
+
+        // Freezing again does not change the segments.
+        assertSame(segments[4], ring.freeze()[4]);
+    }
+
+    /**
+     * Verifies that the oldest segments are dropped to keep the compressed data within bounds,
+     * and that earlier snapshots are unaffected.
+     */
+    @Test
+    public void oldestSegmentsAreDroppedWhenFull() throws Exception {
+        int maxCompressedBytes = 4 * SEGMENT_BYTES;
+        CompressedRingBuffer ring = new CompressedRingBuffer(maxCompressedBytes, SEGMENT_BYTES);
+        Random random = new Random(7);
+        byte[] first = randomBytes(random, SEGMENT_BYTES);
+        ring.append(first);
+        byte[][] snapshot = ring.freeze();
+
+        byte[] latest = null;
+        for (int i = 0; i < 10; i++) {
+            latest = randomBytes(random, SEGMENT_BYTES);
+            ring.append(latest);
+        }
+
+        assertTrue(ring.getCompressedBytes() <= maxCompressedBytes);
+        byte[] data = inflate(ring.freeze());
+        assertTrue(data.length < 10 * SEGMENT_BYTES);
+        assertArrayEquals(latest, Arrays.copyOfRange(data, data.length - SEGMENT_BYTES,
+                data.length));
+        assertArrayEquals(first, inflate(snapshot));
+
+        ring.resize(SEGMENT_BYTES / 2);
+        assertEquals(0, ring.freeze().length);
+        assertEquals(0, ring.getCompressedBytes());
+    }
+}
@@ -20,15 +20,20 @@ import static org.junit.Assert.*;
 import static org.mockito.ArgumentMatchers.any;
 import static org.mockito.ArgumentMatchers.anyInt;
 import static org.mockito.Mockito.doThrow;
+import static org.mockito.Mockito.never;
+import static org.mockito.Mockito.times;
 import static org.mockito.Mockito.verify;
+import static org.mockito.Mockito.when;
 
 import android.net.wifi.ISoftApCallback;
+import android.os.DeadObjectException;
 import android.os.Handler;
 import android.os.IBinder;
 import android.os.RemoteException;
 import android.os.test.TestLooper;
 import android.test.suitebuilder.annotation.SmallTest;
 
+import com.android.server.wifi.Clock;
 import com.android.server.wifi.WifiBaseTest;
 
 import org.junit.Before;
@@ -37,6 +42,9 @@ import org.mockito.ArgumentCaptor;
 import org.mockito.Mock;
 import org.mockito.MockitoAnnotations;
 
+import java.io.PrintWriter;
+import java.io.StringWriter;
+
 /**
  * Unit tests for {@link com.android.server.wifi.util.ExternalCallbackTracker}.
  */
@@ -46,7 +54,12 @@ public class ExternalCallbackTrackerTest extends WifiBaseTest {
     @Mock Handler mHandler;
     @Mock ISoftApCallback mCallback;
     @Mock IBinder mBinder;
+    @Mock ISoftApCallback mCallback2;
+    @Mock IBinder mBinder2;
+    @Mock Clock mClock;
     private TestLooper mTestLooper;
+    private TestLooper mBroadcastLooper;
+    private long mTimeNs;
 
     private ExternalCallbackTracker<ISoftApCallback> mExternalCallbackTracker;
 
@@ -58,6 +71,20 @@ public class ExternalCallbackTrackerTest extends WifiBaseTest {
         mExternalCallbackTracker = new ExternalCallbackTracker<ISoftApCallback>(mHandler);
     }
 
+    /**
+     * Creates a tracker broadcasting on |mBroadcastLooper|, with both callbacks added.
+     */
+    private ExternalCallbackTracker<ISoftApCallback> createBroadcastingTracker() {
+        mBroadcastLooper = new TestLooper();
+        Handler broadcastHandler = new Handler(mBroadcastLooper.getLooper());
+        when(mClock.getElapsedSinceBootNanos()).thenAnswer(invocation -> mTimeNs);
+        ExternalCallbackTracker<ISoftApCallback> tracker =
+                new ExternalCallbackTracker<>(mHandler, broadcastHandler::post, mClock);
+        assertTrue(tracker.add(mBinder, mCallback, TEST_CALLBACK_IDENTIFIER));
+        assertTrue(tracker.add(mBinder2, mCallback2, TEST_CALLBACK_IDENTIFIER + 1));
+        return tracker;
+    }
+
     /**
      * Test adding a callback.
      */
@@ -124,4 +151,136 @@ public class ExternalCallbackTrackerTest extends WifiBaseTest {
         assertTrue(mExternalCallbackTracker.getCallbacks().isEmpty());
         verify(mBinder).unlinkToDeath(any(), anyInt());
     }
+
+    /**
+     * Verify that a broadcast invokes the callbacks on the broadcast executor, with the callbacks
+     * tracked when it was made.
+     */
+    @Test
+    public void testBroadcastInvokesCallbacksOnExecutor() throws Exception {
+        ExternalCallbackTracker<ISoftApCallback> tracker = createBroadcastingTracker();
+
+        tracker.broadcast("onStateChanged", callback -> callback.onStateChanged(1, 0));
+        verify(mCallback, never()).onStateChanged(anyInt(), anyInt());
+        tracker.remove(TEST_CALLBACK_IDENTIFIER + 1);
+        tracker.broadcast("onStateChanged", callback -> callback.onStateChanged(2, 0));
+        mBroadcastLooper.dispatchAll();
+
+        verify(mCallback).onStateChanged(1, 0);
+        verify(mCallback2).onStateChanged(1, 0);
+        verify(mCallback).onStateChanged(2, 0);
+        verify(mCallback2, never()).onStateChanged(2, 0);
+    }
+
+    /**
+     * Verify that a filtered broadcast only invokes the callbacks accepted by the filter.
+     */
+    @Test
+    public void testFilteredBroadcast() throws Exception {
+        ExternalCallbackTracker<ISoftApCallback> tracker = createBroadcastingTracker();
+
+        tracker.broadcast("onStateChanged", callback -> callback == mCallback2,
+                callback -> callback.onStateChanged(1, 0));
+        mBroadcastLooper.dispatchAll();
+
+        verify(mCallback, never()).onStateChanged(anyInt(), anyInt());
+        verify(mCallback2).onStateChanged(1, 0);
+    }
+
+    /**
+     * Verify that a filtered broadcast which no callback accepts posts nothing to the broadcast
+     * executor, and that the dump lists the callbacks from the snapshot.
+     */
+    @Test
+    public void testFilteredOutBroadcastIsNotPosted() throws Exception {
+        ExternalCallbackTracker<ISoftApCallback> tracker = createBroadcastingTracker();
+
+        tracker.broadcast("onStateChanged", callback -> false,
+                callback -> callback.onStateChanged(1, 0));
+
+        assertTrue(mBroadcastLooper.isIdle());
+        StringWriter sw = new StringWriter();
+        tracker.dump(new PrintWriter(sw));
+        assertTrue(sw.toString(), sw.toString().startsWith("mNumBroadcasts=0 mNumEvictions=0"));
+        assertTrue(sw.toString(), sw.toString().contains("callback=" + TEST_CALLBACK_IDENTIFIER
+                + " invocations=0"));
+    }
+
+    /**
+     * Verify that a callback whose binder is dead is evicted after the first failure, without
+     * affecting the other callbacks.
+     */
+    @Test
+    public void testDeadCallbackIsEvicted() throws Exception {
+        ExternalCallbackTracker<ISoftApCallback> tracker = createBroadcastingTracker();
+        doThrow(new DeadObjectException()).when(mCallback).onStateChanged(anyInt(), anyInt());
+
+        tracker.broadcast("onStateChanged", callback -> callback.onStateChanged(1, 0));
+        mBroadcastLooper.dispatchAll();
+        mTestLooper.dispatchAll();
+
+        verify(mCallback2).onStateChanged(1, 0);
+        assertEquals(1, tracker.getNumCallbacks());
+        assertEquals(mCallback2, tracker.getCallbacks().get(0));
+        verify(mBinder).unlinkToDeath(any(), anyInt());
+    }
+
+    /**
+     * Verify that a callback is evicted once it fails
+     * {@link ExternalCallbackTracker#MAX_CONSECUTIVE_FAILURES} invocations in a row.
+     */
+    @Test
+    public void testFailingCallbackIsEvicted() throws Exception {
+        ExternalCallbackTracker<ISoftApCallback> tracker = createBroadcastingTracker();
+        doThrow(new RemoteException()).when(mCallback).onStateChanged(anyInt(), anyInt());
+
+        for (int i = 0; i < ExternalCallbackTracker.MAX_CONSECUTIVE_FAILURES - 1; i++) {
+            tracker.broadcast("onStateChanged", callback -> callback.onStateChanged(1, 0));
+        }
+        mBroadcastLooper.dispatchAll();
+        mTestLooper.dispatchAll();
+        assertEquals(2, tracker.getNumCallbacks());
+
+        tracker.broadcast("onStateChanged", callback -> callback.onStateChanged(1, 0));
+        mBroadcastLooper.dispatchAll();
+        mTestLooper.dispatchAll();
+        assertEquals(1, tracker.getNumCallbacks());
+        assertEquals(mCallback2, tracker.getCallbacks().get(0));
+    }
+
+    /**
+     * Verify that a callback is evicted once it is slow to invoke
+     * {@link ExternalCallbackTracker#MAX_CONSECUTIVE_SLOW_INVOCATIONS} times in a row, and that
+     * its invocation stats are dumped until then.
+     */
+    @Test
+    public void testSlowCallbackIsEvicted() throws Exception {
+        ExternalCallbackTracker<ISoftApCallback> tracker = createBroadcastingTracker();
+        ExternalCallbackTracker.CallbackInvoker<ISoftApCallback> invoker = callback -> {
+            if (callback == mCallback) {
+                mTimeNs += ExternalCallbackTracker.SLOW_INVOCATION_THRESHOLD_NS + 1;
+            }
+            callback.onStateChanged(1, 0);
+        };
+
+        for (int i = 0; i < ExternalCallbackTracker.MAX_CONSECUTIVE_SLOW_INVOCATIONS - 1; i++) {
+            tracker.broadcast("onStateChanged", invoker);
+        }
+        mBroadcastLooper.dispatchAll();
+        mTestLooper.dispatchAll();
+        assertEquals(2, tracker.getNumCallbacks());
+        StringWriter sw = new StringWriter();
+        tracker.dump(new PrintWriter(sw));
+        assertTrue(sw.toString(), sw.toString().contains("callback=" + TEST_CALLBACK_IDENTIFIER
+                + " invocations=" + (ExternalCallbackTracker.MAX_CONSECUTIVE_SLOW_INVOCATIONS - 1)
+                + " failures=0 avgLatencyUs="
+                + (ExternalCallbackTracker.SLOW_INVOCATION_THRESHOLD_NS + 1) / 1000));
+
+        tracker.broadcast("onStateChanged", invoker);
+        mBroadcastLooper.dispatchAll();
+        mTestLooper.dispatchAll();
+        assertEquals(1, tracker.getNumCallbacks());
+        verify(mCallback2, times(ExternalCallbackTracker.MAX_CONSECUTIVE_SLOW_INVOCATIONS))
+                .onStateChanged(1, 0);
+    }
 }
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.server.wifi.util;
+
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertNull;
+import static org.junit.Assert.assertSame;
+import static org.junit.Assert.assertTrue;
+
+import androidx.test.filters.SmallTest;
+
+import com.android.server.wifi.WifiBaseTest;
+
+import org.junit.Test;
+
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
+
+/**
+ * Unit tests for ObjectRingBuffer.
+ */
+@SmallTest
+public class ObjectRingBufferTest extends WifiBaseTest {
+    private static final int CAPACITY = 3;
+
+    private static List<Integer> toList(ObjectRingBuffer<Integer> ring) {
+        List<Integer> list = new ArrayList<>();
+        for (Integer element : ring) {
+            list.add(element);
+        }
+        return list;
+    }
+
+    /**
+     * Verify that a new ring is empty.
+     */
+    @Test
+    public void testEmpty() {
+        ObjectRingBuffer<Integer> ring = new ObjectRingBuffer<>(CAPACITY);
+        assertTrue(ring.isEmpty());
+        assertEquals(0, ring.size());
+        assertEquals(CAPACITY, ring.capacity());
+        assertTrue(toList(ring).isEmpty());
+        assertNull(ring.recycleOldestIfFull());
+    }
+
+    /**
+     * Verify that appending past the capacity evicts the oldest elements, and that the ring is
+     * still read oldest first after wrapping around.
+     */
+    @Test
+    public void testAddEvictsOldestWhenFull() {
+        ObjectRingBuffer<Integer> ring = new ObjectRingBuffer<>(CAPACITY);
+        assertNull(ring.add(1));
+        assertNull(ring.add(2));
+        assertNull(ring.add(3));
+        assertEquals(Integer.valueOf(1), ring.add(4));
+        assertEquals(Integer.valueOf(2), ring.add(5));
+
+        assertEquals(CAPACITY, ring.size());
+        assertEquals(Arrays.asList(3, 4, 5), toList(ring));
+        assertEquals(Integer.valueOf(3), ring.get(0));
+        assertEquals(Integer.valueOf(5), ring.get(2));
+        assertEquals(Integer.valueOf(5), ring.getLast());
+    }
+
+    /**
+     * Verify that the oldest element is only handed back for reuse once the ring is full.
+     */
+    @Test
+    public void testRecycleOldestIfFull() {
+        ObjectRingBuffer<Integer> ring = new ObjectRingBuffer<>(CAPACITY);
+        Integer first = 1000;
+        ring.add(first);
+        ring.add(2);
+        assertNull(ring.recycleOldestIfFull());
+        ring.add(3);
+
+        assertSame(first, ring.recycleOldestIfFull());
+        assertEquals(Arrays.asList(2, 3), toList(ring));
+        ring.add(first);
+        assertEquals(Arrays.asList(2, 3, 1000), toList(ring));
+    }
+
+    /**
+     * Verify removeOldest() and clear().
+     */
+    @Test
+    public void testRemoveOldestAndClear() {
+        ObjectRingBuffer<Integer> ring = new ObjectRingBuffer<>(CAPACITY);
+        for (int i = 0; i < 5; i++) {
+            ring.add(i);
+        }
+        assertEquals(Integer.valueOf(2), ring.removeOldest());
+        assertEquals(Arrays.asList(3, 4), toList(ring));
+
+        ring.clear();
+        assertTrue(ring.isEmpty());
+        ring.add(7);
+        assertEquals(Arrays.asList(7), toList(ring));
+    }
+
+    /**
+     * Verify that reading past the newest element throws.
+     */
+    @Test(expected = IndexOutOfBoundsException.class)
+    public void testGetOutOfBoundsThrows() {
+        ObjectRingBuffer<Integer> ring = new ObjectRingBuffer<>(CAPACITY);
+        ring.add(1);
+        ring.get(1);
+    }
+}
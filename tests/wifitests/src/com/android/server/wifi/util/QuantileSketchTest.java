@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.server.wifi.util;
+
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertTrue;
+
+import androidx.test.filters.SmallTest;
+
+import com.android.server.wifi.WifiBaseTest;
+import com.android.server.wifi.proto.nano.WifiMetricsProto;
+
+import org.junit.Test;
+
+import java.util.Arrays;
+import java.util.Random;
+
+/**
+ * Unit tests for QuantileSketch.
+ */
+@SmallTest
+public class QuantileSketchTest extends WifiBaseTest {
+    private static final int ACCURACY_PPM = 10000;
+    private static final double ACCURACY = ACCURACY_PPM / 1e6;
+
+    private static void assertWithinRelativeAccuracy(double expected, double actual) {
+        assertTrue("expected " + expected + " but was " + actual,
+                Math.abs(actual - expected) <= expected * ACCURACY + 1e-9);
+    }
+
+    /**
+     * Verify that an empty sketch has no quantiles.
+     */
+    @Test
+    public void testEmpty() {
+        QuantileSketch sketch = new QuantileSketch(ACCURACY_PPM);
+        assertEquals(0, sketch.getCount());
+        assertTrue(Double.isNaN(sketch.quantile(0.5)));
+        assertEquals(0, sketch.toProto().bucketCounts.length);
+    }
+
+    /**
+     * Verify that the quantiles of random latencies are within the relative accuracy of the exact
+     * quantiles.
+     */
+    @Test
+    public void testQuantilesWithinRelativeAccuracy() {
+        Random random = new Random(42);
+        int[] values = new int[10001];
+        QuantileSketch sketch = new QuantileSketch(ACCURACY_PPM);
+        for (int i = 0; i < values.length; i++) {
+            // Long tailed, like connection latencies
+            values[i] = 1 + (int) (Math.exp(random.nextGaussian() * 1.5 + 6));
+            sketch.increment(values[i]);
+        }
+        Arrays.sort(values);
+
+        assertEquals(values.length, sketch.getCount());
+        for (double probability : new double[] {0.0, 0.1, 0.5, 0.9, 0.99, 0.999, 1.0}) {
+            int rank = (int) (probability * (values.length - 1));
+            assertWithinRelativeAccuracy(values[rank], sketch.quantile(probability));
+        }
+    }
+
+    /**
+     * Verify that values less than or equal to zero are counted and estimated as zero.
+     */
+    @Test
+    public void testNonPositiveValues() {
+        QuantileSketch sketch = new QuantileSketch(ACCURACY_PPM);
+        sketch.add(0, 2);
+        sketch.increment(-5);
+        sketch.increment(1000);
+
+        assertEquals(4, sketch.getCount());
+        assertEquals(0, sketch.quantile(0.5), 0);
+        assertWithinRelativeAccuracy(1000, sketch.quantile(1.0));
+    }
+
+    /**
+     * Verify that merging two sketches is the same as adding all values to one sketch.
+     */
+    @Test
+    public void testMerge() {
+        QuantileSketch first = new QuantileSketch(ACCURACY_PPM);
+        QuantileSketch second = new QuantileSketch(ACCURACY_PPM);
+        QuantileSketch all = new QuantileSketch(ACCURACY_PPM);
+        for (int value = 1; value <= 500; value++) {
+            first.increment(value);
+            all.increment(value);
+        }
+        for (int value = 100000; value <= 100500; value++) {
+            second.increment(value);
+            all.increment(value);
+        }
+
+        first.merge(second);
+
+        assertEquals(all.getCount(), first.getCount());
+        for (double probability : new double[] {0.0, 0.25, 0.5, 0.75, 1.0}) {
+            assertEquals(all.quantile(probability), first.quantile(probability), 0);
+        }
+    }
+
+    /**
+     * Verify that sketches of different accuracies cannot be merged.
+     */
+    @Test(expected = IllegalArgumentException.class)
+    public void testMergeDifferentAccuracyThrows() {
+        new QuantileSketch(ACCURACY_PPM).merge(new QuantileSketch(ACCURACY_PPM * 2));
+    }
+
+    /**
+     * Verify that a sketch converted to proto and back is unchanged.
+     */
+    @Test
+    public void testProtoRoundTrip() {
+        QuantileSketch sketch = new QuantileSketch(ACCURACY_PPM);
+        sketch.increment(0);
+        sketch.add(35, 3);
+        sketch.increment(12000);
+
+        WifiMetricsProto.QuantileSketch proto = sketch.toProto();
+        assertEquals(ACCURACY_PPM, proto.relativeAccuracyPpm);
+        assertEquals(1, proto.zeroCount);
+        assertEquals(2, proto.bucketCounts.length);
+
+        QuantileSketch copy = QuantileSketch.fromProto(proto);
+        assertEquals(sketch.getCount(), copy.getCount());
+        for (double probability : new double[] {0.0, 0.5, 1.0}) {
+            assertEquals(sketch.quantile(probability), copy.quantile(probability), 0);
+        }
+    }
+
+    /**
+     * Verify that clear() empties the sketch.
+     */
+    @Test
+    public void testClear() {
+        QuantileSketch sketch = new QuantileSketch(ACCURACY_PPM);
+        sketch.increment(20);
+        sketch.clear();
+        assertEquals(0, sketch.getCount());
+        assertEquals(0, sketch.toProto().bucketCounts.length);
+    }
+}
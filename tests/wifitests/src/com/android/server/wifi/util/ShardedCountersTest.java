@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.server.wifi.util;
+
+import static org.junit.Assert.assertEquals;
+
+import androidx.test.filters.SmallTest;
+
+import com.android.server.wifi.WifiBaseTest;
+
+import org.junit.Test;
+
+import java.util.ArrayList;
+import java.util.List;
+import java.util.concurrent.CountDownLatch;
+
+/**
+ * Unit tests for ShardedCounters.
+ */
+@SmallTest
+public class ShardedCountersTest extends WifiBaseTest {
+    private static final int NUM_COUNTERS = 12;
+    private static final int NUM_THREADS = 8;
+    private static final int NUM_UPDATES_PER_THREAD = 20000;
+
+    /**
+     * Verify that counters start at zero and are updated independently of each other.
+     */
+    @Test
+    public void testIncrementAndAdd() {
+        ShardedCounters counters = new ShardedCounters(NUM_COUNTERS);
+        assertEquals(NUM_COUNTERS, counters.size());
+        for (int i = 0; i < NUM_COUNTERS; i++) {
+            assertEquals(0, counters.get(i));
+        }
+
+        counters.increment(0);
+        counters.increment(0);
+        counters.add(5, 40);
+        counters.add(NUM_COUNTERS - 1, 3);
+
+        assertEquals(2, counters.get(0));
+        assertEquals(0, counters.get(1));
+        assertEquals(40, counters.get(5));
+        assertEquals(3, counters.get(NUM_COUNTERS - 1));
+    }
+
+    /**
+     * Verify that drain() returns the counter value and resets it, and clear() resets all of them.
+     */
+    @Test
+    public void testDrainAndClear() {
+        ShardedCounters counters = new ShardedCounters(NUM_COUNTERS);
+        counters.add(1, 7);
+        counters.add(2, 9);
+
+        assertEquals(7, counters.drain(1));
+        assertEquals(0, counters.drain(1));
+        assertEquals(0, counters.get(1));
+        assertEquals(9, counters.get(2));
+
+        counters.clear();
+        assertEquals(0, counters.get(2));
+    }
+
+    /**
+     * Verify that out of range ids are rejected.
+     */
+    @Test(expected = IndexOutOfBoundsException.class)
+    public void testInvalidIdThrows() {
+        ShardedCounters counters = new ShardedCounters(NUM_COUNTERS);
+        counters.increment(NUM_COUNTERS);
+    }
+
+    /**
+     * Verify that no update is lost when many threads update the same counters concurrently
+     * while another thread keeps draining them, which is how WifiMetrics uses them under scan and
+     * RSSI poll load.
+     */
+    @Test
+    public void testConcurrentUpdatesAreNotLost() throws Exception {
+        final ShardedCounters counters = new ShardedCounters(NUM_COUNTERS, 4);
+        final CountDownLatch start = new CountDownLatch(1);
+        List<Thread> threads = new ArrayList<>();
+        for (int t = 0; t < NUM_THREADS; t++) {
+            Thread thread = new Thread(() -> {
+                try {
+                    start.await();
+                } catch (InterruptedException e) {
+                    return;
+                }
+                for (int i = 0; i < NUM_UPDATES_PER_THREAD; i++) {
+                    counters.increment(i % NUM_COUNTERS);
+                }
+            });
+            thread.start();
+            threads.add(thread);
+        }
+
+        long[] drained = new long[NUM_COUNTERS];
+        start.countDown();
+        boolean running = true;
+        while (running) {
+            running = false;
+            for (Thread thread : threads) {
+                running |= thread.isAlive();
+            }
+            for (int id = 0; id < NUM_COUNTERS; id++) {
+                drained[id] += counters.drain(id);
+            }
+        }
+        for (Thread thread : threads) {
+            thread.join();
+        }
+
+        long total = 0;
+        for (int id = 0; id < NUM_COUNTERS; id++) {
+            drained[id] += counters.drain(id);
+            total += drained[id];
+        }
+        assertEquals((long) NUM_THREADS * NUM_UPDATES_PER_THREAD, total);
+        // NUM_UPDATES_PER_THREAD is not a multiple of NUM_COUNTERS, so the first ids get one
+        // extra update per thread.
+        int base = NUM_UPDATES_PER_THREAD / NUM_COUNTERS;
+        int remainder = NUM_UPDATES_PER_THREAD % NUM_COUNTERS;
+        for (int id = 0; id < NUM_COUNTERS; id++) {
+            assertEquals((long) NUM_THREADS * (base + (id < remainder ? 1 : 0)), drained[id]);
+        }
+    }
+}
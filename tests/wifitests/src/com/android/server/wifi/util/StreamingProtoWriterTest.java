@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.server.wifi.util;
+
+import static org.junit.Assert.assertArrayEquals;
+
+import android.util.SparseArray;
+
+import androidx.test.filters.SmallTest;
+
+import com.android.server.wifi.WifiBaseTest;
+import com.android.server.wifi.proto.nano.WifiMetricsProto.ConnectionEvent;
+import com.android.server.wifi.proto.nano.WifiMetricsProto.StaEvent;
+import com.android.server.wifi.proto.nano.WifiMetricsProto.UserActionEvent;
+import com.android.server.wifi.proto.nano.WifiMetricsProto.WifiLog;
+
+import com.google.protobuf.nano.MessageNano;
+
+import org.junit.Test;
+
+import java.io.ByteArrayOutputStream;
+
+/**
+ * Unit tests for StreamingProtoWriter.
+ */
+@SmallTest
+public class StreamingProtoWriterTest extends WifiBaseTest {
+    private static final int CONNECTION_EVENT_FIELD = 1;
+    private static final int STA_EVENT_LIST_FIELD = 52;
+    private static final int USER_ACTION_EVENTS_FIELD = 192;
+
+    private static byte[] writeStreamed(WifiLog log) throws Exception {
+        SparseArray<MessageNano[]> streamedFields = new SparseArray<>();
+        streamedFields.put(CONNECTION_EVENT_FIELD, log.connectionEvent);
+        streamedFields.put(STA_EVENT_LIST_FIELD, log.staEventList);
+        streamedFields.put(USER_ACTION_EVENTS_FIELD, log.userActionEvents);
+        ConnectionEvent[] connectionEvents = log.connectionEvent;
+        StaEvent[] staEvents = log.staEventList;
+        UserActionEvent[] userActionEvents = log.userActionEvents;
+        log.connectionEvent = ConnectionEvent.emptyArray();
+        log.staEventList = StaEvent.emptyArray();
+        log.userActionEvents = UserActionEvent.emptyArray();
+
+        ByteArrayOutputStream out = new ByteArrayOutputStream();
+        new StreamingProtoWriter(out).write(log, streamedFields);
+
+        log.connectionEvent = connectionEvents;
+        log.staEventList = staEvents;
+        log.userActionEvents = userActionEvents;
+        return out.toByteArray();
+    }
+
+    /**
+     * Verify that an empty message is written identically.
+     */
+    @Test
+    public void testEmptyMessage() throws Exception {
+        WifiLog log = new WifiLog();
+        assertArrayEquals(MessageNano.toByteArray(log), writeStreamed(log));
+    }
+
+    /**
+     * Verify that streamed repeated fields are spliced between the other fields in field number
+     * order, so that the output is byte-identical to serializing the whole message, including
+     * null elements, which are skipped.
+     */
+    @Test
+    public void testStreamedFieldsAreByteIdentical() throws Exception {
+        WifiLog log = new WifiLog();
+        log.numSavedNetworks = 7;
+        log.numOneshotScans = 300;
+        log.isLocationEnabled = true;
+        log.numEmptyScanResults = 12;
+        log.numHotspot2R1NetworkScanResults = 5;
+        log.recordDurationSec = 86400;
+        log.connectionEvent = new ConnectionEvent[3];
+        for (int i = 0; i < log.connectionEvent.length; i++) {
+            log.connectionEvent[i] = new ConnectionEvent();
+            log.connectionEvent[i].startTimeMillis = 1000L * i;
+            log.connectionEvent[i].durationTakenToConnectMillis = 250 + i;
+            log.connectionEvent[i].signalStrength = -60 - i;
+        }
+        log.staEventList = new StaEvent[] {new StaEvent(), null, new StaEvent()};
+        log.staEventList[0].type = StaEvent.TYPE_ASSOCIATION_REJECTION_EVENT;
+        log.staEventList[2].type = StaEvent.TYPE_NETWORK_CONNECTION_EVENT;
+        log.staEventList[2].lastRssi = -55;
+        log.userActionEvents = new UserActionEvent[1];
+        log.userActionEvents[0] = new UserActionEvent();
+        log.userActionEvents[0].eventType = UserActionEvent.EVENT_FORGET_WIFI;
+        log.userActionEvents[0].startTimeMillis = 123456789L;
+
+        assertArrayEquals(MessageNano.toByteArray(log), writeStreamed(log));
+    }
+
+    /**
+     * Verify that many streamed elements, together much larger than the element buffer, are
+     * written identically.
+     */
+    @Test
+    public void testManyElements() throws Exception {
+        WifiLog log = new WifiLog();
+        log.numSavedNetworks = 1;
+        log.userActionEvents = new UserActionEvent[2];
+        for (int i = 0; i < log.userActionEvents.length; i++) {
+            log.userActionEvents[i] = new UserActionEvent();
+            log.userActionEvents[i].eventType = UserActionEvent.EVENT_DISCONNECT_WIFI;
+        }
+        log.connectionEvent = new ConnectionEvent[1];
+        log.connectionEvent[0] = new ConnectionEvent();
+        log.staEventList = new StaEvent[1000];
+        for (int i = 0; i < log.staEventList.length; i++) {
+            log.staEventList[i] = new StaEvent();
+            log.staEventList[i].type = StaEvent.TYPE_NETWORK_CONNECTION_EVENT;
+            log.staEventList[i].totalTxBytes = Long.MAX_VALUE - i;
+        }
+
+        assertArrayEquals(MessageNano.toByteArray(log), writeStreamed(log));
+    }
+}